@@ -7,6 +7,7 @@
  // This file exist only to do the implementation of tiny obj loader
 #define TINYOBJLOADER_IMPLEMENTATION
 
+#include <algorithm>
 #include "obj_loader.h"
 
 //-----------------------------------------------------------------------------
@@ -35,52 +36,73 @@ static inline std::string get_path(const std::string& file)
 
 void ObjLoader::loadModel(const std::string& filename)
 {
-    tinyobj::ObjReader reader;
-    reader.ParseFromFile(filename);
-    if (!reader.Valid())
+    parse(filename);
+
+    m_vertices.resize(m_sizes.vertices);
+    m_indices.resize(m_sizes.indices);
+    m_materials.resize(m_sizes.materials);
+    m_matIndx.resize(m_sizes.matIndices);
+
+    writeVertices(m_vertices);
+    writeIndices(m_indices);
+    writeMaterials(m_materials);
+    writeMatIndices(m_matIndx);
+
+    release();
+}
+
+//-----------------------------------------------------------------------------
+// Parses the file and counts the outputs, nothing is converted yet
+//
+bool ObjLoader::parse(const std::string& filename)
+{
+    m_reader.ParseFromFile(filename);
+    if (!m_reader.Valid())
     {
         std::cerr << "Cannot load: " << filename << std::endl;
-        assert(reader.Valid());
+        m_sizes = Sizes();
+        return false;
     }
 
-    // Collecting the material in the scene
-    for (const auto& material : reader.GetMaterials())
+    // a default material is added when there are none
+    m_sizes           = Sizes();
+    m_sizes.materials = (std::max)(m_reader.GetMaterials().size(), size_t(1));
+
+    // one vertex per index, one material index per face
+    for (const auto& shape : m_reader.GetShapes())
+    {
+        m_sizes.vertices   += shape.mesh.indices.size();
+        m_sizes.matIndices += shape.mesh.material_ids.size();
+    }
+    m_sizes.indices = m_sizes.vertices;
+
+    for (const auto& material : m_reader.GetMaterials())
     {
-        MaterialObj m;
-        m.ambient = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
-        m.diffuse = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
-        m.specular = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
-        m.emission = glm::vec3(material.emission[0], material.emission[1], material.emission[2]);
-        m.transmittance = glm::vec3(material.transmittance[0], material.transmittance[1],
-            material.transmittance[2]);
-        m.dissolve = material.dissolve;
-        m.ior = material.ior;
-        m.shininess = material.shininess;
-        m.illum = material.illum;
         if (!material.diffuse_texname.empty())
-        {
             m_textures.push_back(material.diffuse_texname);
-            m.textureID = static_cast<int>(m_textures.size()) - 1;
-        }
-
-        m_materials.emplace_back(m);
     }
+    return true;
+}
 
-    // If there were none, add a default
-    if (m_materials.empty())
-        m_materials.emplace_back(MaterialObj());
+//-----------------------------------------------------------------------------
+// Each vertex is built on the stack and written once, the output can be
+// write-combined memory which must not be read back
+//
+void ObjLoader::writeVertices(ObjSpan<VertexObj> vertices) const
+{
+    assert(vertices.size >= m_sizes.vertices);
 
-    const tinyobj::attrib_t& attrib = reader.GetAttrib();
+    const tinyobj::attrib_t& attrib = m_reader.GetAttrib();
+    const bool computeNormals = attrib.normals.empty();
 
-    for (const auto& shape : reader.GetShapes())
+    size_t    out = 0;
+    VertexObj triangle[3];
+    for (const auto& shape : m_reader.GetShapes())
     {
-        m_vertices.reserve(shape.mesh.indices.size() + m_vertices.size());
-        m_indices.reserve(shape.mesh.indices.size() + m_indices.size());
-        m_matIndx.insert(m_matIndx.end(), shape.mesh.material_ids.begin(),
-            shape.mesh.material_ids.end());
-
-        for (const auto& index : shape.mesh.indices)
+        for (size_t i = 0; i < shape.mesh.indices.size(); i++)
         {
+            const tinyobj::index_t& index = shape.mesh.indices[i];
+
             VertexObj    vertex = {};
             const float* vp = &attrib.vertices[3 * index.vertex_index];
             vertex.pos = { *(vp + 0), *(vp + 1), *(vp + 2) };
@@ -103,32 +125,96 @@ void ObjLoader::loadModel(const std::string& filename)
                 vertex.color = { *(vc + 0), *(vc + 1), *(vc + 2) };
             }
 
-            m_vertices.push_back(vertex);
-            m_indices.push_back(static_cast<int>(m_indices.size()));
+            if (!computeNormals)
+            {
+                vertices[out++] = vertex;
+                continue;
+            }
+
+            // Compute normal when no normal were provided, per triangle
+            triangle[out % 3] = vertex;
+            if (out % 3 == 2)
+            {
+                glm::vec3 n = glm::normalize(glm::cross((triangle[1].pos - triangle[0].pos),
+                                                        (triangle[2].pos - triangle[0].pos)));
+                for (int v = 0; v < 3; v++)
+                {
+                    triangle[v].nrm       = n;
+                    vertices[out - 2 + v] = triangle[v];
+                }
+            }
+            out++;
         }
     }
 
-    // Fixing material indices
-    for (auto& mi : m_matIndx)
+    // incomplete last triangle, only buffered when computing normals
+    if (computeNormals)
+    {
+        for (size_t v = out - out % 3; v < out; v++)
+            vertices[v] = triangle[v % 3];
+    }
+}
+
+//-----------------------------------------------------------------------------
+//
+//
+void ObjLoader::writeIndices(ObjSpan<uint32_t> indices) const
+{
+    assert(indices.size >= m_sizes.indices);
+
+    for (size_t i = 0; i < m_sizes.indices; i++)
+        indices[i] = static_cast<uint32_t>(i);
+}
+
+//-----------------------------------------------------------------------------
+// Collecting the material in the scene
+//
+void ObjLoader::writeMaterials(ObjSpan<MaterialObj> materials) const
+{
+    assert(materials.size >= m_sizes.materials);
+
+    // If there were none, add a default
+    if (m_reader.GetMaterials().empty())
     {
-        if (mi < 0 || mi > m_materials.size())
-            mi = 0;
+        materials[0] = MaterialObj();
+        return;
     }
 
+    size_t out     = 0;
+    int    texture = 0;
+    for (const auto& material : m_reader.GetMaterials())
+    {
+        MaterialObj m;
+        m.ambient = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
+        m.diffuse = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+        m.specular = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
+        m.emission = glm::vec3(material.emission[0], material.emission[1], material.emission[2]);
+        m.transmittance = glm::vec3(material.transmittance[0], material.transmittance[1],
+            material.transmittance[2]);
+        m.dissolve = material.dissolve;
+        m.ior = material.ior;
+        m.shininess = material.shininess;
+        m.illum = material.illum;
+        if (!material.diffuse_texname.empty())
+            m.textureID = texture++;   // same order as m_textures
 
-    // Compute normal when no normal were provided.
-    if (attrib.normals.empty())
+        materials[out++] = m;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Fixing material indices, out of range ones use the first material
+//
+void ObjLoader::writeMatIndices(ObjSpan<uint32_t> matIndices) const
+{
+    assert(matIndices.size >= m_sizes.matIndices);
+
+    const int nMaterials = static_cast<int>(m_sizes.materials);
+
+    size_t out = 0;
+    for (const auto& shape : m_reader.GetShapes())
     {
-        for (size_t i = 0; i < m_indices.size(); i += 3)
-        {
-            VertexObj& v0 = m_vertices[m_indices[i + 0]];
-            VertexObj& v1 = m_vertices[m_indices[i + 1]];
-            VertexObj& v2 = m_vertices[m_indices[i + 2]];
-
-            glm::vec3 n = glm::normalize(glm::cross((v1.pos - v0.pos), (v2.pos - v0.pos)));
-            v0.nrm = n;
-            v1.nrm = n;
-            v2.nrm = n;
-        }
+        for (int mi : shape.mesh.material_ids)
+            matIndices[out++] = (mi < 0 || mi >= nMaterials) ? 0 : static_cast<uint32_t>(mi);
     }
-}
\ No newline at end of file
+}
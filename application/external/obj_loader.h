@@ -6,6 +6,7 @@
 #include "tiny_obj_loader.h"
 #include "glm/glm.hpp"
 #include <array>
+#include <cassert>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
@@ -42,14 +43,57 @@ struct shapeObj
     uint32_t matIndex;
 };
 
+// Contiguous output range, a vector or mapped memory
+template <class T>
+struct ObjSpan
+{
+    T*     data = nullptr;
+    size_t size = 0;
+
+    ObjSpan() = default;
+    ObjSpan(T* data_, size_t size_) : data(data_), size(size_) {}
+    ObjSpan(std::vector<T>& vec) : data(vec.data()), size(vec.size()) {}
+
+    T& operator[](size_t i) const { assert(i < size); return data[i]; }
+    T* begin() const { return data; }
+    T* end() const { return data + size; }
+};
+
 class ObjLoader
 {
 public:
+    // Loads everything in the member vectors
     void loadModel(const std::string& filename);
 
+    // Two phases, the outputs are written where the caller wants them,
+    // e.g. straight into mapped staging memory:
+    // parse() then getSizes(), write*() into spans of those sizes, release()
+    struct Sizes
+    {
+        size_t vertices   = 0;
+        size_t indices    = 0;
+        size_t materials  = 0;
+        size_t matIndices = 0;
+    };
+
+    bool  parse(const std::string& filename);   // also fills m_textures
+    Sizes getSizes() const { return m_sizes; }
+
+    void writeVertices(ObjSpan<VertexObj> vertices) const;
+    void writeIndices(ObjSpan<uint32_t> indices) const;
+    void writeMaterials(ObjSpan<MaterialObj> materials) const;
+    void writeMatIndices(ObjSpan<uint32_t> matIndices) const;
+
+    // frees the parsed file
+    void release() { m_reader = tinyobj::ObjReader(); }
+
     std::vector<VertexObj>   m_vertices;
     std::vector<uint32_t>    m_indices;
     std::vector<MaterialObj> m_materials;
     std::vector<std::string> m_textures;
     std::vector<uint32_t>    m_matIndx;
+
+private:
+    tinyobj::ObjReader m_reader;
+    Sizes              m_sizes;
 };
\ No newline at end of file
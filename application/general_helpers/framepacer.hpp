@@ -0,0 +1,185 @@
+/*
+ *
+ * Andrew Frost
+ * framepacer.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace tools {
+
+///////////////////////////////////////////////////////////////////////////
+// FrameTimeStats                                                        //
+///////////////////////////////////////////////////////////////////////////
+// Rolling window of frame times (ms), mean / variance / min / max       //
+///////////////////////////////////////////////////////////////////////////
+
+class FrameTimeStats
+{
+public:
+    FrameTimeStats(size_t windowSize = 240) { m_samples.resize(windowSize, 0.0); }
+
+    //-------------------------------------------------------------------------
+    // Add one frame time, in milliseconds
+    //
+    void add(double frameTimeMs)
+    {
+        m_samples[m_head] = frameTimeMs;
+        m_head  = (m_head + 1) % m_samples.size();
+        m_count = (std::min)(m_count + 1, m_samples.size());
+        m_dirty = true;
+    }
+
+    void reset()
+    {
+        std::fill(m_samples.begin(), m_samples.end(), 0.0);
+        m_head  = 0;
+        m_count = 0;
+        m_dirty = true;
+    }
+
+    double getMean()     const { update(); return m_mean; }
+    double getVariance() const { update(); return m_variance; }
+    double getStdDev()   const { return std::sqrt(getVariance()); }
+    double getMin()      const { update(); return m_min; }
+    double getMax()      const { update(); return m_max; }
+    double getLast()     const { return m_count ? m_samples[(m_head + m_samples.size() - 1) % m_samples.size()] : 0.0; }
+    size_t getCount()    const { return m_count; }
+
+    // samples in insertion order, oldest first (for plotting)
+    void getHistory(std::vector<float>& history) const
+    {
+        history.resize(m_count);
+        size_t start = (m_head + m_samples.size() - m_count) % m_samples.size();
+        for (size_t i = 0; i < m_count; i++)
+            history[i] = float(m_samples[(start + i) % m_samples.size()]);
+    }
+
+private:
+    //-------------------------------------------------------------------------
+    // Two pass over the window, only when queried
+    //
+    void update() const
+    {
+        if (!m_dirty)
+            return;
+        m_dirty = false;
+
+        m_mean = m_variance = m_min = m_max = 0.0;
+        if (m_count == 0)
+            return;
+
+        double sum = 0.0;
+        m_min = m_max = m_samples[0];
+        for (size_t i = 0; i < m_count; i++) {
+            sum  += m_samples[i];
+            m_min = (std::min)(m_min, m_samples[i]);
+            m_max = (std::max)(m_max, m_samples[i]);
+        }
+        m_mean = sum / double(m_count);
+
+        double sqSum = 0.0;
+        for (size_t i = 0; i < m_count; i++) {
+            double d = m_samples[i] - m_mean;
+            sqSum += d * d;
+        }
+        m_variance = sqSum / double(m_count);
+    }
+
+    std::vector<double> m_samples;
+    size_t              m_head{ 0 };
+    size_t              m_count{ 0 };
+
+    mutable bool        m_dirty{ true };
+    mutable double      m_mean{ 0.0 };
+    mutable double      m_variance{ 0.0 };
+    mutable double      m_min{ 0.0 };
+    mutable double      m_max{ 0.0 };
+
+}; // class FrameTimeStats
+
+///////////////////////////////////////////////////////////////////////////
+// FramePacer                                                            //
+///////////////////////////////////////////////////////////////////////////
+// CPU side frame limiter                                                //
+// - wait() is meant to be called before polling input, so the time     //
+//   spent waiting is not added to the input-to-photon latency           //
+// - sleeps for the bulk of the interval and spins the last part, the    //
+//   OS sleep granularity is too coarse for precise pacing               //
+// - also measures frame time between consecutive wait() calls           //
+///////////////////////////////////////////////////////////////////////////
+
+class FramePacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FramePacer() { m_last = m_next = Clock::now(); }
+
+    //-------------------------------------------------------------------------
+    // fps <= 0 disables pacing, frame times are still measured
+    //
+    void setTargetFps(double fps)
+    {
+        m_targetFps = fps;
+        m_period    = fps > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))
+                                : Clock::duration::zero();
+        m_next      = Clock::now() + m_period;
+    }
+
+    double getTargetFps() const { return m_targetFps; }
+
+    // margin left to spinning, covers the sleep overshoot
+    void setSpinThreshold(std::chrono::microseconds threshold) { m_spinThreshold = threshold; }
+
+    //-------------------------------------------------------------------------
+    // Block until the next frame slot, then record the frame time
+    //
+    void wait()
+    {
+        if (m_period != Clock::duration::zero()) {
+            Clock::time_point now = Clock::now();
+
+            if (m_next - now > m_spinThreshold)
+                std::this_thread::sleep_for(m_next - now - m_spinThreshold);
+
+            while (Clock::now() < m_next)
+                std::this_thread::yield();
+
+            // missed the slot by more than a period, resynchronize instead
+            // of bursting frames to catch up
+            now = Clock::now();
+            m_next += m_period;
+            if (m_next < now)
+                m_next = now + m_period;
+        }
+
+        Clock::time_point frameStart = Clock::now();
+        m_stats.add(std::chrono::duration<double, std::milli>(frameStart - m_last).count());
+        m_last = frameStart;
+    }
+
+    const FrameTimeStats& getStats() const { return m_stats; }
+    FrameTimeStats&       getStats()       { return m_stats; }
+
+private:
+    double                    m_targetFps{ 0.0 };
+    Clock::duration           m_period{ Clock::duration::zero() };
+    std::chrono::microseconds m_spinThreshold{ 1500 };
+
+    Clock::time_point         m_next;
+    Clock::time_point         m_last;
+
+    FrameTimeStats            m_stats;
+
+}; // class FramePacer
+
+} // namespace tools
@@ -0,0 +1,153 @@
+/*
+ *
+ * Andrew Frost
+ * mappedfile.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace tools {
+
+///////////////////////////////////////////////////////////////////////////
+// MappedFile                                                            //
+///////////////////////////////////////////////////////////////////////////
+// Read only view of a whole file through the virtual memory system, no  //
+// copy is made. The mapping is page aligned, valid until close()        //
+///////////////////////////////////////////////////////////////////////////
+
+class MappedFile
+{
+public:
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    MappedFile() {}
+    ~MappedFile() { close(); }
+
+    //-------------------------------------------------------------------------
+    // False when the file is missing or empty
+    //
+    bool open(const std::string& filename)
+    {
+        close();
+#ifdef _WIN32
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER size = {};
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping)
+            m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        m_file = ::open(filename.c_str(), O_RDONLY);
+        if (m_file < 0)
+            return false;
+
+        struct stat info = {};
+        if (fstat(m_file, &info) != 0 || info.st_size == 0) {
+            close();
+            return false;
+        }
+        m_size = static_cast<size_t>(info.st_size);
+
+        m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+        if (m_data == MAP_FAILED)
+            m_data = nullptr;
+#endif
+        if (!m_data) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file    = INVALID_HANDLE_VALUE;
+#else
+        if (m_data)
+            munmap(m_data, m_size);
+        if (m_file >= 0)
+            ::close(m_file);
+        m_file = -1;
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const void* data() const { return m_data; }
+    size_t      size() const { return m_size; }
+
+private:
+#ifdef _WIN32
+    HANDLE m_file{ INVALID_HANDLE_VALUE };
+    HANDLE m_mapping{ nullptr };
+#else
+    int    m_file{ -1 };
+#endif
+    void*  m_data{ nullptr };
+    size_t m_size{ 0 };
+
+}; // class MappedFile
+
+//-------------------------------------------------------------------------
+// Last write time in a platform unit, only good for comparisons. 0 when
+// the file is missing
+//
+inline uint64_t getFileWriteTime(const std::string& filename)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes = {};
+    if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attributes))
+        return 0;
+    return (uint64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat info = {};
+    if (stat(filename.c_str(), &info) != 0)
+        return 0;
+#  ifdef __APPLE__
+    return uint64_t(info.st_mtimespec.tv_sec) * 1000000000ull + uint64_t(info.st_mtimespec.tv_nsec);
+#  else
+    return uint64_t(info.st_mtim.tv_sec) * 1000000000ull + uint64_t(info.st_mtim.tv_nsec);
+#  endif
+#endif
+}
+
+} // namespace tools
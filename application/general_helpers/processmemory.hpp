@@ -0,0 +1,76 @@
+/*
+ *
+ * Andrew Frost
+ * processmemory.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#  include <psapi.h>
+#  pragma comment(lib, "psapi.lib")
+#else
+#  include <sys/resource.h>
+#  include <unistd.h>
+#endif
+
+namespace tools {
+
+///////////////////////////////////////////////////////////////////////////
+// Process memory                                                        //
+///////////////////////////////////////////////////////////////////////////
+// Resident set (working set) of the process, in bytes, 0 when unknown.  //
+// The peak only grows, compare runs in separate processes               //
+///////////////////////////////////////////////////////////////////////////
+
+inline size_t getCurrentRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.WorkingSetSize;
+#else
+    long  pages = 0;
+    FILE* file  = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    if (fscanf(file, "%*s %ld", &pages) != 1)
+        pages = 0;
+    fclose(file);
+    return size_t(pages) * size_t(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+inline size_t getPeakRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#  ifdef __APPLE__
+    return size_t(usage.ru_maxrss);          // bytes
+#  else
+    return size_t(usage.ru_maxrss) * 1024;   // kilobytes
+#  endif
+#endif
+}
+
+} // namespace tools
@@ -0,0 +1,401 @@
+/*
+ *
+ * Andrew Frost
+ * tlsfallocator.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+namespace tools {
+
+///////////////////////////////////////////////////////////////////////////
+// TTlsfAllocator                                                        //
+///////////////////////////////////////////////////////////////////////////
+// Drop-in alternative to TRangeAllocator with the same interface        //
+// (init / subAllocate / subFree / isAvailable ...), for when many live  //
+// ranges make its sorted array slow.                                    //
+// - free ranges sit in two-level segregated fit lists: first level is   //
+//   the power of two of the size, second level splits it linearly in   //
+//   SL_COUNT buckets                                                    //
+// - two bitmaps find a non-empty bucket large enough in O(1)            //
+// - neighbours are merged on free through the physical links            //
+// - allocated nodes are found by start page through a flat index, no    //
+//   hashing or tree on the hot path                                     //
+// Sizes are counted in pages of GRANULARITY bytes, like TRangeAllocator //
+///////////////////////////////////////////////////////////////////////////
+
+// GRANULARITY must be power of two
+template <uint32_t GRANULARITY = 256>
+class TTlsfAllocator
+{
+public:
+    TTlsfAllocator() { deinit(); }
+    TTlsfAllocator(uint32_t size) { init(size); }
+
+    static uint32_t alignedSize(uint32_t size) { return (size + GRANULARITY - 1) & (~(GRANULARITY - 1)); }
+
+    void init(uint32_t size)
+    {
+        assert(size % GRANULARITY == 0 && "managed total size must be aligned to GRANULARITY");
+
+        deinit();
+        m_size = size;
+        m_used = 0;
+
+        uint32_t pages = size / GRANULARITY;
+        m_pageNodes.assign(pages, uint32_t(INVALID));
+        if (pages) {
+            uint32_t node = newNode();
+            m_nodes[node].offset = 0;
+            m_nodes[node].count  = pages;
+            insertFree(node);
+        }
+    }
+
+    void deinit()
+    {
+        m_nodes.clear();
+        m_unusedNodes.clear();
+        m_pageNodes.clear();
+        m_flBitmap = 0;
+        for (uint32_t fl = 0; fl < FL_COUNT; fl++) {
+            m_slBitmap[fl] = 0;
+            for (uint32_t sl = 0; sl < SL_COUNT; sl++)
+                m_heads[fl][sl] = INVALID;
+        }
+        m_size = 0;
+        m_used = 0;
+    }
+
+    bool isEmpty() const { return m_used == 0; }
+
+    uint32_t getUsedSize() const { return m_used; }
+
+    // O(1) from the bitmaps: smallest size of the top non-empty bucket, a
+    // subAllocate with align <= GRANULARITY up to it always succeeds. The
+    // largest range may be up to one bucket larger
+    uint32_t getLargestFreeSize() const
+    {
+        if (!m_flBitmap)
+            return 0;
+
+        uint32_t fl = msb(m_flBitmap);
+        uint32_t sl = msb(m_slBitmap[fl]);
+        return (fl ? (SL_COUNT | sl) << (fl - 1) : sl) * GRANULARITY;
+    }
+
+    // exact, walks the top bucket, for stats
+    uint32_t computeLargestFreeSize() const
+    {
+        if (!m_flBitmap)
+            return 0;
+
+        uint32_t fl      = msb(m_flBitmap);
+        uint32_t sl      = msb(m_slBitmap[fl]);
+        uint32_t largest = 0;
+        for (uint32_t node = m_heads[fl][sl]; node != INVALID; node = m_nodes[node].nextFree)
+            largest = (std::max)(largest, m_nodes[node].count);
+        return largest * GRANULARITY;
+    }
+
+    bool isAvailable(uint32_t size, uint32_t align) const
+    {
+        if (m_used >= m_size)
+            return false;
+
+        return findFree(reservedCount(size, align)) != INVALID;
+    }
+
+    bool subAllocate(uint32_t size, uint32_t align, uint32_t& outOffset, uint32_t& outAligned, uint32_t& outSize)
+    {
+        outSize    = 0;
+        outOffset  = 0;
+        outAligned = 0;
+
+        if (m_used >= m_size)
+            return false;
+
+        uint32_t countReserved = reservedCount(size, align);
+        uint32_t node          = findFree(countReserved);
+        if (node == INVALID)
+            return false;
+
+        removeFree(node);
+        if (m_nodes[node].count > countReserved)
+            releaseNode(split(node, countReserved));
+
+        outOffset  = m_nodes[node].offset * GRANULARITY;
+        outAligned = ((outOffset + align - 1) / align) * align;
+
+        // give back pages skipped for the custom alignment, front and end
+        uint32_t skipFront = (outAligned - outOffset) / GRANULARITY;
+        if (skipFront) {
+            uint32_t front = node;
+            node           = split(front, skipFront);
+            releaseNode(front);
+            outOffset += skipFront * GRANULARITY;
+        }
+
+        uint32_t outLast   = alignedSize(outAligned + (size ? size : 1));
+        outSize            = outLast - outOffset;
+        uint32_t usedCount = outSize / GRANULARITY;
+        assert(usedCount <= m_nodes[node].count);
+
+        if (usedCount < m_nodes[node].count)
+            releaseNode(split(node, usedCount));
+
+        assert((outAligned + size) <= (outOffset + outSize));
+
+        m_pageNodes[m_nodes[node].offset] = node;
+        m_used += outSize;
+        return true;
+    }
+
+    void subFree(uint32_t offset, uint32_t size)
+    {
+        assert(offset % GRANULARITY == 0);
+        assert(size % GRANULARITY == 0);
+
+        uint32_t page = offset / GRANULARITY;
+        assert(page < m_pageNodes.size() && m_pageNodes[page] != INVALID && "range not allocated");
+        uint32_t node = m_pageNodes[page];
+        assert(m_nodes[node].count == size / GRANULARITY);
+        m_pageNodes[page] = INVALID;
+
+        m_used -= size;
+        releaseNode(node);
+    }
+
+private:
+    static const uint32_t INVALID  = ~0u;
+    static const uint32_t SL_LOG2  = 4;
+    static const uint32_t SL_COUNT = 1 << SL_LOG2;
+    static const uint32_t FL_COUNT = 32 - SL_LOG2 + 1;
+
+    struct Node
+    {
+        uint32_t offset   = 0;        // in pages
+        uint32_t count    = 0;        // in pages
+        uint32_t prevPhys = INVALID;  // neighbours in memory order
+        uint32_t nextPhys = INVALID;
+        uint32_t prevFree = INVALID;  // links in the segregated list
+        uint32_t nextFree = INVALID;
+        bool     free     = false;
+    };
+
+    static uint32_t msb(uint32_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse(&index, value);
+        return uint32_t(index);
+#else
+        return 31 - uint32_t(__builtin_clz(value));
+#endif
+    }
+
+    static uint32_t lsb(uint32_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, value);
+        return uint32_t(index);
+#else
+        return uint32_t(__builtin_ctz(value));
+#endif
+    }
+
+    // bucket holding free ranges of count pages
+    static void mapping(uint32_t count, uint32_t& fl, uint32_t& sl)
+    {
+        if (count < SL_COUNT) {
+            fl = 0;
+            sl = count;
+        }
+        else {
+            uint32_t top = msb(count);
+            fl           = top - SL_LOG2 + 1;
+            sl           = (count >> (top - SL_LOG2)) ^ SL_COUNT;
+        }
+    }
+
+    // same padding rules as TRangeAllocator::subAllocate
+    uint32_t reservedCount(uint32_t size, uint32_t align) const
+    {
+        uint32_t alignRest    = align - 1;
+        uint32_t sizeReserved = size;
+        bool     alignIsPOT   = (align & alignRest) == 0;
+
+        if (m_used != 0 && (alignIsPOT ? (align > GRANULARITY) : ((alignRest + size) > GRANULARITY)))
+            sizeReserved += alignRest;
+
+        uint32_t count = (sizeReserved + GRANULARITY - 1) / GRANULARITY;
+        return count ? count : 1;
+    }
+
+    //-------------------------------------------------------------------------
+    // Size rounded up to the next bucket, every range in there fits. When
+    // nothing is found the request's own bucket may still hold a range
+    // large enough, it is scanned as a last resort
+    //
+    uint32_t findFree(uint32_t count) const
+    {
+        uint32_t rounded = count;
+        if (count >= SL_COUNT) {
+            uint64_t up = uint64_t(count) + (uint64_t(1) << (msb(count) - SL_LOG2)) - 1;
+            rounded     = up > 0xFFFFFFFFull ? 0xFFFFFFFFu : uint32_t(up);
+        }
+
+        uint32_t fl, sl;
+        mapping(rounded, fl, sl);
+
+        if (fl < FL_COUNT) {
+            uint32_t slMap = m_slBitmap[fl] & (~0u << sl);
+            if (!slMap) {
+                uint32_t flMap = (fl + 1 < 32) ? (m_flBitmap & (~0u << (fl + 1))) : 0;
+                if (flMap) {
+                    fl    = lsb(flMap);
+                    slMap = m_slBitmap[fl];
+                }
+            }
+            if (slMap)
+                return m_heads[fl][lsb(slMap)];
+        }
+
+        mapping(count, fl, sl);
+        for (uint32_t node = m_heads[fl][sl]; node != INVALID; node = m_nodes[node].nextFree) {
+            if (m_nodes[node].count >= count)
+                return node;
+        }
+        return INVALID;
+    }
+
+    uint32_t newNode()
+    {
+        if (!m_unusedNodes.empty()) {
+            uint32_t node = m_unusedNodes.back();
+            m_unusedNodes.pop_back();
+            m_nodes[node] = Node();
+            return node;
+        }
+        m_nodes.push_back(Node());
+        return uint32_t(m_nodes.size() - 1);
+    }
+
+    void insertFree(uint32_t node)
+    {
+        uint32_t fl, sl;
+        mapping(m_nodes[node].count, fl, sl);
+
+        Node& n    = m_nodes[node];
+        n.free     = true;
+        n.prevFree = INVALID;
+        n.nextFree = m_heads[fl][sl];
+        if (n.nextFree != INVALID)
+            m_nodes[n.nextFree].prevFree = node;
+        m_heads[fl][sl] = node;
+
+        m_slBitmap[fl] |= 1u << sl;
+        m_flBitmap |= 1u << fl;
+    }
+
+    void removeFree(uint32_t node)
+    {
+        uint32_t fl, sl;
+        mapping(m_nodes[node].count, fl, sl);
+
+        Node& n = m_nodes[node];
+        if (n.prevFree != INVALID)
+            m_nodes[n.prevFree].nextFree = n.nextFree;
+        else
+            m_heads[fl][sl] = n.nextFree;
+        if (n.nextFree != INVALID)
+            m_nodes[n.nextFree].prevFree = n.prevFree;
+
+        if (m_heads[fl][sl] == INVALID) {
+            m_slBitmap[fl] &= ~(1u << sl);
+            if (!m_slBitmap[fl])
+                m_flBitmap &= ~(1u << fl);
+        }
+
+        n.free     = false;
+        n.prevFree = INVALID;
+        n.nextFree = INVALID;
+    }
+
+    // keeps count pages in node, returns the (not free) rest
+    uint32_t split(uint32_t node, uint32_t count)
+    {
+        uint32_t rest = newNode();
+        Node&    n    = m_nodes[node];
+        Node&    r    = m_nodes[rest];
+
+        r.offset   = n.offset + count;
+        r.count    = n.count - count;
+        r.prevPhys = node;
+        r.nextPhys = n.nextPhys;
+        if (r.nextPhys != INVALID)
+            m_nodes[r.nextPhys].prevPhys = rest;
+
+        n.count    = count;
+        n.nextPhys = rest;
+        return rest;
+    }
+
+    // absorbs next into node
+    void merge(uint32_t node, uint32_t next)
+    {
+        Node& n = m_nodes[node];
+        Node& x = m_nodes[next];
+
+        n.count += x.count;
+        n.nextPhys = x.nextPhys;
+        if (n.nextPhys != INVALID)
+            m_nodes[n.nextPhys].prevPhys = node;
+
+        m_unusedNodes.push_back(next);
+    }
+
+    // turn a node free, merged with free neighbours
+    void releaseNode(uint32_t node)
+    {
+        uint32_t next = m_nodes[node].nextPhys;
+        if (next != INVALID && m_nodes[next].free) {
+            removeFree(next);
+            merge(node, next);
+        }
+
+        uint32_t prev = m_nodes[node].prevPhys;
+        if (prev != INVALID && m_nodes[prev].free) {
+            removeFree(prev);
+            merge(prev, node);
+            node = prev;
+        }
+
+        insertFree(node);
+    }
+
+    uint32_t m_size = 0;
+    uint32_t m_used = 0;
+
+    std::vector<Node>     m_nodes;
+    std::vector<uint32_t> m_unusedNodes;  // recycled node slots
+    std::vector<uint32_t> m_pageNodes;    // start page -> allocated node, INVALID otherwise
+
+    uint32_t m_flBitmap = 0;
+    uint32_t m_slBitmap[FL_COUNT] = {};
+    uint32_t m_heads[FL_COUNT][SL_COUNT];
+
+}; // class TTlsfAllocator
+
+} // namespace tools
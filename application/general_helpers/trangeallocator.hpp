@@ -110,6 +110,16 @@ public:
 
     bool isEmpty() const { return m_used == 0; }
 
+    uint32_t getUsedSize() const { return m_used; }
+
+    // upper bound of the largest size a subAllocate with align <= GRANULARITY
+    // can succeed with, O(1). Frees raise it, a failed subAllocate visits
+    // every range and makes it exact
+    uint32_t getLargestFreeSize() const { return m_used >= m_size ? 0 : m_LargestBound * GRANULARITY; }
+
+    // exact largest free size, walks the ranges
+    uint32_t computeLargestFreeSize() const { return m_used >= m_size ? 0 : largestRangeCount() * GRANULARITY; }
+
     bool isAvailable(uint32_t size, uint32_t align) const
     {
         uint32_t alignRest = align - 1;
@@ -229,6 +239,7 @@ public:
         m_Count = other.m_Count;
         m_Capacity = other.m_Capacity;
         m_MaxID = other.m_MaxID;
+        m_LargestBound = other.m_LargestBound;
 
         if (m_Ranges)
         {
@@ -248,6 +259,7 @@ public:
         m_Count = other.m_Count;
         m_Capacity = other.m_Capacity;
         m_MaxID = other.m_MaxID;
+        m_LargestBound = other.m_LargestBound;
 
         if (m_Ranges)
         {
@@ -265,6 +277,7 @@ public:
         m_Count = other.m_Count;
         m_Capacity = other.m_Capacity;
         m_MaxID = other.m_MaxID;
+        m_LargestBound = other.m_LargestBound;
 
         other.m_Ranges = nullptr;
 
@@ -280,6 +293,7 @@ public:
         m_Count = other.m_Count;
         m_Capacity = other.m_Capacity;
         m_MaxID = other.m_MaxID;
+        m_LargestBound = other.m_LargestBound;
 
         other.m_Ranges = nullptr;
     }
@@ -299,6 +313,7 @@ private:
     uint32_t m_Count = 0;        // Number of ranges in list
     uint32_t m_Capacity = 0;        // Total capacity of range list
     uint32_t m_MaxID = 0;
+    uint32_t m_LargestBound = 0;  // pages, >= largest range
 
 public:
     void rangeInit(const uint32_t max_id)
@@ -310,6 +325,7 @@ public:
         m_Count = 1;
         m_Capacity = 1;
         m_MaxID = max_id;
+        m_LargestBound = max_id + 1;
     }
 
     void rangeDeinit()
@@ -319,6 +335,7 @@ public:
             ::free(m_Ranges);
             m_Ranges = nullptr;
         }
+        m_LargestBound = 0;
     }
 
     bool createID(uint32_t& id)
@@ -345,6 +362,7 @@ public:
 
     bool createRangeID(uint32_t& id, const uint32_t count)
     {
+        uint32_t largest = 0;
         uint32_t i = 0;
         do
         {
@@ -364,10 +382,13 @@ public:
                 }
                 return true;
             }
+            largest = std::max(largest, range_count);
             ++i;
         } while (i < m_Count);
 
-        // No range of free IDs was large enough to create the requested continuous ID sequence
+        // No range of free IDs was large enough to create the requested continuous ID sequence,
+        // all of them were visited
+        m_LargestBound = largest;
         return false;
     }
 
@@ -401,11 +422,13 @@ public:
                         // Merge with previous range
                         m_Ranges[i - 1].m_Last = m_Ranges[i].m_Last;
                         destroyRange(i);
+                        raiseLargestBound(i - 1);
                     }
                     else
                     {
                         // Just grow range
                         m_Ranges[i].m_First = id;
+                        raiseLargestBound(i);
                     }
                     return true;
                 }
@@ -423,6 +446,7 @@ public:
                         insertRange(i);
                         m_Ranges[i].m_First = id;
                         m_Ranges[i].m_Last = end_id - 1;
+                        raiseLargestBound(i);
                         return true;
                     }
                 }
@@ -444,6 +468,7 @@ public:
                         // Just grow range
                         m_Ranges[i].m_Last += count;
                     }
+                    raiseLargestBound(i);
                     return true;
                 }
                 else
@@ -460,6 +485,7 @@ public:
                         insertRange(i + 1);
                         m_Ranges[i + 1].m_First = id;
                         m_Ranges[i + 1].m_Last = end_id - 1;
+                        raiseLargestBound(i + 1);
                         return true;
                     }
                 }
@@ -487,6 +513,27 @@ public:
         return false;
     }
 
+    // a freed range can only raise the largest one
+    void raiseLargestBound(const uint32_t index)
+    {
+        m_LargestBound = std::max(m_LargestBound, m_Ranges[index].m_Last + 1 - m_Ranges[index].m_First);
+    }
+
+    // size in pages of the largest continuous free range
+    uint32_t largestRangeCount() const
+    {
+        if (!m_Ranges)
+            return 0;
+
+        uint32_t largest = 0;
+        for (uint32_t i = 0; i < m_Count; i++)
+        {
+            uint32_t count = m_Ranges[i].m_Last + 1 - m_Ranges[i].m_First;
+            largest = std::max(largest, count);
+        }
+        return largest;
+    }
+
     void printRanges() const
     {
         uint32_t i = 0;
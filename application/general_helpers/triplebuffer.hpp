@@ -0,0 +1,85 @@
+/*
+ *
+ * Andrew Frost
+ * triplebuffer.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace tools {
+
+///////////////////////////////////////////////////////////////////////////
+// TripleBuffer                                                          //
+///////////////////////////////////////////////////////////////////////////
+// Lock-free single producer / single consumer handoff                   //
+// - producer fills getWriteBuffer() and publish()es it                  //
+// - consumer consume()s and reads getReadBuffer()                       //
+// - a third slot sits in the middle, exchanged atomically, so neither   //
+//   side ever touches the slot the other one is using                   //
+// - waitConsumed() lets the producer stay at most one item ahead        //
+///////////////////////////////////////////////////////////////////////////
+
+template <class T>
+class TripleBuffer
+{
+public:
+    TripleBuffer(TripleBuffer const&) = delete;
+    TripleBuffer& operator=(TripleBuffer const&) = delete;
+
+    TripleBuffer() {}
+
+    //-------------------------------------------------------------------------
+    // Producer side
+    //
+    T& getWriteBuffer() { return m_buffers[m_writeIndex]; }
+
+    void publish()
+    {
+        uint32_t previous = m_middle.exchange(m_writeIndex | s_pendingBit, std::memory_order_acq_rel);
+        m_writeIndex      = previous & s_indexMask;
+    }
+
+    // true while the last published item was not picked up
+    bool isPending() const { return (m_middle.load(std::memory_order_acquire) & s_pendingBit) != 0; }
+
+    // spin until the consumer took the last published item, or abort is set
+    void waitConsumed(const std::atomic<bool>& abort) const
+    {
+        while (isPending() && !abort.load(std::memory_order_relaxed))
+            std::this_thread::yield();
+    }
+
+    //-------------------------------------------------------------------------
+    // Consumer side, returns false when nothing new was published
+    //
+    bool consume()
+    {
+        if (!isPending())
+            return false;
+
+        uint32_t previous = m_middle.exchange(m_readIndex, std::memory_order_acq_rel);
+        m_readIndex       = previous & s_indexMask;
+        return true;
+    }
+
+    T& getReadBuffer() { return m_buffers[m_readIndex]; }
+
+private:
+    static const uint32_t s_pendingBit = 0x4;
+    static const uint32_t s_indexMask  = 0x3;
+
+    std::array<T, 3>      m_buffers;
+    uint32_t              m_writeIndex{ 0 };  // producer only
+    std::atomic<uint32_t> m_middle{ 1 };
+    uint32_t              m_readIndex{ 2 };   // consumer only
+
+}; // class TripleBuffer
+
+} // namespace tools
@@ -4,4 +4,8 @@
 C:/VulkanSDK/1.2.135.0/Bin/glslc.exe frag_shader.frag -o frag_shader.frag.spv
 C:/VulkanSDK/1.2.135.0/Bin/glslc.exe vert_shader.vert -o vert_shader.vert.spv
 C:/VulkanSDK/1.2.135.0/Bin/glslc.exe post.frag -o post.frag.spv 
-C:/VulkanSDK/1.2.135.0/Bin/glslc.exe passthrough.vert -o passthrough.vert.spv 
\ No newline at end of file
+C:/VulkanSDK/1.2.135.0/Bin/glslc.exe passthrough.vert -o passthrough.vert.spv 
+C:/VulkanSDK/1.2.135.0/Bin/glslc.exe vert_shader_bda.vert -o vert_shader_bda.vert.spv
+C:/VulkanSDK/1.2.135.0/Bin/glslc.exe frag_shader_bda.frag -o frag_shader_bda.frag.spv
+C:/VulkanSDK/1.2.135.0/Bin/glslc.exe --target-env=vulkan1.1 -DSPD_SUBGROUPS spd.comp -o spd.comp.spv
+C:/VulkanSDK/1.2.135.0/Bin/glslc.exe spd.comp -o spd_lds.comp.spv
\ No newline at end of file
@@ -16,6 +16,14 @@ layout(push_constant) uniform shaderInformation
 }
 pushC;
 
+// Permutations of the material path, the defaults are the uber shader
+// - LIGHT_TYPE: -1 reads pushC.lightType, otherwise fixed
+// - HAS_TEXTURES: false when no material of the draws is textured
+// - HAS_SPECULAR: false when all materials are Lambert (illum < 2)
+layout(constant_id = 0) const int  LIGHT_TYPE   = -1;
+layout(constant_id = 1) const bool HAS_TEXTURES = true;
+layout(constant_id = 2) const bool HAS_SPECULAR = true;
+
 // clang-format off
 // Incoming 
 //layout(location = 0) flat in int matIndex;
@@ -48,7 +56,8 @@ void main()
   // Vector toward light
   vec3  L;
   float lightIntensity = pushC.lightIntensity;
-  if(pushC.lightType == 0)
+  int   lightType      = LIGHT_TYPE < 0 ? pushC.lightType : LIGHT_TYPE;
+  if(lightType == 0)
   {
     vec3  lDir     = pushC.lightPosition - worldPos;
     float d        = length(lDir);
@@ -63,7 +72,7 @@ void main()
 
   // Diffuse
   vec3 diffuse = computeDiffuse(mat, L, N);
-  if(mat.textureId >= 0)
+  if(HAS_TEXTURES && mat.textureId >= 0)
   {
     int  txtOffset  = scnDesc.i[pushC.instanceId].txtOffset;
     uint txtId      = txtOffset + mat.textureId;
@@ -72,7 +81,7 @@ void main()
   }
 
   // Specular
-  vec3 specular = computeSpecular(mat, viewDir, L, N);
+  vec3 specular = HAS_SPECULAR ? computeSpecular(mat, viewDir, L, N) : vec3(0);
 
   // Result
   outColor = vec4(lightIntensity * (diffuse + specular), 1);
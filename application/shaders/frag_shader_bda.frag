@@ -0,0 +1,87 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_scalar_block_layout : enable
+#extension GL_EXT_buffer_reference : enable
+#extension GL_EXT_buffer_reference_uvec2 : enable
+
+#include "wavefront.glsl"
+
+
+layout(push_constant) uniform shaderInformation
+{
+  vec3  lightPosition;
+  uint  instanceId;
+  float lightIntensity;
+  int   lightType;
+}
+pushC;
+
+// Permutations of the material path, the defaults are the uber shader
+// - LIGHT_TYPE: -1 reads pushC.lightType, otherwise fixed
+// - HAS_TEXTURES: false when no material of the draws is textured
+// - HAS_SPECULAR: false when all materials are Lambert (illum < 2)
+layout(constant_id = 0) const int  LIGHT_TYPE   = -1;
+layout(constant_id = 1) const bool HAS_TEXTURES = true;
+layout(constant_id = 2) const bool HAS_SPECULAR = true;
+
+// clang-format off
+// Incoming 
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) in vec3 fragNormal;
+layout(location = 3) in vec3 viewDir;
+layout(location = 4) in vec3 worldPos;
+// Outgoing
+layout(location = 0) out vec4 outColor;
+// Buffers, materials are read through the addresses of the scene description
+layout(buffer_reference, scalar) readonly buffer Materials { WaveFrontMaterial m[]; };
+layout(buffer_reference, scalar) readonly buffer MatIndices { int i[]; };
+layout(binding = 2, scalar) buffer ScnDesc { sceneDesc i[]; } scnDesc;
+layout(binding = 3) uniform sampler2D[] textureSamplers;
+
+// clang-format on
+
+
+void main()
+{
+  sceneDesc desc = scnDesc.i[pushC.instanceId];
+
+  // Material of the object
+  int               matIndex = MatIndices(desc.matIndexAddress).i[gl_PrimitiveID];
+  WaveFrontMaterial mat      = Materials(desc.materialAddress).m[matIndex];
+
+  vec3 N = normalize(fragNormal);
+
+  // Vector toward light
+  vec3  L;
+  float lightIntensity = pushC.lightIntensity;
+  int   lightType      = LIGHT_TYPE < 0 ? pushC.lightType : LIGHT_TYPE;
+  if(lightType == 0)
+  {
+    vec3  lDir     = pushC.lightPosition - worldPos;
+    float d        = length(lDir);
+    lightIntensity = pushC.lightIntensity / (d * d);
+    L              = normalize(lDir);
+  }
+  else
+  {
+    L = normalize(pushC.lightPosition - vec3(0));
+  }
+
+
+  // Diffuse
+  vec3 diffuse = computeDiffuse(mat, L, N);
+  if(HAS_TEXTURES && mat.textureId >= 0)
+  {
+    uint txtId      = desc.txtOffset + mat.textureId;
+    vec3 diffuseTxt = texture(textureSamplers[nonuniformEXT(txtId)], fragTexCoord).xyz;
+    diffuse *= diffuseTxt;
+  }
+
+  // Specular
+  vec3 specular = HAS_SPECULAR ? computeSpecular(mat, viewDir, L, N) : vec3(0);
+
+  // Result
+  outColor = vec4(lightIntensity * (diffuse + specular), 1);
+}
@@ -0,0 +1,61 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_scalar_block_layout : enable
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_buffer_reference : enable
+#extension GL_EXT_buffer_reference_uvec2 : enable
+
+#include "wavefront.glsl"
+
+// clang-format off
+layout(buffer_reference, scalar) readonly buffer Vertices { Vertex v[]; };
+layout(buffer_reference, scalar) readonly buffer Indices { uint i[]; };
+
+layout(binding = 2, set = 0, scalar) buffer ScnDesc { sceneDesc i[]; } scnDesc;
+// clang-format on
+
+layout(binding = 0) uniform UniformBufferObject
+{
+  mat4 view;
+  mat4 proj;
+  mat4 viewI;
+}
+ubo;
+
+layout(push_constant) uniform shaderInformation
+{
+  vec3  lightPosition;
+  uint  instanceId;
+  float lightIntensity;
+  int   lightType;
+}
+pushC;
+
+//layout(location = 0) flat out int matIndex;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 fragNormal;
+layout(location = 3) out vec3 viewDir;
+layout(location = 4) out vec3 worldPos;
+
+out gl_PerVertex
+{
+  vec4 gl_Position;
+};
+
+
+void main()
+{
+  sceneDesc desc = scnDesc.i[pushC.instanceId];
+
+  // vertex pulling, gl_VertexIndex is the value read from the bound index buffer
+  Vertex vtx = Vertices(desc.vertexAddress).v[gl_VertexIndex];
+
+  vec3 origin = vec3(ubo.viewI * vec4(0, 0, 0, 1));
+
+  worldPos     = vec3(desc.transfo * vec4(vtx.pos, 1.0));
+  viewDir      = vec3(worldPos - origin);
+  fragTexCoord = vtx.texCoord;
+  fragNormal   = vec3(desc.transfoIT * vec4(vtx.nrm, 0.0));
+
+  gl_Position = ubo.proj * ubo.view * vec4(worldPos, 1.0);
+}
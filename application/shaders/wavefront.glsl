@@ -26,6 +26,11 @@ struct sceneDesc
   int  txtOffset;
   mat4 transfo;
   mat4 transfoIT;
+  // device address mode only, 0 otherwise
+  uvec2 vertexAddress;
+  uvec2 indexAddress;
+  uvec2 materialAddress;
+  uvec2 matIndexAddress;
 };
 
 
@@ -8,6 +8,11 @@
 
 #define VMA_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <thread>
 #include "stb_image.h"
 #include "examplevulkan.hpp"
 
@@ -21,7 +26,14 @@
 void ExampleVulkan::setupVulkan(const app::ContextCreateInfo& info, GLFWwindow* window)
 {
     VulkanBackend::setupVulkan(info, window);
-    m_allocator.init(m_device, m_physicalDevice, m_instance);
+    m_allocator.init(m_device, m_physicalDevice, m_instance, APP_DEFAULT_STAGING_BLOCKSIZE,
+                     isDeviceExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME), isBufferDeviceAddressSupported());
+    m_uploadRing.init(m_device, m_allocator.getAllocator(), &m_timeline);
+    m_defragmenter.init(m_device, m_allocator.getAllocator(), &m_timeline, m_graphicsQueueIdx);
+    m_descriptors.init(m_device, &m_timeline, isDeviceExtensionEnabled(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME));
+    getRenderTargetPool().setMemoryStats(&m_allocator.getMemoryStats());
+    m_gpuTimer.init(m_device, m_physicalDevice, m_graphicsQueueIdx, &m_timeline);
+    m_mipGenerator.init(m_device, m_physicalDevice, &m_allocator, &getPipelineCache(), &getShaderModules());
 #if _DEBUG
     m_debug.setup(m_device, m_instance);
 #endif
@@ -32,38 +44,65 @@ void ExampleVulkan::setupVulkan(const app::ContextCreateInfo& info, GLFWwindow*
 //
 void ExampleVulkan::destroyResources()
 {
-    m_device.destroy(m_graphicsPipeline);
+    // run retired destructions while the allocator is alive
+    m_timeline.collect();
+    waitPipelines();
+
     m_device.destroy(m_pipelineLayout);
-    m_device.destroy(m_descriptorPool);
-    m_device.destroy(m_descriptorSetLayout);
+    for (uint32_t moduleID : m_sceneShaders)
+        getShaderModules().release(moduleID);
+    for (uint32_t moduleID : m_postShaders)
+        getShaderModules().release(moduleID);
     m_allocator.destroy(m_cameraMat);
     m_allocator.destroy(m_sceneDesc);
+    m_uploadRing.deinit();
+    m_defragmenter.deinit();
+    m_gpuTimer.deinit();
+    m_mipGenerator.deinit();
 
+    // evict callbacks must not run past this point
+    app::MemoryBudget& budget = m_allocator.getMemoryBudget();
     for (auto& model : m_objModel)
     {
+        budget.remove(model.residencyID);
         m_allocator.destroy(model.vertexBuffer);
         m_allocator.destroy(model.indexBuffer);
         m_allocator.destroy(model.matColorBuffer);
         m_allocator.destroy(model.matIndexBuffer);
     }
 
-    for (auto& texture : m_textures)
+    for (size_t i = 0; i < m_textures.size(); ++i)
     {
-        m_allocator.destroy(texture);
+        budget.remove(m_textureResidency[i]);
+        m_allocator.destroy(m_textures[i]);
     }
+    for (auto& texture : m_evictedTextures)
+        m_allocator.destroy(texture);
+    m_evictedTextures.clear();
+    if (m_placeholderTexture.image)
+        m_allocator.destroy(m_placeholderTexture);
 
     // Post 
-    m_device.destroy(m_postPipeline);
     m_device.destroy(m_postPipelineLayout);
-    m_device.destroy(m_postDescriptorPool);
-    m_device.destroy(m_postDescriptorSetLayout);
-    m_allocator.destroy(m_offscreenColor);
-    m_allocator.destroy(m_offscreenDepth);
-    m_allocator.destroy(m_offscreenResolve);
+    m_descriptors.deinit();
+    getRenderTargetPool().release(m_offscreenColor);
+    getRenderTargetPool().release(m_offscreenDepth);
+    getRenderTargetPool().release(m_offscreenResolve);
+    m_device.destroy(m_offscreenSampler);
     m_device.destroy(m_offscreenRenderPass);
     m_device.destroy(m_offscreenFramebuffer);
 }
 
+//-------------------------------------------------------------------------
+//
+//
+bool ExampleVulkan::setDeviceAddressMode(bool enable)
+{
+    assert(m_objModel.empty() && "set before loading");
+    m_deviceAddressMode = enable && m_allocator.isBufferDeviceAddressEnabled();
+    return m_deviceAddressMode;
+}
+
 //-------------------------------------------------------------------------
 // called when resizing of the window
 //
@@ -79,14 +118,14 @@ void ExampleVulkan::onResize(int /*w*/, int /*h*/)
 void ExampleVulkan::loadModel(const std::string& filename, glm::mat4 transform)
 {
     ObjLoader loader;
-    loader.loadModel(filename);
+    if (!loader.parse(filename))
+        throw std::runtime_error("failed to load " + filename + "!");
+    const ObjLoader::Sizes sizes = loader.getSizes();
 
-    // convert srgb to linear
-    for (auto& m : loader.m_materials) {
-        m.ambient  = glm::pow(m.ambient, glm::vec3(2.2f));
-        m.diffuse  = glm::pow(m.diffuse, glm::vec3(2.2f));
-        m.specular = glm::pow(m.specular, glm::vec3(2.2f));
-    }
+    // once the set exists, its arrays have room for a fixed number of elements
+    if (m_descriptorSet && (m_objModel.size() + 1 > m_objCapacity
+                            || m_textures.size() + loader.m_textures.size() > m_textureCapacity))
+        throw std::runtime_error("scene exceeds the descriptor set capacity!");
 
     ObjInstance instance = {};
     instance.objIndex    = static_cast<uint32_t>(m_objModel.size());
@@ -95,31 +134,175 @@ void ExampleVulkan::loadModel(const std::string& filename, glm::mat4 transform)
     instance.txtOffset   = static_cast<uint32_t>(m_textures.size());
 
     ObjModel model = {};
-    model.nIndices  = static_cast<uint32_t>(loader.m_indices.size());
-    model.nVertices = static_cast<uint32_t>(loader.m_vertices.size());
+    model.txtOffset = static_cast<uint32_t>(m_textures.size());
+    model.filename  = filename;
+
+    // evict what was not drawn lately rather than failing the allocation
+    m_allocator.getMemoryBudget().makeRoom(sizes.vertices * sizeof(VertexObj) + sizes.indices * sizeof(uint32_t));
+
+    // convert srgb to linear
+    auto toLinear = [](MaterialObj& m) {
+        m.ambient  = glm::pow(m.ambient, glm::vec3(2.2f));
+        m.diffuse  = glm::pow(m.diffuse, glm::vec3(2.2f));
+        m.specular = glm::pow(m.specular, glm::vec3(2.2f));
+    };
+
+    // branches of the fragment shader any material of the model takes
+    auto materialVariant = [](const std::vector<MaterialObj>& materials) {
+        uint32_t variant = 0;
+        for (const auto& m : materials) {
+            if (m.textureID >= 0)
+                variant |= eVariantTextured;
+            if (m.illum >= 2)
+                variant |= eVariantSpecular;
+        }
+        return variant;
+    };
 
     // create buffers on device and copy vertices, indices and materials
     app::CommandPool cmdBufferGet(m_device, m_graphicsQueueIdx);
     vk::CommandBuffer commandBuffer = cmdBufferGet.createBuffer();
-    model.vertexBuffer   = m_allocator.createBuffer(commandBuffer, loader.m_vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    model.indexBuffer    = m_allocator.createBuffer(commandBuffer, loader.m_indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-    model.matColorBuffer = m_allocator.createBuffer(commandBuffer, loader.m_materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    model.matIndexBuffer = m_allocator.createBuffer(commandBuffer, loader.m_matIndx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    createGeometry(commandBuffer, loader, model);
+    if (m_loadInPlace) {
+        // few materials, converted on the stack rather than read back from the mapping
+        std::vector<MaterialObj> materials(sizes.materials);
+        loader.writeMaterials(materials);
+        for (auto& m : materials)
+            toLinear(m);
+        model.variant = materialVariant(materials);
+
+        model.matColorBuffer = m_allocator.createSlice(commandBuffer, materials, app::MemoryStats::Category::eMaterial);
+        model.matIndexBuffer = m_allocator.createSliceInPlace(commandBuffer, sizes.matIndices * sizeof(uint32_t),
+            [&](void* mapping) {
+                loader.writeMatIndices({ static_cast<uint32_t*>(mapping), sizes.matIndices });
+            }, app::MemoryStats::Category::eMaterial);
+    }
+    else {
+        loader.m_materials.resize(sizes.materials);
+        loader.m_matIndx.resize(sizes.matIndices);
+        loader.writeMaterials(loader.m_materials);
+        loader.writeMatIndices(loader.m_matIndx);
+        for (auto& m : loader.m_materials)
+            toLinear(m);
+        model.variant = materialVariant(loader.m_materials);
+
+        model.matColorBuffer = m_allocator.createSlice(commandBuffer, loader.m_materials, app::MemoryStats::Category::eMaterial);
+        model.matIndexBuffer = m_allocator.createSlice(commandBuffer, loader.m_matIndx, app::MemoryStats::Category::eMaterial);
+    }
+    loader.release();
+
     // creates all textures found
     createTextureImages(commandBuffer, loader.m_textures);
-    cmdBufferGet.submitAndWait(commandBuffer);
-    m_allocator.finalizeAndReleaseStaging();
+    model.txtCount = static_cast<uint32_t>(m_textures.size()) - model.txtOffset;
+    uint64_t uploadValue = cmdBufferGet.submitAndWait(commandBuffer, m_timeline);
+    m_allocator.finalizeAndReleaseStaging(m_timeline, uploadValue);
+
+    registerGeometry(instance.objIndex, model);
+
+    fillInstanceAddresses(instance, model);
+    m_objModel.emplace_back(model);
+    m_objInstance.emplace_back(instance);
+    m_drawListDirty = true;
+}
+
+//-------------------------------------------------------------------------
+// Device address mode only, one instance per model
+//
+void ExampleVulkan::fillInstanceAddresses(ObjInstance& instance, const ObjModel& model) const
+{
+    if (!m_deviceAddressMode)
+        return;
+
+    instance.vertexAddress   = model.vertexBuffer.buffer ? m_allocator.getDeviceAddress(model.vertexBuffer.buffer) : 0;
+    instance.indexAddress    = model.indexBuffer.buffer ? m_allocator.getDeviceAddress(model.indexBuffer.buffer) : 0;
+    instance.materialAddress = m_allocator.getDeviceAddress(model.matColorBuffer);
+    instance.matIndexAddress = m_allocator.getDeviceAddress(model.matIndexBuffer);
+}
+
+//-------------------------------------------------------------------------
+// Runs before the frame's commands are recorded, the copy lands before
+// any draw of the frame
+//
+void ExampleVulkan::uploadInstance(uint32_t objIndex)
+{
+    ObjInstance& instance = m_objInstance[objIndex];
+    fillInstanceAddresses(instance, m_objModel[instance.objIndex]);
+    if (!m_sceneDesc.buffer)
+        return;
+
+    m_uploadRing.cmdToBuffer(m_sceneDesc.buffer, m_sceneDesc.offset + objIndex * sizeof(ObjInstance),
+                             sizeof(ObjInstance), &instance);
+}
+
+//-------------------------------------------------------------------------
+// Recorded in cmdBuffer, staging is released by the caller once it ran
+//
+void ExampleVulkan::createGeometry(const vk::CommandBuffer& cmdBuffer, ObjLoader& loader, ObjModel& model)
+{
+    const ObjLoader::Sizes sizes = loader.getSizes();
+    model.nIndices     = static_cast<uint32_t>(sizes.indices);
+    model.nVertices    = static_cast<uint32_t>(sizes.vertices);
+    model.geometrySize = sizes.vertices * sizeof(VertexObj) + sizes.indices * sizeof(uint32_t);
+
+    // geometry is also pulled through its address in device address mode
+    const VkBufferUsageFlags addressUsage = m_deviceAddressMode ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR : 0;
+
+    if (m_loadInPlace) {
+        // written once, straight into staging or the buffers themselves
+        model.vertexBuffer = m_allocator.createBufferInPlace(cmdBuffer, sizes.vertices * sizeof(VertexObj),
+            VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | addressUsage, [&](void* mapping) {
+                loader.writeVertices({ static_cast<VertexObj*>(mapping), sizes.vertices });
+            });
+        model.indexBuffer = m_allocator.createBufferInPlace(cmdBuffer, sizes.indices * sizeof(uint32_t),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | addressUsage, [&](void* mapping) {
+                loader.writeIndices({ static_cast<uint32_t*>(mapping), sizes.indices });
+            });
+    }
+    else {
+        loader.m_vertices.resize(sizes.vertices);
+        loader.m_indices.resize(sizes.indices);
+        loader.writeVertices(loader.m_vertices);
+        loader.writeIndices(loader.m_indices);
+
+        model.vertexBuffer = m_allocator.createBuffer(cmdBuffer, loader.m_vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | addressUsage);
+        model.indexBuffer  = m_allocator.createBuffer(cmdBuffer, loader.m_indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | addressUsage);
+    }
+}
+
+//-------------------------------------------------------------------------
+// Memory category, residency and defragmentation of the model's vertex
+// and index buffers, once they are uploaded
+//
+void ExampleVulkan::registerGeometry(uint32_t objIndex, ObjModel& model)
+{
+    // vertex and index are known from the buffer usage
+    std::string objNb = std::to_string(objIndex);
+    m_allocator.setCategory(model.vertexBuffer, app::MemoryStats::Category::eVertex, ("vertex_" + objNb).c_str());
+    m_allocator.setCategory(model.indexBuffer, app::MemoryStats::Category::eIndex, ("index_" + objNb).c_str());
 
 #if _DEBUG
-    std::string objNb = std::to_string(instance.objIndex);
     m_debug.setObjectName(model.vertexBuffer.buffer, (std::string("vertex_" + objNb).c_str()));
     m_debug.setObjectName(model.indexBuffer.buffer, (std::string("index_" + objNb).c_str()));
-    m_debug.setObjectName(model.matColorBuffer.buffer, (std::string("mat_" + objNb).c_str()));
-    m_debug.setObjectName(model.matIndexBuffer.buffer, (std::string("matIdx_" + objNb).c_str()));
 #endif
 
-    m_objModel.emplace_back(model);
-    m_objInstance.emplace_back(instance);
+    // geometry goes after textures, the index buffer is freed along
+    model.residencyID = m_allocator.getMemoryBudget().add(model.vertexBuffer.allocation,
+        app::MemoryBudget::Priority::eNormal, [this, objIndex]() { evictModel(objIndex); });
+
+    // vertices and indices are bound when drawing, materials live in the
+    // arena. A moved buffer has a new device address
+    const VkBufferUsageFlags   addressUsage = m_deviceAddressMode ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR : 0;
+    const vk::BufferUsageFlags movableUsage = vk::BufferUsageFlags(addressUsage);
+    model.defragIDs[0] = addMovableBuffer(model.vertexBuffer, model.nVertices * sizeof(VertexObj),
+        vk::BufferUsageFlagBits::eVertexBuffer | movableUsage, [this, objIndex](vk::Buffer buffer) {
+            m_objModel[objIndex].vertexBuffer.buffer = static_cast<VkBuffer>(buffer);
+            uploadInstance(objIndex);
+        });
+    model.defragIDs[1] = addMovableBuffer(model.indexBuffer, model.nIndices * sizeof(uint32_t),
+        vk::BufferUsageFlagBits::eIndexBuffer | movableUsage, [this, objIndex](vk::Buffer buffer) {
+            m_objModel[objIndex].indexBuffer.buffer = static_cast<VkBuffer>(buffer);
+            uploadInstance(objIndex);
+        });
 }
 
 //-------------------------------------------------------------------------
@@ -136,6 +319,16 @@ void ExampleVulkan::createTextureImages(const vk::CommandBuffer& cmdBuffer,
 
     vk::Format format = vk::Format::eR8G8B8A8Srgb;
 
+    // bound in place of evicted textures
+    if (!m_placeholderTexture.image) {
+        glm::u8vec4 color(255, 255, 255, 255);
+        vk::ImageCreateInfo imageCreateInfo = app::image::create2DInfo(vk::Extent2D(1, 1), format);
+
+        app::ImageVma image = m_allocator.createImage(cmdBuffer, sizeof(color), &color, imageCreateInfo);
+        vk::ImageViewCreateInfo imageViewCreateInfo = app::image::makeImageViewCreateInfo(image.image, imageCreateInfo);
+        m_placeholderTexture = m_allocator.createTexture(image, imageViewCreateInfo, samplerCreateInfo);
+    }
+
     // if no textures are present, create a dummy one to accomodate the pipeline layout
     if (textures.empty() && m_textures.empty()) {
         app::TextureVma texture;
@@ -155,49 +348,140 @@ void ExampleVulkan::createTextureImages(const vk::CommandBuffer& cmdBuffer,
         app::image::cmdBarrierImageLayout(cmdBuffer, texture.image, vk::ImageLayout::eUndefined,
                                           vk::ImageLayout::eShaderReadOnlyOptimal);
         m_textures.push_back(texture);
+        m_textureResidency.push_back(app::MemoryBudget::INVALID_ID);
     }
     else {
-        // Uploading all images
-        for (const auto& texture : textures) {
-            std::stringstream ss;
-            int texWidth, texHeight, texChannels;
-            ss << "../media/textures/" << texture;
-
-            stbi_uc* pixels =
-                stbi_load(ss.str().c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-
-            // Handle failure
-            if (!pixels)
-            {
-                texWidth = texHeight = 1;
-                texChannels = 4;
-                glm::u8vec4* color = new glm::u8vec4(255, 0, 255, 255);
-                pixels = reinterpret_cast<stbi_uc*>(color);
+        // decoded and uploaded in parallel, each thread through its own
+        // upload context, only the queue submits are serialized
+        std::vector<app::TextureVma> loaded(textures.size());
+        std::vector<std::exception_ptr> errors(textures.size());
+        std::atomic<uint32_t> next{ 0 };
+
+        auto worker = [&]() {
+            app::UploadContext upload;
+            upload.init(&m_allocator, &m_timeline, m_device, m_graphicsQueueIdx);
+            for (uint32_t i = next++; i < textures.size(); i = next++) {
+                try {
+                    loaded[i] = loadTexture(upload, textures[i], samplerCreateInfo, format);
+                }
+                catch (...) {
+                    errors[i] = std::current_exception();
+                }
             }
+            upload.submit();
+            upload.deinit();
+        };
+
+        uint32_t threadCount = (std::min)((std::max)(std::thread::hardware_concurrency(), 1u),
+                                          static_cast<uint32_t>(textures.size()));
+        std::vector<std::thread> threads;
+        for (uint32_t t = 1; t < threadCount; t++)
+            threads.emplace_back(worker);
+        worker();
+        for (auto& thread : threads)
+            thread.join();
+
+        for (const auto& error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
 
-            vk::DeviceSize bufferSize = static_cast<uint64_t>(texWidth) * texHeight * sizeof(glm::u8vec4);
-            auto imageSize = vk::Extent2D(texWidth, texHeight);
-            auto imageCreateInfo = app::image::create2DInfo(imageSize, format, vk::ImageUsageFlagBits::eSampled, true);
+        // textures are evicted first
+        for (const auto& texture : loaded) {
+            uint32_t textureID = static_cast<uint32_t>(m_textures.size());
+            m_textures.push_back(texture);
+            m_textureResidency.push_back(m_allocator.getMemoryBudget().add(texture.allocation,
+                app::MemoryBudget::Priority::eLow, [this, textureID]() { evictTexture(textureID); }));
+        }
+    }
+}
 
-            app::ImageVma image = m_allocator.createImage(cmdBuffer, bufferSize, pixels, imageCreateInfo);
-            app::image::generateMipmaps(cmdBuffer, image.image, format, imageSize, imageCreateInfo.mipLevels);
-            
-            vk::ImageViewCreateInfo imageViewCreateInfo = app::image::makeImageViewCreateInfo(image.image, imageCreateInfo);
+//-------------------------------------------------------------------------
+//
+//
+app::TextureVma ExampleVulkan::loadTexture(app::UploadContext& upload, const std::string& filename,
+                                           const vk::SamplerCreateInfo& samplerCreateInfo, vk::Format format)
+{
+    std::stringstream ss;
+    int texWidth, texHeight, texChannels;
+    ss << "../media/textures/" << filename;
 
-            app::TextureVma texture = m_allocator.createTexture(image, imageViewCreateInfo, samplerCreateInfo);
+    stbi_uc* pixels =
+        stbi_load(ss.str().c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 
-            m_textures.push_back(texture);
-        }
+    // Handle failure
+    glm::u8vec4 magenta(255, 0, 255, 255);
+    const void* data = pixels;
+    if (!pixels)
+    {
+        texWidth = texHeight = 1;
+        texChannels = 4;
+        data = &magenta;
     }
+
+    vk::DeviceSize bufferSize = static_cast<uint64_t>(texWidth) * texHeight * sizeof(glm::u8vec4);
+    auto imageSize = vk::Extent2D(texWidth, texHeight);
+    auto imageCreateInfo = app::image::create2DInfo(imageSize, format, vk::ImageUsageFlagBits::eSampled, true);
+
+    // one dispatch for the whole chain, the views of the call are
+    // destroyed once the upload is done with them
+    const bool computeMips = m_computeMips && m_mipGenerator.canGenerate(format, imageSize, imageCreateInfo.mipLevels);
+    if (computeMips)
+        app::MipGenerator::prepareImageInfo(imageCreateInfo);
+
+    // the pixels are in staging once recorded
+    app::ImageVma image = upload.createImage(bufferSize, data, imageCreateInfo);
+    if (pixels)
+        stbi_image_free(pixels);
+    if (computeMips)
+        upload.retire(m_mipGenerator.cmdGenerate(upload.getCommandBuffer(), image.image, format, imageSize,
+                                                 imageCreateInfo.mipLevels));
+    else
+        app::image::generateMipmaps(upload.getCommandBuffer(), image.image, format, imageSize, imageCreateInfo.mipLevels);
+
+    vk::ImageViewCreateInfo      imageViewCreateInfo = app::image::makeImageViewCreateInfo(image.image, imageCreateInfo);
+    vk::ImageViewUsageCreateInfo imageViewUsageInfo;
+    if (computeMips)
+        app::MipGenerator::prepareViewInfo(imageViewCreateInfo, imageViewUsageInfo);
+
+    app::TextureVma texture = m_allocator.createTexture(image, imageViewCreateInfo, samplerCreateInfo);
+    m_allocator.setCategory(texture, app::MemoryStats::Category::eTexture, ss.str().c_str());
+    return texture;
 }
 
 //-------------------------------------------------------------------------
-// Describing the layout pushed when rendering
+// Describing the layout pushed when rendering. With descriptor indexing
+// the material and texture arrays get room for models added later. In
+// device address mode the materials are read through the scene
+// description and only the textures remain arrays
 //
 void ExampleVulkan::createDescriptorSetLayout()
 {
-    uint32_t nTextures = static_cast<uint32_t>(m_textures.size());
-    uint32_t nObjects  = static_cast<uint32_t>(m_objModel.size());
+    const vk::PhysicalDeviceDescriptorIndexingFeaturesEXT& indexing = getDescriptorIndexingFeatures();
+    m_runtimeDescriptors = indexing.descriptorBindingPartiallyBound
+                        && indexing.descriptorBindingVariableDescriptorCount
+                        && indexing.descriptorBindingUpdateUnusedWhilePending
+                        && (m_deviceAddressMode || indexing.descriptorBindingStorageBufferUpdateAfterBind)
+                        && indexing.descriptorBindingSampledImageUpdateAfterBind;
+
+    m_objCapacity     = static_cast<uint32_t>(m_objModel.size());
+    m_textureCapacity = static_cast<uint32_t>(m_textures.size());
+    if (m_runtimeDescriptors) {
+        auto properties = m_physicalDevice.getProperties2<vk::PhysicalDeviceProperties2,
+                                                           vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+        const auto& limits = properties.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+
+        // bindings 1 and 4 are per object, binding 2 is the scene
+        uint32_t storageBuffers = (std::min)(limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+                                             limits.maxDescriptorSetUpdateAfterBindStorageBuffers);
+        uint32_t samplers       = (std::min)({ limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                               limits.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                               limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                                               limits.maxDescriptorSetUpdateAfterBindSamplers });
+        const uint32_t objLimit = m_deviceAddressMode ? s_maxObjects : (storageBuffers - 1) / 2;
+        m_objCapacity     = (std::max)(m_objCapacity, (std::min)(s_maxObjects, objLimit));
+        m_textureCapacity = (std::max)(m_textureCapacity, (std::min)(s_maxTextures, samplers));
+    }
 
     // Camera matrices (binding = 0)
     vk::DescriptorSetLayoutBinding bindingCamera = {};
@@ -208,13 +492,15 @@ void ExampleVulkan::createDescriptorSetLayout()
     m_descSetLayoutBind.addBinding(bindingCamera);
 
     // Materials (binding = 1)
-    vk::DescriptorSetLayoutBinding bindingMat = {};
-    bindingMat.binding         = 1;
-    bindingMat.descriptorType  = vk::DescriptorType::eStorageBuffer;
-    bindingMat.descriptorCount = nObjects;
-    bindingMat.stageFlags      = vk::ShaderStageFlagBits::eVertex
-                               | vk::ShaderStageFlagBits::eFragment;
-    m_descSetLayoutBind.addBinding(bindingMat);
+    if (!m_deviceAddressMode) {
+        vk::DescriptorSetLayoutBinding bindingMat = {};
+        bindingMat.binding         = 1;
+        bindingMat.descriptorType  = vk::DescriptorType::eStorageBuffer;
+        bindingMat.descriptorCount = m_objCapacity;
+        bindingMat.stageFlags      = vk::ShaderStageFlagBits::eVertex
+                                   | vk::ShaderStageFlagBits::eFragment;
+        m_descSetLayoutBind.addBinding(bindingMat);
+    }
 
     // Scene Decription (binding = 2)
     vk::DescriptorSetLayoutBinding bindingScene = {};
@@ -229,25 +515,51 @@ void ExampleVulkan::createDescriptorSetLayout()
     vk::DescriptorSetLayoutBinding bindingTextures = {};
     bindingTextures.binding         = 3;
     bindingTextures.descriptorType  = vk::DescriptorType::eCombinedImageSampler;
-    bindingTextures.descriptorCount = nTextures;
+    bindingTextures.descriptorCount = m_textureCapacity;
     bindingTextures.stageFlags      = vk::ShaderStageFlagBits::eFragment;
     m_descSetLayoutBind.addBinding(bindingTextures);
 
     // Materials (binding = 4)
-    vk::DescriptorSetLayoutBinding bindingMaterial = {};
-    bindingMaterial.binding         = 4;
-    bindingMaterial.descriptorType  = vk::DescriptorType::eStorageBuffer;
-    bindingMaterial.descriptorCount = nObjects;
-    bindingMaterial.stageFlags      = vk::ShaderStageFlagBits::eFragment;
-    m_descSetLayoutBind.addBinding(bindingMaterial);
+    if (!m_deviceAddressMode) {
+        vk::DescriptorSetLayoutBinding bindingMaterial = {};
+        bindingMaterial.binding         = 4;
+        bindingMaterial.descriptorType  = vk::DescriptorType::eStorageBuffer;
+        bindingMaterial.descriptorCount = m_objCapacity;
+        bindingMaterial.stageFlags      = vk::ShaderStageFlagBits::eFragment;
+        m_descSetLayoutBind.addBinding(bindingMaterial);
+    }
 
-    m_descriptorSetLayout = m_descSetLayoutBind.createLayout(m_device);
-    m_descriptorPool      = m_descSetLayoutBind.createPool(m_device, 1);
-    m_descriptorSet       = app::util::allocateDescriptorSet(m_device, m_descriptorPool, m_descriptorSetLayout);
+    if (!m_runtimeDescriptors) {
+        m_descriptorSetLayout = m_descriptors.getLayout(m_descSetLayoutBind);
+        m_descriptorSet       = m_descriptors.allocate(m_descriptorSetLayout, &m_descSetLayoutBind);
+        return;
+    }
+
+    // elements past the loaded models are never read, new ones are written
+    // while the frames in flight use the set. Only the last binding can
+    // have a variable count, the set is allocated with the full capacity
+    const vk::DescriptorBindingFlags arrayFlags = vk::DescriptorBindingFlagBits::ePartiallyBoundEXT
+                                                | vk::DescriptorBindingFlagBits::eUpdateAfterBindEXT
+                                                | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePendingEXT;
+    uint32_t variableCount = m_objCapacity;
+    if (m_deviceAddressMode) {
+        m_descSetLayoutBind.setBindingFlags(3, arrayFlags | vk::DescriptorBindingFlagBits::eVariableDescriptorCountEXT);
+        variableCount = m_textureCapacity;
+    }
+    else {
+        m_descSetLayoutBind.setBindingFlags(1, arrayFlags);
+        m_descSetLayoutBind.setBindingFlags(3, arrayFlags);
+        m_descSetLayoutBind.setBindingFlags(4, arrayFlags | vk::DescriptorBindingFlagBits::eVariableDescriptorCountEXT);
+    }
+
+    m_descriptorSetLayout = m_descriptors.getLayout(m_descSetLayoutBind,
+                                                    vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT);
+    m_descriptorSet       = m_descriptors.allocate(m_descriptorSetLayout, &m_descSetLayoutBind, variableCount);
 }
 
 //-------------------------------------------------------------------------
-// Creating the pipeline layout
+// Creating the pipeline layout, the pipeline compiles on a worker of the
+// pipeline builder, picked up by waitPipelines()
 //
 void ExampleVulkan::createGraphicsPipeline()
 {
@@ -270,12 +582,91 @@ void ExampleVulkan::createGraphicsPipeline()
         throw std::runtime_error("failed to create pipeline layout!");
     }
 
-    // Create the Pipeline
+    // modules shared by all the scene pipelines, vertices are pulled
+    // through their address in device address mode
+    app::ShaderModuleRegistry& shaderModules = getShaderModules();
+    m_sceneShaders[0] = shaderModules.acquire(m_deviceAddressMode ? "shaders/vert_shader_bda.vert.spv"
+                                                                  : "shaders/vert_shader.vert.spv");
+    m_sceneShaders[1] = shaderModules.acquire(m_deviceAddressMode ? "shaders/frag_shader_bda.frag.spv"
+                                                                  : "shaders/frag_shader.frag.spv");
+
+    // Create the Pipeline, the settings of the first frame
+    m_activeRaster          = getRasterSettings();
+    RasterSettings raster   = m_activeRaster;
+    m_graphicsPipelineBuild = m_pipelineBuilder.submit([this, raster](vk::PipelineCache cache) {
+        return getScenePipeline(raster, s_uberVariant, 0, cache);
+    });
+
+    // variants of the models loaded so far, others compile on first draw
+    m_variantLightType  = m_pushConstant.lightType;
+    const int lightType = m_variantLightType;
+    bool used[s_variantCount] = {};
+    for (const auto& model : m_objModel)
+        used[model.variant] = true;
+    for (uint32_t variant = 0; variant < s_variantCount; variant++) {
+        if (!used[variant])
+            continue;
+        m_variantPipelineBuilds[variant] = m_pipelineBuilder.submit(
+            [this, raster, variant, lightType](vk::PipelineCache cache) {
+                return getScenePipeline(raster, variant, lightType, cache);
+            });
+    }
+}
+
+//-------------------------------------------------------------------------
+// Pipeline of the scene for these settings, from the pipeline map. With
+// extended dynamic state the cull mode and depth test are set while
+// recording and only the polygon mode makes another pipeline. Without a
+// cache, created through the timed pipeline cache.
+// A variant fixes the light type to lightType and compiles out the
+// material branches it does not have, the map tells the variants apart
+// by their specialization data
+//
+vk::Pipeline ExampleVulkan::getScenePipeline(const RasterSettings& raster, uint32_t variant, int lightType,
+                                             vk::PipelineCache cache)
+{
+    // constant_id 0 to 2 of the fragment shaders
+    struct Specialization
+    {
+        int32_t  lightType;
+        VkBool32 hasTextures;
+        VkBool32 hasSpecular;
+    };
+    Specialization specialization = {};
+    specialization.lightType   = lightType;
+    specialization.hasTextures = (variant & eVariantTextured) ? VK_TRUE : VK_FALSE;
+    specialization.hasSpecular = (variant & eVariantSpecular) ? VK_TRUE : VK_FALSE;
+
+    const vk::SpecializationMapEntry mapEntries[] = {
+        { 0, offsetof(Specialization, lightType), sizeof(int32_t) },
+        { 1, offsetof(Specialization, hasTextures), sizeof(VkBool32) },
+        { 2, offsetof(Specialization, hasSpecular), sizeof(VkBool32) } };
+    const vk::SpecializationInfo specializationInfo(3, mapEntries, sizeof(Specialization), &specialization);
+
     app::GraphicsPipelineGeneratorCombined pipelineGenerator(m_device, m_pipelineLayout, m_offscreenRenderPass);
-    pipelineGenerator.depthStencilState.depthTestEnable =  true;
-    pipelineGenerator.addShader(app::util::readFile("shaders/vert_shader.vert.spv"), vk::ShaderStageFlagBits::eVertex);
-    pipelineGenerator.addShader(app::util::readFile("shaders/frag_shader.frag.spv"), vk::ShaderStageFlagBits::eFragment);
+    pipelineGenerator.depthStencilState.depthTestEnable =  raster.depthTest;
+    pipelineGenerator.depthStencilState.depthWriteEnable = raster.depthTest;
     pipelineGenerator.multisampleState.rasterizationSamples  = m_sampleCount;
+    pipelineGenerator.rasterizationState.cullMode    = raster.cullMode;
+    pipelineGenerator.rasterizationState.polygonMode = raster.wireframe ? vk::PolygonMode::eLine : vk::PolygonMode::eFill;
+#ifdef VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME
+    if (isExtendedDynamicStateSupported())
+        pipelineGenerator.addExtendedDynamicStates();
+#endif
+
+    const app::ShaderModuleRegistry& shaderModules = getShaderModules();
+    pipelineGenerator.addShader(shaderModules.getModule(m_sceneShaders[0]), vk::ShaderStageFlagBits::eVertex,
+                                shaderModules.getKey(m_sceneShaders[0]));
+    vk::PipelineShaderStageCreateInfo& fragStage = pipelineGenerator.addShader(
+        shaderModules.getModule(m_sceneShaders[1]), vk::ShaderStageFlagBits::eFragment,
+        shaderModules.getKey(m_sceneShaders[1]));
+    if (variant != s_uberVariant)
+        fragStage.pSpecializationInfo = &specializationInfo;
+
+    // vertices are pulled through their address, no vertex input
+    if (m_deviceAddressMode)
+        return cache ? m_pipelineMap.get(pipelineGenerator, cache) : m_pipelineMap.get(pipelineGenerator);
+
     pipelineGenerator.addBindingDescription({0, sizeof(VertexObj)});
     pipelineGenerator.addAttributeDescriptions(std::vector<vk::VertexInputAttributeDescription> {
         {0, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, pos)},
@@ -283,24 +674,89 @@ void ExampleVulkan::createGraphicsPipeline()
         { 2, 0, vk::Format::eR32G32B32Sfloat, offsetof(VertexObj, color) },
         { 3, 0, vk::Format::eR32G32Sfloat, offsetof(VertexObj, texCoord) }});
 
-    m_graphicsPipeline = pipelineGenerator.createPipeline();
+    return cache ? m_pipelineMap.get(pipelineGenerator, cache) : m_pipelineMap.get(pipelineGenerator);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void ExampleVulkan::setRasterSettings(const RasterSettings& raster)
+{
+    std::lock_guard<std::mutex> lock(m_rasterMutex);
+    m_rasterSettings = raster;
+}
 
+ExampleVulkan::RasterSettings ExampleVulkan::getRasterSettings() const
+{
+    std::lock_guard<std::mutex> lock(m_rasterMutex);
+    return m_rasterSettings;
+}
+
+//-------------------------------------------------------------------------
+// Specialized pipeline of the variant for m_activeRaster and the light
+// type, null while it compiles on the pipeline builder: the first call
+// submits it, the draws use the uber pipeline meanwhile
+//
+vk::Pipeline ExampleVulkan::getVariantPipeline(uint32_t variant)
+{
+    if (m_variantPipelines[variant])
+        return m_variantPipelines[variant];
+
+    std::future<vk::Pipeline>& build = m_variantPipelineBuilds[variant];
+    if (!build.valid()) {
+        const RasterSettings raster    = m_activeRaster;
+        const int            lightType = m_variantLightType;
+        build = m_pipelineBuilder.submit([this, raster, variant, lightType](vk::PipelineCache cache) {
+            return getScenePipeline(raster, variant, lightType, cache);
+        });
+    }
+
+    // a variant that does not build is drawn with the uber pipeline
+    if (build.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        try {
+            m_variantPipelines[variant] = build.get();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "variant " << variant << ": " << e.what() << std::endl;
+            m_variantPipelines[variant] = m_graphicsPipeline;
+        }
+    }
+    return m_variantPipelines[variant];
+}
+
+//-------------------------------------------------------------------------
+// Blocks on the pipelines still compiling, rethrows their errors
+//
+void ExampleVulkan::waitPipelines()
+{
+    if (m_graphicsPipelineBuild.valid()) {
+        m_graphicsPipeline = m_graphicsPipelineBuild.get();
 #if _DEBUG
-    m_debug.setObjectName(m_graphicsPipeline, "graphicsPipeline");
+        m_debug.setObjectName(m_graphicsPipeline, "graphicsPipeline");
 #endif
+    }
+    for (uint32_t variant = 0; variant < s_variantCount; variant++) {
+        if (m_variantPipelineBuilds[variant].valid())
+            m_variantPipelines[variant] = m_variantPipelineBuilds[variant].get();
+    }
+    if (m_postPipelineBuild.valid()) {
+        m_postPipeline = m_postPipelineBuild.get();
+#if _DEBUG
+        m_debug.setObjectName(m_postPipeline, "postPipeline");
+#endif
+    }
+
+    // the main cache gets what the workers compiled
+    m_pipelineBuilder.wait();
 }
 
 //-------------------------------------------------------------------------
 // Creating the uniform buffer holding the camera matrices
-// - Buffer is host visible
+// - Slice of the device local arena, written every frame by the upload ring
 //
 void ExampleVulkan::createUniformBuffer()
 {
-    m_cameraMat = m_allocator.createBuffer(sizeof(CameraMatrices), vk::BufferUsageFlagBits::eUniformBuffer,
-        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-#if _DEBUG
-    m_debug.setObjectName(m_cameraMat.buffer, "cameraMatBuffer");
-#endif
+    m_cameraMat = m_allocator.createSlice(nullptr, sizeof(CameraMatrices), nullptr);
 }
 
 //-------------------------------------------------------------------------
@@ -314,13 +770,12 @@ void ExampleVulkan::createSceneDescriptionBuffer()
     app::CommandPool commandGen(m_device, m_graphicsQueueIdx);
     auto commandBuffer = commandGen.createBuffer();
 
-    m_sceneDesc = m_allocator.createBuffer(commandBuffer, m_objInstance, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    commandGen.submitAndWait(commandBuffer);
-    m_allocator.finalizeAndReleaseStaging();
-
-#if _DEBUG
-    m_debug.setObjectName(m_sceneDesc.buffer, "sceneDescBuffer");
-#endif
+    // room for the instances added at runtime, written by appendModel
+    std::vector<ObjInstance> instances = m_objInstance;
+    instances.resize((std::max)(static_cast<size_t>(m_objCapacity), instances.size()));
+    m_sceneDesc = m_allocator.createSlice(commandBuffer, instances);
+    uint64_t uploadValue = commandGen.submitAndWait(commandBuffer, m_timeline);
+    m_allocator.finalizeAndReleaseStaging(m_timeline, uploadValue);
 }
 
 //-------------------------------------------------------------------------
@@ -331,58 +786,76 @@ void ExampleVulkan::updateDescriptorSet()
     std::vector<vk::WriteDescriptorSet> writes;
 
     // Camera Matrices
-    vk::DescriptorBufferInfo cameraBufferInfo = {};
-    cameraBufferInfo.buffer = m_cameraMat.buffer;
-    cameraBufferInfo.offset = 0;
-    cameraBufferInfo.range  = VK_WHOLE_SIZE;
+    vk::DescriptorBufferInfo cameraBufferInfo = m_cameraMat.getDescriptorInfo();
     writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSet, 0, &cameraBufferInfo));
     
     // Scene Description
-    vk::DescriptorBufferInfo SceneBufferInfo = {};
-    SceneBufferInfo.buffer = m_sceneDesc.buffer;
-    SceneBufferInfo.offset = 0;
-    SceneBufferInfo.range  = VK_WHOLE_SIZE;
+    vk::DescriptorBufferInfo SceneBufferInfo = m_sceneDesc.getDescriptorInfo();
     writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSet, 2, &SceneBufferInfo));
 
-    // All material buffers, 1 buffer per Obj
+    // writing the information
+    m_descriptors.update(writes);
+    writeSceneDescriptors(0, 0);
+}
+
+//-------------------------------------------------------------------------
+// Only the loaded elements are written, the rest of the arrays is
+// partially bound
+//
+void ExampleVulkan::writeSceneDescriptors(uint32_t firstObject, uint32_t firstTexture)
+{
+    std::vector<vk::WriteDescriptorSet> writes;
+
+    // All material buffers, 1 slice per Obj, most share the same arena buffer
     std::vector<vk::DescriptorBufferInfo> materialBuffersInfo;
     std::vector<vk::DescriptorBufferInfo> materialBuffersIdxInfo;
 
-    for (size_t i = 0; i < m_objModel.size(); ++i) {
-        materialBuffersInfo.push_back({ m_objModel[i].matColorBuffer.buffer, 0, VK_WHOLE_SIZE });
-        materialBuffersIdxInfo.push_back({ m_objModel[i].matIndexBuffer.buffer, 0, VK_WHOLE_SIZE });
+    for (size_t i = firstObject; i < m_objModel.size() && !m_deviceAddressMode; ++i) {
+        materialBuffersInfo.push_back(m_objModel[i].matColorBuffer.getDescriptorInfo());
+        materialBuffersIdxInfo.push_back(m_objModel[i].matIndexBuffer.getDescriptorInfo());
+    }
+    if (!materialBuffersInfo.empty()) {
+        writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSet, 1, materialBuffersInfo.data(), firstObject));
+        writes.back().descriptorCount = static_cast<uint32_t>(materialBuffersInfo.size());
+        writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSet, 4, materialBuffersIdxInfo.data(), firstObject));
+        writes.back().descriptorCount = static_cast<uint32_t>(materialBuffersIdxInfo.size());
     }
-    writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descriptorSet, 1, materialBuffersInfo.data()));
-    writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descriptorSet, 4, materialBuffersIdxInfo.data()));
 
     // All texture samplers
     std::vector<vk::DescriptorImageInfo> textureImageInfo;
-    for (size_t i = 0; i < m_textures.size(); ++i) {
-        textureImageInfo.push_back(m_textures[i].descriptor);
+    for (size_t i = firstTexture; i < m_textures.size(); ++i) {
+        textureImageInfo.push_back(m_textures[i].image ? m_textures[i].descriptor : m_placeholderTexture.descriptor);
+    }
+    if (!textureImageInfo.empty()) {
+        writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descriptorSet, 3, textureImageInfo.data(), firstTexture));
+        writes.back().descriptorCount = static_cast<uint32_t>(textureImageInfo.size());
     }
-    writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descriptorSet, 3, textureImageInfo.data()));
 
-    // writing the information
-    m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    if (!writes.empty())
+        m_descriptors.update(writes);
 }
 
 //-------------------------------------------------------------------------
-// Called at each frame to update the camera matrix
+// Called at each frame to compute the camera matrix
 //
-void ExampleVulkan::updateUniformBuffer()
+ExampleVulkan::CameraMatrices ExampleVulkan::computeCameraMatrices(float aspectRatio) const
 {
-    const float aspectRatio = m_size.width / static_cast<float>(m_size.height);
-
     CameraMatrices ubo = {};
     ubo.view = CameraManipulator.getMatrix();
     ubo.proj = glm::perspective(glm::radians(65.0f), aspectRatio, 0.1f, 1000.0f);
     ubo.proj[1][1] *= -1;  // Inverting Y for Vulkan
     ubo.viewInverse = glm::inverse(ubo.view);
+    return ubo;
+}
 
-    void* data;
-    vmaMapMemory(m_allocator.getAllocator(), m_cameraMat.allocation, &data);
-    memcpy(data, &ubo, sizeof(ubo));
-    vmaUnmapMemory(m_allocator.getAllocator(), m_cameraMat.allocation);
+//-------------------------------------------------------------------------
+//
+//
+void ExampleVulkan::updateUniformBuffer(const CameraMatrices& ubo)
+{
+    // frames in flight keep reading their own copy until the ring's
+    // barrier, no host write races the GPU
+    m_uploadRing.cmdToBuffer(m_cameraMat.buffer, m_cameraMat.offset, sizeof(ubo), &ubo);
 }
 
 //-------------------------------------------------------------------------
@@ -408,112 +881,409 @@ void ExampleVulkan::rasterize(const vk::CommandBuffer& cmdBuffer)
     cmdBuffer.setViewport(0, { viewport });
     cmdBuffer.setScissor(0, { scissor });
 
-    // Drawing all traingles
-    cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_graphicsPipeline);
+    // variants compile on the pipeline builder on first use, the map
+    // returns them afterwards. Builds for the old settings still running
+    // are dropped, the builder finishes them into the map
+    const RasterSettings raster = getRasterSettings();
+    if (raster != m_activeRaster || m_pushConstant.lightType != m_variantLightType) {
+        if (raster != m_activeRaster)
+            m_graphicsPipeline = getScenePipeline(raster);
+        m_activeRaster     = raster;
+        m_variantLightType = m_pushConstant.lightType;
+        for (uint32_t variant = 0; variant < s_variantCount; variant++) {
+            m_variantPipelines[variant]      = nullptr;  // owned by the map
+            m_variantPipelineBuilds[variant] = std::future<vk::Pipeline>();
+        }
+    }
+
+    if (m_drawListDirty) {
+        buildDrawBuckets();
+        m_drawListDirty = false;
+    }
+
+#ifdef VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME
+    if (isExtendedDynamicStateSupported()) {
+        cmdBuffer.setCullModeEXT(raster.cullMode);
+        cmdBuffer.setFrontFaceEXT(vk::FrontFace::eCounterClockwise);
+        cmdBuffer.setDepthTestEnableEXT(raster.depthTest);
+        cmdBuffer.setDepthWriteEnableEXT(raster.depthTest);
+        cmdBuffer.setDepthCompareOpEXT(vk::CompareOp::eLessOrEqual);
+        cmdBuffer.setPrimitiveTopologyEXT(vk::PrimitiveTopology::eTriangleList);
+    }
+#endif
+
+    // the same layout for every variant, the set stays bound
     cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pipelineLayout, 0, { m_descriptorSet }, {});
 
-    for (int i = 0; i < m_objInstance.size(); ++i) {
-        auto& instance = m_objInstance[i];
-        auto& model = m_objModel[instance.objIndex];
-        m_pushConstant.instanceId = i; // which instance to draw
+    // timed under the shader path in use, the two are compared in the UI
+    const bool     specialized = m_specializedShaders;
+    const uint32_t sceneTimer  = m_gpuTimer.cmdBegin(cmdBuffer, specialized ? "Scene (specialized)" : "Scene (uber)");
+
+    app::MemoryBudget& budget = m_allocator.getMemoryBudget();
+    vk::Pipeline       boundPipeline;
+
+    // Drawing all traingles, one pipeline bind per bucket
+    for (uint32_t variant = 0; variant < s_variantCount; variant++) {
+        if (m_drawBuckets[variant].empty())
+            continue;
+
+        // uber pipeline until the variant is compiled
+        vk::Pipeline pipeline = m_graphicsPipeline;
+        if (specialized) {
+            if (vk::Pipeline variantPipeline = getVariantPipeline(variant))
+                pipeline = variantPipeline;
+        }
+        if (pipeline != boundPipeline) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+            boundPipeline = pipeline;
+        }
 
-        cmdBuffer.pushConstants<ObjPushConstant>(m_pipelineLayout,
-                                                 vk::ShaderStageFlagBits::eVertex
-                                                 | vk::ShaderStageFlagBits::eFragment,
-                                                 0, m_pushConstant);
+        for (uint32_t i : m_drawBuckets[variant]) {
+            auto& instance = m_objInstance[i];
+            auto& model = m_objModel[instance.objIndex];
+            m_pushConstant.instanceId = i; // which instance to draw
 
-        cmdBuffer.bindVertexBuffers(0, 1, &vk::Buffer(model.vertexBuffer.buffer), &offset);
-        cmdBuffer.bindIndexBuffer(model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(model.nIndices, 1, 0, 0, 0);
+            budget.touch(model.residencyID);
+            for (uint32_t t = model.txtOffset; t < model.txtOffset + model.txtCount; ++t)
+                budget.touch(m_textureResidency[t]);
+
+            cmdBuffer.pushConstants<ObjPushConstant>(m_pipelineLayout,
+                                                     vk::ShaderStageFlagBits::eVertex
+                                                     | vk::ShaderStageFlagBits::eFragment,
+                                                     0, m_pushConstant);
+
+            if (!m_deviceAddressMode)
+                cmdBuffer.bindVertexBuffers(0, 1, &vk::Buffer(model.vertexBuffer.buffer), &offset);
+            cmdBuffer.bindIndexBuffer(model.indexBuffer.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexed(model.nIndices, 1, 0, 0, 0);
+        }
     }
+
+    m_gpuTimer.cmdEnd(cmdBuffer, sceneTimer);
 }
 
-///////////////////////////////////////////////////////////////////////////
-// Post-processing                                                       //
-///////////////////////////////////////////////////////////////////////////
+//-------------------------------------------------------------------------
+// Evicted models are left out
+//
+void ExampleVulkan::buildDrawBuckets()
+{
+    for (auto& bucket : m_drawBuckets)
+        bucket.clear();
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_objInstance.size()); ++i) {
+        const ObjModel& model = m_objModel[m_objInstance[i].objIndex];
+        if (model.nIndices)
+            m_drawBuckets[model.variant].push_back(i);
+    }
+}
 
 //-------------------------------------------------------------------------
-// Creating an offscreen frame buffer and the associated render pass
+// Called at each frame, before recording
 //
-void ExampleVulkan::createOffscreenRender()
+void ExampleVulkan::updateResidency()
 {
-    m_allocator.destroy(m_offscreenColor);
-    m_allocator.destroy(m_offscreenDepth);
-    m_allocator.destroy(m_offscreenResolve);
+    // evictions leave holes in the heaps. Otherwise, with room under the
+    // low watermark, the first evicted model is reloaded. Waited for like
+    // a load, the draw list has it from this frame on
+    app::MemoryBudget& budget = m_allocator.getMemoryBudget();
+    if (budget.update()) {
+        m_defragmenter.requestRun();
+    }
+    else {
+        for (uint32_t i = 0; i < static_cast<uint32_t>(m_objModel.size()); i++) {
+            const ObjModel& model = m_objModel[i];
+            if (model.nIndices || model.filename.empty())
+                continue;
+            if (budget.canPageIn(model.geometrySize))
+                pageInModel(i);
+            break;
+        }
+    }
 
-    // creating the color image
+    // idles the GPU when buffers were moved
+    m_defragmenter.step();
+
+    // models dropped since the last frame, first: making room for them
+    // can evict textures this frame's set would still point to
+    std::vector<std::string> requested;
     {
-        vk::ImageCreateInfo colorCreateInfo = app::image::create2DInfo(m_size, m_offscreenColorFormat,
-            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
-            false, m_sampleCount);
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        requested.swap(m_requestedModels);
+    }
+    for (const auto& filename : requested)
+        appendModel(filename);
+
+    // the descriptor set is bound by the frames in flight, rare enough to
+    // wait for them rather than keeping a set per frame. Evicted textures
+    // are unreferenced once it is rewritten, and the GPU is idle
+    if (m_descriptorSetDirty) {
+        m_timeline.waitIdle();
+        updateDescriptorSet();
+        m_descriptorSetDirty = false;
+
+        for (auto& texture : m_evictedTextures)
+            m_allocator.destroy(texture);
+        m_evictedTextures.clear();
+    }
+}
 
-        app::ImageVma image = {};
+//-------------------------------------------------------------------------
+// Pipelines of the shader keys leave the map, variants of the old code
+// or settings included, and are destroyed after the frames in flight
+//
+void ExampleVulkan::retirePipelines(const std::vector<uint64_t>& shaderKeys)
+{
+    std::vector<vk::Pipeline> pipelines = getPipelineMap().remove(shaderKeys);
+    if (pipelines.empty())
+        return;
+
+    m_timeline.retire([this, pipelines]() {
+        for (vk::Pipeline pipeline : pipelines)
+            m_device.destroyPipeline(pipeline);
+    });
+}
 
-        try {
-            image = m_allocator.createImage(colorCreateInfo);
+//-------------------------------------------------------------------------
+// Pipelines are rebuilt from the staged modules before anything is
+// replaced: a shader that does not link keeps the old modules and
+// pipelines and is reported. Once the new ones are in, the pipelines of
+// the replaced code leave the map. They and the replaced modules are
+// destroyed once the frames recorded so far are done
+//
+void ExampleVulkan::updateShaders()
+{
+    if (!m_shaderHotReload)
+        return;
+
+    // a few stat calls, not every frame
+    const auto now = std::chrono::steady_clock::now();
+    if (now - m_lastShaderCheck < std::chrono::milliseconds(500))
+        return;
+    m_lastShaderCheck = now;
+
+    app::ShaderModuleRegistry& shaderModules = getShaderModules();
+    const uint32_t             failures      = shaderModules.getStats().failures;
+    const std::vector<uint32_t> changed      = shaderModules.stageChanged();
+    if (shaderModules.getStats().failures != failures)
+        std::cerr << "shader reload: " << shaderModules.getStats().lastError << std::endl;
+    if (changed.empty())
+        return;
+
+    // builder jobs read the modules, none may run while they change. Their
+    // results are of the old code or of the staged one, dropped either way
+    m_pipelineBuilder.wait();
+    for (auto& build : m_variantPipelineBuilds)
+        build = std::future<vk::Pipeline>();
+
+    auto uses = [&changed](const uint32_t (&moduleIDs)[2]) {
+        return std::find_first_of(changed.begin(), changed.end(), std::begin(moduleIDs), std::end(moduleIDs))
+               != changed.end();
+    };
+
+    // the new code has another key in the map, new pipelines are made
+    vk::Pipeline graphicsPipeline = m_graphicsPipeline;
+    vk::Pipeline variants[s_variantCount] = {};
+    vk::Pipeline postPipeline = m_postPipeline;
+    try {
+        if (uses(m_sceneShaders)) {
+            for (uint32_t variant = 0; variant < s_variantCount; variant++) {
+                if (!m_drawBuckets[variant].empty())
+                    variants[variant] = getScenePipeline(m_activeRaster, variant, m_variantLightType);
+            }
+            graphicsPipeline = getScenePipeline(m_activeRaster);
         }
-        catch (vk::SystemError err) {
-            throw std::runtime_error("failed to create image!");
+        if (uses(m_postShaders))
+            postPipeline = getPostPipeline();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "shader reload: " << e.what() << std::endl;
+
+        // pipelines of the staged code built before the failure
+        std::vector<uint64_t> stagedKeys;
+        for (uint32_t moduleID : changed) {
+            stagedKeys.push_back(shaderModules.getKey(moduleID));
+            shaderModules.discardStaged(moduleID, e.what());
         }
-        
-        vk::ImageViewCreateInfo imageViewCreateInfo = app::image::makeImageViewCreateInfo(image.image, colorCreateInfo);
-        m_offscreenColor = m_allocator.createTexture(image, imageViewCreateInfo, vk::SamplerCreateInfo());
-        m_offscreenColor.descriptor.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        retirePipelines(stagedKeys);
+        return;
     }
 
-    // creating the depth buffer
-    {
-        vk::ImageCreateInfo depthCreateInfo = 
-            app::image::create2DInfo(m_size, m_offscreenDepthFormat,
-                                     vk::ImageUsageFlagBits::eDepthStencilAttachment, 
-                                    false, m_sampleCount);
+    std::vector<uint64_t> replacedKeys;
+    for (uint32_t moduleID : changed) {
+        uint64_t         replacedKey = 0;
+        vk::ShaderModule replaced    = shaderModules.commitStaged(moduleID, replacedKey);
+        m_timeline.retire([this, replaced]() { m_device.destroyShaderModule(replaced); });
+        replacedKeys.push_back(replacedKey);
+    }
+    retirePipelines(replacedKeys);
 
-        app::ImageVma image = {};
+    if (uses(m_sceneShaders)) {
+        m_graphicsPipeline = graphicsPipeline;
+        std::copy(std::begin(variants), std::end(variants), std::begin(m_variantPipelines));
+    }
+    m_postPipeline = postPipeline;
+}
 
-        try {
-            image = m_allocator.createImage(depthCreateInfo);
-        }
-        catch (vk::SystemError err) {
-            throw std::runtime_error("failed to create image!");
-        }
+//-------------------------------------------------------------------------
+//
+//
+void ExampleVulkan::requestModel(const std::string& filename)
+{
+    std::lock_guard<std::mutex> lock(m_requestMutex);
+    m_requestedModels.push_back(filename);
+}
 
-        vk::ImageViewCreateInfo depthStencilView = {};
-        depthStencilView.viewType         = vk::ImageViewType::e2D;
-        depthStencilView.format           = m_offscreenDepthFormat;
-        depthStencilView.subresourceRange = { vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 };
-        depthStencilView.image            = image.image;
+//-------------------------------------------------------------------------
+// Runs on the thread recording the frames, before this frame's commands.
+// The frames in flight keep rendering: the new descriptor elements and
+// the instance are not read by them, the pipeline is left as it is
+//
+void ExampleVulkan::appendModel(const std::string& filename, glm::mat4 transform)
+{
+    if (!m_runtimeDescriptors) {
+        std::cerr << "cannot add " << filename << ", descriptor indexing (update after bind) not supported" << std::endl;
+        return;
+    }
 
-        try {
-            m_offscreenDepth = m_allocator.createTexture(image, depthStencilView);
-        }
-        catch (vk::SystemError err) {
-            throw std::runtime_error("failed to create image!");
-        }
-        m_offscreenDepth.descriptor.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    const uint32_t firstObject  = static_cast<uint32_t>(m_objModel.size());
+    const uint32_t firstTexture = static_cast<uint32_t>(m_textures.size());
+    try {
+        loadModel(filename, transform);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "cannot add " << filename << ": " << e.what() << std::endl;
+        return;
     }
-    // creating the resolve buffer
-    {
-        vk::ImageCreateInfo colorResolveInfo = app::image::create2DInfo(m_size, m_offscreenResolveFormat,
-            vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage);
 
-        app::ImageVma image = {};
+    uploadInstance(firstObject);
+    writeSceneDescriptors(firstObject, firstTexture);
+}
+
+//-------------------------------------------------------------------------
+// The texture is sampled as the placeholder once the descriptor set is
+// rewritten, updateResidency frees it then. Retiring it on the timeline
+// is not enough, the set still points to it until that rewrite
+//
+void ExampleVulkan::evictTexture(uint32_t textureID)
+{
+    m_evictedTextures.push_back(m_textures[textureID]);
+
+    m_textures[textureID]         = app::TextureVma();
+    m_textureResidency[textureID] = app::MemoryBudget::INVALID_ID;
+    m_descriptorSetDirty          = true;
+}
 
+//-------------------------------------------------------------------------
+// Frees vertices and indices, the model is not drawn anymore. Materials
+// are small and stay, they are bound in the descriptor set
+//
+void ExampleVulkan::evictModel(uint32_t objIndex)
+{
+    ObjModel& model = m_objModel[objIndex];
+    m_defragmenter.remove(model.defragIDs[0]);
+    m_defragmenter.remove(model.defragIDs[1]);
+    model.defragIDs[0] = app::Defragmenter::INVALID_ID;
+    model.defragIDs[1] = app::Defragmenter::INVALID_ID;
+
+    app::BufferVma vertexBuffer = model.vertexBuffer;
+    app::BufferVma indexBuffer  = model.indexBuffer;
+    m_timeline.retire([this, vertexBuffer, indexBuffer]() mutable {
+        m_allocator.destroy(vertexBuffer);
+        m_allocator.destroy(indexBuffer);
+    });
+
+    model.vertexBuffer = app::BufferVma();
+    model.indexBuffer  = app::BufferVma();
+    model.nIndices     = 0;
+    model.residencyID  = app::MemoryBudget::INVALID_ID;
+    m_drawListDirty    = true;
+}
+
+//-------------------------------------------------------------------------
+// Reads the geometry back from the model's file, materials and textures
+// did not leave. A file that cannot be read anymore is not retried
+//
+bool ExampleVulkan::pageInModel(uint32_t objIndex)
+{
+    ObjModel& model = m_objModel[objIndex];
+    ObjLoader loader;
+    if (!loader.parse(model.filename)) {
+        std::cerr << "cannot page in " << model.filename << ", model stays evicted" << std::endl;
+        model.filename.clear();
+        return false;
+    }
+
+    app::CommandPool  cmdBufferGet(m_device, m_graphicsQueueIdx);
+    vk::CommandBuffer commandBuffer = cmdBufferGet.createBuffer();
+    createGeometry(commandBuffer, loader, model);
+    loader.release();
+    uint64_t uploadValue = cmdBufferGet.submitAndWait(commandBuffer, m_timeline);
+    m_allocator.finalizeAndReleaseStaging(m_timeline, uploadValue);
+
+    registerGeometry(objIndex, model);
+    uploadInstance(objIndex);  // new addresses in device address mode
+    m_drawListDirty = true;
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// Same create info as Allocator::createBuffer, recreated when moved
+//
+uint32_t ExampleVulkan::addMovableBuffer(const app::BufferVma& buffer, vk::DeviceSize size, vk::BufferUsageFlags usage,
+                                         std::function<void(vk::Buffer)> onMoved)
+{
+    vk::BufferCreateInfo createInfo = {};
+    createInfo.size  = size;
+    createInfo.usage = usage | vk::BufferUsageFlagBits::eTransferDst;
+    return m_defragmenter.add(buffer.allocation, buffer.buffer, createInfo, std::move(onMoved));
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Post-processing                                                       //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Creating an offscreen frame buffer and the associated render pass
+//
+void ExampleVulkan::createOffscreenRender()
+{
+    // frames in flight may still render to / sample the previous targets,
+    // the pool hands their memory out again once they are done
+    if (m_offscreenFramebuffer) {
+        vk::Framebuffer framebuffer = m_offscreenFramebuffer;
+        m_timeline.retire([this, framebuffer]() { m_device.destroy(framebuffer); });
+        m_offscreenFramebuffer = nullptr;
+    }
+    app::RenderTargetPool& pool = getRenderTargetPool();
+    pool.release(m_offscreenColor);
+    pool.release(m_offscreenDepth);
+    pool.release(m_offscreenResolve);
+
+    // creating the color, depth and resolve images. Multisampled color and
+    // depth only live within the render pass: transient, in lazily allocated
+    // memory where the device has it (tilers), device local otherwise
+    m_offscreenColor   = pool.acquire(m_size, m_offscreenColorFormat, m_sampleCount,
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransientAttachment,
+        vk::MemoryPropertyFlagBits::eLazilyAllocated);
+    m_offscreenDepth   = pool.acquire(m_size, m_offscreenDepthFormat, m_sampleCount,
+        vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransientAttachment,
+        vk::MemoryPropertyFlagBits::eLazilyAllocated);
+    m_offscreenResolve = pool.acquire(m_size, m_offscreenResolveFormat, vk::SampleCountFlagBits::e1,
+        vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage);
+
+    // sampling the resolve image in post, independent of the size
+    if (!m_offscreenSampler) {
         try {
-            image = m_allocator.createImage(colorResolveInfo);
+            m_offscreenSampler = m_device.createSampler(vk::SamplerCreateInfo());
         }
         catch (vk::SystemError err) {
-            throw std::runtime_error("failed to create image!");
+            throw std::runtime_error("failed to create offscreen sampler!");
         }
-
-        vk::ImageViewCreateInfo imageViewCreateInfo = app::image::makeImageViewCreateInfo(image.image, colorResolveInfo);
-        m_offscreenResolve = m_allocator.createTexture(image, imageViewCreateInfo, vk::SamplerCreateInfo());
-        m_offscreenResolve.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
     }
 
     // setting the image layout for color, depth and resolve
     {
-        app::CommandPool commandBufferGen(m_device, m_graphicsQueueIdx);
-        vk::CommandBuffer commandBuffer = commandBufferGen.createBuffer();
+        vk::CommandBuffer commandBuffer = createTempCmdBuffer();
 
         app::image::cmdBarrierImageLayout(
             commandBuffer, m_offscreenColor.image,
@@ -528,7 +1298,8 @@ void ExampleVulkan::createOffscreenRender()
             commandBuffer, m_offscreenResolve.image, vk::ImageLayout::eUndefined,
             vk::ImageLayout::ePresentSrcKHR);
        
-        commandBufferGen.submitAndWait(commandBuffer);
+        // no wait, the next frame is submitted behind these barriers
+        submitTempCmdBuffer(commandBuffer);
     }
 
     // creating a render pass for the offscreen
@@ -536,7 +1307,7 @@ void ExampleVulkan::createOffscreenRender()
         m_offscreenRenderPass = app::util::createRenderPass(
             m_device, { m_offscreenColorFormat }, m_offscreenDepthFormat, 
             m_offscreenResolveFormat, m_sampleCount, 1, true, true, 
-            vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+            vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral, true);
 #if _DEBUG
         m_debug.setObjectName(m_offscreenRenderPass, "offscreenRenderPass");
 #endif
@@ -544,11 +1315,9 @@ void ExampleVulkan::createOffscreenRender()
 
     // creating the frambuffer for offscreen
     {
-        std::vector<vk::ImageView> attachments = { m_offscreenColor.descriptor.imageView,
-                                                   m_offscreenDepth.descriptor.imageView,
-                                                   m_offscreenResolve.descriptor.imageView };
-
-        m_device.destroy(m_offscreenFramebuffer);
+        std::vector<vk::ImageView> attachments = { m_offscreenColor.view,
+                                                   m_offscreenDepth.view,
+                                                   m_offscreenResolve.view };
 
         vk::FramebufferCreateInfo framebufferInfo = {};
         framebufferInfo.renderPass      = m_offscreenRenderPass;
@@ -580,9 +1349,11 @@ void ExampleVulkan::createPostDescriptor()
     postBinding.stageFlags      = vk::ShaderStageFlagBits::eFragment;
     m_postDescSetLayoutBind.addBinding(postBinding);
     
-    m_postDescriptorSetLayout = m_postDescSetLayoutBind.createLayout(m_device);
-    m_postDescriptorPool      = m_postDescSetLayoutBind.createPool(m_device);
-    m_postDescriptorSet       = app::util::allocateDescriptorSet(m_device, m_postDescriptorPool, m_postDescriptorSetLayout);
+    m_postDescriptorSetLayout = m_descriptors.getLayout(m_postDescSetLayoutBind);
+
+    // each frame writes m_postImageInfo to a set of its own
+    m_postUpdateTemplate = m_descriptors.createUpdateTemplate(m_postDescriptorSetLayout,
+        { m_postDescSetLayoutBind.makeTemplateEntry(0, 0, sizeof(vk::DescriptorImageInfo)) });
 }
 
 //-------------------------------------------------------------------------
@@ -607,17 +1378,30 @@ void ExampleVulkan::createPostPipeline()
         throw std::runtime_error("failed to create pipeline layout!");
     }
 
-    // Create the Pipeline
+    m_postShaders[0] = getShaderModules().acquire("shaders/passthrough.vert.spv");
+    m_postShaders[1] = getShaderModules().acquire("shaders/post.frag.spv");
+
+    // Create the Pipeline, on a worker
+    m_postPipelineBuild = m_pipelineBuilder.submit([this](vk::PipelineCache cache) {
+        return getPostPipeline(cache);
+    });
+}
+
+//-------------------------------------------------------------------------
+// From the pipeline map, without a cache through the timed pipeline cache
+//
+vk::Pipeline ExampleVulkan::getPostPipeline(vk::PipelineCache cache)
+{
     app::GraphicsPipelineGeneratorCombined  pipelineGenerator(m_device, m_postPipelineLayout, m_renderPass);
 
-    pipelineGenerator.addShader(app::util::readFile("shaders/passthrough.vert.spv"), vk::ShaderStageFlagBits::eVertex);
-    pipelineGenerator.addShader(app::util::readFile("shaders/post.frag.spv"), vk::ShaderStageFlagBits::eFragment);
+    const app::ShaderModuleRegistry& shaderModules = getShaderModules();
+    pipelineGenerator.addShader(shaderModules.getModule(m_postShaders[0]), vk::ShaderStageFlagBits::eVertex,
+                                shaderModules.getKey(m_postShaders[0]));
+    pipelineGenerator.addShader(shaderModules.getModule(m_postShaders[1]), vk::ShaderStageFlagBits::eFragment,
+                                shaderModules.getKey(m_postShaders[1]));
     pipelineGenerator.multisampleState.setRasterizationSamples(vk::SampleCountFlagBits::e1);
     pipelineGenerator.rasterizationState.setCullMode(vk::CullModeFlagBits::eNone);
-    m_postPipeline = pipelineGenerator.createPipeline();
-#if _DEBUG
-    m_debug.setObjectName(m_postPipeline, "postPipeline");
-#endif
+    return cache ? m_pipelineMap.get(pipelineGenerator, cache) : m_pipelineMap.get(pipelineGenerator);
 }
 
 //-------------------------------------------------------------------------
@@ -625,9 +1409,8 @@ void ExampleVulkan::createPostPipeline()
 //
 void ExampleVulkan::updatePostDescriptorSet()
 {
-    vk::WriteDescriptorSet writeDescSet =
-        m_postDescSetLayoutBind.makeWrite(m_postDescriptorSet, 0, reinterpret_cast<vk::DescriptorImageInfo*>(&m_offscreenResolve.descriptor));
-    m_device.updateDescriptorSets(writeDescSet, nullptr);
+    // frames in flight keep their own set, the next frame picks this up
+    m_postImageInfo = vk::DescriptorImageInfo(m_offscreenSampler, m_offscreenResolve.view, vk::ImageLayout::eGeneral);
 }
 
 //-------------------------------------------------------------------------
@@ -657,7 +1440,11 @@ void ExampleVulkan::drawPost(vk::CommandBuffer cmdBuffer)
 
     cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_postPipeline);
 
+    // recycled with the frame pools once this frame completed
+    vk::DescriptorSet postDescriptorSet = m_descriptors.allocateFrame(m_postDescriptorSetLayout, &m_postDescSetLayoutBind);
+    m_descriptors.update(postDescriptorSet, m_postUpdateTemplate, &m_postImageInfo);
+
     cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_postPipelineLayout, 
-                                 0, m_postDescriptorSet, {});
+                                 0, postDescriptorSet, {});
     cmdBuffer.draw(3, 1, 0, 0);
 }
\ No newline at end of file
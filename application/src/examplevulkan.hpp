@@ -8,6 +8,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
 #include <sstream>
 #include "vulkan/vulkan.hpp"
 
@@ -28,6 +32,11 @@
 #include "../vk_helpers/debug.hpp"
 #include "../vk_helpers/descriptorsets.hpp"
 #include "../vk_helpers/allocator.hpp"
+#include "../vk_helpers/uploadring.hpp"
+#include "../vk_helpers/uploadcontext.hpp"
+#include "../vk_helpers/defragmenter.hpp"
+#include "../vk_helpers/gputimer.hpp"
+#include "../vk_helpers/mipgenerator.hpp"
 
  ///////////////////////////////////////////////////////////////////////////
  // Example Vulkan                                                        //
@@ -51,23 +60,123 @@ public:
 
     void loadModel(const std::string& filename, glm::mat4 transform = glm::mat4(1));
 
+    // Queues a model to add to the running scene, from any thread. Loaded
+    // by appendModel in updateResidency
+    void requestModel(const std::string& filename);
+
+    // Loads a model once the scene is set up, writes only its descriptor
+    // elements. Needs the runtime descriptor layout
+    void appendModel(const std::string& filename, glm::mat4 transform = glm::mat4(1));
+
+    // In place: the loader writes geometry straight into staging (or the
+    // buffers with direct uploads), otherwise through vectors first
+    void setLoadInPlace(bool inPlace) { m_loadInPlace = inPlace; }
+
+    // Shaders reach the geometry and materials of each model through the
+    // device addresses in the scene description instead of per object
+    // descriptor arrays. Set before loading, false when not supported
+    bool setDeviceAddressMode(bool enable);
+
     void createTextureImages(const vk::CommandBuffer& cmdBuffer,
                              const std::vector<std::string>& textures);
 
+    // Decodes and uploads one texture, called from the loading threads
+    app::TextureVma loadTexture(app::UploadContext& upload, const std::string& filename,
+                                const vk::SamplerCreateInfo& samplerCreateInfo, vk::Format format);
+
     void createDescriptorSetLayout();
 
+    // pipelines compile on the builder's workers, startup keeps loading
     void createGraphicsPipeline();
 
+    // pipelines submitted by createGraphicsPipeline / createPostPipeline
+    // are ready past this point
+    void waitPipelines();
+
+    //-------------------------------------------------------------------------
+    // Material paths used by a model, pick the specialized fragment shader
+    // of its draws. Without a bit the branch is compiled out
+    //
+    enum VariantBits : uint32_t
+    {
+        eVariantTextured = 1,  // a material samples a texture
+        eVariantSpecular = 2,  // a material is not Lambert (illum >= 2)
+    };
+    static const uint32_t s_variantCount = 4;
+    static const uint32_t s_uberVariant  = ~0u;  // no specialization
+
+    // Off: every draw uses the uber shader, for comparing GPU times
+    void setSpecializedShaders(bool enable) { m_specializedShaders = enable; }
+    bool isSpecializedShaders() const { return m_specializedShaders; }
+
+    // Once per frame, before recording. Polls the SPIR-V files when hot
+    // reload is on and rebuilds the pipelines of the changed ones only
+    void updateShaders();
+    void retirePipelines(const std::vector<uint64_t>& shaderKeys);
+
+    void setShaderHotReload(bool enable) { m_shaderHotReload = enable; }
+    bool isShaderHotReload() const { return m_shaderHotReload; }
+
+    // Off: mip chains of loaded textures are blitted level by level
+    void setComputeMips(bool enable) { m_computeMips = enable; }
+    bool isComputeMips() const { return m_computeMips; }
+
+    app::MipGenerator& getMipGenerator() { return m_mipGenerator; }
+
+    //-------------------------------------------------------------------------
+    // Raster variants of the scene, set from the UI, picked up when
+    // recording the next frame
+    //
+    struct RasterSettings
+    {
+        bool                 wireframe{ false };
+        vk::CullModeFlagBits cullMode{ vk::CullModeFlagBits::eBack };
+        bool                 depthTest{ true };
+
+        bool operator==(const RasterSettings& other) const
+        {
+            return wireframe == other.wireframe && cullMode == other.cullMode && depthTest == other.depthTest;
+        }
+        bool operator!=(const RasterSettings& other) const { return !(*this == other); }
+    };
+
+    void           setRasterSettings(const RasterSettings& raster);
+    RasterSettings getRasterSettings() const;
+
+    vk::Pipeline getScenePipeline(const RasterSettings& raster, uint32_t variant = s_uberVariant, int lightType = 0,
+                                  vk::PipelineCache cache = nullptr);
+    vk::Pipeline getVariantPipeline(uint32_t variant);
+
     void createUniformBuffer();
 
     void createSceneDescriptionBuffer();
 
     void updateDescriptorSet();
 
-    void updateUniformBuffer();
+    // Materials from firstObject and textures from firstTexture on
+    void writeSceneDescriptors(uint32_t firstObject, uint32_t firstTexture);
 
     void rasterize(const vk::CommandBuffer& cmdBuffer);
 
+    // Instances grouped by the variant of their model, after loads and
+    // evictions
+    void buildDrawBuckets();
+
+    // Once per frame, refreshes the heap budgets and evicts textures then
+    // geometry, least recently drawn first, when over budget. Evictions
+    // start a defragmentation run, stepped here as well. Under the low
+    // watermark, evicted geometry is paged back in, a model per frame
+    void updateResidency();
+
+    void evictTexture(uint32_t textureID);
+
+    void evictModel(uint32_t objIndex);
+    bool pageInModel(uint32_t objIndex);
+
+    // Registers a buffer made by m_allocator.createBuffer for defragmentation
+    uint32_t addMovableBuffer(const app::BufferVma& buffer, vk::DeviceSize size, vk::BufferUsageFlags usage,
+                              std::function<void(vk::Buffer)> onMoved);
+
     // Holding the camera matrices
     struct CameraMatrices
     {
@@ -76,6 +185,13 @@ public:
         glm::mat4 viewInverse;
     };
 
+    // Split for threaded rendering, matrices are computed on the main
+    // thread and uploaded on the render thread
+    CameraMatrices computeCameraMatrices(float aspectRatio) const;
+
+    // Streamed through the upload ring, copied by m_uploadRing.cmdFlush
+    void updateUniformBuffer(const CameraMatrices& ubo);
+
     // OBJ representation of a vertex
     struct Vertex
     {
@@ -89,12 +205,19 @@ public:
     // The OBJ model
     struct ObjModel
     {
-        uint32_t       nIndices{ 0 };
+        uint32_t       nIndices{ 0 };   // 0 once evicted
         uint32_t       nVertices{ 0 };
+        vk::DeviceSize geometrySize{ 0 };  // vertex and index bytes
+        std::string    filename;        // geometry reloaded from it after an eviction
+        uint32_t       txtOffset{ 0 };  // textures loaded with the model
+        uint32_t       txtCount{ 0 };
+        uint32_t       variant{ eVariantTextured | eVariantSpecular };  // VariantBits of the materials
+        uint32_t       residencyID{ app::MemoryBudget::INVALID_ID };
+        uint32_t       defragIDs[2]{ app::Defragmenter::INVALID_ID, app::Defragmenter::INVALID_ID };  // vertex, index
         app::BufferVma vertexBuffer;   // Device buffer of all vertex
         app::BufferVma indexBuffer;    // Device buffer of all indices forming triangles
-        app::BufferVma matColorBuffer; // Device buffer of array of wavefront material
-        app::BufferVma matIndexBuffer; // Device buffer of array of Wavefront material
+        app::BufferSlice matColorBuffer; // Arena slice of array of wavefront material
+        app::BufferSlice matIndexBuffer; // Arena slice of array of Wavefront material
     };
 
     // Instance of the OBJ
@@ -104,6 +227,12 @@ public:
         uint32_t  txtOffset{ 0 };   // Offset in 'm_textures'
         glm::mat4 transform{ 1 };   // Position of the instance
         glm::mat4 transformIT{ 1 }; // Inverse Transpose
+
+        // Device address mode, the model's data read through buffer_reference
+        uint64_t  vertexAddress{ 0 };
+        uint64_t  indexAddress{ 0 };
+        uint64_t  materialAddress{ 0 };
+        uint64_t  matIndexAddress{ 0 };
     };
 
     // Information pushed at each draw call
@@ -116,6 +245,15 @@ public:
     };
     ObjPushConstant m_pushConstant;
 
+    void fillInstanceAddresses(ObjInstance& instance, const ObjModel& model) const;
+
+    // Copies the instance to the scene description with this frame's uploads
+    void uploadInstance(uint32_t objIndex);
+
+    // Vertex and index buffers of a parsed file, at load and page-in
+    void createGeometry(const vk::CommandBuffer& cmdBuffer, ObjLoader& loader, ObjModel& model);
+    void registerGeometry(uint32_t objIndex, ObjModel& model);
+
     // Array of objects and instances in the scene
     std::vector<ObjModel>        m_objModel;
     std::vector<ObjInstance>     m_objInstance;
@@ -123,16 +261,58 @@ public:
     // Graphic pipeline
     vk::PipelineLayout           m_pipelineLayout;
     vk::Pipeline                 m_graphicsPipeline;
+    std::future<vk::Pipeline>    m_graphicsPipelineBuild;  // until waitPipelines()
+    RasterSettings               m_activeRaster;           // of m_graphicsPipeline, render thread
+    RasterSettings               m_rasterSettings;         // requested
+    mutable std::mutex           m_rasterMutex;
+
+    // Specialized pipelines, render thread. Built for m_activeRaster and
+    // the light type, dropped when either changes
+    vk::Pipeline                 m_variantPipelines[s_variantCount]{};
+    std::future<vk::Pipeline>    m_variantPipelineBuilds[s_variantCount];  // compiling, picked up when ready
+    int                          m_variantLightType{ 0 };
+    std::vector<uint32_t>        m_drawBuckets[s_variantCount];            // instance indices
+    bool                         m_drawListDirty{ true };
+    std::atomic<bool>            m_specializedShaders{ true };
+
+    // vertex, fragment, from the backend's shader module registry
+    uint32_t                     m_sceneShaders[2]{ app::ShaderModuleRegistry::INVALID_ID,
+                                                    app::ShaderModuleRegistry::INVALID_ID };
+    std::atomic<bool>            m_shaderHotReload{ true };
+    std::chrono::steady_clock::time_point m_lastShaderCheck;
+
     app::DescriptorSetBindings   m_descSetLayoutBind;
-    vk::DescriptorPool           m_descriptorPool;
-    vk::DescriptorSetLayout      m_descriptorSetLayout;
+    vk::DescriptorSetLayout      m_descriptorSetLayout;  // owned by m_descriptors
     vk::DescriptorSet            m_descriptorSet;
 
-    app::BufferVma               m_cameraMat;  // Device-Host of the camera matrices
-    app::BufferVma               m_sceneDesc;  // Device buffer of the OBJ instances
+    app::BufferSlice             m_cameraMat;  // Arena slice of the camera matrices
+    app::BufferSlice             m_sceneDesc;  // Arena slice of the OBJ instances
     std::vector<app::TextureVma> m_textures;   // vector of all textures of the scene
+    std::vector<uint32_t>        m_textureResidency;   // MemoryBudget id per texture
+    app::TextureVma              m_placeholderTexture; // bound in place of evicted textures
+    std::vector<app::TextureVma> m_evictedTextures;    // still in the descriptor set until it is rewritten
+    bool                         m_descriptorSetDirty{ false };  // textures evicted or buffers moved
+
+    // Runtime layout: partially bound, update after bind arrays sized for
+    // s_maxObjects / s_maxTextures, new elements are written while frames
+    // are in flight. Otherwise sized for the scene at creation
+    static const uint32_t        s_maxObjects  = 1024;
+    static const uint32_t        s_maxTextures = 4096;
+    bool                         m_runtimeDescriptors{ false };
+    uint32_t                     m_objCapacity{ 0 };
+    uint32_t                     m_textureCapacity{ 0 };
+    std::mutex                   m_requestMutex;
+    std::vector<std::string>     m_requestedModels;
+    bool                         m_loadInPlace{ true };
+    bool                         m_deviceAddressMode{ false };
     
     app::Allocator               m_allocator;
+    app::UploadRing              m_uploadRing; // per frame dynamic data
+    app::Defragmenter            m_defragmenter;
+    app::DescriptorSetContainer  m_descriptors;   // layouts, sets and update templates
+    app::GpuTimer                m_gpuTimer;      // named sections of the frame
+    app::MipGenerator            m_mipGenerator;  // texture mip chains in one dispatch
+    std::atomic<bool>            m_computeMips{ true };
     app::debug::DebugUtil        m_debug;
 
 ///////////////////////////////////////////////////////////////////////////
@@ -145,23 +325,29 @@ public:
 
     void createPostPipeline();
 
+    vk::Pipeline getPostPipeline(vk::PipelineCache cache = nullptr);
+
     void updatePostDescriptorSet();
 
     void drawPost(vk::CommandBuffer cmdBuffer);
 
     app::DescriptorSetBindings m_postDescSetLayoutBind;
-    vk::DescriptorPool         m_postDescriptorPool;
-    vk::DescriptorSetLayout    m_postDescriptorSetLayout;
-    vk::DescriptorSet          m_postDescriptorSet;
+    vk::DescriptorSetLayout    m_postDescriptorSetLayout;  // owned by m_descriptors
+    vk::DescriptorImageInfo    m_postImageInfo;            // written to a frame set in drawPost
+    uint32_t                   m_postUpdateTemplate{ app::DescriptorSetContainer::INVALID_ID };
 
     vk::Pipeline               m_postPipeline;
+    std::future<vk::Pipeline>  m_postPipelineBuild;
+    uint32_t                   m_postShaders[2]{ app::ShaderModuleRegistry::INVALID_ID,
+                                                 app::ShaderModuleRegistry::INVALID_ID };
     vk::PipelineLayout         m_postPipelineLayout;
     vk::RenderPass             m_offscreenRenderPass;
     vk::Framebuffer            m_offscreenFramebuffer;
 
-    app::TextureVma            m_offscreenColor;
-    app::TextureVma            m_offscreenDepth;
-    app::TextureVma            m_offscreenResolve;
+    app::RenderTarget          m_offscreenColor;       // memory from the backend render target pool
+    app::RenderTarget          m_offscreenDepth;
+    app::RenderTarget          m_offscreenResolve;
+    vk::Sampler                m_offscreenSampler;
     vk::Format                 m_offscreenColorFormat  { vk::Format::eR32G32B32A32Sfloat };
     vk::Format                 m_offscreenDepthFormat  { vk::Format::eD32Sfloat };
     vk::Format                 m_offscreenResolveFormat{ vk::Format::eR32G32B32A32Sfloat };
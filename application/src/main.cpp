@@ -15,6 +15,13 @@
 #include "../external/imgui/imgui_impl_vulkan.h"
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <random>
+#include <thread>
 #include <vulkan/vulkan.hpp>
 VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 
@@ -28,12 +35,28 @@ VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 #include "../vk_helpers/vulkanbackend.hpp"
 #include "../vk_helpers/commands.hpp"
 #include "../general_helpers/manipulator.h"
+#include "../general_helpers/framepacer.hpp"
+#include "../general_helpers/triplebuffer.hpp"
+#include "../general_helpers/processmemory.hpp"
 #include "../vk_helpers/utilities.hpp"
 #include "examplevulkan.hpp"
 
 static int  g_winWidth      = 800;
 static int  g_winHeight     = 600;
 
+// Threading model, main thread does events / ImGui / camera and the
+// render thread records and submits, pipelined by one frame
+static bool               g_renderThreaded = false;
+static bool               g_benchUpload    = false;
+static std::string        g_benchLoadFile;             // --bench-load <file.obj>
+static bool               g_benchLoadVectors = false;  // --vectors, loads without the in place path
+static bool               g_benchMips      = false;
+static bool               g_benchStaging   = false;
+static bool               g_benchRanges    = false;
+static bool               g_deviceAddress  = false;    // --bda, scene data read through buffer device addresses
+static float              g_mainCpuMs      = 0.0f;
+static std::atomic<float> g_renderCpuMs{ 0.0f };
+
 //-------------------------------------------------------------------------
 // GLFW on Error Callback
 //
@@ -42,6 +65,342 @@ static void onErrorCallback(int error, const char* description)
     std::cerr << "GLFW Error " << error << ": " << description << std::endl;
 }
 
+//-------------------------------------------------------------------------
+// Present mode, swapchain images, frame pacing and frame time report
+//
+static void renderFramePacingUI(ExampleVulkan& vkExample, tools::FramePacer& pacer)
+{
+    if (!ImGui::CollapsingHeader("Frame Pacing"))
+        return;
+
+    // present mode, only the supported ones are listed
+    std::vector<vk::PresentModeKHR> presentModes = vkExample.getSupportedPresentModes();
+    vk::PresentModeKHR              current      = vkExample.getPresentMode();
+    if (ImGui::BeginCombo("Present mode", vk::to_string(current).c_str())) {
+        for (auto mode : presentModes) {
+            if (ImGui::Selectable(vk::to_string(mode).c_str(), mode == current))
+                vkExample.setPresentMode(mode);
+        }
+        ImGui::EndCombo();
+    }
+
+    int imageCount = static_cast<int>(vkExample.getImageCount());
+    if (ImGui::SliderInt("Swapchain images", &imageCount, 2, 4))
+        vkExample.setSwapchainImageCount(static_cast<uint32_t>(imageCount));
+
+    float targetFps = static_cast<float>(pacer.getTargetFps());
+    if (ImGui::SliderFloat("Target FPS (0 = off)", &targetFps, 0.0f, 240.0f, "%.0f"))
+        pacer.setTargetFps(targetFps);
+
+    const tools::FrameTimeStats& stats = pacer.getStats();
+    ImGui::Text("Frame time %.3f ms (mean %.3f ms)", stats.getLast(), stats.getMean());
+    ImGui::Text("Variance %.4f ms^2 (std dev %.3f ms)", stats.getVariance(), stats.getStdDev());
+    ImGui::Text("Min %.3f ms / Max %.3f ms", stats.getMin(), stats.getMax());
+
+    static std::vector<float> history;
+    stats.getHistory(history);
+    ImGui::PlotLines("##frametimes", history.data(), static_cast<int>(history.size()), 0, nullptr,
+                     0.0f, static_cast<float>(stats.getMax()) * 1.2f, ImVec2(0, 60));
+    if (ImGui::Button("Reset stats"))
+        pacer.getStats().reset();
+}
+
+//-------------------------------------------------------------------------
+// Heap budgets and usage, residency and evictions
+//
+static void renderMemoryUI(ExampleVulkan& vkExample)
+{
+    if (!ImGui::CollapsingHeader("Memory"))
+        return;
+
+    const app::MemoryBudget::Stats stats = vkExample.m_allocator.getMemoryBudget().getStats();
+    ImGui::Text("Budget from %s", stats.extensionBudget ? "VK_EXT_memory_budget" : "heap sizes (estimated)");
+
+    const float toMB = 1.0f / (1024.0f * 1024.0f);
+    for (size_t h = 0; h < stats.heaps.size(); h++) {
+        const app::MemoryBudget::Heap& heap = stats.heaps[h];
+        ImGui::Text("Heap %d%s: %.1f / %.1f MB (blocks %.1f MB, allocations %.1f MB, retiring %.1f MB)", int(h),
+                    heap.deviceLocal ? " device" : " host", heap.usage * toMB, heap.budget * toMB,
+                    heap.blockBytes * toMB, heap.allocationBytes * toMB, heap.retiringBytes * toMB);
+        ImGui::ProgressBar(heap.budget ? float(double(heap.usage) / double(heap.budget)) : 0.0f);
+    }
+    ImGui::Text("Resident %u, evicted %u (%.1f MB), paged in %u", stats.residentCount, stats.evictions,
+                stats.evictedBytes * toMB, stats.pageIns);
+
+    const app::Allocator::UploadStats uploads = vkExample.m_allocator.getUploadStats();
+    ImGui::Text("Uploads direct %llu (%.1f MB), staged %llu (%.1f MB)%s",
+                (unsigned long long)uploads.directCount, uploads.directBytes * toMB,
+                (unsigned long long)uploads.stagedCount, uploads.stagedBytes * toMB,
+                vkExample.m_allocator.isDirectUploadSupported() ? "" : ", no host visible device local memory");
+
+    // live totals per category, peak and count made help spotting leaks
+    const app::MemoryStats::Counters counters = vkExample.m_allocator.getMemoryStats().getCounters();
+    ImGui::Columns(5, "categories");
+    ImGui::Text("Category"); ImGui::NextColumn();
+    ImGui::Text("MB");       ImGui::NextColumn();
+    ImGui::Text("Peak MB");  ImGui::NextColumn();
+    ImGui::Text("Live");     ImGui::NextColumn();
+    ImGui::Text("Made");     ImGui::NextColumn();
+    ImGui::Separator();
+    for (uint32_t i = 0; i < app::MemoryStats::CATEGORY_COUNT; i++) {
+        const app::MemoryStats::Counter& counter = counters[i];
+        ImGui::Text("%s", app::MemoryStats::getName(app::MemoryStats::Category(i))); ImGui::NextColumn();
+        ImGui::Text("%.2f", counter.bytes * toMB);                                   ImGui::NextColumn();
+        ImGui::Text("%.2f", counter.peakBytes * toMB);                               ImGui::NextColumn();
+        ImGui::Text("%u", counter.count);                                            ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long)counter.allocations);                ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    if (ImGui::Button("Dump JSON")) {
+        if (!vkExample.m_allocator.dumpMemoryStats("memory_stats.json"))
+            std::cerr << "failed to write memory_stats.json" << std::endl;
+    }
+
+    // compaction, before / after the last run
+    const app::Defragmenter::Stats defrag = vkExample.m_defragmenter.getStats();
+    if (ImGui::Button(defrag.running ? "Defragmenting..." : "Defragment"))
+        vkExample.m_defragmenter.requestRun();
+    ImGui::Text("Runs %u, steps %u, moved %u (%.1f MB), freed %u blocks (%.1f MB)", defrag.runs, defrag.steps,
+                defrag.allocationsMoved, defrag.bytesMoved * toMB, defrag.blocksFreed, defrag.bytesFreed * toMB);
+    if (defrag.runs) {
+        ImGui::Text("Before: %u blocks, %u free ranges, %.1f MB free, fragmentation %.2f", defrag.before.blockCount,
+                    defrag.before.unusedRangeCount, defrag.before.unusedBytes * toMB, defrag.before.ratio);
+        if (!defrag.running)
+            ImGui::Text("After:  %u blocks, %u free ranges, %.1f MB free, fragmentation %.2f", defrag.after.blockCount,
+                        defrag.after.unusedRangeCount, defrag.after.unusedBytes * toMB, defrag.after.ratio);
+    }
+}
+
+//-------------------------------------------------------------------------
+// Layouts, pools and the descriptor updates of the last frame
+//
+static void renderDescriptorUI(ExampleVulkan& vkExample)
+{
+    if (!ImGui::CollapsingHeader("Descriptors"))
+        return;
+
+    const app::DescriptorSetContainer::Stats stats = vkExample.m_descriptors.getStats();
+    ImGui::Text("Layouts %u, pools %u, sets %u, templates %u (%s)", stats.layoutCount, stats.poolCount,
+                stats.setCount, stats.templateCount, stats.templatesEnabled ? "update templates" : "plain writes");
+    ImGui::Text("Last frame: %u frame sets, %u template / %u write updates, %u descriptors, %.3f ms",
+                stats.frameSets, stats.templateUpdates, stats.writeUpdates, stats.descriptorWrites, stats.updateMs);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+static void renderPipelineUI(ExampleVulkan& vkExample)
+{
+    if (!ImGui::CollapsingHeader("Pipelines"))
+        return;
+
+    const app::PipelineCache::Stats stats = vkExample.getPipelineCache().getStats();
+    ImGui::Text("%s start: %s", stats.warm ? "Warm" : "Cold", stats.status.c_str());
+    ImGui::Text("%u pipelines created in %.2f ms", stats.pipelineCount, stats.createMs);
+
+    const app::PipelineBuilder::Stats builder = vkExample.getPipelineBuilder().getStats();
+    ImGui::Text("Builder: %u workers, %u pending, %u compiled in %.2f ms", builder.workerCount, builder.pending,
+                builder.compiled, builder.compileMs);
+    ImGui::Text("Loaded %.1f KB, saved %.1f KB", stats.loadedBytes / 1024.0, stats.savedBytes / 1024.0);
+    if (ImGui::Button("Save cache") && !vkExample.getPipelineCache().save())
+        std::cerr << "failed to write " << APP_DEFAULT_PIPELINE_CACHE_FILE << std::endl;
+
+    // scene variants, deduplicated by the pipeline map
+    ExampleVulkan::RasterSettings raster = vkExample.getRasterSettings();
+    bool changed = false;
+    if (vkExample.getPhysicalDevice().getFeatures().fillModeNonSolid)
+        changed |= ImGui::Checkbox("Wireframe", &raster.wireframe);
+    changed |= ImGui::Checkbox("Depth test", &raster.depthTest);
+    int cullMode = static_cast<int>(raster.cullMode);
+    if (ImGui::Combo("Cull mode", &cullMode, "None\0Front\0Back\0")) {
+        raster.cullMode = static_cast<vk::CullModeFlagBits>(cullMode);
+        changed = true;
+    }
+    if (changed)
+        vkExample.setRasterSettings(raster);
+
+    const app::GraphicsPipelineMap::Stats map = vkExample.getPipelineMap().getStats();
+    ImGui::Text("Map: %u pipelines, %u hits, %u misses, %u removed, extended dynamic state %s", map.pipelineCount,
+                map.hits, map.misses, map.removed, vkExample.isExtendedDynamicStateSupported() ? "on" : "off");
+
+    // material paths compiled out per draw bucket, timed in "GPU Timing"
+    bool specialized = vkExample.isSpecializedShaders();
+    if (ImGui::Checkbox("Specialized shaders", &specialized))
+        vkExample.setSpecializedShaders(specialized);
+
+    // modules shared by the pipelines, changed .spv files are picked up
+    const app::ShaderModuleRegistry::Stats shaders = vkExample.getShaderModules().getStats();
+    bool hotReload = vkExample.isShaderHotReload();
+    if (ImGui::Checkbox("Hot reload shaders", &hotReload))
+        vkExample.setShaderHotReload(hotReload);
+    ImGui::Text("Shaders: %u modules, %u references, %u loads (%.1f KB mapped), %u shared", shaders.moduleCount,
+                shaders.references, shaders.loads, shaders.mappedBytes / 1024.0, shaders.shared);
+    ImGui::Text("Reloads: %u, %u failed", shaders.reloads, shaders.failures);
+    if (!shaders.lastError.empty())
+        ImGui::TextWrapped("%s", shaders.lastError.c_str());
+
+    // mip chains of the textures loaded from now on, --bench-mips compares
+    const app::MipGenerator::Stats mips = vkExample.getMipGenerator().getStats();
+    bool computeMips = vkExample.isComputeMips();
+    if (ImGui::Checkbox("Compute mipmaps", &computeMips))
+        vkExample.setComputeMips(computeMips);
+    ImGui::Text("Mipmaps: %s, %u generated, %u blitted, %u in flight",
+                vkExample.getMipGenerator().isSupported()
+                    ? (vkExample.getMipGenerator().isSubgroupPath() ? "subgroups" : "shared memory")
+                    : "not supported",
+                mips.generated, mips.fallbacks, mips.inFlight);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+static void renderGpuTimingUI(ExampleVulkan& vkExample)
+{
+    if (!ImGui::CollapsingHeader("GPU Timing"))
+        return;
+
+    if (!vkExample.m_gpuTimer.isSupported()) {
+        ImGui::Text("No timestamps on the graphics queue");
+        return;
+    }
+
+    for (const auto& section : vkExample.m_gpuTimer.getStats())
+        ImGui::Text("%-20s %6.3f ms (avg %6.3f ms)", section.name.c_str(), section.lastMs, section.averageMs);
+}
+
+//-------------------------------------------------------------------------
+// OBJ files dropped on the window are added to the running scene
+//
+static void onFileDrop(GLFWwindow* window, int count, const char** paths)
+{
+    auto* backend   = static_cast<app::VulkanBackend*>(glfwGetWindowUserPointer(window));
+    auto* vkExample = static_cast<ExampleVulkan*>(backend);
+    for (int i = 0; i < count; i++) {
+        std::string path = paths[i];
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0)
+            vkExample->requestModel(path);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////
+// Frame                                                                 //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Everything the render thread needs for one frame, filled on the main
+// thread. ImGui's draw data is only valid until the next NewFrame, so the
+// draw lists are cloned
+//
+struct FramePacket
+{
+    ExampleVulkan::CameraMatrices camera;
+    glm::vec4                     clearColor;
+    ImDrawData                    drawData;
+    std::vector<ImDrawList*>      drawLists;
+
+    FramePacket() = default;
+    ~FramePacket() { releaseDrawData(); }
+
+    FramePacket(FramePacket const&) = delete;
+    FramePacket& operator=(FramePacket const&) = delete;
+
+    void captureDrawData(const ImDrawData* src)
+    {
+        releaseDrawData();
+
+        drawLists.resize(src->CmdListsCount);
+        for (int i = 0; i < src->CmdListsCount; i++) {
+            drawLists[i] = src->CmdLists[i]->CloneOutput();
+        }
+
+        drawData.Valid            = src->Valid;
+        drawData.CmdLists         = drawLists.data();
+        drawData.CmdListsCount    = src->CmdListsCount;
+        drawData.TotalIdxCount    = src->TotalIdxCount;
+        drawData.TotalVtxCount    = src->TotalVtxCount;
+        drawData.DisplayPos       = src->DisplayPos;
+        drawData.DisplaySize      = src->DisplaySize;
+        drawData.FramebufferScale = src->FramebufferScale;
+    }
+
+    void releaseDrawData()
+    {
+        for (auto list : drawLists) {
+            IM_DELETE(list);
+        }
+        drawLists.clear();
+        drawData.Clear();
+    }
+};
+
+//-------------------------------------------------------------------------
+// Acquire, record both passes and submit, on whichever thread renders.
+// Skipped while the swapchain has no image to give (minimized)
+//
+static void renderFrame(ExampleVulkan& vkExample, const ExampleVulkan::CameraMatrices& camera,
+                        const glm::vec4& clearColor, ImDrawData* drawData)
+{
+    // Start rendering the scene
+    if (!vkExample.prepareFrame())
+        return;
+    vkExample.m_uploadRing.beginFrame();
+    vkExample.m_descriptors.beginFrame();
+    vkExample.updateResidency();
+    vkExample.updateShaders();
+
+    // Start command buffer of this frame
+    auto                     currentFrame = vkExample.getCurrentFrame();
+    const vk::CommandBuffer& cmdBuffer    = vkExample.getCommandBuffers()[currentFrame];
+
+    cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    vkExample.m_gpuTimer.beginFrame(cmdBuffer);
+
+    // Stream the per frame data, copies must be outside the render passes
+    vkExample.updateUniformBuffer(camera);
+    vkExample.m_uploadRing.cmdFlush(cmdBuffer);
+
+    // clearing the screen
+    vk::ClearValue clearValues[3];
+    clearValues[0].setColor(app::util::clearColor(clearColor));
+    clearValues[1].setDepthStencil({ 1.0f, 0 });
+    clearValues[2].setColor(app::util::clearColor(clearColor));
+
+    // Offscreen render pass
+    vk::RenderPassBeginInfo offscreenRenderPassBeginInfo = {};
+    offscreenRenderPassBeginInfo.clearValueCount = 3;
+    offscreenRenderPassBeginInfo.pClearValues    = clearValues;
+    offscreenRenderPassBeginInfo.renderPass      = vkExample.m_offscreenRenderPass;
+    offscreenRenderPassBeginInfo.framebuffer     = vkExample.m_offscreenFramebuffer;
+    offscreenRenderPassBeginInfo.renderArea      = vk::Rect2D({}, vkExample.getSize());
+
+    // Rendering the scene
+    cmdBuffer.beginRenderPass(offscreenRenderPassBeginInfo, vk::SubpassContents::eInline);
+    vkExample.rasterize(cmdBuffer);
+    cmdBuffer.endRenderPass();
+
+    // 2nd Render Pass : tone mapper, UI
+    vk::RenderPassBeginInfo postRenderPassBeginInfo = {};
+    postRenderPassBeginInfo.clearValueCount = 3;
+    postRenderPassBeginInfo.pClearValues    = clearValues;
+    postRenderPassBeginInfo.renderPass      = vkExample.getRenderPass();
+    postRenderPassBeginInfo.framebuffer     = vkExample.getFramebuffers()[currentFrame];
+    postRenderPassBeginInfo.renderArea      = vk::Rect2D({}, vkExample.getSize());
+
+    cmdBuffer.beginRenderPass(postRenderPassBeginInfo, vk::SubpassContents::eInline);
+
+    // Rendering tonemapper
+    vkExample.drawPost(cmdBuffer);
+
+    // Rendering UI
+    ImGui_ImplVulkan_RenderDrawData(drawData, cmdBuffer); 
+    cmdBuffer.endRenderPass();
+
+    // Submit for Display
+    cmdBuffer.end();
+    vkExample.submitFrame();
+}
+
 //-------------------------------------------------------------------------
 // Render UI
 //
@@ -57,6 +416,362 @@ static void renderUI()
     ImGui::SliderFloat("Test Slider", &value, 0, 100);
 }
 
+//-------------------------------------------------------------------------
+// Upload throughput of device local buffers, through staging and, when
+// the device allows it, written directly. Software implementations
+// (lavapipe, SwiftShader) expose host visible device local memory and
+// run both paths
+//
+static void benchmarkUploads(ExampleVulkan& vkExample)
+{
+    app::Allocator&  allocator = vkExample.m_allocator;
+    app::Timeline&   timeline  = vkExample.getTimeline();
+    app::CommandPool cmdPool(vkExample.getDevice(), vkExample.getGraphicsQueueIdx());
+
+    const vk::DeviceSize sizes[]    = { 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+    const vk::DeviceSize totalBytes = 64 * 1024 * 1024;   // per size, fits one staging block
+    const std::vector<uint8_t> data(16 * 1024 * 1024, 0x5a);
+
+    const bool supported = allocator.isDirectUploadSupported();
+    std::cout << "Upload benchmark on " << vkExample.getPhysicalDevice().getProperties().deviceName
+              << ", direct path " << (supported ? "supported" : "not supported") << std::endl;
+
+    for (int direct = 0; direct < (supported ? 2 : 1); direct++) {
+        allocator.setDirectUpload(direct != 0);
+
+        for (vk::DeviceSize size : sizes) {
+            std::vector<app::BufferVma> buffers(static_cast<size_t>(totalBytes / size));
+
+            // creation, copies and the wait for the GPU
+            auto start = std::chrono::steady_clock::now();
+            vk::CommandBuffer cmdBuffer = cmdPool.createBuffer();
+            for (auto& buffer : buffers)
+                buffer = allocator.createBuffer(cmdBuffer, size, data.data(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            uint64_t value = cmdPool.submitAndWait(cmdBuffer, timeline);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            allocator.finalizeAndReleaseStaging(timeline, value);
+            for (auto& buffer : buffers)
+                allocator.destroy(buffer);
+
+            std::cout << (direct ? "  direct " : "  staged ") << std::setw(6) << size / 1024 << " KB x "
+                      << std::setw(5) << buffers.size() << ": " << std::fixed << std::setprecision(2) << std::setw(8)
+                      << ms << " ms, " << std::setw(8) << (double(totalBytes) / (1024.0 * 1024.0)) / (ms / 1000.0)
+                      << " MB/s" << std::endl;
+        }
+    }
+
+    allocator.setDirectUpload(supported);
+}
+
+//-------------------------------------------------------------------------
+// Staging under thousands of uploads of mixed sizes, 64 B to 3 MB, copied
+// into one device local buffer. A few batches stay in flight so ranges
+// are freed out of order, like the uploads of a frame loop. Reports the
+// throughput, the staging blocks allocated and the fragmentation of the
+// staging manager after each release, RANGE is its range allocator
+//
+template <class RANGE>
+static void benchmarkStaging(ExampleVulkan& vkExample, const char* rangeName)
+{
+    app::Allocator&  allocator = vkExample.m_allocator;
+    app::Timeline&   timeline  = vkExample.getTimeline();
+    vk::Device       device    = vkExample.getDevice();
+    vk::Queue        queue     = vkExample.getGraphicsQueue();
+    app::CommandPool cmdPool(device, vkExample.getGraphicsQueueIdx(), vk::CommandPoolCreateFlagBits::eTransient, queue);
+
+    const uint32_t       batches  = 128;
+    const uint32_t       perBatch = 64;    // uploads, about 18 MB
+    const uint32_t       inFlight = 3;     // batches
+    const vk::DeviceSize minSize  = 64;
+    const vk::DeviceSize maxSize  = 3 * 1024 * 1024;
+    const vk::DeviceSize dstSize  = 64 * 1024 * 1024;
+    const std::vector<uint8_t> data(static_cast<size_t>(maxSize), 0x5a);
+
+    // sizes spread evenly in log scale, same sequence on every run
+    std::mt19937                           random(2020);
+    std::uniform_real_distribution<double> logSize(std::log2(double(minSize)), std::log2(double(maxSize)));
+
+    app::BufferVma dst = allocator.createBuffer(dstSize, vk::BufferUsageFlagBits::eTransferDst,
+                                                vk::MemoryPropertyFlagBits::eDeviceLocal);
+    app::TStagingMemoryManagerVma<RANGE> staging;
+    allocator.initStaging(staging);
+
+    const auto category = static_cast<uint32_t>(app::MemoryStats::Category::eStaging);
+    const auto before   = allocator.getMemoryStats().getCounters()[category];
+
+    std::deque<std::pair<vk::CommandBuffer, uint64_t>> pending;
+    vk::DeviceSize totalBytes        = 0;
+    vk::DeviceSize peakAllocated     = 0;
+    double         fragmentationSum  = 0.0;
+    float          fragmentationPeak = 0.0f;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t batch = 0; batch < batches; batch++) {
+        vk::CommandBuffer cmdBuffer = cmdPool.createBuffer();
+        for (uint32_t i = 0; i < perBatch; i++) {
+            vk::DeviceSize size   = (static_cast<vk::DeviceSize>(std::exp2(logSize(random))) + 3) & ~vk::DeviceSize(3);
+            vk::DeviceSize offset = (random() % ((dstSize - size) / 4 + 1)) * 4;
+            staging.cmdToBuffer(cmdBuffer, dst.buffer, offset, size, data.data());
+            totalBytes += size;
+        }
+        cmdBuffer.end();
+        uint64_t value = timeline.submit(queue, cmdBuffer);
+        staging.finalizeResources(timeline, value);
+        pending.push_back({ cmdBuffer, value });
+
+        if (pending.size() >= inFlight) {
+            timeline.wait(pending.front().second);
+            cmdPool.destroy(pending.front().first);
+            pending.pop_front();
+        }
+        staging.releaseResources();
+
+        vk::DeviceSize allocated = 0, used = 0;
+        staging.getUtilisation(allocated, used);
+        peakAllocated = (std::max)(peakAllocated, allocated);
+
+        float fragmentation = staging.getFragmentation();
+        fragmentationSum += fragmentation;
+        fragmentationPeak = (std::max)(fragmentationPeak, fragmentation);
+    }
+    for (auto& submitted : pending) {
+        timeline.wait(submitted.second);
+        cmdPool.destroy(submitted.first);
+    }
+    staging.releaseResources();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const auto after = allocator.getMemoryStats().getCounters()[category];
+    staging.deinit();
+    allocator.destroy(dst);
+
+    std::cout << "Staging benchmark on " << vkExample.getPhysicalDevice().getProperties().deviceName << ", "
+              << batches * perBatch << " uploads of " << minSize << " B to " << maxSize / (1024 * 1024) << " MB, "
+              << inFlight << " batches in flight, " << rangeName << std::endl;
+    std::cout << "  " << std::fixed << std::setprecision(2) << std::setw(8) << ms << " ms, " << std::setw(8)
+              << (double(totalBytes) / (1024.0 * 1024.0)) / (ms / 1000.0) << " MB/s, " << std::setw(5)
+              << (after.allocations - before.allocations) << " block allocations, peak "
+              << peakAllocated / (1024 * 1024) << " MB, fragmentation " << std::setprecision(3)
+              << fragmentationSum / batches << " average, " << fragmentationPeak << " peak" << std::endl;
+}
+
+//-------------------------------------------------------------------------
+// CPU cost of the staging range allocators alone: random allocations and
+// frees of 16 B to 64 KB in one 256 MB block, held around liveRanges live
+// ranges, with the largest free size queried after each operation like
+// the staging manager does. Both see the same sequence
+//
+template <class RANGE>
+static void benchmarkRangeAllocator(const char* name, uint32_t liveRanges)
+{
+    const uint32_t blockSize  = 256 * 1024 * 1024;
+    const uint32_t operations = 1000000;
+
+    struct Operation
+    {
+        uint32_t size;
+        uint32_t pick;
+        bool     allocate;   // when below liveRanges
+    };
+    std::vector<Operation>                 sequence(operations);
+    std::mt19937                           random(2020);
+    std::uniform_real_distribution<double> logSize(4.0, 16.0);
+    for (auto& operation : sequence) {
+        operation.size     = static_cast<uint32_t>(std::exp2(logSize(random)));
+        operation.pick     = random();
+        operation.allocate = random() % 4 != 0;
+    }
+
+    struct Live
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+    std::vector<Live> live;
+    live.reserve(liveRanges * 2);
+
+    RANGE    range(blockSize);
+    uint32_t          failed  = 0;
+    volatile uint32_t largest = 0;   // kept from being optimized out
+    auto              apply   = [&](const Operation& operation, bool allocate) {
+        if (allocate || live.empty()) {
+            uint32_t offset, aligned, size;
+            if (range.subAllocate(operation.size, 16, offset, aligned, size))
+                live.push_back({ offset, size });
+            else
+                failed++;
+        }
+        else {
+            size_t index = operation.pick % live.size();
+            range.subFree(live[index].offset, live[index].size);
+            live[index] = live.back();
+            live.pop_back();
+        }
+        largest = range.getLargestFreeSize();
+    };
+
+    // fill up to liveRanges, not timed
+    for (uint32_t i = 0; live.size() < liveRanges && i < operations; i++)
+        apply(sequence[i], true);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const Operation& operation : sequence)
+        apply(operation, live.size() < liveRanges ? operation.allocate : !operation.allocate);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    const uint32_t freeSize = blockSize - range.getUsedSize();
+    const float fragmentation = freeSize ? 1.0f - float(range.computeLargestFreeSize()) / float(freeSize) : 0.0f;
+
+    std::cout << "  " << name << std::setw(6) << liveRanges << " live: " << std::fixed << std::setprecision(1)
+              << std::setw(7) << ns / operations << " ns/op, " << std::setw(5) << failed << " failed, fragmentation "
+              << std::setprecision(3) << fragmentation << std::endl;
+}
+
+static void benchmarkRangeAllocators()
+{
+    std::cout << "Range allocator benchmark, 1000000 operations of 16 B to 64 KB in 256 MB" << std::endl;
+    for (uint32_t liveRanges : { 256u, 4096u, 16384u }) {
+        benchmarkRangeAllocator<tools::TRangeAllocator<256>>("range ", liveRanges);
+        benchmarkRangeAllocator<tools::TTlsfAllocator<256>>("tlsf  ", liveRanges);
+    }
+}
+
+//-------------------------------------------------------------------------
+// Load time and peak resident memory of one OBJ, in place or through the
+// loader's vectors. The peak covers the whole process, so each mode is
+// run in its own process
+//
+static void benchmarkLoad(ExampleVulkan& vkExample, const std::string& filename, bool inPlace)
+{
+    const double toMB = 1.0 / (1024.0 * 1024.0);
+
+    vkExample.setLoadInPlace(inPlace);
+    const size_t rssBefore  = tools::getCurrentRss();
+    const size_t peakBefore = tools::getPeakRss();
+
+    auto start = std::chrono::steady_clock::now();
+    vkExample.loadModel(filename);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t peakAfter = tools::getPeakRss();
+    // a peak reached before loading (device creation) hides the load's own
+    std::cout << "Load " << filename << (inPlace ? " in place" : " through vectors") << ": " << std::fixed
+              << std::setprecision(2) << ms << " ms, peak RSS " << peakAfter * toMB << " MB (before loading: RSS "
+              << rssBefore * toMB << " MB, peak " << peakBefore * toMB << " MB), load peak +"
+              << (peakAfter > rssBefore ? peakAfter - rssBefore : 0) * toMB << " MB" << std::endl;
+}
+
+//-------------------------------------------------------------------------
+// GPU time of a full mip chain per texture size: blitted level by level,
+// in one compute dispatch on the graphics queue and, when the device has
+// one, on a compute only queue. Timed with timestamps around a few
+// generations in a row, the queue family must support them
+//
+static void benchmarkMipmaps(ExampleVulkan& vkExample)
+{
+    app::Allocator&    allocator = vkExample.m_allocator;
+    app::Timeline&     timeline  = vkExample.getTimeline();
+    app::MipGenerator& generator = vkExample.getMipGenerator();
+    vk::Device         device    = vkExample.getDevice();
+
+    const uint32_t sizes[]     = { 256, 512, 1024, 2048, 4096 };
+    const uint32_t repetitions = 5;
+    const vk::Format format    = vk::Format::eR8G8B8A8Srgb;
+
+    std::cout << "Mipmap benchmark on " << vkExample.getPhysicalDevice().getProperties().deviceName << ", compute path "
+              << (generator.isSupported() ? (generator.isSubgroupPath() ? "subgroups" : "shared memory") : "not supported")
+              << ", async compute queue " << (vkExample.getComputeQueue() ? "available" : "not available") << std::endl;
+
+    struct Method
+    {
+        const char* name;
+        uint32_t    queueFamily;
+        vk::Queue   queue;
+        bool        compute;
+    };
+    std::vector<Method> methods = { { "blit         ", vkExample.getGraphicsQueueIdx(), vkExample.getGraphicsQueue(), false } };
+    if (generator.isSupported()) {
+        methods.push_back({ "compute      ", vkExample.getGraphicsQueueIdx(), vkExample.getGraphicsQueue(), true });
+        if (vkExample.getComputeQueue())
+            methods.push_back({ "compute async", vkExample.getComputeQueueIdx(), vkExample.getComputeQueue(), true });
+    }
+
+    const auto  families  = vkExample.getPhysicalDevice().getQueueFamilyProperties();
+    const float period    = vkExample.getPhysicalDevice().getProperties().limits.timestampPeriod;
+    uint32_t    familyIndices[] = { vkExample.getGraphicsQueueIdx(), vkExample.getComputeQueueIdx() };
+
+    vk::QueryPool queryPool = device.createQueryPool({ {}, vk::QueryType::eTimestamp, 2 });
+    timeline.waitIdle();
+
+    for (uint32_t size : sizes) {
+        const vk::Extent2D extent(size, size);
+        for (const Method& method : methods) {
+            if (!families[method.queueFamily].timestampValidBits) {
+                std::cout << "  " << method.name << " " << std::setw(4) << size << ": no timestamps on the queue" << std::endl;
+                continue;
+            }
+
+            // shared by both families, level 0 cleared on the graphics queue
+            vk::ImageCreateInfo imageInfo = app::image::create2DInfo(extent, format, vk::ImageUsageFlagBits::eSampled, true);
+            app::MipGenerator::prepareImageInfo(imageInfo);
+            if (vkExample.getComputeQueue()) {
+                imageInfo.sharingMode           = vk::SharingMode::eConcurrent;
+                imageInfo.queueFamilyIndexCount = 2;
+                imageInfo.pQueueFamilyIndices   = familyIndices;
+            }
+            app::ImageVma image = allocator.createImage(imageInfo);
+            {
+                app::CommandPool  cmdPool(device, vkExample.getGraphicsQueueIdx());
+                vk::CommandBuffer cmdBuffer = cmdPool.createBuffer();
+                app::image::cmdBarrierImageLayout(cmdBuffer, image.image, vk::ImageLayout::eUndefined,
+                                                  vk::ImageLayout::eTransferDstOptimal);
+                vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+                cmdBuffer.clearColorImage(image.image, vk::ImageLayout::eTransferDstOptimal,
+                                          vk::ClearColorValue(std::array<float, 4>{ 0.2f, 0.4f, 0.6f, 1.0f }), range);
+                app::image::cmdBarrierImageLayout(cmdBuffer, image.image, vk::ImageLayout::eTransferDstOptimal,
+                                                  vk::ImageLayout::eShaderReadOnlyOptimal);
+                cmdPool.submitAndWait(cmdBuffer, timeline);
+            }
+
+            app::CommandPool  cmdPool(device, method.queueFamily, vk::CommandPoolCreateFlagBits::eTransient, method.queue);
+            vk::CommandBuffer cmdBuffer = cmdPool.createBuffer();
+            std::vector<std::function<void()>> releases;
+
+            cmdBuffer.resetQueryPool(queryPool, 0, 2);
+            cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, queryPool, 0);
+            for (uint32_t i = 0; i < repetitions; i++) {
+                if (method.compute)
+                    releases.push_back(generator.cmdGenerate(cmdBuffer, image.image, format, extent, imageInfo.mipLevels));
+                else
+                    app::image::generateMipmaps(cmdBuffer, image.image, format, extent, imageInfo.mipLevels);
+            }
+            cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, 1);
+            cmdPool.submitAndWait(cmdBuffer, timeline);
+
+            for (auto& release : releases) {
+                if (release)
+                    release();
+            }
+
+            uint64_t timestamps[2] = {};
+            (void)device.getQueryPoolResults(queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                             vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+            const uint64_t mask = families[method.queueFamily].timestampValidBits >= 64
+                                ? ~0ull : (1ull << families[method.queueFamily].timestampValidBits) - 1;
+            double ms = double((timestamps[1] - timestamps[0]) & mask) * period / 1e6 / repetitions;
+
+            allocator.destroy(image);
+
+            std::cout << "  " << method.name << " " << std::setw(4) << size << "x" << std::setw(4) << size << ", "
+                      << std::setw(2) << imageInfo.mipLevels << " levels: " << std::fixed << std::setprecision(3)
+                      << std::setw(8) << ms << " ms" << std::endl;
+        }
+    }
+
+    device.destroyQueryPool(queryPool);
+}
+
 ///////////////////////////////////////////////////////////////////////////
 // Application                                                           //
 ///////////////////////////////////////////////////////////////////////////
@@ -92,44 +807,126 @@ void application()
     contextInfo.addDeviceExtension(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
     contextInfo.addDeviceExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
     contextInfo.addDeviceExtension(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME);
+    contextInfo.addDeviceExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    contextInfo.addDeviceExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, true);
+    contextInfo.addDeviceExtension(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME, true);
+    contextInfo.addDeviceExtension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME, true);
+#ifdef VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME
+    contextInfo.addDeviceExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME, true);
+#endif
 
     // Vulkan
     ExampleVulkan vkExample;
     vkExample.setupVulkan(contextInfo, window);
 
+    if (g_deviceAddress && !vkExample.setDeviceAddressMode(true))
+        std::cerr << "buffer device address not supported, using descriptor arrays" << std::endl;
+
+    if (g_benchUpload || g_benchStaging || g_benchRanges || g_benchMips || !g_benchLoadFile.empty()) {
+        if (g_benchUpload)
+            benchmarkUploads(vkExample);
+        if (g_benchStaging) {
+            benchmarkStaging<tools::TRangeAllocator<256>>(vkExample, "range allocator");
+            benchmarkStaging<tools::TTlsfAllocator<256>>(vkExample, "TLSF allocator");
+        }
+        if (g_benchRanges)
+            benchmarkRangeAllocators();
+        if (g_benchMips)
+            benchmarkMipmaps(vkExample);
+        if (!g_benchLoadFile.empty())
+            benchmarkLoad(vkExample, g_benchLoadFile, !g_benchLoadVectors);
+        vkExample.getDevice().waitIdle();
+        vkExample.destroyResources();
+        vkExample.destroy();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return;
+    }
+
     // Imgui 
     vkExample.initGUI(window);
 
-    vkExample.loadModel("../media/scenes/cube_multi.obj");
+    // pipelines compile on workers while the scene loads, the post
+    // pipeline does not depend on it
+    auto startupStart = std::chrono::steady_clock::now();
     vkExample.createOffscreenRender();
+    vkExample.createPostDescriptor();
+    vkExample.createPostPipeline();
+
+    vkExample.loadModel("../media/scenes/cube_multi.obj");
     vkExample.createDescriptorSetLayout();
     vkExample.createGraphicsPipeline();
     vkExample.createUniformBuffer();
     vkExample.createSceneDescriptionBuffer();
     vkExample.updateDescriptorSet();
-
-    vkExample.createPostDescriptor();
-    vkExample.createPostPipeline();
     vkExample.updatePostDescriptorSet();
+
+    vkExample.waitPipelines();
+    double startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+
+    const app::PipelineCache::Stats pipelineStats = vkExample.getPipelineCache().getStats();
+    std::cout << "Pipelines: " << pipelineStats.pipelineCount << " created in " << std::fixed << std::setprecision(2)
+              << pipelineStats.createMs << " ms, " << (pipelineStats.warm ? "warm" : "cold") << " start ("
+              << pipelineStats.status << "), scene and pipelines ready in " << startupMs << " ms" << std::endl;
+
     glm::vec4 clearColor = glm::vec4(1, 1, 1, 1.00f);
 
     vkExample.setupGlfwCallbacks(window);
+    glfwSetDropCallback(window, &onFileDrop);
     ImGui_ImplGlfw_InitForVulkan(window, true);
+
+    tools::FramePacer framePacer;
+
+    // Render thread, consumes the packets published by the main thread
+    tools::TripleBuffer<FramePacket> packets;
+    std::atomic<bool>                renderRunning{ true };
+    std::atomic<bool>                renderFailed{ false };
+    std::thread                      renderThread;
+
+    vkExample.setRenderThreaded(g_renderThreaded);
+    if (g_renderThreaded) {
+        renderThread = std::thread([&]() {
+            try {
+                while (renderRunning) {
+                    if (!packets.consume()) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    auto start = std::chrono::steady_clock::now();
+
+                    FramePacket& packet = packets.getReadBuffer();
+                    renderFrame(vkExample, packet.camera, packet.clearColor, &packet.drawData);
+
+                    g_renderCpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+                }
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                renderFailed = true;
+            }
+        });
+    }
     
     // Main Loop
-    while (!glfwWindowShouldClose(window))
+    while (!glfwWindowShouldClose(window) && !renderFailed)
     {
+        // Pace before sampling input, so waiting doesn't add latency
+        framePacer.wait();
+
         glfwPollEvents();
 
         if (vkExample.isMinimized())
             continue;
 
+        auto simStart = std::chrono::steady_clock::now();
+
         // Start ImGUI frame
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        // update camera buffer
-        vkExample.updateUniformBuffer();
+        // camera of this frame, uploaded by whichever thread renders
+        const ImVec2                  displaySize = ImGui::GetIO().DisplaySize;
+        ExampleVulkan::CameraMatrices camera      = vkExample.computeCameraMatrices(displaySize.x / displaySize.y);
 
         // Show UI window
         {
@@ -137,60 +934,45 @@ void application()
             
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
                  1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+            ImGui::Text("CPU main %.3f ms, render %.3f ms (%s)", g_mainCpuMs, g_renderCpuMs.load(),
+                 g_renderThreaded ? "render thread" : "single thread");
             
             renderUI();
+
+            renderFramePacingUI(vkExample, framePacer);
+            renderMemoryUI(vkExample);
+            renderDescriptorUI(vkExample);
+            renderPipelineUI(vkExample);
+            renderGpuTimingUI(vkExample);
             
             ImGui::Render();
         }
 
-        // Start rendering the scene
-        vkExample.prepareFrame();
-
-        // Start command buffer of this frame
-        auto                     currentFrame = vkExample.getCurrentFrame();
-        const vk::CommandBuffer& cmdBuffer    = vkExample.getCommandBuffers()[currentFrame];
+        if (g_renderThreaded) {
+            // Fill the free slot while the render thread records the
+            // previous frame, then hand it over once that one was picked up
+            FramePacket& packet = packets.getWriteBuffer();
+            packet.camera     = camera;
+            packet.clearColor = clearColor;
+            packet.captureDrawData(ImGui::GetDrawData());
 
-        cmdBuffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+            g_mainCpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - simStart).count();
 
-        // clearing the screen
-        vk::ClearValue clearValues[3];
-        clearValues[0].setColor(app::util::clearColor(clearColor));
-        clearValues[1].setDepthStencil({ 1.0f, 0 });
-        clearValues[2].setColor(app::util::clearColor(clearColor));
-
-        // Offscreen render pass
-        vk::RenderPassBeginInfo offscreenRenderPassBeginInfo = {};
-        offscreenRenderPassBeginInfo.clearValueCount = 3;
-        offscreenRenderPassBeginInfo.pClearValues    = clearValues;
-        offscreenRenderPassBeginInfo.renderPass      = vkExample.m_offscreenRenderPass;
-        offscreenRenderPassBeginInfo.framebuffer     = vkExample.m_offscreenFramebuffer;
-        offscreenRenderPassBeginInfo.renderArea      = vk::Rect2D({}, vkExample.getSize());
-
-        // Rendering the scene
-        cmdBuffer.beginRenderPass(offscreenRenderPassBeginInfo, vk::SubpassContents::eInline);
-        vkExample.rasterize(cmdBuffer);
-        cmdBuffer.endRenderPass();
-
-        // 2nd Render Pass : tone mapper, UI
-        vk::RenderPassBeginInfo postRenderPassBeginInfo = {};
-        postRenderPassBeginInfo.clearValueCount = 3;
-        postRenderPassBeginInfo.pClearValues    = clearValues;
-        postRenderPassBeginInfo.renderPass      = vkExample.getRenderPass();
-        postRenderPassBeginInfo.framebuffer     = vkExample.getFramebuffers()[currentFrame];
-        postRenderPassBeginInfo.renderArea      = vk::Rect2D({}, vkExample.getSize());
-
-        cmdBuffer.beginRenderPass(postRenderPassBeginInfo, vk::SubpassContents::eInline);
-
-        // Rendering tonemapper
-        vkExample.drawPost(cmdBuffer);
+            packets.waitConsumed(renderFailed);
+            packets.publish();
+        }
+        else {
+            g_mainCpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - simStart).count();
 
-        // Rendering UI
-        ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmdBuffer); 
-        cmdBuffer.endRenderPass();
+            auto renderStart = std::chrono::steady_clock::now();
+            renderFrame(vkExample, camera, clearColor, ImGui::GetDrawData());
+            g_renderCpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - renderStart).count();
+        }
+    }
 
-        // Submit for Display
-        cmdBuffer.end();
-        vkExample.submitFrame();
+    if (renderThread.joinable()) {
+        renderRunning = false;
+        renderThread.join();
     }
 
     // Cleanup
@@ -207,7 +989,24 @@ void application()
 //
 int main(int argc, char* argv[]) 
 {
-    (void)(argc), (void)(argv);
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--render-thread")
+            g_renderThreaded = true;
+        else if (std::string(argv[i]) == "--bench-upload")
+            g_benchUpload = true;
+        else if (std::string(argv[i]) == "--bench-staging")
+            g_benchStaging = true;
+        else if (std::string(argv[i]) == "--bench-ranges")
+            g_benchRanges = true;
+        else if (std::string(argv[i]) == "--bench-mips")
+            g_benchMips = true;
+        else if (std::string(argv[i]) == "--bench-load" && i + 1 < argc)
+            g_benchLoadFile = argv[++i];
+        else if (std::string(argv[i]) == "--vectors")
+            g_benchLoadVectors = true;
+        else if (std::string(argv[i]) == "--bda")
+            g_deviceAddress = true;
+    }
 
     try {
         application();
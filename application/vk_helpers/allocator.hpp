@@ -8,14 +8,25 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <mutex>
 #include "..//external/vk_mem_alloc.h"
 #include "vulkan/vulkan.hpp"
 #include "memorymanagement.hpp"
+#include "bufferarena.hpp"
+#include "memorybudget.hpp"
+#include "memorystats.hpp"
 #include "samplers.hpp"
 #include "images.hpp"
 
 namespace app {
 
+// smallest host visible device local heap taken as resizable BAR, the
+// 256 MB window of discrete GPUs without it is left alone
+#define APP_DIRECT_UPLOAD_MIN_HEAPSIZE (VkDeviceSize(256) * 1024 * 1024)
+
 // Objects
 struct BufferVma
 {
@@ -45,27 +56,38 @@ struct AccelerationDedicated
 ///////////////////////////////////////////////////////////////////////////
 // Staging Memory Manager  VMA                                           //
 ///////////////////////////////////////////////////////////////////////////
+// RANGE as in TStagingMemoryManager, StagingMemoryManagerVma uses the   //
+// APP_STAGING_RANGE_ALLOCATOR default                                   //
+///////////////////////////////////////////////////////////////////////////
 
-class StagingMemoryManagerVma : public StagingMemoryManager
+template <class RANGE>
+class TStagingMemoryManagerVma : public TStagingMemoryManager<RANGE>
 {
+    using Base  = TStagingMemoryManager<RANGE>;
+    using Block = typename Base::Block;
+    using Base::m_device;
+
 public:
     //-------------------------------------------------------------------------
     // 
     //
-    StagingMemoryManagerVma(vk::Device device, vk::PhysicalDevice physicalDevice, VmaAllocator memAllocator, vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE)
+    TStagingMemoryManagerVma(vk::Device device, vk::PhysicalDevice physicalDevice, VmaAllocator memAllocator,
+                             vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE, MemoryStats* stats = nullptr)
     {
-        init(device, physicalDevice, memAllocator, stagingBlockSize);
+        init(device, physicalDevice, memAllocator, stagingBlockSize, stats);
     }
 
-    StagingMemoryManagerVma() {};
+    TStagingMemoryManagerVma() {};
 
     //-------------------------------------------------------------------------
     // Initialization
     //
-    void init(vk::Device device, vk::PhysicalDevice physicalDevice, VmaAllocator memAllocator, vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE)
+    void init(vk::Device device, vk::PhysicalDevice physicalDevice, VmaAllocator memAllocator,
+              vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE, MemoryStats* stats = nullptr)
     {
-        StagingMemoryManager::init(device, physicalDevice, stagingBlockSize);
+        Base::init(device, physicalDevice, stagingBlockSize);
         m_allocator = memAllocator;
+        m_stats     = stats;
     }
 
 protected:
@@ -83,10 +105,14 @@ protected:
         VmaAllocationCreateInfo allocInfo = {};
         allocInfo.usage = toDevice ? VMA_MEMORY_USAGE_CPU_TO_GPU : VMA_MEMORY_USAGE_GPU_TO_CPU;
 
-        VkResult result = vmaCreateBuffer(m_allocator, &createInfo, &allocInfo, reinterpret_cast<VkBuffer*>(&block.buffer), &m_blockAllocations[index], nullptr);
+        VmaAllocationInfo allocationInfo = {};
+        VkResult result = vmaCreateBuffer(m_allocator, &createInfo, &allocInfo, reinterpret_cast<VkBuffer*>(&block.buffer), &m_blockAllocations[index], &allocationInfo);
         if (result != VK_SUCCESS)
             return vk::Result(result);
 
+        if (m_stats)
+            m_stats->add((uint64_t)m_blockAllocations[index], MemoryStats::Category::eStaging, allocationInfo.size);
+
         result = vmaMapMemory(m_allocator, m_blockAllocations[index], (void**)& block.mapping);
         return vk::Result(result);
     }
@@ -96,6 +122,8 @@ protected:
     //
     void freeBlockMemory(uint32_t index, const Block& block) override
     {
+        if (m_stats)
+            m_stats->remove((uint64_t)m_blockAllocations[index]);
         m_device.destroyBuffer(block.buffer);
         vmaUnmapMemory(m_allocator, m_blockAllocations[index]);
         vmaFreeMemory(m_allocator, m_blockAllocations[index]);
@@ -115,18 +143,37 @@ protected:
 
     VmaAllocator               m_allocator;
     std::vector<VmaAllocation> m_blockAllocations;
+    MemoryStats*               m_stats{ nullptr };
+
+}; // TStagingMemoryManagerVma
 
-}; // StagingMemoryManagerVma
+using StagingMemoryManagerVma      = TStagingMemoryManagerVma<APP_STAGING_RANGE_ALLOCATOR>;
+using StagingMemoryManagerVmaRange = TStagingMemoryManagerVma<tools::TRangeAllocator<256>>;
+using StagingMemoryManagerVmaTlsf  = TStagingMemoryManagerVma<tools::TTlsfAllocator<256>>;
 
 ///////////////////////////////////////////////////////////////////////////
 // Allocator                                                             //
 ///////////////////////////////////////////////////////////////////////////
 // Allocator for buffers, images and acceleration structures             //
+// - creates and destroys can come from several threads, VMA locks       //
+//   itself, the sampler pool and the arena are locked here              //
+// - the built-in staging (create* taking only a command buffer) and the //
+//   memory budget belong to the thread owning the allocator, workers    //
+//   upload through their own staging, see UploadContext                 //
 ///////////////////////////////////////////////////////////////////////////
 
 class Allocator
 {
 public:
+    // buffers created with data, by path
+    struct UploadStats
+    {
+        uint64_t directCount = 0;
+        uint64_t directBytes = 0;
+        uint64_t stagedCount = 0;
+        uint64_t stagedBytes = 0;
+    };
+
     //-------------------------------------------------------------------------
     //
     //
@@ -139,25 +186,94 @@ public:
     //
     void deinit()
     {
+        m_arena.deinit();
+        m_budget.deinit();
         m_samplerPool.deinit();
         m_staging.deinit();
     }
 
     //-------------------------------------------------------------------------
     // Initialization of the allocator
+    // memoryBudget: VK_EXT_memory_budget is enabled on the device, budgets
+    // are estimated from the heap sizes otherwise
+    // bufferDeviceAddress: VK_KHR_buffer_device_address is enabled, memory
+    // can back buffers with eShaderDeviceAddress, arena slices included
     //
-    void init(vk::Device device, vk::PhysicalDevice physicalDevice, vk::Instance instance, vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE)
+    void init(vk::Device device, vk::PhysicalDevice physicalDevice, vk::Instance instance,
+              vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE, bool memoryBudget = false,
+              bool bufferDeviceAddress = false)
     {
-        m_device = device;
+        m_device              = device;
+        m_physicalDevice      = physicalDevice;
+        m_bufferDeviceAddress = bufferDeviceAddress;
 
         VmaAllocatorCreateInfo allocatorInfo = {};
         allocatorInfo.physicalDevice = physicalDevice;
         allocatorInfo.device = device;
         allocatorInfo.instance = instance;
+        if (memoryBudget)
+            allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+        if (bufferDeviceAddress)
+            allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
         vmaCreateAllocator(&allocatorInfo, &m_allocator);
 
-        m_staging.init(device, physicalDevice, m_allocator, stagingBlockSize);
+        vk::BufferUsageFlags arenaUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eUniformBuffer;
+        if (bufferDeviceAddress)
+            arenaUsage |= vk::BufferUsageFlagBits::eShaderDeviceAddressKHR;
+
+        m_staging.init(device, physicalDevice, m_allocator, stagingBlockSize, &m_stats);
         m_samplerPool.init(device);
+        m_budget.init(m_allocator, memoryBudget);
+        m_arena.init(device, physicalDevice, m_allocator, APP_DEFAULT_ARENA_CHUNK_SIZE, arenaUsage);
+
+        m_directUploadSupported = detectDirectUpload(physicalDevice);
+        m_directUpload          = m_directUploadSupported;
+    }
+
+    //-------------------------------------------------------------------------
+    // Device local buffers created with data are written by the host when
+    // the device has host visible device local memory (integrated GPUs,
+    // resizable BAR), staging is used otherwise or when that heap is full
+    //
+    void setDirectUpload(bool enable) { m_directUpload = enable && m_directUploadSupported; }
+    bool isDirectUploadSupported() const { return m_directUploadSupported; }
+    bool isDirectUploadEnabled() const { return m_directUpload; }
+
+    UploadStats getUploadStats() const
+    {
+        UploadStats stats;
+        stats.directCount = m_directCount;
+        stats.directBytes = m_directBytes;
+        stats.stagedCount = m_stagedCount;
+        stats.stagedBytes = m_stagedBytes;
+        return stats;
+    }
+
+    //-------------------------------------------------------------------------
+    // Device addresses, the buffer needs eShaderDeviceAddress. A moved
+    // buffer has a new address
+    //
+    bool isBufferDeviceAddressEnabled() const { return m_bufferDeviceAddress; }
+
+    vk::DeviceAddress getDeviceAddress(vk::Buffer buffer) const
+    {
+        assert(m_bufferDeviceAddress);
+        return m_device.getBufferAddressKHR(vk::BufferDeviceAddressInfo(buffer));
+    }
+
+    vk::DeviceAddress getDeviceAddress(const BufferSlice& slice) const
+    {
+        return getDeviceAddress(slice.buffer) + slice.offset;
+    }
+
+    //-------------------------------------------------------------------------
+    // Staging of another thread, reporting to this allocator's stats, with
+    // either range allocator
+    //
+    template <class RANGE>
+    void initStaging(TStagingMemoryManagerVma<RANGE>& staging, vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE)
+    {
+        staging.init(m_device, m_physicalDevice, m_allocator, stagingBlockSize, &m_stats);
     }
 
     //-------------------------------------------------------------------------
@@ -185,9 +301,13 @@ public:
 
         VmaAllocationCreateInfo allocInfo = {};
         allocInfo.usage = memUsage;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;   // names set by setCategory
 
-        VkResult result = vmaCreateBuffer(m_allocator, &info, &allocInfo, &resultBuffer.buffer, &resultBuffer.allocation, nullptr);
+        VmaAllocationInfo allocationInfo = {};
+        VkResult result = vmaCreateBuffer(m_allocator, &info, &allocInfo, &resultBuffer.buffer, &resultBuffer.allocation, &allocationInfo);
         assert(result == VK_SUCCESS);
+
+        m_stats.add((uint64_t)resultBuffer.allocation, guessCategory(info.usage), allocationInfo.size);
         return resultBuffer;
     }
     
@@ -231,10 +351,29 @@ public:
                            VkBufferUsageFlags usage,
                            VmaMemoryUsage memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
     {
-        BufferVma resultBuffer = createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memUsage);
+        return createBuffer(m_staging, cmdBuffer, size, data, usage, memUsage);
+    }
+
+    template <class RANGE>
+    BufferVma createBuffer(TStagingMemoryManager<RANGE>& staging,
+                           vk::CommandBuffer             cmdBuffer,
+                           VkDeviceSize                  size,
+                           const void*                   data,
+                           VkBufferUsageFlags            usage,
+                           VmaMemoryUsage                memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        BufferVma resultBuffer;
+        if (data && m_directUpload && memUsage == VMA_MEMORY_USAGE_GPU_ONLY
+            && createBufferDirect(size, usage, [&](void* mapping) { memcpy(mapping, data, size); }, resultBuffer)) {
+            return resultBuffer;
+        }
+
+        resultBuffer = createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, memUsage);
         
         if (data) {
-            m_staging.cmdToBuffer(cmdBuffer, resultBuffer.buffer, 0, size, data);
+            staging.cmdToBuffer(cmdBuffer, resultBuffer.buffer, 0, size, data);
+            m_stagedCount++;
+            m_stagedBytes += size;
         }
 
         return resultBuffer;
@@ -246,7 +385,7 @@ public:
                            VkBufferUsageFlags usage,
                            vk::MemoryPropertyFlags memProps)
     {
-        createBuffer(cmdBuffer, size, data, usage, vkToVmaMemoryUsage(memProps));
+        return createBuffer(cmdBuffer, size, data, usage, vkToVmaMemoryUsage(memProps));
     }
 
     //-------------------------------------------------------------------------
@@ -259,12 +398,7 @@ public:
                            VmaMemoryUsage        memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
     {
         VkDeviceSize size = sizeof(T) * data.size();
-        BufferVma resultBuffer = createBuffer(size, usage, memUsage);
-        if (!data.empty()) {
-            m_staging.cmdToBuffer(cmdBuffer, resultBuffer.buffer, 0, size, data.data());
-        }
-
-        return resultBuffer;
+        return createBuffer(m_staging, cmdBuffer, size, data.empty() ? nullptr : data.data(), usage, memUsage);
     }
 
     template <typename T>
@@ -276,6 +410,82 @@ public:
         return createBuffer(cmdBuffer, data, usage, vkToVmaMemoryUsage(memProps));
     }
 
+    //-------------------------------------------------------------------------
+    // Device local buffer whose content fill() writes in place, into the
+    // buffer itself with direct uploads, into staging otherwise. Saves the
+    // intermediate copy of the data. The mapping can be write-combined,
+    // fill() should write once and not read back
+    //
+    using FillFunction = std::function<void(void* mapping)>;
+
+    BufferVma createBufferInPlace(vk::CommandBuffer   cmdBuffer,
+                                  VkDeviceSize        size,
+                                  VkBufferUsageFlags  usage,
+                                  const FillFunction& fill)
+    {
+        return createBufferInPlace(m_staging, cmdBuffer, size, usage, fill);
+    }
+
+    template <class RANGE>
+    BufferVma createBufferInPlace(TStagingMemoryManager<RANGE>& staging,
+                                  vk::CommandBuffer             cmdBuffer,
+                                  VkDeviceSize                  size,
+                                  VkBufferUsageFlags            usage,
+                                  const FillFunction&           fill)
+    {
+        BufferVma resultBuffer;
+        if (m_directUpload && createBufferDirect(size, usage, fill, resultBuffer))
+            return resultBuffer;
+
+        resultBuffer = createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+        if (size) {
+            fill(staging.cmdToBuffer(cmdBuffer, resultBuffer.buffer, 0, size, nullptr));
+            m_stagedCount++;
+            m_stagedBytes += size;
+        }
+        return resultBuffer;
+    }
+
+    //-------------------------------------------------------------------------
+    // Slice of the shared storage / uniform buffers, uploading data through
+    // staging. Bind with the slice's buffer, offset and range
+    //
+    BufferSlice createSlice(vk::CommandBuffer     cmdBuffer,
+                            vk::DeviceSize        size,
+                            const void*           data,
+                            MemoryStats::Category category = MemoryStats::Category::eOther)
+    {
+        BufferSlice slice;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            slice = m_arena.allocate(size);
+        }
+        if (data) {
+            m_staging.cmdToBuffer(cmdBuffer, slice.buffer, slice.offset, size, data);
+        }
+
+        m_stats.add(sliceKey(slice), category, slice.allocSize);
+        return slice;
+    }
+
+    template <typename T>
+    BufferSlice createSlice(vk::CommandBuffer     cmdBuffer,
+                            const std::vector<T>& data,
+                            MemoryStats::Category category = MemoryStats::Category::eOther)
+    {
+        return createSlice(cmdBuffer, sizeof(T) * data.size(), data.data(), category);
+    }
+
+    BufferSlice createSliceInPlace(vk::CommandBuffer     cmdBuffer,
+                                   vk::DeviceSize        size,
+                                   const FillFunction&   fill,
+                                   MemoryStats::Category category = MemoryStats::Category::eOther)
+    {
+        BufferSlice slice = createSlice(cmdBuffer, size, nullptr, category);
+        fill(m_staging.cmdToBuffer(cmdBuffer, slice.buffer, slice.offset, size, nullptr));
+        return slice;
+    }
+
     //-------------------------------------------------------------------------
     // Create Image
     //
@@ -287,10 +497,14 @@ public:
 
         VmaAllocationCreateInfo allocInfo = {};
         allocInfo.usage = memUsage;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
 
-        VkResult result = vmaCreateImage(m_allocator, &imageInfo, &allocInfo, &imageResult.image, &imageResult.allocation, nullptr);
+        VmaAllocationInfo allocationInfo = {};
+        VkResult result = vmaCreateImage(m_allocator, &imageInfo, &allocInfo, &imageResult.image, &imageResult.allocation, &allocationInfo);
         assert(result == VK_SUCCESS);
 
+        m_stats.add((uint64_t)imageResult.allocation, MemoryStats::Category::eOther, allocationInfo.size);
+
         return imageResult;
     }
 
@@ -305,7 +519,20 @@ public:
         VkImageLayout            layout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
         VmaMemoryUsage           memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
     {
-        ImageVma imageResult = createImage(info);
+        return createImage(m_staging, cmdBuffer, size, data, info, layout, memUsage);
+    }
+
+    template <class RANGE>
+    ImageVma createImage(
+        TStagingMemoryManager<RANGE>& staging,
+        const vk::CommandBuffer       cmdBuffer,
+        vk::DeviceSize                size,
+        const void*                   data,
+        const VkImageCreateInfo&      info,
+        VkImageLayout                 layout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VmaMemoryUsage                memUsage = VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        ImageVma imageResult = createImage(info, memUsage);
 
         // Copy the data to staging buffer than to image
         if (data != nullptr) {
@@ -326,7 +553,7 @@ public:
             subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
             subresource.layerCount = 1;
 
-            m_staging.cmdToImage(cmdBuffer, imageResult.image, offset, info.extent, subresource, size, data);
+            staging.cmdToImage(cmdBuffer, imageResult.image, offset, info.extent, subresource, size, data);
 
             // Setting final image Layout
             app::image::cmdBarrierImageLayout(vk::CommandBuffer(cmdBuffer), vk::Image(imageResult.image), vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout(layout));
@@ -350,6 +577,7 @@ public:
         textureResult.image      = image.image;
         textureResult.allocation = image.allocation;
         textureResult.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        m_stats.retag((uint64_t)image.allocation, MemoryStats::Category::eTexture);
 
         assert(imageViewCreateInfo.image == image.image);
         try {
@@ -367,6 +595,8 @@ public:
         const VkSamplerCreateInfo& samplerCreateInfo)
     {
         TextureVma resultTexture = createTexture(image, imageViewCreateInfo);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
         resultTexture.descriptor.sampler = m_samplerPool.acquireSampler(samplerCreateInfo);
 
         return resultTexture;
@@ -386,7 +616,21 @@ public:
         const vk::ImageLayout&       layout = vk::ImageLayout::eShaderReadOnlyOptimal,
         bool                         isCube = false)
     {
-        ImageVma image = createImage(static_cast<VkCommandBuffer>(cmdBuffer), size, data, info, static_cast<VkImageLayout>(layout));
+        return createTexture(m_staging, cmdBuffer, size, data, info, samplerCreateInfo, layout, isCube);
+    }
+
+    template <class RANGE>
+    TextureVma createTexture(
+        TStagingMemoryManager<RANGE>& staging,
+        const vk::CommandBuffer&      cmdBuffer,
+        size_t                        size,
+        const void*                   data,
+        const vk::ImageCreateInfo&    info,
+        const vk::SamplerCreateInfo&  samplerCreateInfo,
+        const vk::ImageLayout&        layout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        bool                          isCube = false)
+    {
+        ImageVma image = createImage(staging, static_cast<VkCommandBuffer>(cmdBuffer), size, data, info, static_cast<VkImageLayout>(layout));
     
         VkImageViewCreateInfo viewInfo = {};
         viewInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -438,6 +682,14 @@ public:
     }
     void releaseStaging() { m_staging.releaseResources(); }
 
+    // staging released once the timeline reaches value
+    void finalizeStaging(const Timeline& timeline, uint64_t value) { m_staging.finalizeResources(timeline, value); }
+    void finalizeAndReleaseStaging(const Timeline& timeline, uint64_t value)
+    {
+        m_staging.finalizeResources(timeline, value);
+        m_staging.releaseResources();
+    }
+
     StagingMemoryManager* getStaging() { return &m_staging; }
     const StagingMemoryManager* getStaging() const { return &m_staging; }
 
@@ -448,8 +700,11 @@ public:
     {
         if (buffer.buffer)
             vkDestroyBuffer(static_cast<VkDevice>(m_device), buffer.buffer, nullptr);
-        if (buffer.allocation)
-            vmaFreeMemory(m_allocator, buffer.allocation);      
+        if (buffer.allocation) {
+            m_stats.remove((uint64_t)buffer.allocation);
+            m_budget.released(buffer.allocation);
+            vmaFreeMemory(m_allocator, buffer.allocation);
+        }
 
         buffer = BufferVma();
     }
@@ -458,8 +713,11 @@ public:
     {
         if (image.image)
             vkDestroyImage(static_cast<VkDevice>(m_device), image.image, nullptr);
-        if (image.allocation)
+        if (image.allocation) {
+            m_stats.remove((uint64_t)image.allocation);
+            m_budget.released(image.allocation);
             vmaFreeMemory(m_allocator, image.allocation);
+        }
 
         image = ImageVma();
     }
@@ -469,15 +727,29 @@ public:
         vkDestroyImageView(static_cast<VkDevice>(m_device), texture.descriptor.imageView, nullptr);
         vkDestroyImage(static_cast<VkDevice>(m_device), texture.image, nullptr);
 
-        if (texture.descriptor.sampler)
+        if (texture.descriptor.sampler) {
+            std::lock_guard<std::mutex> lock(m_mutex);
             m_samplerPool.releaseSampler(texture.descriptor.sampler);
+        }
 
-        if (texture.allocation)
+        if (texture.allocation) {
+            m_stats.remove((uint64_t)texture.allocation);
+            m_budget.released(texture.allocation);
             vmaFreeMemory(m_allocator, texture.allocation);
+        }
 
         texture = TextureVma();
     }
 
+    void destroy(BufferSlice& slice)
+    {
+        if (slice.chunkID != ~0u)
+            m_stats.remove(sliceKey(slice));
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_arena.free(slice);
+    }
+
     void destroy(AccelerationDedicated& acceleration)
     {
 
@@ -488,6 +760,42 @@ public:
     //
     VmaAllocator& getAllocator() { return m_allocator; }
 
+    //-------------------------------------------------------------------------
+    // Heap budgets and eviction of registered resources
+    //
+    MemoryBudget& getMemoryBudget() { return m_budget; }
+    const MemoryBudget& getMemoryBudget() const { return m_budget; }
+
+    //-------------------------------------------------------------------------
+    // Counters per category of every allocation made here, name shows in
+    // the VMA part of the JSON dump
+    //
+    void setCategory(VmaAllocation allocation, MemoryStats::Category category, const char* name = nullptr)
+    {
+        m_stats.retag((uint64_t)allocation, category);
+        if (name)
+            vmaSetAllocationUserData(m_allocator, allocation, const_cast<char*>(name));
+    }
+    void setCategory(const BufferVma& buffer, MemoryStats::Category category, const char* name = nullptr)
+    {
+        setCategory(buffer.allocation, category, name);
+    }
+    void setCategory(const ImageVma& image, MemoryStats::Category category, const char* name = nullptr)
+    {
+        setCategory(image.allocation, category, name);
+    }
+    void setCategory(const TextureVma& texture, MemoryStats::Category category, const char* name = nullptr)
+    {
+        setCategory(texture.allocation, category, name);
+    }
+
+    BufferArena& getArena() { return m_arena; }
+    const BufferArena& getArena() const { return m_arena; }
+
+    MemoryStats& getMemoryStats() { return m_stats; }
+    const MemoryStats& getMemoryStats() const { return m_stats; }
+    bool dumpMemoryStats(const std::string& filename) const { return m_stats.dumpJson(filename, m_allocator); }
+
     //-------------------------------------------------------------------------
     // Other
     //
@@ -500,11 +808,103 @@ public:
 
     void unmap(const BufferVma& buffer) { vmaUnmapMemory(m_allocator, buffer.allocation); }
 
-protected:    
+protected:
+    //-------------------------------------------------------------------------
+    // Best guess from the usage, materials and others are set by the caller
+    //
+    static MemoryStats::Category guessCategory(VkBufferUsageFlags usage)
+    {
+        if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+            return MemoryStats::Category::eVertex;
+        if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+            return MemoryStats::Category::eIndex;
+        return MemoryStats::Category::eOther;
+    }
+
+    //-------------------------------------------------------------------------
+    // Any host visible device local type on an integrated or CPU device,
+    // only a large one (resizable BAR) on a discrete GPU
+    //
+    static bool detectDirectUpload(vk::PhysicalDevice physicalDevice)
+    {
+        const vk::PhysicalDeviceMemoryProperties memProps   = physicalDevice.getMemoryProperties();
+        const vk::PhysicalDeviceType             deviceType = physicalDevice.getProperties().deviceType;
+        const bool unified = deviceType == vk::PhysicalDeviceType::eIntegratedGpu || deviceType == vk::PhysicalDeviceType::eCpu;
+
+        const vk::MemoryPropertyFlags flags = vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible;
+        for (uint32_t i = 0; i < memProps.memoryTypeCount; i++) {
+            const vk::MemoryType& type = memProps.memoryTypes[i];
+            if ((type.propertyFlags & flags) != flags)
+                continue;
+            if (unified || memProps.memoryHeaps[type.heapIndex].size > APP_DIRECT_UPLOAD_MIN_HEAPSIZE)
+                return true;
+        }
+        return false;
+    }
+
+    //-------------------------------------------------------------------------
+    // fill() writes straight into a host visible device local buffer, the
+    // next queue submit makes the host write visible. False when no such
+    // memory is left, the caller stages instead
+    //
+    bool createBufferDirect(VkDeviceSize size, VkBufferUsageFlags usage, const FillFunction& fill, BufferVma& resultBuffer)
+    {
+        VkBufferCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        info.size  = size;
+        info.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;   // defragmentation copies into it
+
+        VmaAllocationCreateInfo allocInfo = {};
+        allocInfo.usage         = VMA_MEMORY_USAGE_GPU_ONLY;
+        allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        allocInfo.flags         = VMA_ALLOCATION_CREATE_USER_DATA_COPY_STRING_BIT;
+
+        VmaAllocationInfo allocationInfo = {};
+        VkResult result = vmaCreateBuffer(m_allocator, &info, &allocInfo, &resultBuffer.buffer, &resultBuffer.allocation, &allocationInfo);
+        if (result != VK_SUCCESS) {
+            resultBuffer = BufferVma();
+            return false;
+        }
+
+        void* mapped = nullptr;
+        if (vmaMapMemory(m_allocator, resultBuffer.allocation, &mapped) != VK_SUCCESS) {
+            vmaDestroyBuffer(m_allocator, resultBuffer.buffer, resultBuffer.allocation);
+            resultBuffer = BufferVma();
+            return false;
+        }
+        fill(mapped);
+        vmaFlushAllocation(m_allocator, resultBuffer.allocation, 0, VK_WHOLE_SIZE);   // no-op on coherent memory
+        vmaUnmapMemory(m_allocator, resultBuffer.allocation);
+
+        m_stats.add((uint64_t)resultBuffer.allocation, guessCategory(info.usage), allocationInfo.size);
+        m_directCount++;
+        m_directBytes += size;
+        return true;
+    }
+
+    // slices have no allocation handle, top bit keeps them apart from those
+    static uint64_t sliceKey(const BufferSlice& slice)
+    {
+        return (uint64_t(1) << 63) | (uint64_t(slice.chunkID) << 32) | slice.allocOffset;
+    }
+
     vk::Device                         m_device;
+    vk::PhysicalDevice                 m_physicalDevice;
     VmaAllocator                       m_allocator;
+    app::MemoryStats                   m_stats;     // before m_staging, which reports to it
     app::StagingMemoryManagerVma       m_staging;
     app::SamplerPool                   m_samplerPool;
+    app::MemoryBudget                  m_budget;
+    app::BufferArena                   m_arena;
+    std::mutex                         m_mutex;     // sampler pool and arena, shared between threads
+
+    bool                               m_bufferDeviceAddress{ false };
+    bool                               m_directUploadSupported{ false };
+    std::atomic<bool>                  m_directUpload{ false };
+    std::atomic<uint64_t>              m_directCount{ 0 };
+    std::atomic<uint64_t>              m_directBytes{ 0 };
+    std::atomic<uint64_t>              m_stagedCount{ 0 };
+    std::atomic<uint64_t>              m_stagedBytes{ 0 };
 
 }; // class Allocator
 
@@ -0,0 +1,181 @@
+/*
+ *
+ * Andrew Frost
+ * bufferarena.cpp
+ * 2020
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include "bufferarena.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// BufferArena                                                           //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void BufferArena::init(vk::Device device, vk::PhysicalDevice physicalDevice, VmaAllocator allocator,
+                       vk::DeviceSize chunkSize, vk::BufferUsageFlags usage)
+{
+    assert(!m_device);
+    m_device    = device;
+    m_allocator = allocator;
+    m_usage     = usage | vk::BufferUsageFlagBits::eTransferDst;
+    m_chunkSize = tools::TTlsfAllocator<GRANULARITY>::alignedSize(static_cast<uint32_t>(chunkSize));
+
+    // one alignment serves both descriptor types
+    const vk::PhysicalDeviceLimits limits = physicalDevice.getProperties().limits;
+    m_alignment = (std::max)({ m_alignment, limits.minStorageBufferOffsetAlignment, limits.minUniformBufferOffsetAlignment });
+
+    m_stats = Stats();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void BufferArena::deinit()
+{
+    if (!m_device)
+        return;
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_chunks.size()); i++) {
+        assert(!m_chunks[i].slices && "buffer slice not freed");
+        if (m_chunks[i].buffer)
+            destroyChunk(i);
+    }
+    m_chunks.clear();
+
+    m_stats  = Stats();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t BufferArena::createChunk(vk::DeviceSize size)
+{
+    Chunk chunk;
+    chunk.size = size;
+
+    VkBufferCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.usage = static_cast<VkBufferUsageFlags>(m_usage);
+    createInfo.size  = size;
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VkResult result = vmaCreateBuffer(m_allocator, &createInfo, &allocInfo,
+        reinterpret_cast<VkBuffer*>(&chunk.buffer), &chunk.allocation, nullptr);
+    if (result != VK_SUCCESS)
+        throw std::runtime_error("failed to create buffer arena chunk!");
+
+    chunk.range.init(static_cast<uint32_t>(size));
+
+    m_stats.chunkCount++;
+    m_stats.chunkBytes += size;
+
+    // recycle a freed slot
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_chunks.size()); i++) {
+        if (!m_chunks[i].buffer) {
+            m_chunks[i] = chunk;
+            return i;
+        }
+    }
+    m_chunks.push_back(chunk);
+    return static_cast<uint32_t>(m_chunks.size() - 1);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void BufferArena::destroyChunk(uint32_t chunkID)
+{
+    Chunk& chunk = m_chunks[chunkID];
+    vmaDestroyBuffer(m_allocator, static_cast<VkBuffer>(chunk.buffer), chunk.allocation);
+
+    m_stats.chunkCount--;
+    m_stats.chunkBytes -= chunk.size;
+    chunk = Chunk();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+BufferSlice BufferArena::allocate(vk::DeviceSize size)
+{
+    assert(m_device);
+    assert(size && "empty buffer slice");
+
+    const uint32_t size32  = static_cast<uint32_t>(size);
+    const uint32_t align32 = static_cast<uint32_t>(m_alignment);
+
+    uint32_t chunkID    = ~0u;
+    uint32_t outOffset  = 0;
+    uint32_t outAligned = 0;
+    uint32_t outSize    = 0;
+
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_chunks.size()); i++) {
+        if (m_chunks[i].buffer && m_chunks[i].range.subAllocate(size32, align32, outOffset, outAligned, outSize)) {
+            chunkID = i;
+            break;
+        }
+    }
+
+    if (chunkID == ~0u) {
+        // oversized slices get their own chunk, with room for the alignment
+        vk::DeviceSize chunkSize = m_chunkSize;
+        if (size + m_alignment > chunkSize)
+            chunkSize = tools::TTlsfAllocator<GRANULARITY>::alignedSize(size32 + align32);
+
+        chunkID = createChunk(chunkSize);
+        if (!m_chunks[chunkID].range.subAllocate(size32, align32, outOffset, outAligned, outSize))
+            throw std::runtime_error("failed to allocate buffer slice!");
+    }
+
+    Chunk& chunk = m_chunks[chunkID];
+    chunk.slices++;
+
+    m_stats.sliceCount++;
+    m_stats.usedBytes += outSize;
+
+    BufferSlice slice;
+    slice.buffer      = chunk.buffer;
+    slice.offset      = outAligned;
+    slice.range       = size;
+    slice.chunkID     = chunkID;
+    slice.allocOffset = outOffset;
+    slice.allocSize   = outSize;
+    return slice;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void BufferArena::free(BufferSlice& slice)
+{
+    if (slice.chunkID == ~0u)
+        return;
+
+    Chunk& chunk = m_chunks[slice.chunkID];
+    assert(chunk.buffer == slice.buffer);
+    chunk.range.subFree(slice.allocOffset, slice.allocSize);
+    chunk.slices--;
+
+    m_stats.sliceCount--;
+    m_stats.usedBytes -= slice.allocSize;
+
+    // keep one chunk around for the next slices
+    if (!chunk.slices && m_stats.chunkCount > 1)
+        destroyChunk(slice.chunkID);
+
+    slice = BufferSlice();
+}
+
+} // namespace app
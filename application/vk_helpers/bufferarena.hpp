@@ -0,0 +1,113 @@
+/*
+ *
+ * Andrew Frost
+ * bufferarena.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "../external/vk_mem_alloc.h"
+#include "../general_helpers/tlsfallocator.hpp"
+
+namespace app {
+
+#define APP_DEFAULT_ARENA_CHUNK_SIZE (VkDeviceSize(1) * 1024 * 1024)
+
+//-------------------------------------------------------------------------
+// Range of a shared device buffer, bound with offset / range
+//
+struct BufferSlice
+{
+    vk::Buffer     buffer;
+    vk::DeviceSize offset{ 0 };
+    vk::DeviceSize range{ 0 };
+
+    uint32_t       chunkID{ ~0u };
+    uint32_t       allocOffset{ 0 };   // range given back to the chunk
+    uint32_t       allocSize{ 0 };
+
+    vk::DescriptorBufferInfo getDescriptorInfo() const { return { buffer, offset, range }; }
+};
+
+///////////////////////////////////////////////////////////////////////////
+// BufferArena                                                           //
+///////////////////////////////////////////////////////////////////////////
+// Small storage / uniform data (materials, scene description, camera)   //
+// packed in a few large device buffers instead of one allocation each   //
+// - chunks of chunkSize bytes, sub-allocated with TTlsfAllocator at the //
+//   device's storage and uniform offset alignment                       //
+// - slices larger than a chunk get a chunk of their own                 //
+// - chunks left empty are freed, the first one is kept                  //
+// Chunks are not tracked by MemoryStats, the Allocator reports slices   //
+///////////////////////////////////////////////////////////////////////////
+
+class BufferArena
+{
+public:
+    struct Stats
+    {
+        uint32_t       chunkCount = 0;
+        uint32_t       sliceCount = 0;
+        vk::DeviceSize chunkBytes = 0;
+        vk::DeviceSize usedBytes  = 0;   // alignment padding included
+    };
+
+    BufferArena(BufferArena const&) = delete;
+    BufferArena& operator=(BufferArena const&) = delete;
+
+    BufferArena() {}
+    ~BufferArena() { deinit(); }
+
+    void init(vk::Device device, vk::PhysicalDevice physicalDevice, VmaAllocator allocator,
+              vk::DeviceSize chunkSize = APP_DEFAULT_ARENA_CHUNK_SIZE,
+              vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eUniformBuffer);
+
+    // every slice must be freed, GPU must be idle
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Slice of at least size bytes, offset aligned for storage and uniform
+    // descriptors. The content is undefined
+    //
+    BufferSlice allocate(vk::DeviceSize size);
+
+    //-------------------------------------------------------------------------
+    // The GPU must be done with the slice, like Allocator::destroy
+    //
+    void free(BufferSlice& slice);
+
+    vk::DeviceSize getAlignment() const { return m_alignment; }
+    const Stats&   getStats() const { return m_stats; }
+
+private:
+    static const uint32_t GRANULARITY = 256;
+
+    struct Chunk
+    {
+        vk::Buffer                          buffer;
+        VmaAllocation                       allocation = nullptr;
+        vk::DeviceSize                      size       = 0;
+        uint32_t                            slices     = 0;
+        tools::TTlsfAllocator<GRANULARITY>  range;
+    };
+
+    uint32_t createChunk(vk::DeviceSize size);
+    void     destroyChunk(uint32_t chunkID);
+
+    vk::Device           m_device;
+    VmaAllocator         m_allocator{ nullptr };
+    vk::BufferUsageFlags m_usage;
+    vk::DeviceSize       m_chunkSize{ 0 };
+    vk::DeviceSize       m_alignment{ 16 };
+
+    std::vector<Chunk>   m_chunks;   // freed chunks keep their slot, buffer is null
+    Stats                m_stats;
+
+}; // class BufferArena
+
+} // namespace app
@@ -11,6 +11,8 @@
 #include <iostream>
 #include <vulkan/vulkan.hpp>
 
+#include "timeline.hpp"
+
 ///////////////////////////////////////////////////////////////////////////
 // SingleCommandBuffer                                                   //
 ///////////////////////////////////////////////////////////////////////////
@@ -166,6 +168,25 @@ public:
     
     void submitAndWait(vk::CommandBuffer cmd) { submitAndWait(1, &cmd, m_queue); }
 
+    //-------------------------------------------------------------------------
+    // ends and submits to the default queue through the timeline, only waits
+    // for this submission instead of the whole queue, then destroys cmds
+    //
+    uint64_t submitAndWait(size_t count, const vk::CommandBuffer* commands, Timeline& timeline)
+    {
+        for (size_t i = 0; i < count; i++) {
+            commands[i].end();
+        }
+
+        uint64_t value = timeline.submit(m_queue, static_cast<uint32_t>(count), commands);
+        timeline.wait(value);
+
+        m_device.freeCommandBuffers(m_commandPool, (uint32_t)count, commands);
+        return value;
+    }
+
+    uint64_t submitAndWait(vk::CommandBuffer cmd, Timeline& timeline) { return submitAndWait(1, &cmd, timeline); }
+
     vk::CommandPool getCommandPool() const { return m_commandPool; }
 private:
     vk::Device        m_device      = nullptr;
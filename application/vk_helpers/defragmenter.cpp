@@ -0,0 +1,235 @@
+/*
+ *
+ * Andrew Frost
+ * defragmenter.cpp
+ * 2020
+ *
+ */
+
+#include <cassert>
+#include <stdexcept>
+#include "commands.hpp"
+#include "defragmenter.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// Defragmenter                                                          //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void Defragmenter::init(vk::Device device, VmaAllocator allocator, Timeline* timeline, uint32_t queueFamilyIndex,
+                        vk::DeviceSize maxBytesPerStep, uint32_t maxMovesPerStep)
+{
+    assert(!m_device);
+    assert(timeline);
+
+    m_device           = device;
+    m_allocator        = allocator;
+    m_timeline         = timeline;
+    m_queueFamilyIndex = queueFamilyIndex;
+    m_maxBytesPerStep  = maxBytesPerStep;
+    m_maxMovesPerStep  = maxMovesPerStep;
+    m_runRequested     = false;
+    m_running          = false;
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats = Stats();
+}
+
+//-------------------------------------------------------------------------
+// Registered buffers are owned by the application
+//
+void Defragmenter::deinit()
+{
+    if (!m_device)
+        return;
+
+    m_entries.clear();
+    m_freeEntry = INVALID_ID;
+    m_allocations.clear();
+    m_allocationIDs.clear();
+    m_changed.clear();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t Defragmenter::add(VmaAllocation allocation, vk::Buffer buffer, const vk::BufferCreateInfo& createInfo,
+                           std::function<void(vk::Buffer)> onMoved)
+{
+    uint32_t id;
+    if (m_freeEntry != INVALID_ID) {
+        id          = m_freeEntry;
+        m_freeEntry = m_entries[id].nextFree;
+    }
+    else {
+        id = static_cast<uint32_t>(m_entries.size());
+        m_entries.emplace_back();
+    }
+
+    Entry& entry     = m_entries[id];
+    entry.allocation = allocation;
+    entry.buffer     = buffer;
+    entry.createInfo = createInfo;
+    entry.onMoved    = std::move(onMoved);
+    entry.nextFree   = INVALID_ID;
+    entry.active     = true;
+    return id;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void Defragmenter::remove(uint32_t id)
+{
+    if (id == INVALID_ID)
+        return;
+
+    Entry& entry = m_entries[id];
+    assert(entry.active);
+    entry          = Entry();
+    entry.nextFree = m_freeEntry;
+    m_freeEntry    = id;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+Defragmenter::Fragmentation Defragmenter::measure() const
+{
+    VmaStats vmaStats = {};
+    vmaCalculateStats(m_allocator, &vmaStats);
+
+    Fragmentation result      = {};
+    result.usedBytes          = vmaStats.total.usedBytes;
+    result.unusedBytes        = vmaStats.total.unusedBytes;
+    result.largestUnusedRange = vmaStats.total.unusedRangeCount ? vmaStats.total.unusedRangeSizeMax : 0;
+    result.blockCount         = vmaStats.total.blockCount;
+    result.allocationCount    = vmaStats.total.allocationCount;
+    result.unusedRangeCount   = vmaStats.total.unusedRangeCount;
+    result.ratio              = result.unusedBytes ?
+        1.0f - float(double(result.largestUnusedRange) / double(result.unusedBytes)) : 0.0f;
+    return result;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool Defragmenter::step()
+{
+    if (!m_running) {
+        if (!m_runRequested.exchange(false))
+            return false;
+
+        m_running = true;
+        Fragmentation before = measure();
+
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_stats.before  = before;
+        m_stats.running = true;
+        m_stats.runs++;
+    }
+
+    m_allocations.clear();
+    m_allocationIDs.clear();
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_entries.size()); i++) {
+        if (m_entries[i].active) {
+            m_allocations.push_back(m_entries[i].allocation);
+            m_allocationIDs.push_back(i);
+        }
+    }
+    m_changed.assign(m_allocations.size(), VK_FALSE);
+
+    VmaDefragmentationStats defragStats = {};
+    if (!m_allocations.empty()) {
+        CommandPool       cmdPool(m_device, m_queueFamilyIndex);
+        vk::CommandBuffer cmdBuffer = cmdPool.createBuffer();
+
+        // frames in flight may still read the ranges written by the copies
+        vk::MemoryBarrier barrier = {};
+        barrier.srcAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+            vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+        // GPU copies only, CPU moves would race the frames in flight
+        VmaDefragmentationInfo2 defragInfo = {};
+        defragInfo.allocationCount         = static_cast<uint32_t>(m_allocations.size());
+        defragInfo.pAllocations            = m_allocations.data();
+        defragInfo.pAllocationsChanged     = m_changed.data();
+        defragInfo.maxCpuBytesToMove       = 0;
+        defragInfo.maxCpuAllocationsToMove = 0;
+        defragInfo.maxGpuBytesToMove       = m_maxBytesPerStep;
+        defragInfo.maxGpuAllocationsToMove = m_maxMovesPerStep;
+        defragInfo.commandBuffer           = cmdBuffer;
+
+        VmaDefragmentationContext context = nullptr;
+        VkResult result = vmaDefragmentationBegin(m_allocator, &defragInfo, &defragStats, &context);
+        if (result < 0) {
+            cmdPool.submitAndWait(cmdBuffer, *m_timeline);
+            throw std::runtime_error("failed to begin defragmentation!");
+        }
+
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+            vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+        // queued behind the frames in flight, the GPU is idle after it
+        cmdPool.submitAndWait(cmdBuffer, *m_timeline);
+        vmaDefragmentationEnd(m_allocator, context);
+    }
+
+    // rebind, the data is already at the new place
+    for (size_t i = 0; i < m_allocations.size(); i++) {
+        if (!m_changed[i])
+            continue;
+
+        Entry& entry = m_entries[m_allocationIDs[i]];
+        m_device.destroyBuffer(entry.buffer);
+        try {
+            entry.buffer = m_device.createBuffer(entry.createInfo);
+        }
+        catch (vk::SystemError err) {
+            throw std::runtime_error("failed to recreate defragmented buffer!");
+        }
+        m_device.getBufferMemoryRequirements(entry.buffer);   // expected before binding by the validation layers
+        vmaBindBufferMemory(m_allocator, entry.allocation, entry.buffer);
+
+        entry.onMoved(entry.buffer);
+    }
+
+    const bool moved = defragStats.allocationsMoved != 0;
+    if (!moved)
+        m_running = false;
+
+    Fragmentation after;
+    if (!m_running)
+        after = measure();
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats.steps++;
+    m_stats.allocationsMoved += defragStats.allocationsMoved;
+    m_stats.bytesMoved       += defragStats.bytesMoved;
+    m_stats.bytesFreed       += defragStats.bytesFreed;
+    m_stats.blocksFreed      += defragStats.deviceMemoryBlocksFreed;
+    m_stats.running           = m_running;
+    if (!m_running)
+        m_stats.after = after;
+    return moved;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+Defragmenter::Stats Defragmenter::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_stats;
+}
+
+} // namespace app
@@ -0,0 +1,134 @@
+/*
+ *
+ * Andrew Frost
+ * defragmenter.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "../external/vk_mem_alloc.h"
+#include "timeline.hpp"
+
+namespace app {
+
+#define APP_DEFAULT_DEFRAG_BYTES_PER_STEP (VkDeviceSize(16) * 1024 * 1024)
+
+///////////////////////////////////////////////////////////////////////////
+// Defragmenter                                                          //
+///////////////////////////////////////////////////////////////////////////
+// Incremental compaction of VMA heaps, for long sessions loading and    //
+// unloading models                                                      //
+// - buffers are registered with their create info and a callback        //
+//   receiving the new handle once moved                                 //
+// - a run is a sequence of steps, one per frame at most, each moving at //
+//   most maxBytesPerStep on the GPU through VMA's defragmentation; the  //
+//   run ends on the first step that moves nothing                       //
+// - a step waits for its copies, so the GPU is idle when callbacks run  //
+//   and descriptors can be updated in place                             //
+// Images are not registered, VMA can only move linear images            //
+///////////////////////////////////////////////////////////////////////////
+
+class Defragmenter
+{
+public:
+    struct Fragmentation
+    {
+        vk::DeviceSize usedBytes          = 0;
+        vk::DeviceSize unusedBytes        = 0;
+        vk::DeviceSize largestUnusedRange = 0;
+        uint32_t       blockCount         = 0;
+        uint32_t       allocationCount    = 0;
+        uint32_t       unusedRangeCount   = 0;
+        float          ratio              = 0.0f;   // 1 - largest free range / free bytes
+    };
+
+    struct Stats
+    {
+        Fragmentation  before;                 // of the last run
+        Fragmentation  after;
+        uint32_t       runs             = 0;
+        uint32_t       steps            = 0;
+        uint32_t       allocationsMoved = 0;
+        vk::DeviceSize bytesMoved       = 0;
+        vk::DeviceSize bytesFreed       = 0;
+        uint32_t       blocksFreed      = 0;
+        bool           running          = false;
+    };
+
+    static const uint32_t INVALID_ID = ~0u;
+
+    Defragmenter(Defragmenter const&) = delete;
+    Defragmenter& operator=(Defragmenter const&) = delete;
+
+    Defragmenter() {}
+    ~Defragmenter() { deinit(); }
+
+    void init(vk::Device device, VmaAllocator allocator, Timeline* timeline, uint32_t queueFamilyIndex,
+              vk::DeviceSize maxBytesPerStep = APP_DEFAULT_DEFRAG_BYTES_PER_STEP, uint32_t maxMovesPerStep = 64);
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // onMoved gets the new buffer, the old one is already destroyed
+    //
+    uint32_t add(VmaAllocation allocation, vk::Buffer buffer, const vk::BufferCreateInfo& createInfo,
+                 std::function<void(vk::Buffer)> onMoved);
+    void     remove(uint32_t id);
+
+    // safe from any thread, the run starts with the next step
+    void requestRun() { m_runRequested = true; }
+
+    //-------------------------------------------------------------------------
+    // Once per frame, outside of command buffer recording. Returns true
+    // when buffers were moved
+    //
+    bool step();
+
+    // vmaCalculateStats, not meant for every frame
+    Fragmentation measure() const;
+
+    // copy, safe from another thread
+    Stats getStats() const;
+
+private:
+    struct Entry
+    {
+        VmaAllocation                   allocation = nullptr;
+        vk::Buffer                      buffer;
+        vk::BufferCreateInfo            createInfo;
+        std::function<void(vk::Buffer)> onMoved;
+        uint32_t                        nextFree   = INVALID_ID;
+        bool                            active     = false;
+    };
+
+    vk::Device                 m_device;
+    VmaAllocator               m_allocator{ nullptr };
+    Timeline*                  m_timeline{ nullptr };
+    uint32_t                   m_queueFamilyIndex{ 0 };
+    vk::DeviceSize             m_maxBytesPerStep{ 0 };
+    uint32_t                   m_maxMovesPerStep{ 0 };
+
+    std::vector<Entry>         m_entries;
+    uint32_t                   m_freeEntry{ INVALID_ID };
+
+    std::atomic<bool>          m_runRequested{ false };
+    bool                       m_running{ false };
+
+    // scratch, capacity is kept between steps
+    std::vector<VmaAllocation> m_allocations;
+    std::vector<uint32_t>      m_allocationIDs;
+    std::vector<VkBool32>      m_changed;
+
+    mutable std::mutex         m_statsMutex;
+    Stats                      m_stats;
+
+}; // class Defragmenter
+
+} // namespace app
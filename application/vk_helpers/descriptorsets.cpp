@@ -6,6 +6,11 @@
  *
  */
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
 #include "descriptorsets.hpp"
 
 namespace app {
@@ -69,16 +74,22 @@ uint32_t DescriptorSetBindings::getCount(uint32_t binding) const
 //
 vk::DescriptorSetLayout DescriptorSetBindings::createLayout(vk::Device device, vk::DescriptorSetLayoutCreateFlags flags) const
 {
+    // one flag per binding, the ones set before the last binding was added
+    // are padded
+    std::vector<vk::DescriptorBindingFlags> bindingFlags = m_bindingFlags;
+    if (!bindingFlags.empty())
+        bindingFlags.resize(m_bindings.size(), vk::DescriptorBindingFlags());
+
     vk::DescriptorSetLayoutBindingFlagsCreateInfo extendedInfo{};
     extendedInfo.pNext         = nullptr;
-    extendedInfo.bindingCount  = static_cast<uint32_t>(m_bindingFlags.size());
-    extendedInfo.pBindingFlags = m_bindingFlags.data();
+    extendedInfo.bindingCount  = static_cast<uint32_t>(bindingFlags.size());
+    extendedInfo.pBindingFlags = bindingFlags.data();
 
     vk::DescriptorSetLayoutCreateInfo layoutCreateInfo = {};
     layoutCreateInfo.bindingCount = static_cast<uint32_t>(m_bindings.size());
     layoutCreateInfo.pBindings    = m_bindings.data();
     layoutCreateInfo.flags        = flags;
-    layoutCreateInfo.pNext        = m_bindingFlags.empty() ? nullptr : &extendedInfo;
+    layoutCreateInfo.pNext        = bindingFlags.empty() ? nullptr : &extendedInfo;
 
     try {
         vk::DescriptorSetLayout layout = device.createDescriptorSetLayout(layoutCreateInfo);
@@ -93,7 +104,8 @@ vk::DescriptorSetLayout DescriptorSetBindings::createLayout(vk::Device device, v
 // generates the descriptor pool with enough space to handle all the 
 // bound resources and allocate up to maxSets descriptor sets
 //
-vk::DescriptorPool DescriptorSetBindings::createPool(vk::Device device, uint32_t maxSets) const
+vk::DescriptorPool DescriptorSetBindings::createPool(vk::Device device, uint32_t maxSets,
+                                                     vk::DescriptorPoolCreateFlags flags) const
 {
     // Aggregate the bindings to obtain the required size of the descriptors using that layout
     std::vector<vk::DescriptorPoolSize> poolSizes;
@@ -107,6 +119,7 @@ vk::DescriptorPool DescriptorSetBindings::createPool(vk::Device device, uint32_t
     poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolCreateInfo.pPoolSizes    = poolSizes.data();
     poolCreateInfo.maxSets       = maxSets;
+    poolCreateInfo.flags         = flags;
 
     try {
         vk::DescriptorPool pool = device.createDescriptorPool(poolCreateInfo);
@@ -143,6 +156,23 @@ void DescriptorSetBindings::addRequiredPoolSizes(std::vector<vk::DescriptorPoolS
     }
 }
 
+//-------------------------------------------------------------------------
+// Update template entry
+//
+vk::DescriptorUpdateTemplateEntry DescriptorSetBindings::makeTemplateEntry(uint32_t dstBinding, size_t offset,
+    size_t stride, uint32_t arrayElement, uint32_t count) const
+{
+    for (size_t i = 0; i < m_bindings.size(); i++) {
+        if (m_bindings[i].binding == dstBinding) {
+            if (count == ~0u)
+                count = m_bindings[i].descriptorCount - arrayElement;
+            return { dstBinding, arrayElement, count, m_bindings[i].descriptorType, offset, stride };
+        }
+    }
+    assert(0 && "binding not found");
+    return {};
+}
+
 //-------------------------------------------------------------------------
 // Write Descriptor Sets 
 //
@@ -295,4 +325,555 @@ vk::WriteDescriptorSet DescriptorSetBindings::makeWriteArray(vk::DescriptorSet d
 }
 
 
-} // namespace app
\ No newline at end of file
+///////////////////////////////////////////////////////////////////////////
+// DescriptorLayoutCache                                                 //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void DescriptorLayoutCache::deinit()
+{
+    if (!m_device)
+        return;
+
+    for (const auto& it : m_layouts)
+        m_device.destroy(it.second);
+    m_layouts.clear();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Bindings are compared in binding order, so the order they were added
+// in does not create a second layout
+//
+vk::DescriptorSetLayout DescriptorLayoutCache::getLayout(const DescriptorSetBindings& bindings,
+                                                         vk::DescriptorSetLayoutCreateFlags flags)
+{
+    assert(m_device);
+
+    const std::vector<vk::DescriptorSetLayoutBinding>& srcBindings = bindings.getBindings();
+    const std::vector<vk::DescriptorBindingFlags>&     srcFlags    = bindings.getBindingFlags();
+
+    std::vector<size_t> order(srcBindings.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return srcBindings[a].binding < srcBindings[b].binding; });
+
+    LayoutKey key;
+    key.flags = flags;
+    bool hasFlags = false;
+    for (size_t i : order) {
+        vk::DescriptorSetLayoutBinding binding = srcBindings[i];
+        if (binding.pImmutableSamplers) {
+            key.samplers.insert(key.samplers.end(), binding.pImmutableSamplers,
+                                binding.pImmutableSamplers + binding.descriptorCount);
+            binding.pImmutableSamplers = nullptr;
+        }
+        key.bindings.push_back(binding);
+
+        vk::DescriptorBindingFlags bindingFlags = i < srcFlags.size() ? srcFlags[i] : vk::DescriptorBindingFlags();
+        key.bindingFlags.push_back(bindingFlags);
+        hasFlags |= bool(bindingFlags);
+    }
+    if (!hasFlags)
+        key.bindingFlags.clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_layouts.find(key);
+    if (it != m_layouts.end())
+        return it->second;
+
+    vk::DescriptorSetLayout layout = bindings.createLayout(m_device, flags);
+    m_layouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t DescriptorLayoutCache::getLayoutCount() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<uint32_t>(m_layouts.size());
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool DescriptorLayoutCache::LayoutKey::operator==(const LayoutKey& other) const
+{
+    return flags == other.flags && bindings == other.bindings && bindingFlags == other.bindingFlags
+        && samplers == other.samplers;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+std::size_t DescriptorLayoutCache::HashFn::operator()(const LayoutKey& key) const
+{
+    std::hash<uint64_t> hasher;
+    size_t              seed = 0;
+    // https://www.boost.org/doc/libs/1_35_0/doc/html/boost/hash_combine_id241013.html
+    auto combine = [&](uint64_t value) { seed ^= hasher(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2); };
+
+    combine(static_cast<VkDescriptorSetLayoutCreateFlags>(key.flags));
+    for (const auto& binding : key.bindings) {
+        combine(binding.binding);
+        combine(static_cast<uint64_t>(binding.descriptorType));
+        combine(binding.descriptorCount);
+        combine(static_cast<VkShaderStageFlags>(binding.stageFlags));
+    }
+    for (const auto& flags : key.bindingFlags)
+        combine(static_cast<VkDescriptorBindingFlags>(flags));
+    for (const auto& sampler : key.samplers)
+        combine((uint64_t)static_cast<VkSampler>(sampler));
+    return seed;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// DescriptorAllocator                                                   //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void DescriptorAllocator::init(vk::Device device, uint32_t setsPerPool, const std::vector<PoolSizeRatio>& ratios,
+                               vk::DescriptorPoolCreateFlags flags)
+{
+    assert(!m_device);
+    m_device      = device;
+    m_setsPerPool = setsPerPool;
+    m_ratios      = ratios;
+    m_flags       = flags;
+    m_current     = 0;
+    m_stats       = Stats();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void DescriptorAllocator::deinit()
+{
+    if (!m_device)
+        return;
+
+    for (auto pool : m_pools)
+        m_device.destroy(pool);
+    m_pools.clear();
+
+    m_stats  = Stats();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Descriptors per set, generous for the types a scene set uses
+//
+const std::vector<DescriptorAllocator::PoolSizeRatio>& DescriptorAllocator::getDefaultRatios()
+{
+    static const std::vector<PoolSizeRatio> ratios = {
+        { vk::DescriptorType::eSampler,              0.5f },
+        { vk::DescriptorType::eCombinedImageSampler, 4.0f },
+        { vk::DescriptorType::eSampledImage,         4.0f },
+        { vk::DescriptorType::eStorageImage,         1.0f },
+        { vk::DescriptorType::eUniformTexelBuffer,   1.0f },
+        { vk::DescriptorType::eStorageTexelBuffer,   1.0f },
+        { vk::DescriptorType::eUniformBuffer,        2.0f },
+        { vk::DescriptorType::eStorageBuffer,        2.0f },
+        { vk::DescriptorType::eUniformBufferDynamic, 1.0f },
+        { vk::DescriptorType::eStorageBufferDynamic, 1.0f },
+        { vk::DescriptorType::eInputAttachment,      0.5f },
+    };
+    return ratios;
+}
+
+//-------------------------------------------------------------------------
+// Sized from the ratios, plus one set of bindings when given. The next
+// pool holds twice as many sets
+//
+vk::DescriptorPool DescriptorAllocator::createPool(const DescriptorSetBindings* bindings)
+{
+    std::vector<vk::DescriptorPoolSize> poolSizes;
+    for (const auto& ratio : m_ratios)
+        poolSizes.emplace_back(ratio.type, (std::max)(1u, uint32_t(ratio.ratio * float(m_setsPerPool))));
+    if (bindings)
+        bindings->addRequiredPoolSizes(poolSizes, 1);
+
+    vk::DescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolCreateInfo.pPoolSizes    = poolSizes.data();
+    poolCreateInfo.maxSets       = m_setsPerPool;
+    poolCreateInfo.flags         = m_flags;
+
+    vk::DescriptorPool pool;
+    try {
+        pool = m_device.createDescriptorPool(poolCreateInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    m_setsPerPool = (std::min)(m_setsPerPool * 2, uint32_t(APP_MAX_DESCRIPTOR_POOL_SETS));
+    m_stats.poolCount++;
+    m_stats.poolsCreated++;
+    return pool;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::DescriptorSet DescriptorAllocator::allocate(vk::DescriptorSetLayout layout, const DescriptorSetBindings* bindings,
+                                                uint32_t variableCount)
+{
+    assert(m_device);
+
+    vk::DescriptorSetVariableDescriptorCountAllocateInfoEXT variableInfo = {};
+    variableInfo.descriptorSetCount = 1;
+    variableInfo.pDescriptorCounts  = &variableCount;
+
+    vk::DescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts        = &layout;
+    allocInfo.pNext              = variableCount ? &variableInfo : nullptr;
+
+    vk::DescriptorSet set;
+    vk::Result        result = vk::Result::eSuccess;
+    bool              fresh  = false;
+
+    // full pools are left behind until reset()
+    for (;; m_current++) {
+        fresh = m_current == m_pools.size();
+        if (fresh)
+            m_pools.push_back(createPool(nullptr));
+
+        allocInfo.descriptorPool = m_pools[m_current];
+        result = m_device.allocateDescriptorSets(&allocInfo, &set);
+        if (result == vk::Result::eSuccess) {
+            m_stats.setCount++;
+            return set;
+        }
+        if (result != vk::Result::eErrorOutOfPoolMemory && result != vk::Result::eErrorFragmentedPool)
+            throw std::runtime_error("failed to allocate descriptor set!");
+        if (fresh)
+            break;
+    }
+
+    // does not fit an empty pool, size one for it
+    if (!bindings)
+        throw std::runtime_error("descriptor set larger than a descriptor pool!");
+
+    m_device.destroy(m_pools[m_current]);
+    m_stats.poolCount--;
+    m_pools[m_current] = createPool(bindings);
+
+    allocInfo.descriptorPool = m_pools[m_current];
+    result = m_device.allocateDescriptorSets(&allocInfo, &set);
+    if (result != vk::Result::eSuccess)
+        throw std::runtime_error("failed to allocate descriptor set!");
+
+    m_stats.setCount++;
+    return set;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void DescriptorAllocator::reset()
+{
+    for (auto pool : m_pools)
+        m_device.resetDescriptorPool(pool);
+
+    m_current = 0;
+    m_stats.setCount = 0;
+    m_stats.resets++;
+}
+
+///////////////////////////////////////////////////////////////////////////
+// DescriptorSetContainer                                                //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void DescriptorSetContainer::init(vk::Device device, Timeline* timeline, bool useUpdateTemplates, uint32_t frameCount)
+{
+    assert(!m_device);
+    assert(timeline && frameCount);
+
+    m_device       = device;
+    m_timeline     = timeline;
+    m_useTemplates = useUpdateTemplates;
+
+    m_layoutCache.init(device);
+    m_allocator.init(device);
+    m_updateAfterBindAllocator.init(device, APP_DEFAULT_DESCRIPTOR_POOL_SETS, DescriptorAllocator::getDefaultRatios(),
+                                    vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT);
+
+    m_frames = std::vector<Frame>(frameCount);
+    for (auto& frame : m_frames)
+        frame.allocator.init(device);
+    m_frameIndex   = 0;
+    m_frameStarted = false;
+
+    m_counters     = FrameCounters();
+    m_lastCounters = FrameCounters();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void DescriptorSetContainer::deinit()
+{
+    if (!m_device)
+        return;
+
+    for (const auto& updateTemplate : m_templates) {
+        if (updateTemplate.handle)
+            m_device.destroyDescriptorUpdateTemplateKHR(updateTemplate.handle);
+    }
+    m_templates.clear();
+
+    for (auto& frame : m_frames)
+        frame.allocator.deinit();
+    m_frames.clear();
+
+    m_allocator.deinit();
+    m_updateAfterBindAllocator.deinit();
+    m_updateAfterBindLayouts.clear();
+    m_layoutCache.deinit();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::DescriptorSetLayout DescriptorSetContainer::getLayout(const DescriptorSetBindings& bindings,
+                                                          vk::DescriptorSetLayoutCreateFlags flags)
+{
+    vk::DescriptorSetLayout layout = m_layoutCache.getLayout(bindings, flags);
+
+    // their sets need pools created with the same flag
+    if (flags & vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (std::find(m_updateAfterBindLayouts.begin(), m_updateAfterBindLayouts.end(), layout)
+            == m_updateAfterBindLayouts.end())
+            m_updateAfterBindLayouts.push_back(layout);
+    }
+    return layout;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::DescriptorSet DescriptorSetContainer::allocate(vk::DescriptorSetLayout layout, const DescriptorSetBindings* bindings,
+                                                   uint32_t variableCount)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (std::find(m_updateAfterBindLayouts.begin(), m_updateAfterBindLayouts.end(), layout)
+        != m_updateAfterBindLayouts.end())
+        return m_updateAfterBindAllocator.allocate(layout, bindings, variableCount);
+
+    return m_allocator.allocate(layout, bindings, variableCount);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::DescriptorSet DescriptorSetContainer::allocateFrame(vk::DescriptorSetLayout layout,
+                                                        const DescriptorSetBindings* bindings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    assert(m_frameStarted && "beginFrame missing");
+
+    m_counters.frameSets++;
+    return m_frames[m_frameIndex].allocator.allocate(layout, bindings);
+}
+
+//-------------------------------------------------------------------------
+// The wait rarely blocks, the swapchain already limits the frames in
+// flight
+//
+void DescriptorSetContainer::beginFrame()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_frameStarted) {
+        m_frames[m_frameIndex].timelineValue = m_timeline->getSubmittedValue();
+        m_frameIndex = (m_frameIndex + 1) % static_cast<uint32_t>(m_frames.size());
+
+        m_lastCounters = m_counters;
+        m_counters     = FrameCounters();
+    }
+    m_frameStarted = true;
+
+    Frame& frame = m_frames[m_frameIndex];
+    if (frame.timelineValue)
+        m_timeline->wait(frame.timelineValue);
+    frame.allocator.reset();
+}
+
+//-------------------------------------------------------------------------
+// Without VK_KHR_descriptor_update_template only the entries are kept,
+// update() turns them into writes
+//
+uint32_t DescriptorSetContainer::createUpdateTemplate(vk::DescriptorSetLayout layout,
+                                                      const std::vector<vk::DescriptorUpdateTemplateEntry>& entries)
+{
+    UpdateTemplate updateTemplate;
+    updateTemplate.entries = entries;
+
+    if (m_useTemplates) {
+        vk::DescriptorUpdateTemplateCreateInfo createInfo = {};
+        createInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+        createInfo.pDescriptorUpdateEntries   = entries.data();
+        createInfo.templateType               = vk::DescriptorUpdateTemplateType::eDescriptorSet;
+        createInfo.descriptorSetLayout        = layout;
+
+        try {
+            updateTemplate.handle = m_device.createDescriptorUpdateTemplateKHR(createInfo);
+        }
+        catch (vk::SystemError err) {
+            throw std::runtime_error("failed to create descriptor update template!");
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_templates.push_back(updateTemplate);
+    return static_cast<uint32_t>(m_templates.size() - 1);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void DescriptorSetContainer::update(vk::DescriptorSet set, uint32_t templateID, const void* data)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    assert(templateID < m_templates.size());
+
+    const UpdateTemplate& updateTemplate = m_templates[templateID];
+    if (updateTemplate.handle)
+        m_device.updateDescriptorSetWithTemplateKHR(set, updateTemplate.handle, data);
+    else
+        writeFromTemplate(set, updateTemplate, data);
+
+    m_counters.templateUpdates++;
+    for (const auto& entry : updateTemplate.entries)
+        m_counters.descriptorWrites += entry.descriptorCount;
+    m_counters.updateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void DescriptorSetContainer::update(const std::vector<vk::WriteDescriptorSet>& writes)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counters.writeUpdates++;
+    for (const auto& write : writes)
+        m_counters.descriptorWrites += write.descriptorCount;
+    m_counters.updateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//-------------------------------------------------------------------------
+// One write per entry when its infos are packed, one per descriptor
+// otherwise
+//
+void DescriptorSetContainer::writeFromTemplate(vk::DescriptorSet set, const UpdateTemplate& updateTemplate,
+                                               const void* data)
+{
+    std::vector<vk::WriteDescriptorSet> writes;
+
+    // image and buffer infos are both 24 bytes, the kind can't come from the size
+    enum class InfoKind
+    {
+        eImage,
+        eBuffer,
+        eTexelBufferView
+    };
+
+    for (const auto& entry : updateTemplate.entries) {
+        InfoKind kind;
+        size_t   infoSize = 0;
+        switch (entry.descriptorType) {
+        case vk::DescriptorType::eSampler:
+        case vk::DescriptorType::eCombinedImageSampler:
+        case vk::DescriptorType::eSampledImage:
+        case vk::DescriptorType::eStorageImage:
+        case vk::DescriptorType::eInputAttachment:
+            kind     = InfoKind::eImage;
+            infoSize = sizeof(vk::DescriptorImageInfo);
+            break;
+        case vk::DescriptorType::eUniformBuffer:
+        case vk::DescriptorType::eStorageBuffer:
+        case vk::DescriptorType::eUniformBufferDynamic:
+        case vk::DescriptorType::eStorageBufferDynamic:
+            kind     = InfoKind::eBuffer;
+            infoSize = sizeof(vk::DescriptorBufferInfo);
+            break;
+        case vk::DescriptorType::eUniformTexelBuffer:
+        case vk::DescriptorType::eStorageTexelBuffer:
+            kind     = InfoKind::eTexelBufferView;
+            infoSize = sizeof(vk::BufferView);
+            break;
+        default:
+            assert(0 && "descriptor type not supported by update templates");
+            continue;
+        }
+
+        const bool     packed = entry.stride == infoSize || entry.descriptorCount == 1;
+        const uint32_t count  = packed ? entry.descriptorCount : 1;
+        for (uint32_t i = 0; i < entry.descriptorCount; i += count) {
+            const void* info = static_cast<const uint8_t*>(data) + entry.offset + i * entry.stride;
+
+            vk::WriteDescriptorSet write = { set, entry.dstBinding, entry.dstArrayElement + i, count, entry.descriptorType };
+            switch (kind) {
+            case InfoKind::eImage:
+                write.pImageInfo = static_cast<const vk::DescriptorImageInfo*>(info);
+                break;
+            case InfoKind::eBuffer:
+                write.pBufferInfo = static_cast<const vk::DescriptorBufferInfo*>(info);
+                break;
+            case InfoKind::eTexelBufferView:
+                write.pTexelBufferView = static_cast<const vk::BufferView*>(info);
+                break;
+            }
+            writes.push_back(write);
+        }
+    }
+
+    m_device.updateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+DescriptorSetContainer::Stats DescriptorSetContainer::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Stats stats;
+    stats.layoutCount      = m_layoutCache.getLayoutCount();
+    stats.poolCount        = m_allocator.getStats().poolCount + m_updateAfterBindAllocator.getStats().poolCount;
+    stats.setCount         = m_allocator.getStats().setCount + m_updateAfterBindAllocator.getStats().setCount;
+    stats.templateCount    = static_cast<uint32_t>(m_templates.size());
+    stats.templatesEnabled = m_useTemplates;
+    for (const auto& frame : m_frames)
+        stats.poolCount += frame.allocator.getStats().poolCount;
+
+    stats.frameSets        = m_lastCounters.frameSets;
+    stats.templateUpdates  = m_lastCounters.templateUpdates;
+    stats.writeUpdates     = m_lastCounters.writeUpdates;
+    stats.descriptorWrites = m_lastCounters.descriptorWrites;
+    stats.updateMs         = m_lastCounters.updateMs;
+    return stats;
+}
+
+} // namespace app
@@ -9,9 +9,13 @@
 #pragma once
 
 #include <vector>
+#include <mutex>
+#include <unordered_map>
 #include <vulkan/vulkan.hpp>
 #include <iostream>
 
+#include "timeline.hpp"
+
 namespace app {
 
 ///////////////////////////////////////////////////////////////////////////
@@ -159,10 +163,23 @@ public:
     vk::DescriptorSetLayout createLayout( vk::Device device, 
         vk::DescriptorSetLayoutCreateFlags flags = vk::DescriptorSetLayoutCreateFlags()) const;
 
-    vk::DescriptorPool createPool(vk::Device device, uint32_t maxSets = 1) const;
+    vk::DescriptorPool createPool(vk::Device device, uint32_t maxSets = 1,
+        vk::DescriptorPoolCreateFlags flags = vk::DescriptorPoolCreateFlags()) const;
 
     void addRequiredPoolSizes(std::vector<vk::DescriptorPoolSize>& poolSizes, uint32_t numSets) const;
 
+    //-------------------------------------------------------------------------
+    // Update template entry for binding, the infos are read from the
+    // template data at offset, stride bytes apart. count = ~0 is the whole
+    // binding
+    //
+    vk::DescriptorUpdateTemplateEntry makeTemplateEntry(
+        uint32_t dstBinding,
+        size_t   offset,
+        size_t   stride,
+        uint32_t arrayElement = 0,
+        uint32_t count        = ~0u) const;
+
     //-------------------------------------------------------------------------
     // Write Descriptor Sets 
     //
@@ -232,16 +249,257 @@ public:
     vk::DescriptorType getType(uint32_t binding) const;
     uint32_t           getCount(uint32_t binding) const;
 
-    
+    const std::vector<vk::DescriptorSetLayoutBinding>& getBindings() const { return m_bindings; }
+    const std::vector<vk::DescriptorBindingFlags>&     getBindingFlags() const { return m_bindingFlags; }
 
 private:
     std::vector<vk::DescriptorSetLayoutBinding> m_bindings;
     std::vector<vk::DescriptorBindingFlags>     m_bindingFlags;
 };
 
+#define APP_DEFAULT_DESCRIPTOR_POOL_SETS     64
+#define APP_MAX_DESCRIPTOR_POOL_SETS         4096
+#define APP_DEFAULT_DESCRIPTOR_FRAME_COUNT   3
+
+///////////////////////////////////////////////////////////////////////////
+// DescriptorLayoutCache                                                 //
+///////////////////////////////////////////////////////////////////////////
+// One vk::DescriptorSetLayout per distinct set of bindings, flags and   //
+// immutable samplers, looked up by hash. Layouts live until deinit()    //
+///////////////////////////////////////////////////////////////////////////
+
+class DescriptorLayoutCache
+{
+public:
+    DescriptorLayoutCache(DescriptorLayoutCache const&) = delete;
+    DescriptorLayoutCache& operator=(DescriptorLayoutCache const&) = delete;
+
+    DescriptorLayoutCache() {}
+    ~DescriptorLayoutCache() { deinit(); }
+
+    void init(vk::Device device) { m_device = device; }
+    void deinit();
+
+    vk::DescriptorSetLayout getLayout(const DescriptorSetBindings& bindings,
+        vk::DescriptorSetLayoutCreateFlags flags = vk::DescriptorSetLayoutCreateFlags());
+
+    uint32_t getLayoutCount() const;
+
+private:
+    struct LayoutKey
+    {
+        vk::DescriptorSetLayoutCreateFlags          flags;
+        std::vector<vk::DescriptorSetLayoutBinding> bindings;      // sorted, pImmutableSamplers cleared
+        std::vector<vk::DescriptorBindingFlags>     bindingFlags;  // matches bindings
+        std::vector<vk::Sampler>                    samplers;      // immutable samplers, in binding order
+
+        bool operator==(const LayoutKey& other) const;
+    };
+
+    struct HashFn
+    {
+        std::size_t operator()(const LayoutKey& key) const;
+    };
+
+    vk::Device                                                    m_device;
+    std::unordered_map<LayoutKey, vk::DescriptorSetLayout, HashFn> m_layouts;
+    mutable std::mutex                                            m_mutex;
+
+}; // class DescriptorLayoutCache
+
+///////////////////////////////////////////////////////////////////////////
+// DescriptorAllocator                                                   //
+///////////////////////////////////////////////////////////////////////////
+// Sets from a growing list of pools, allocation does not fail once a    //
+// pool is full                                                          //
+// - pools are sized from per type ratios times the sets per pool, the   //
+//   sets per pool grow with each new pool up to a limit                 //
+// - a full or fragmented pool is put aside and the next one is taken    //
+// - reset() resets every pool in one call, they are reused in order     //
+// A set larger than a pool gets a pool sized for its bindings           //
+///////////////////////////////////////////////////////////////////////////
+
+class DescriptorAllocator
+{
+public:
+    struct PoolSizeRatio
+    {
+        vk::DescriptorType type;
+        float              ratio;   // descriptors per set
+    };
+
+    struct Stats
+    {
+        uint32_t poolCount    = 0;
+        uint32_t setCount     = 0;   // since the last reset
+        uint32_t poolsCreated = 0;
+        uint32_t resets       = 0;
+    };
+
+    DescriptorAllocator(DescriptorAllocator const&) = delete;
+    DescriptorAllocator& operator=(DescriptorAllocator const&) = delete;
+
+    DescriptorAllocator() {}
+    ~DescriptorAllocator() { deinit(); }
+
+    void init(vk::Device device, uint32_t setsPerPool = APP_DEFAULT_DESCRIPTOR_POOL_SETS,
+              const std::vector<PoolSizeRatio>& ratios = getDefaultRatios(),
+              vk::DescriptorPoolCreateFlags flags = vk::DescriptorPoolCreateFlags());
+
+    // the GPU must be done with every set
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // bindings, when known, size a dedicated pool for sets no pool fits.
+    // variableCount is the size of the layout's variable count binding
+    //
+    vk::DescriptorSet allocate(vk::DescriptorSetLayout layout, const DescriptorSetBindings* bindings = nullptr,
+                               uint32_t variableCount = 0);
+
+    //-------------------------------------------------------------------------
+    // Frees every set at once, the GPU must be done with them
+    //
+    void reset();
+
+    const Stats& getStats() const { return m_stats; }
+
+    static const std::vector<PoolSizeRatio>& getDefaultRatios();
+
+private:
+    vk::DescriptorPool createPool(const DescriptorSetBindings* bindings);
+    vk::DescriptorPool nextPool();
+
+    vk::Device                      m_device;
+    vk::DescriptorPoolCreateFlags   m_flags;
+    std::vector<PoolSizeRatio>      m_ratios;
+    uint32_t                        m_setsPerPool{ APP_DEFAULT_DESCRIPTOR_POOL_SETS };
+
+    std::vector<vk::DescriptorPool> m_pools;     // in the order they are used
+    uint32_t                        m_current{ 0 };
+    Stats                           m_stats;
+
+}; // class DescriptorAllocator
+
+///////////////////////////////////////////////////////////////////////////
+// DescriptorSetContainer                                                //
+///////////////////////////////////////////////////////////////////////////
+// Layouts, sets and updates of the application                          //
+// - layouts come from a DescriptorLayoutCache                           //
+// - allocate() sets that live until deinit(), from pools created with   //
+//   update after bind for layouts with eUpdateAfterBindPool             //
+// - allocateFrame() sets that live for one frame, each frame has its    //
+//   allocator, reset in beginFrame() once the timeline passed the last  //
+//   frame that used it                                                  //
+// - update templates write a whole set from one struct, plain writes    //
+//   are used when VK_KHR_descriptor_update_template is not enabled      //
+// - update count and CPU time are measured per frame                    //
+///////////////////////////////////////////////////////////////////////////
+
 class DescriptorSetContainer
 {
+public:
+    static const uint32_t INVALID_ID = ~0u;
 
-};
+    struct Stats
+    {
+        uint32_t layoutCount      = 0;
+        uint32_t poolCount        = 0;   // persistent and frame pools
+        uint32_t setCount         = 0;   // persistent sets
+        uint32_t templateCount    = 0;
+        bool     templatesEnabled = false;
+
+        // last completed frame
+        uint32_t frameSets        = 0;
+        uint32_t templateUpdates  = 0;
+        uint32_t writeUpdates     = 0;
+        uint32_t descriptorWrites = 0;
+        double   updateMs         = 0.0;
+    };
+
+    DescriptorSetContainer(DescriptorSetContainer const&) = delete;
+    DescriptorSetContainer& operator=(DescriptorSetContainer const&) = delete;
+
+    DescriptorSetContainer() {}
+    ~DescriptorSetContainer() { deinit(); }
+
+    void init(vk::Device device, Timeline* timeline, bool useUpdateTemplates,
+              uint32_t frameCount = APP_DEFAULT_DESCRIPTOR_FRAME_COUNT);
+
+    // the GPU must be idle
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Layouts and Sets
+    //
+    vk::DescriptorSetLayout getLayout(const DescriptorSetBindings& bindings,
+        vk::DescriptorSetLayoutCreateFlags flags = vk::DescriptorSetLayoutCreateFlags());
+
+    vk::DescriptorSet allocate(vk::DescriptorSetLayout layout, const DescriptorSetBindings* bindings = nullptr,
+                               uint32_t variableCount = 0);
+
+    // valid until the frame's commands completed
+    vk::DescriptorSet allocateFrame(vk::DescriptorSetLayout layout, const DescriptorSetBindings* bindings = nullptr);
+
+    //-------------------------------------------------------------------------
+    // Closes the frame submitted last and recycles the pools of the oldest
+    // one, called once per frame before allocateFrame()
+    //
+    void beginFrame();
+
+    //-------------------------------------------------------------------------
+    // Updates
+    //
+    uint32_t createUpdateTemplate(vk::DescriptorSetLayout layout,
+                                  const std::vector<vk::DescriptorUpdateTemplateEntry>& entries);
+
+    // data holds the infos at the offsets given to the template entries
+    void update(vk::DescriptorSet set, uint32_t templateID, const void* data);
+    void update(const std::vector<vk::WriteDescriptorSet>& writes);
+
+    Stats getStats() const;
+
+private:
+    struct UpdateTemplate
+    {
+        vk::DescriptorUpdateTemplate                   handle;
+        std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+    };
+
+    struct Frame
+    {
+        DescriptorAllocator allocator;
+        uint64_t            timelineValue = 0;
+    };
+
+    struct FrameCounters
+    {
+        uint32_t frameSets        = 0;
+        uint32_t templateUpdates  = 0;
+        uint32_t writeUpdates     = 0;
+        uint32_t descriptorWrites = 0;
+        double   updateMs         = 0.0;
+    };
+
+    void writeFromTemplate(vk::DescriptorSet set, const UpdateTemplate& updateTemplate, const void* data);
+
+    vk::Device                           m_device;
+    Timeline*                            m_timeline{ nullptr };
+    bool                                 m_useTemplates{ false };
+
+    DescriptorLayoutCache                m_layoutCache;
+    DescriptorAllocator                  m_allocator;
+    DescriptorAllocator                  m_updateAfterBindAllocator;
+    std::vector<vk::DescriptorSetLayout> m_updateAfterBindLayouts;
+    std::vector<Frame>                   m_frames;
+    uint32_t                             m_frameIndex{ 0 };
+    bool                                 m_frameStarted{ false };
+
+    std::vector<UpdateTemplate>          m_templates;
+
+    FrameCounters                        m_counters;     // frame being recorded
+    FrameCounters                        m_lastCounters;
+    mutable std::mutex                   m_mutex;
+
+}; // class DescriptorSetContainer
 
 } // namespace app
\ No newline at end of file
@@ -0,0 +1,172 @@
+/*
+ *
+ * Andrew Frost
+ * gputimer.cpp
+ * 2020
+ *
+ */
+
+#include <cassert>
+#include <stdexcept>
+#include "gputimer.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// GpuTimer                                                              //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Queries are only made when the queue writes timestamps
+//
+void GpuTimer::init(vk::Device device, vk::PhysicalDevice physicalDevice, uint32_t queueFamilyIndex,
+                    Timeline* timeline, uint32_t maxSections, uint32_t frameCount)
+{
+    assert(!m_device);
+    assert(timeline);
+    m_device       = device;
+    m_timeline     = timeline;
+    m_maxSections  = maxSections;
+    m_frameIndex   = 0;
+    m_frameStarted = false;
+    m_frames.assign(frameCount, Frame());
+
+    const uint32_t validBits = physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+    if (!validBits)
+        return;
+
+    m_validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    m_period    = physicalDevice.getProperties().limits.timestampPeriod;
+
+    vk::QueryPoolCreateInfo createInfo = {};
+    createInfo.queryType  = vk::QueryType::eTimestamp;
+    createInfo.queryCount = frameCount * maxSections * 2;
+
+    try {
+        m_queryPool = m_device.createQueryPool(createInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create timestamp query pool!");
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void GpuTimer::deinit()
+{
+    if (!m_device)
+        return;
+
+    if (m_queryPool)
+        m_device.destroyQueryPool(m_queryPool);
+    m_queryPool = nullptr;
+    m_frames.clear();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sections.clear();
+    m_timeline = nullptr;
+    m_device   = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// The frame reusing the range was submitted frameCount frames ago, the
+// wait is normally already satisfied by the swapchain's own pacing
+//
+void GpuTimer::beginFrame(vk::CommandBuffer cmdBuffer)
+{
+    if (!m_queryPool)
+        return;
+
+    if (m_frameStarted) {
+        m_frames[m_frameIndex].timelineValue = m_timeline->getSubmittedValue();
+        m_frameIndex = (m_frameIndex + 1) % static_cast<uint32_t>(m_frames.size());
+    }
+    m_frameStarted = true;
+
+    Frame& frame = m_frames[m_frameIndex];
+    if (!frame.names.empty()) {
+        m_timeline->wait(frame.timelineValue);
+        readBack(m_frameIndex);
+        frame.names.clear();
+    }
+
+    cmdBuffer.resetQueryPool(m_queryPool, m_frameIndex * m_maxSections * 2, m_maxSections * 2);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t GpuTimer::cmdBegin(vk::CommandBuffer cmdBuffer, const std::string& name)
+{
+    if (!m_queryPool || !m_frameStarted)
+        return INVALID_ID;
+
+    Frame& frame = m_frames[m_frameIndex];
+    if (frame.names.size() >= m_maxSections)
+        return INVALID_ID;
+
+    const uint32_t sectionID = static_cast<uint32_t>(frame.names.size());
+    frame.names.push_back(name);
+    cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_queryPool,
+                             (m_frameIndex * m_maxSections + sectionID) * 2);
+    return sectionID;
+}
+
+void GpuTimer::cmdEnd(vk::CommandBuffer cmdBuffer, uint32_t sectionID)
+{
+    if (sectionID == INVALID_ID)
+        return;
+
+    cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_queryPool,
+                             (m_frameIndex * m_maxSections + sectionID) * 2 + 1);
+}
+
+//-------------------------------------------------------------------------
+// The frame is complete, the results are available without waiting
+//
+void GpuTimer::readBack(uint32_t frameIndex)
+{
+    const Frame& frame = m_frames[frameIndex];
+    std::vector<uint64_t> timestamps(frame.names.size() * 2);
+
+    vk::Result result = m_device.getQueryPoolResults(m_queryPool, frameIndex * m_maxSections * 2,
+        static_cast<uint32_t>(timestamps.size()), timestamps.size() * sizeof(uint64_t), timestamps.data(),
+        sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < frame.names.size(); i++) {
+        const uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & m_validMask;
+        const double   ms    = ticks * m_period * 1e-6;
+
+        Section* section = nullptr;
+        for (auto& s : m_sections) {
+            if (s.name == frame.names[i]) {
+                section = &s;
+                break;
+            }
+        }
+        if (!section) {
+            m_sections.emplace_back();
+            section       = &m_sections.back();
+            section->name = frame.names[i];
+        }
+
+        section->lastMs    = ms;
+        section->averageMs = section->samples ? section->averageMs + (ms - section->averageMs) * 0.02 : ms;
+        section->samples++;
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+std::vector<GpuTimer::Section> GpuTimer::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_sections;
+}
+
+} // namespace app
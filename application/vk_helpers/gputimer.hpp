@@ -0,0 +1,96 @@
+/*
+ *
+ * Andrew Frost
+ * gputimer.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "timeline.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// GpuTimer                                                              //
+///////////////////////////////////////////////////////////////////////////
+// GPU time of named sections of the frame through timestamp queries     //
+// - one range of queries per frame in flight, read back once the        //
+//   timeline reached the frame, nothing stalls on the GPU               //
+// - sections are keyed by name, the same name in several frames is      //
+//   averaged                                                            //
+// - without timestamps on the queue, the calls record nothing           //
+// Recording is done by one thread, getStats() from any                  //
+///////////////////////////////////////////////////////////////////////////
+
+class GpuTimer
+{
+public:
+    static const uint32_t INVALID_ID = ~0u;
+
+    struct Section
+    {
+        std::string name;
+        double      lastMs    = 0.0;
+        double      averageMs = 0.0;  // exponential, about the last 50 frames
+        uint32_t    samples   = 0;
+    };
+
+    GpuTimer(GpuTimer const&) = delete;
+    GpuTimer& operator=(GpuTimer const&) = delete;
+
+    GpuTimer() {}
+    ~GpuTimer() { deinit(); }
+
+    void init(vk::Device device, vk::PhysicalDevice physicalDevice, uint32_t queueFamilyIndex, Timeline* timeline,
+              uint32_t maxSections = 16, uint32_t frameCount = 3);
+
+    // the GPU must be done with the queries
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Once per frame, first in the command buffer and outside render passes:
+    // reads the oldest frame back and resets its queries for this one
+    //
+    void beginFrame(vk::CommandBuffer cmdBuffer);
+
+    // INVALID_ID once the frame ran out of sections, cmdEnd ignores it
+    uint32_t cmdBegin(vk::CommandBuffer cmdBuffer, const std::string& name);
+    void     cmdEnd(vk::CommandBuffer cmdBuffer, uint32_t sectionID);
+
+    bool isSupported() const { return static_cast<bool>(m_queryPool); }
+
+    std::vector<Section> getStats() const;
+
+private:
+    struct Frame
+    {
+        uint64_t                 timelineValue = 0;
+        std::vector<std::string> names;  // section i uses queries 2i and 2i + 1
+    };
+
+    void readBack(uint32_t frameIndex);
+
+    vk::Device            m_device;
+    Timeline*             m_timeline{ nullptr };
+    vk::QueryPool         m_queryPool;
+    double                m_period{ 1.0 };      // nanoseconds per tick
+    uint64_t              m_validMask{ ~0ull };
+    uint32_t              m_maxSections{ 0 };
+
+    std::vector<Frame>    m_frames;
+    uint32_t              m_frameIndex{ 0 };
+    bool                  m_frameStarted{ false };
+
+    mutable std::mutex    m_mutex;
+    std::vector<Section>  m_sections;
+
+}; // class GpuTimer
+
+} // namespace app
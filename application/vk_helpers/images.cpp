@@ -165,7 +165,7 @@ vk::ImageViewCreateInfo makeImageViewCreateInfo(
 
 //-------------------------------------------------------------------------
 // mipmap generation relies on blitting
-// a more sophisticated version could be done with computer shader <-- TODO
+// MipGenerator does it in a single compute dispatch for RGBA8 images
 //
 void generateMipmaps(
     vk::CommandBuffer cmdBuffer,
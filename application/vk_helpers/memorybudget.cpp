@@ -0,0 +1,306 @@
+/*
+ *
+ * Andrew Frost
+ * memorybudget.cpp
+ * 2020
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include "memorybudget.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// MemoryBudget                                                          //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void MemoryBudget::init(VmaAllocator allocator, bool extensionBudget)
+{
+    m_allocator = allocator;
+    m_frame     = 0;
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats                 = Stats();
+    m_stats.extensionBudget = extensionBudget;
+}
+
+//-------------------------------------------------------------------------
+// Registered resources are owned by the application, nothing is evicted
+//
+void MemoryBudget::deinit()
+{
+    m_entries.clear();
+    m_candidates.clear();
+    m_freeEntry = INVALID_ID;
+    m_allocator = nullptr;
+
+    std::lock_guard<std::mutex> lock(m_retiringMutex);
+    m_retiring.clear();
+    m_retiringCount = 0;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t MemoryBudget::add(VmaAllocation allocation, Priority priority, std::function<void()> evict)
+{
+    VmaAllocationInfo allocationInfo = {};
+    vmaGetAllocationInfo(m_allocator, allocation, &allocationInfo);
+
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(m_allocator, &memoryProperties);
+
+    uint32_t id;
+    if (m_freeEntry != INVALID_ID) {
+        id          = m_freeEntry;
+        m_freeEntry = m_entries[id].nextFree;
+    }
+    else {
+        id = static_cast<uint32_t>(m_entries.size());
+        m_entries.emplace_back();
+    }
+
+    Entry& entry     = m_entries[id];
+    entry.allocation = allocation;
+    entry.size       = allocationInfo.size;
+    entry.heapIndex  = memoryProperties->memoryTypes[allocationInfo.memoryType].heapIndex;
+    entry.priority   = priority;
+    entry.lastUsed   = m_frame;
+    entry.evict      = std::move(evict);
+    entry.nextFree   = INVALID_ID;
+    entry.active     = true;
+    return id;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void MemoryBudget::remove(uint32_t id)
+{
+    if (id == INVALID_ID)
+        return;
+
+    Entry& entry = m_entries[id];
+    assert(entry.active);
+    entry          = Entry();
+    entry.nextFree = m_freeEntry;
+    m_freeEntry    = id;
+}
+
+//-------------------------------------------------------------------------
+// Evict resources of a heap until bytes are on their way out, or nothing
+// is left. They are freed once the frames using them are done
+//
+uint32_t MemoryBudget::evict(uint32_t heapIndex, vk::DeviceSize bytes)
+{
+    m_candidates.clear();
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_entries.size()); i++) {
+        if (m_entries[i].active && m_entries[i].heapIndex == heapIndex)
+            m_candidates.push_back(i);
+    }
+
+    // lowest priority, then least recently used
+    std::sort(m_candidates.begin(), m_candidates.end(), [this](uint32_t a, uint32_t b) {
+        const Entry& ea = m_entries[a];
+        const Entry& eb = m_entries[b];
+        if (ea.priority != eb.priority)
+            return ea.priority < eb.priority;
+        return ea.lastUsed < eb.lastUsed;
+    });
+
+    uint32_t       count = 0;
+    vk::DeviceSize freed = 0;
+    for (uint32_t id : m_candidates) {
+        if (freed >= bytes)
+            break;
+
+        std::function<void()> evictFunction = std::move(m_entries[id].evict);
+        {
+            std::lock_guard<std::mutex> lock(m_retiringMutex);
+            m_retiring.push_back({ m_entries[id].allocation, m_entries[id].size, heapIndex });
+            m_retiringCount++;
+        }
+        freed += m_entries[id].size;
+        remove(id);
+
+        evictFunction();
+        count++;
+    }
+
+    if (count)
+        updateStats(count, freed);
+    return count;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t MemoryBudget::update()
+{
+    // a new frame index makes VMA fetch the budget from the extension
+    m_frame++;
+    vmaSetCurrentFrameIndex(m_allocator, static_cast<uint32_t>(m_frame));
+
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(m_allocator, &memoryProperties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetBudget(m_allocator, budgets);
+
+    uint32_t evicted = 0;
+    for (uint32_t h = 0; h < memoryProperties->memoryHeapCount; h++) {
+        if (!(memoryProperties->memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+
+        // what was evicted is still in allocationBytes until freed,
+        // evicting more now would overshoot the low watermark
+        if (getRetiringBytes(h))
+            continue;
+
+        const vk::DeviceSize high = vk::DeviceSize(double(budgets[h].budget) * m_highWatermark);
+        const vk::DeviceSize low  = vk::DeviceSize(double(budgets[h].budget) * m_lowWatermark);
+        if (budgets[h].allocationBytes > high)
+            evicted += evict(h, budgets[h].allocationBytes - low);
+    }
+
+    updateStats(0, 0);
+    return evicted;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t MemoryBudget::makeRoom(vk::DeviceSize size)
+{
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(m_allocator, &memoryProperties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetBudget(m_allocator, budgets);
+
+    uint32_t evicted = 0;
+    for (uint32_t h = 0; h < memoryProperties->memoryHeapCount; h++) {
+        if (!(memoryProperties->memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+
+        // bytes still retiring are as good as freed
+        const vk::DeviceSize retiring  = (std::min)(getRetiringBytes(h), budgets[h].allocationBytes);
+        const vk::DeviceSize allocated = budgets[h].allocationBytes - retiring + size;
+
+        const vk::DeviceSize high = vk::DeviceSize(double(budgets[h].budget) * m_highWatermark);
+        const vk::DeviceSize low  = vk::DeviceSize(double(budgets[h].budget) * m_lowWatermark);
+        if (allocated > high)
+            evicted += evict(h, allocated - low);
+    }
+    return evicted;
+}
+
+//-------------------------------------------------------------------------
+// Under the low watermark so the page-in does not trigger an eviction
+// right away
+//
+bool MemoryBudget::canPageIn(vk::DeviceSize size)
+{
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(m_allocator, &memoryProperties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetBudget(m_allocator, budgets);
+
+    for (uint32_t h = 0; h < memoryProperties->memoryHeapCount; h++) {
+        if (!(memoryProperties->memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+
+        const vk::DeviceSize low = vk::DeviceSize(double(budgets[h].budget) * m_lowWatermark);
+        if (getRetiringBytes(h) || budgets[h].allocationBytes + size > low)
+            return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats.pageIns++;
+    return true;
+}
+
+//-------------------------------------------------------------------------
+// Most frees are not evictions, they only read the atomic
+//
+void MemoryBudget::released(VmaAllocation allocation)
+{
+    if (m_retiringCount == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_retiringMutex);
+    for (size_t i = 0; i < m_retiring.size(); i++) {
+        if (m_retiring[i].allocation == allocation) {
+            m_retiring[i] = m_retiring.back();
+            m_retiring.pop_back();
+            m_retiringCount--;
+            return;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::DeviceSize MemoryBudget::getRetiringBytes(uint32_t heapIndex) const
+{
+    std::lock_guard<std::mutex> lock(m_retiringMutex);
+    vk::DeviceSize bytes = 0;
+    for (const auto& retiring : m_retiring) {
+        if (retiring.heapIndex == heapIndex)
+            bytes += retiring.size;
+    }
+    return bytes;
+}
+
+//-------------------------------------------------------------------------
+// Snapshot for getStats, refreshed from the thread driving the frames
+//
+void MemoryBudget::updateStats(uint32_t evictions, vk::DeviceSize evictedBytes)
+{
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = nullptr;
+    vmaGetMemoryProperties(m_allocator, &memoryProperties);
+
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS] = {};
+    vmaGetBudget(m_allocator, budgets);
+
+    uint32_t residentCount = 0;
+    for (const auto& entry : m_entries)
+        residentCount += entry.active ? 1 : 0;
+
+    vk::DeviceSize retiringBytes[VK_MAX_MEMORY_HEAPS] = {};
+    for (uint32_t h = 0; h < memoryProperties->memoryHeapCount; h++)
+        retiringBytes[h] = getRetiringBytes(h);
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_stats.heaps.resize(memoryProperties->memoryHeapCount);
+    for (uint32_t h = 0; h < memoryProperties->memoryHeapCount; h++) {
+        Heap& heap           = m_stats.heaps[h];
+        heap.budget          = budgets[h].budget;
+        heap.usage           = budgets[h].usage;
+        heap.blockBytes      = budgets[h].blockBytes;
+        heap.allocationBytes = budgets[h].allocationBytes;
+        heap.retiringBytes   = retiringBytes[h];
+        heap.deviceLocal     = (memoryProperties->memoryHeaps[h].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+    }
+    m_stats.residentCount = residentCount;
+    m_stats.evictions    += evictions;
+    m_stats.evictedBytes += evictedBytes;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+MemoryBudget::Stats MemoryBudget::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_stats;
+}
+
+} // namespace app
@@ -0,0 +1,169 @@
+/*
+ *
+ * Andrew Frost
+ * memorybudget.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "../external/vk_mem_alloc.h"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// MemoryBudget                                                          //
+///////////////////////////////////////////////////////////////////////////
+// Heap budgets from VMA, backed by VK_EXT_memory_budget when enabled,   //
+// refreshed once per frame, and a residency registry for eviction       //
+// - resources are registered with a priority and an evict function that //
+//   frees or demotes them, touch() marks them as used                   //
+// - when a device local heap goes past the high watermark of its budget //
+//   resources are evicted, lowest priority then least recently used     //
+//   first, until the heap is back under the low watermark               //
+// - pressure is measured on the bytes allocated, not on whole blocks,   //
+//   and an evicted resource counts as freed once the Allocator released //
+//   its memory. No more evictions in a heap until then                  //
+///////////////////////////////////////////////////////////////////////////
+
+class MemoryBudget
+{
+public:
+    enum class Priority : uint32_t
+    {
+        eLow    = 0,   // cheap to demote, textures
+        eNormal = 1,   // geometry
+        eHigh   = 2,
+    };
+
+    struct Heap
+    {
+        vk::DeviceSize budget          = 0;
+        vk::DeviceSize usage           = 0;
+        vk::DeviceSize blockBytes      = 0;
+        vk::DeviceSize allocationBytes = 0;
+        vk::DeviceSize retiringBytes   = 0;   // evicted, not freed yet
+        bool           deviceLocal     = false;
+    };
+
+    struct Stats
+    {
+        std::vector<Heap> heaps;
+        uint32_t          residentCount   = 0;
+        uint32_t          evictions       = 0;
+        vk::DeviceSize    evictedBytes    = 0;
+        uint32_t          pageIns         = 0;
+        bool              extensionBudget = false;   // VK_EXT_memory_budget, estimated otherwise
+    };
+
+    static const uint32_t INVALID_ID = ~0u;
+
+    MemoryBudget(MemoryBudget const&) = delete;
+    MemoryBudget& operator=(MemoryBudget const&) = delete;
+
+    MemoryBudget() {}
+
+    void init(VmaAllocator allocator, bool extensionBudget);
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Fractions of the budget, eviction starts above high and stops below low
+    //
+    void setWatermarks(float low, float high)
+    {
+        m_lowWatermark  = low;
+        m_highWatermark = high;
+    }
+
+    //-------------------------------------------------------------------------
+    // Once per frame, refreshes the budgets and evicts when over budget.
+    // Returns the number of resources evicted
+    //
+    uint32_t update();
+
+    //-------------------------------------------------------------------------
+    // Evicts ahead of an allocation of size bytes in device local memory
+    //
+    uint32_t makeRoom(vk::DeviceSize size);
+
+    //-------------------------------------------------------------------------
+    // Whether size bytes can be brought back in device local memory and
+    // stay under the low watermark, nothing evicted still retiring. Counts
+    // a page-in when it returns true
+    //
+    bool canPageIn(vk::DeviceSize size);
+
+    //-------------------------------------------------------------------------
+    // Called by the Allocator for every allocation it frees, from any
+    // thread. Completes the eviction of an evicted allocation
+    //
+    void released(VmaAllocation allocation);
+
+    //-------------------------------------------------------------------------
+    // The evict function is called at most once, the entry is removed
+    // before. It must not call add / remove
+    //
+    uint32_t add(VmaAllocation allocation, Priority priority, std::function<void()> evict);
+    void     remove(uint32_t id);
+    void     touch(uint32_t id)
+    {
+        if (id != INVALID_ID)
+            m_entries[id].lastUsed = m_frame;
+    }
+
+    // copy, safe from another thread
+    Stats getStats() const;
+
+private:
+    struct Entry
+    {
+        VmaAllocation         allocation = nullptr;
+        vk::DeviceSize        size       = 0;
+        uint32_t              heapIndex  = 0;
+        Priority              priority   = Priority::eNormal;
+        uint64_t              lastUsed   = 0;
+        std::function<void()> evict;
+        uint32_t              nextFree   = INVALID_ID;
+        bool                  active     = false;
+    };
+
+    // evicted, waiting for the Allocator to free it
+    struct Retiring
+    {
+        VmaAllocation  allocation = nullptr;
+        vk::DeviceSize size       = 0;
+        uint32_t       heapIndex  = 0;
+    };
+
+    uint32_t evict(uint32_t heapIndex, vk::DeviceSize bytes);
+
+    vk::DeviceSize getRetiringBytes(uint32_t heapIndex) const;
+
+    void updateStats(uint32_t evictions, vk::DeviceSize evictedBytes);
+
+    VmaAllocator          m_allocator{ nullptr };
+    uint64_t              m_frame{ 0 };
+    float                 m_lowWatermark{ 0.85f };
+    float                 m_highWatermark{ 0.95f };
+
+    std::vector<Entry>    m_entries;
+    uint32_t              m_freeEntry{ INVALID_ID };
+    std::vector<uint32_t> m_candidates;   // scratch for the eviction order
+
+    mutable std::mutex    m_retiringMutex;
+    std::vector<Retiring> m_retiring;
+    std::atomic<uint32_t> m_retiringCount{ 0 };   // released() returns early at 0
+
+    mutable std::mutex    m_statsMutex;
+    Stats                 m_stats;
+
+}; // class MemoryBudget
+
+} // namespace app
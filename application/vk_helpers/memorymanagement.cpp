@@ -6,6 +6,7 @@
  *
  */
 
+#include <algorithm>
 #include "memorymanagement.hpp"
 
 namespace app {
@@ -21,7 +22,8 @@ namespace app {
 //-------------------------------------------------------------------------
 // 
 //
-void StagingMemoryManager::init(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize stagingBlockSize)
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::init(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize stagingBlockSize)
 {
     assert(!m_device);
 
@@ -29,7 +31,9 @@ void StagingMemoryManager::init(vk::Device device, vk::PhysicalDevice physicalDe
     m_physicalDevice   = physicalDevice;
     m_stagingBlockSize = stagingBlockSize;
     m_memoryTypeIndex  = ~0;
-    m_freeOnRelease    = true;
+    m_keepIdleBlocks   = APP_DEFAULT_STAGING_KEEP_IDLE_BLOCKS;
+    m_idleReleaseCount = APP_DEFAULT_STAGING_IDLE_RELEASES;
+    m_releaseCount     = 0;
 
     m_freeStagingIndex = INVALID_ID_INDEX;
     m_freeBlockIndex   = INVALID_ID_INDEX;
@@ -42,7 +46,8 @@ void StagingMemoryManager::init(vk::Device device, vk::PhysicalDevice physicalDe
 //-------------------------------------------------------------------------
 //
 //
-void StagingMemoryManager::deinit()
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::deinit()
 {
     if (!m_device)
         return;
@@ -51,30 +56,27 @@ void StagingMemoryManager::deinit()
 
     m_sets.clear();
     m_blocks.clear();
+    m_freeIndex.clear();
     m_device = nullptr;
 }
 
 //-------------------------------------------------------------------------
-// Test if there is enough space in current allocations
+// Test if there is enough space in current allocations, from the free
+// index: a block more fragmented than its key can make it a false positive
 //
-bool StagingMemoryManager::fitsInAllocated(vk::DeviceSize size) const
+template <class RANGE>
+bool TStagingMemoryManager<RANGE>::fitsInAllocated(vk::DeviceSize size) const
 {
-    for (const auto& block : m_blocks) {
-        if (block.buffer) {
-            if (block.range.isAvailable((uint32_t)size, 16)) {
-                return true;
-            }
-        }
-    }
-
-    return false;
+    return !m_freeIndex.empty()
+        && m_freeIndex.rbegin()->first >= RANGE::alignedSize((uint32_t)size);
 }
 
 //-------------------------------------------------------------------------
 // if data != nullptr, memcpies to mapping and returns nullptr
 // otherwise returns temporary mapping (valid until "Complete" functions)
 //
-void* StagingMemoryManager::cmdToImage(
+template <class RANGE>
+void* TStagingMemoryManager<RANGE>::cmdToImage(
     vk::CommandBuffer cmdBuffer, vk::Image image, const vk::Offset3D& offset,
     const vk::Extent3D& extent, const vk::ImageSubresourceLayers& subresource, 
     vk::DeviceSize size, const void* data)
@@ -106,7 +108,8 @@ void* StagingMemoryManager::cmdToImage(
 // if data != nullptr, memcpies to mapping and returns nullptr
 // otherwise returns temporary mapping (valid until "Complete" functions)
 //
-void* StagingMemoryManager::cmdToBuffer(vk::CommandBuffer cmdBuffer, vk::Buffer buffer, 
+template <class RANGE>
+void* TStagingMemoryManager<RANGE>::cmdToBuffer(vk::CommandBuffer cmdBuffer, vk::Buffer buffer, 
     vk::DeviceSize offset, vk::DeviceSize size, const void* data)
 {
     if (!size)
@@ -136,7 +139,8 @@ void* StagingMemoryManager::cmdToBuffer(vk::CommandBuffer cmdBuffer, vk::Buffer
 // Closes the batch of staging resources since last finalize Resources call
 // and associates it with a fence for later release
 //
-void StagingMemoryManager::finalizeResources(vk::Fence fence)
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::finalizeResources(vk::Fence fence)
 {
     if (m_sets[m_stagingIndex].entries.empty())
         return;
@@ -146,23 +150,55 @@ void StagingMemoryManager::finalizeResources(vk::Fence fence)
 }
 
 //-------------------------------------------------------------------------
-// Releases the staging resources whose fences have complete and
-// those who had no fence at all
+// Same as above, but the batch is released once the timeline has
+// reached value, polling it is cheaper than a fence status query
 //
-void StagingMemoryManager::releaseResources()
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::finalizeResources(const Timeline& timeline, uint64_t value)
 {
+    if (m_sets[m_stagingIndex].entries.empty())
+        return;
+
+    m_sets[m_stagingIndex].timeline      = &timeline;
+    m_sets[m_stagingIndex].timelineValue = value;
+    m_stagingIndex                       = newStagingIndex();
+}
+
+//-------------------------------------------------------------------------
+// Releases the staging resources whose fences or timeline values have
+// completed and those who had neither
+//
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::releaseResources()
+{
+    m_releaseCount++;
+
     for (auto& set : m_sets) {
-        if (!set.entries.empty() && (!set.fence || m_device.getFenceStatus(set.fence) == vk::Result::eSuccess)) {
+        if (set.entries.empty())
+            continue;
+
+        bool done = true;
+        if (set.fence)
+            done = m_device.getFenceStatus(set.fence) == vk::Result::eSuccess;
+        else if (set.timeline)
+            done = set.timeline->isComplete(set.timelineValue);
+
+        if (done) {
             releaseResources(set.index);
-            set.fence = nullptr;
+            set.fence         = nullptr;
+            set.timeline      = nullptr;
+            set.timelineValue = 0;
         }
     }
+
+    trimIdleBlocks();
 }
 
 //-------------------------------------------------------------------------
 //
 //
-void StagingMemoryManager::releaseResources(uint32_t stagingID)
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::releaseResources(uint32_t stagingID)
 {
     assert(stagingID != INVALID_ID_INDEX);
     StagingSet& set = m_sets[stagingID];
@@ -175,9 +211,10 @@ void StagingMemoryManager::releaseResources(uint32_t stagingID)
 
         m_usedSize -= entry.size;
 
-        if (block.range.isEmpty() && m_freeOnRelease) {
-            freeBlock(block);
-        }
+        if (block.range.isEmpty())
+            block.idleSince = m_releaseCount;
+
+        updateFreeIndex(block);
     }
 
     set.entries.clear();
@@ -190,7 +227,8 @@ void StagingMemoryManager::releaseResources(uint32_t stagingID)
 //-------------------------------------------------------------------------
 //
 //
-float StagingMemoryManager::getUtilisation(vk::DeviceSize& allocatedSize, vk::DeviceSize& usedSize) const
+template <class RANGE>
+float TStagingMemoryManager<RANGE>::getUtilisation(vk::DeviceSize& allocatedSize, vk::DeviceSize& usedSize) const
 {
     allocatedSize = m_allocatedSize;
     usedSize = m_usedSize;
@@ -201,7 +239,25 @@ float StagingMemoryManager::getUtilisation(vk::DeviceSize& allocatedSize, vk::De
 //-------------------------------------------------------------------------
 //
 //
-void StagingMemoryManager::free(bool unusedOnly)
+template <class RANGE>
+float TStagingMemoryManager<RANGE>::getFragmentation() const
+{
+    vk::DeviceSize freeSize = m_allocatedSize - m_usedSize;
+    if (m_freeIndex.empty() || !freeSize)
+        return 0.0f;
+
+    uint32_t largest = 0;
+    for (const auto& indexed : m_freeIndex)
+        largest = std::max(largest, m_blocks[indexed.second].range.computeLargestFreeSize());
+
+    return 1.0f - float(double(largest) / double(freeSize));
+}
+
+//-------------------------------------------------------------------------
+//
+//
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::free(bool unusedOnly)
 {
     for (uint32_t i = 0; i < (uint32_t)m_blocks.size(); i++) {
         Block& block = m_blocks[i];
@@ -220,8 +276,10 @@ void StagingMemoryManager::free(bool unusedOnly)
 //-------------------------------------------------------------------------
 //
 //
-void StagingMemoryManager::freeBlock(Block& block)
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::freeBlock(Block& block)
 {
+    removeFromFreeIndex(block);
     m_allocatedSize -= block.size;
     freeBlockMemory(block.index, block);
     block.memory = nullptr;
@@ -233,10 +291,62 @@ void StagingMemoryManager::freeBlock(Block& block)
     m_freeBlockIndex = setIndexValue(block.index, m_freeBlockIndex);
 }
 
+//-------------------------------------------------------------------------
+// Free idle blocks beyond the ones kept, once they stayed empty long
+// enough. Avoids freeing and reallocating a block between every upload
+//
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::trimIdleBlocks()
+{
+    std::vector<uint32_t> idleBlocks;
+    for (const auto& block : m_blocks) {
+        if (block.buffer && block.range.isEmpty())
+            idleBlocks.push_back(block.index);
+    }
+
+    if (idleBlocks.size() <= m_keepIdleBlocks)
+        return;
+
+    // keep the most recently used ones
+    std::sort(idleBlocks.begin(), idleBlocks.end(), [this](uint32_t a, uint32_t b) {
+        return m_blocks[a].idleSince > m_blocks[b].idleSince;
+    });
+
+    for (size_t i = m_keepIdleBlocks; i < idleBlocks.size(); i++) {
+        Block& block = getBlock(idleBlocks[i]);
+        if (m_releaseCount - block.idleSince >= m_idleReleaseCount)
+            freeBlock(block);
+    }
+}
+
+//-------------------------------------------------------------------------
+// Re-key the block after its ranges changed
+//
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::updateFreeIndex(Block& block)
+{
+    removeFromFreeIndex(block);
+    block.freeIt  = m_freeIndex.emplace(block.range.getLargestFreeSize(), block.index);
+    block.indexed = true;
+}
+
 //-------------------------------------------------------------------------
 //
 //
-uint32_t StagingMemoryManager::newStagingIndex()
+template <class RANGE>
+void TStagingMemoryManager<RANGE>::removeFromFreeIndex(Block& block)
+{
+    if (block.indexed) {
+        m_freeIndex.erase(block.freeIt);
+        block.indexed = false;
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+template <class RANGE>
+uint32_t TStagingMemoryManager<RANGE>::newStagingIndex()
 {
     // find free slot
     if (m_freeStagingIndex != INVALID_ID_INDEX) {
@@ -262,7 +372,8 @@ uint32_t StagingMemoryManager::newStagingIndex()
 //-------------------------------------------------------------------------
 //
 //
-void* StagingMemoryManager::getStagingSpace(vk::DeviceSize size, vk::Buffer& buffer, vk::DeviceSize& offset)
+template <class RANGE>
+void* TStagingMemoryManager<RANGE>::getStagingSpace(vk::DeviceSize size, vk::Buffer& buffer, vk::DeviceSize& offset)
 {
     assert(m_sets[m_stagingIndex].index == m_stagingIndex && "illegal index, did you forget finalizeResources");
 
@@ -272,14 +383,25 @@ void* StagingMemoryManager::getStagingSpace(vk::DeviceSize size, vk::Buffer& buf
 
     uint32_t blockIndex = INVALID_ID_INDEX;
 
-    for (uint32_t i = 0; i < (uint32_t)m_blocks.size(); i++) {
-        Block& block = m_blocks[i];
-        if (block.buffer && block.range.subAllocate((uint32_t)size, 16, usedOffset, usedAligned, usedSize)) {
-            blockIndex = block.index;
+    // best fit over the blocks' largest free ranges, O(log blocks). A
+    // failed allocation leaves the block keyed below the request, the next
+    // candidate is tried
+    const uint32_t alignedSize = RANGE::alignedSize((uint32_t)size);
+    auto           it          = m_freeIndex.lower_bound(alignedSize);
+    while (it != m_freeIndex.end()) {
+        Block& block = getBlock(it->second);
+        bool   found = block.range.subAllocate((uint32_t)size, 16, usedOffset, usedAligned, usedSize);
+
+        updateFreeIndex(block);
 
-            offset = usedAligned;
-            buffer = block.buffer;
+        if (found) {
+            blockIndex = block.index;
+            offset     = usedAligned;
+            buffer     = block.buffer;
+            break;
         }
+        assert(block.freeIt->first < alignedSize && "free index out of sync");
+        it = m_freeIndex.lower_bound(alignedSize);
     }
 
     if (blockIndex == INVALID_ID_INDEX) {
@@ -312,6 +434,7 @@ void* StagingMemoryManager::getStagingSpace(vk::DeviceSize size, vk::Buffer& buf
 
         block.range.init((uint32_t)block.size);
         block.range.subAllocate((uint32_t)size, 16, usedOffset, usedAligned, usedSize);
+        updateFreeIndex(block);
 
         offset = usedAligned;
         buffer = block.buffer;
@@ -325,5 +448,10 @@ void* StagingMemoryManager::getStagingSpace(vk::DeviceSize size, vk::Buffer& buf
 }
 
 
+//-------------------------------------------------------------------------
+// Both range allocators are compiled here, the header only declares them
+//
+template class TStagingMemoryManager<tools::TRangeAllocator<256>>;
+template class TStagingMemoryManager<tools::TTlsfAllocator<256>>;
 
 } // namespace app
\ No newline at end of file
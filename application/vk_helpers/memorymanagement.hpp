@@ -9,9 +9,12 @@
 #pragma once
 
 #include <assert.h>
+#include <map>
 #include <vector>
 #include "../general_helpers/trangeallocator.hpp"
+#include "../general_helpers/tlsfallocator.hpp"
 #include <vulkan/vulkan.hpp>
+#include "timeline.hpp"
 
 namespace app {
 
@@ -21,15 +24,39 @@ namespace app {
 
 #define APP_DEFAULT_STAGING_BLOCKSIZE (VkDeviceSize(64) * 1024 * 1024)
 
+// idle staging blocks kept, and releases an extra idle block survives
+#define APP_DEFAULT_STAGING_KEEP_IDLE_BLOCKS 1
+#define APP_DEFAULT_STAGING_IDLE_RELEASES    16
+
+// range allocator used by StagingMemoryManager, tools::TTlsfAllocator<256>
+// keeps alloc / free constant time when blocks hold many live ranges
+#ifndef APP_STAGING_RANGE_ALLOCATOR
+#define APP_STAGING_RANGE_ALLOCATOR tools::TRangeAllocator<256>
+#endif
+
 static const uint32_t INVALID_ID_INDEX = ~0;
 
 ///////////////////////////////////////////////////////////////////////////
 // Staging Memory Manager                                                //
 ///////////////////////////////////////////////////////////////////////////
+// RANGE sub-allocates inside a block, either tools::TRangeAllocator or  //
+// tools::TTlsfAllocator                                                 //
+///////////////////////////////////////////////////////////////////////////
 
-class StagingMemoryManager
+template <class RANGE>
+class TStagingMemoryManager
 {
 protected:
+    //-------------------------------------------------------------------------
+    // Largest free range of every allocated block -> block index, a request
+    // takes the block with the smallest range it fits in. The key is the
+    // range allocator's O(1) estimate: TRangeAllocator's upper bound, a
+    // block too fragmented for the request is re-keyed with the exact value
+    // by the failed allocation, or TTlsfAllocator's bucket floor, which
+    // always fits
+    //
+    using FreeIndex = std::multimap<uint32_t, uint32_t>;
+
     //-------------------------------------------------------------------------
     // Block stores vk::Buffers taht we sub-allocate the staging space from.
     // The "index" element in the struct refers to the next free list item,
@@ -41,8 +68,12 @@ protected:
         vk::DeviceSize              size = 0;
         vk::Buffer                  buffer = nullptr;
         vk::DeviceMemory            memory = nullptr;
-        tools::TRangeAllocator<256> range;
+        RANGE                       range;
         uint8_t*                    mapping;
+
+        FreeIndex::iterator         freeIt;              // entry in m_freeIndex
+        bool                        indexed = false;
+        uint32_t                    idleSince = 0;       // release count when it became empty
     };
 
     struct Entry
@@ -60,6 +91,8 @@ protected:
     {
         uint32_t           index = INVALID_ID_INDEX;
         vk::Fence          fence = nullptr;
+        const Timeline*    timeline = nullptr;
+        uint64_t           timelineValue = 0;
         std::vector<Entry> entries;
     };
 
@@ -67,11 +100,11 @@ public:
     //-------------------------------------------------------------------------
     // 
     //
-    StagingMemoryManager(StagingMemoryManager const&) = delete;
-    StagingMemoryManager& operator=(StagingMemoryManager const&) = delete;
+    TStagingMemoryManager(TStagingMemoryManager const&) = delete;
+    TStagingMemoryManager& operator=(TStagingMemoryManager const&) = delete;
 
-    StagingMemoryManager() {}
-    StagingMemoryManager(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE)
+    TStagingMemoryManager() {}
+    TStagingMemoryManager(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE)
     {
         init(device, physicalDevice, stagingBlockSize);
     }
@@ -79,10 +112,27 @@ public:
     void init(vk::Device device, vk::PhysicalDevice physicalDevice, vk::DeviceSize stagingBlockSize = APP_DEFAULT_STAGING_BLOCKSIZE);
     void deinit();
 
+    //-------------------------------------------------------------------------
+    // Empty blocks are not freed right away, uploads tend to come in bursts.
+    // Up to keepBlocks idle blocks are kept, others are freed once they
+    // stayed empty for idleReleases calls to releaseResources
+    //
+    void setIdleBlockPolicy(uint32_t keepBlocks, uint32_t idleReleases)
+    {
+        m_keepIdleBlocks   = keepBlocks;
+        m_idleReleaseCount = idleReleases;
+    }
+
     //-------------------------------------------------------------------------
     // If true, we free memory completely when release 
     //
-    void setFreeUnusedOnRelease(bool state) { m_freeOnRelease = state; }
+    void setFreeUnusedOnRelease(bool state)
+    {
+        if (state)
+            setIdleBlockPolicy(0, 0);
+        else
+            setIdleBlockPolicy(~0u, ~0u);
+    }
 
     bool fitsInAllocated(vk::DeviceSize size) const;
 
@@ -109,6 +159,7 @@ public:
     }
 
     void finalizeResources(vk::Fence fence = nullptr);
+    void finalizeResources(const Timeline& timeline, uint64_t value);
 
     void releaseResources();
 
@@ -119,6 +170,13 @@ public:
 
     float getUtilisation(vk::DeviceSize& allocatedSize, vk::DeviceSize& usedSize) const;
 
+    //-------------------------------------------------------------------------
+    // 1 - largest free range / total free space, 0 when any free byte
+    // could serve a single request. Walks the free ranges of every block,
+    // for statistics
+    //
+    float getFragmentation() const;
+
 protected:
 
     uint32_t setIndexValue(uint32_t& index, uint32_t newValue)
@@ -130,6 +188,10 @@ protected:
 
     void free(bool unusedOnly);
     void freeBlock(Block& block);
+    void trimIdleBlocks();
+
+    void updateFreeIndex(Block& block);
+    void removeFromFreeIndex(Block& block);
 
     uint32_t newStagingIndex();
 
@@ -156,10 +218,13 @@ protected:
     vk::PhysicalDevice m_physicalDevice = nullptr;
     uint32_t           m_memoryTypeIndex;
     vk::DeviceSize     m_stagingBlockSize;
-    bool               m_freeOnRelease;
+    uint32_t           m_keepIdleBlocks;
+    uint32_t           m_idleReleaseCount;
+    uint32_t           m_releaseCount;
 
     std::vector<Block>      m_blocks;
     std::vector<StagingSet> m_sets;
+    FreeIndex               m_freeIndex;
 
     uint32_t m_stagingIndex;     // active staging Index, must be valid    
     uint32_t m_freeStagingIndex; // linked-list to next free staging set    
@@ -169,6 +234,11 @@ protected:
     vk::DeviceSize m_usedSize;
 
 
-}; // class StagingMemoryManager
+}; // class TStagingMemoryManager
+
+extern template class TStagingMemoryManager<tools::TRangeAllocator<256>>;
+extern template class TStagingMemoryManager<tools::TTlsfAllocator<256>>;
+
+using StagingMemoryManager = TStagingMemoryManager<APP_STAGING_RANGE_ALLOCATOR>;
 
 } // namespace app
\ No newline at end of file
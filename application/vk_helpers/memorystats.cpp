@@ -0,0 +1,143 @@
+/*
+ *
+ * Andrew Frost
+ * memorystats.cpp
+ * 2020
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <sstream>
+#include "memorystats.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// MemoryStats                                                           //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+const char* MemoryStats::getName(Category category)
+{
+    switch (category) {
+    case Category::eOther:        return "other";
+    case Category::eVertex:       return "vertex";
+    case Category::eIndex:        return "index";
+    case Category::eMaterial:     return "material";
+    case Category::eTexture:      return "texture";
+    case Category::eRenderTarget: return "render target";
+    case Category::eStaging:      return "staging";
+    default:                      return "unknown";
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void MemoryStats::add(uint64_t key, Category category, vk::DeviceSize size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    assert(m_entries.find(key) == m_entries.end());
+    m_entries[key] = { category, size };
+
+    Counter& counter = m_counters[static_cast<uint32_t>(category)];
+    counter.bytes += size;
+    counter.count++;
+    counter.allocations++;
+    counter.peakBytes = (std::max)(counter.peakBytes, counter.bytes);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void MemoryStats::retag(uint64_t key, Category category)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() || it->second.category == category)
+        return;
+
+    Counter& from = m_counters[static_cast<uint32_t>(it->second.category)];
+    from.bytes -= it->second.size;
+    from.count--;
+    from.allocations--;
+
+    Counter& to = m_counters[static_cast<uint32_t>(category)];
+    to.bytes += it->second.size;
+    to.count++;
+    to.allocations++;
+    to.peakBytes = (std::max)(to.peakBytes, to.bytes);
+
+    it->second.category = category;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void MemoryStats::remove(uint64_t key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return;
+
+    Counter& counter = m_counters[static_cast<uint32_t>(it->second.category)];
+    counter.bytes -= it->second.size;
+    counter.count--;
+    m_entries.erase(it);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+MemoryStats::Counters MemoryStats::getCounters() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counters;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+std::string MemoryStats::toJson(VmaAllocator allocator) const
+{
+    Counters counters = getCounters();
+
+    std::stringstream ss;
+    ss << "{\n  \"categories\": {\n";
+    for (uint32_t i = 0; i < CATEGORY_COUNT; i++) {
+        const Counter& counter = counters[i];
+        ss << "    \"" << getName(Category(i)) << "\": { \"bytes\": " << counter.bytes
+           << ", \"peakBytes\": " << counter.peakBytes << ", \"count\": " << counter.count
+           << ", \"allocations\": " << counter.allocations << " }" << (i + 1 < CATEGORY_COUNT ? ",\n" : "\n");
+    }
+    ss << "  }";
+
+    if (allocator) {
+        char* vmaStats = nullptr;
+        vmaBuildStatsString(allocator, &vmaStats, VK_TRUE);
+        ss << ",\n  \"vma\": " << vmaStats;
+        vmaFreeStatsString(allocator, vmaStats);
+    }
+    ss << "\n}\n";
+    return ss.str();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool MemoryStats::dumpJson(const std::string& filename, VmaAllocator allocator) const
+{
+    std::ofstream file(filename);
+    if (!file.is_open())
+        return false;
+
+    file << toJson(allocator);
+    return file.good();
+}
+
+} // namespace app
@@ -0,0 +1,90 @@
+/*
+ *
+ * Andrew Frost
+ * memorystats.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vulkan/vulkan.hpp>
+
+#include "../external/vk_mem_alloc.h"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// MemoryStats                                                           //
+///////////////////////////////////////////////////////////////////////////
+// Live device memory counters per category, for leaks and bloat         //
+// - allocations are keyed by their handle (VmaAllocation or             //
+//   VkDeviceMemory), added when made, retagged when their use is known  //
+//   and removed when freed                                              //
+// - dumpJson() writes the counters with VMA's detailed stats string     //
+// Always compiled in, the cost is one map operation per allocation      //
+///////////////////////////////////////////////////////////////////////////
+
+class MemoryStats
+{
+public:
+    enum class Category : uint32_t
+    {
+        eOther = 0,
+        eVertex,
+        eIndex,
+        eMaterial,
+        eTexture,
+        eRenderTarget,
+        eStaging,
+        eCount
+    };
+    static const uint32_t CATEGORY_COUNT = static_cast<uint32_t>(Category::eCount);
+
+    struct Counter
+    {
+        vk::DeviceSize bytes       = 0;
+        vk::DeviceSize peakBytes   = 0;
+        uint32_t       count       = 0;
+        uint64_t       allocations = 0;   // ever made
+    };
+    using Counters = std::array<Counter, CATEGORY_COUNT>;
+
+    static const char* getName(Category category);
+
+    MemoryStats(MemoryStats const&) = delete;
+    MemoryStats& operator=(MemoryStats const&) = delete;
+
+    MemoryStats() {}
+
+    void add(uint64_t key, Category category, vk::DeviceSize size);
+    void retag(uint64_t key, Category category);
+    void remove(uint64_t key);
+
+    // copy, safe from another thread
+    Counters getCounters() const;
+
+    //-------------------------------------------------------------------------
+    // allocator can be null, the VMA part is left out then
+    //
+    std::string toJson(VmaAllocator allocator) const;
+    bool        dumpJson(const std::string& filename, VmaAllocator allocator) const;
+
+private:
+    struct Entry
+    {
+        Category       category;
+        vk::DeviceSize size;
+    };
+
+    mutable std::mutex                  m_mutex;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    Counters                            m_counters;
+
+}; // class MemoryStats
+
+} // namespace app
@@ -0,0 +1,371 @@
+/*
+ *
+ * Andrew Frost
+ * mipgenerator.cpp
+ * 2020
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+#include "mipgenerator.hpp"
+#include "images.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// MipGenerator                                                          //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// The shader needs Vulkan 1.1 (extended usage of sRGB images), dynamic
+// indexing of the storage image array and RGBA8 storage images. The
+// subgroup build is chosen when quad operations are available to compute
+// shaders. A shader that does not load or compile leaves the generator
+// unsupported, the textures are blitted
+//
+void MipGenerator::init(vk::Device device, vk::PhysicalDevice physicalDevice, Allocator* allocator,
+                        PipelineCache* cache, ShaderModuleRegistry* shaderModules)
+{
+    assert(!m_device);
+    m_device        = device;
+    m_allocator     = allocator;
+    m_shaderModules = shaderModules;
+    m_stats         = Stats();
+
+    const vk::PhysicalDeviceProperties properties = physicalDevice.getProperties();
+    const vk::PhysicalDeviceFeatures   features   = physicalDevice.getFeatures();
+    const vk::FormatProperties         formatProperties =
+        physicalDevice.getFormatProperties(vk::Format::eR8G8B8A8Unorm);
+
+    if (properties.apiVersion < VK_API_VERSION_1_1
+        || !features.shaderStorageImageArrayDynamicIndexing
+        || !(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eStorageImage))
+        return;
+
+    auto properties2 = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2,
+                                                     vk::PhysicalDeviceSubgroupProperties>();
+    const auto& subgroup = properties2.get<vk::PhysicalDeviceSubgroupProperties>();
+    m_subgroups = (subgroup.supportedStages & vk::ShaderStageFlagBits::eCompute)
+               && (subgroup.supportedOperations & vk::SubgroupFeatureFlagBits::eQuad)
+               && subgroup.subgroupSize >= 4;
+
+    // sampler
+    vk::SamplerCreateInfo samplerInfo = {};
+    samplerInfo.magFilter    = vk::Filter::eLinear;
+    samplerInfo.minFilter    = vk::Filter::eLinear;
+    samplerInfo.mipmapMode   = vk::SamplerMipmapMode::eNearest;
+    samplerInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+    samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+    samplerInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+    try {
+        m_sampler = m_device.createSampler(samplerInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create mipmap sampler!");
+    }
+
+    // descriptors, one set per job allocated upfront
+    const vk::ShaderStageFlags stage = vk::ShaderStageFlagBits::eCompute;
+    m_bindings.addBinding(0, vk::DescriptorType::eCombinedImageSampler, 1, stage);
+    m_bindings.addBinding(1, vk::DescriptorType::eStorageImage, s_maxLevels - 1, stage);
+    m_bindings.addBinding(2, vk::DescriptorType::eStorageImage, 1, stage);
+    m_bindings.addBinding(3, vk::DescriptorType::eStorageBuffer, 1, stage);
+    m_descriptorSetLayout = m_bindings.createLayout(m_device);
+    m_descriptorPool      = m_bindings.createPool(m_device, s_maxJobs);
+
+    std::vector<vk::DescriptorSet> sets;
+    util::allocateDescriptorSets(m_device, m_descriptorPool, m_descriptorSetLayout, s_maxJobs, sets);
+
+    m_jobs.resize(s_maxJobs);
+    for (uint32_t jobID = 0; jobID < s_maxJobs; jobID++) {
+        m_jobs[jobID].descriptorSet = sets[jobID];
+        m_jobs[jobID].nextFree      = jobID + 1;
+    }
+    m_freeJob = 0;
+
+    // pipeline
+    vk::PushConstantRange pushConstantRange = { stage, 0, sizeof(PushConstant) };
+
+    vk::PipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.setLayoutCount         = 1;
+    pipelineLayoutInfo.pSetLayouts            = &m_descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+    try {
+        m_pipelineLayout = m_device.createPipelineLayout(pipelineLayoutInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create mipmap pipeline layout!");
+    }
+
+    try {
+        m_shaderModule = m_shaderModules->acquire(m_subgroups ? "shaders/spd.comp.spv" : "shaders/spd_lds.comp.spv");
+
+        vk::ComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.stage.stage  = stage;
+        pipelineInfo.stage.module = m_shaderModules->getModule(m_shaderModule);
+        pipelineInfo.stage.pName  = "main";
+        pipelineInfo.layout       = m_pipelineLayout;
+        m_pipeline = cache->createComputePipeline(pipelineInfo);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "mipmaps are blitted, " << e.what() << std::endl;
+        return;
+    }
+
+    // atomic counters, reset by each generation
+    m_counters = m_allocator->createBuffer(vk::DeviceSize(s_maxJobs * sizeof(uint32_t)),
+                                           vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                                           vk::MemoryPropertyFlagBits::eDeviceLocal);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void MipGenerator::deinit()
+{
+    if (!m_device)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    assert(m_stats.inFlight == 0);
+    for (auto& job : m_jobs) {
+        for (auto view : job.views)
+            m_device.destroyImageView(view);
+    }
+    m_jobs.clear();
+
+    m_device.destroyPipeline(m_pipeline);
+    m_device.destroyPipelineLayout(m_pipelineLayout);
+    m_device.destroyDescriptorPool(m_descriptorPool);
+    m_device.destroyDescriptorSetLayout(m_descriptorSetLayout);
+    m_device.destroySampler(m_sampler);
+    m_allocator->destroy(m_counters);
+    m_shaderModules->release(m_shaderModule);
+
+    m_pipeline            = nullptr;
+    m_pipelineLayout      = nullptr;
+    m_descriptorPool      = nullptr;
+    m_descriptorSetLayout = nullptr;
+    m_sampler             = nullptr;
+    m_shaderModule        = ShaderModuleRegistry::INVALID_ID;
+    m_subgroups           = false;
+    m_bindings.clear();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool MipGenerator::canGenerate(vk::Format format, const vk::Extent2D& size, uint32_t levelCount) const
+{
+    if (!isSupported())
+        return false;
+    if (format != vk::Format::eR8G8B8A8Unorm && format != vk::Format::eR8G8B8A8Srgb)
+        return false;
+    return levelCount > 1 && levelCount <= s_maxLevels && (std::max)(size.width, size.height) < (1u << s_maxLevels);
+}
+
+//-------------------------------------------------------------------------
+// sRGB formats support neither storage usage nor views of another format
+// without these flags
+//
+void MipGenerator::prepareImageInfo(vk::ImageCreateInfo& imageInfo)
+{
+    imageInfo.usage |= vk::ImageUsageFlagBits::eStorage;
+    if (imageInfo.format == vk::Format::eR8G8B8A8Srgb)
+        imageInfo.flags |= vk::ImageCreateFlagBits::eMutableFormat | vk::ImageCreateFlagBits::eExtendedUsage;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void MipGenerator::prepareViewInfo(vk::ImageViewCreateInfo& viewInfo, vk::ImageViewUsageCreateInfo& usageInfo)
+{
+    if (viewInfo.format != vk::Format::eR8G8B8A8Srgb)
+        return;
+
+    usageInfo.usage = vk::ImageUsageFlagBits::eSampled;
+    usageInfo.pNext = viewInfo.pNext;
+    viewInfo.pNext  = &usageInfo;
+}
+
+//-------------------------------------------------------------------------
+// Level 0 is read through a sampler, the other levels are written as
+// storage images, in the general layout meanwhile. Array elements past the
+// last level repeat a valid view, the shader never writes them
+//
+std::function<void()> MipGenerator::cmdGenerate(
+    vk::CommandBuffer   cmdBuffer,
+    vk::Image           image,
+    vk::Format          format,
+    const vk::Extent2D& size,
+    uint32_t            levelCount,
+    vk::ImageLayout     currentLayout)
+{
+    assert(canGenerate(format, size, levelCount));
+
+    uint32_t jobID = s_maxJobs;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_freeJob == s_maxJobs) {
+            m_stats.fallbacks++;
+        }
+        else {
+            jobID     = m_freeJob;
+            m_freeJob = m_jobs[jobID].nextFree;
+            m_stats.generated++;
+            m_stats.inFlight++;
+        }
+    }
+
+    if (jobID == s_maxJobs) {
+        image::generateMipmaps(cmdBuffer, image, format, size, levelCount, 1, currentLayout);
+        return std::function<void()>();
+    }
+
+    Job& job = m_jobs[jobID];
+    assert(job.views.empty());
+
+    // views, the first one sampled
+    vk::ImageViewCreateInfo viewInfo = {};
+    viewInfo.image                       = image;
+    viewInfo.viewType                    = vk::ImageViewType::e2D;
+    viewInfo.format                      = format;
+    viewInfo.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    vk::ImageViewUsageCreateInfo usageInfo;
+    prepareViewInfo(viewInfo, usageInfo);
+
+    try {
+        job.views.push_back(m_device.createImageView(viewInfo));
+
+        viewInfo.pNext  = nullptr;
+        viewInfo.format = vk::Format::eR8G8B8A8Unorm;
+        for (uint32_t level = 1; level < levelCount; level++) {
+            viewInfo.subresourceRange.baseMipLevel = level;
+            job.views.push_back(m_device.createImageView(viewInfo));
+        }
+    }
+    catch (vk::SystemError err) {
+        release(jobID);
+        throw std::runtime_error("failed to create mipmap image views!");
+    }
+
+    vk::DescriptorImageInfo sourceInfo = { m_sampler, job.views[0], vk::ImageLayout::eShaderReadOnlyOptimal };
+
+    std::vector<vk::DescriptorImageInfo> mipInfos(s_maxLevels - 1);
+    for (uint32_t level = 1; level < s_maxLevels; level++) {
+        mipInfos[level - 1].imageView   = job.views[(std::min)(level, levelCount - 1)];
+        mipInfos[level - 1].imageLayout = vk::ImageLayout::eGeneral;
+    }
+
+    vk::DescriptorBufferInfo counterInfo = { m_counters.buffer, 0, VK_WHOLE_SIZE };
+
+    std::vector<vk::WriteDescriptorSet> writes;
+    writes.push_back(m_bindings.makeWrite(job.descriptorSet, 0, &sourceInfo));
+    writes.push_back(m_bindings.makeWriteArray(job.descriptorSet, 1, mipInfos.data()));
+    writes.push_back(m_bindings.makeWrite(job.descriptorSet, 2, &mipInfos[5]));
+    writes.push_back(m_bindings.makeWrite(job.descriptorSet, 3, &counterInfo));
+    m_device.updateDescriptorSets(writes, nullptr);
+
+    // the counter of the job is zero before the dispatch
+    cmdBuffer.fillBuffer(m_counters.buffer, jobID * sizeof(uint32_t), sizeof(uint32_t), 0);
+
+    vk::BufferMemoryBarrier counterBarrier = {};
+    counterBarrier.srcAccessMask       = vk::AccessFlagBits::eTransferWrite;
+    counterBarrier.dstAccessMask       = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    counterBarrier.buffer              = m_counters.buffer;
+    counterBarrier.offset              = jobID * sizeof(uint32_t);
+    counterBarrier.size                = sizeof(uint32_t);
+
+    // level 0 is read, the others are discarded and written
+    std::vector<vk::ImageMemoryBarrier> barriers(2);
+    barriers[0].srcAccessMask                 = vk::AccessFlagBits::eMemoryWrite;
+    barriers[0].dstAccessMask                 = vk::AccessFlagBits::eShaderRead;
+    barriers[0].oldLayout                     = currentLayout;
+    barriers[0].newLayout                     = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barriers[0].srcQueueFamilyIndex           = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].dstQueueFamilyIndex           = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].image                         = image;
+    barriers[0].subresourceRange              = viewInfo.subresourceRange;
+    barriers[0].subresourceRange.baseMipLevel = 0;
+    barriers[0].subresourceRange.levelCount   = 1;
+
+    barriers[1]                               = barriers[0];
+    barriers[1].dstAccessMask                 = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+    barriers[1].oldLayout                     = vk::ImageLayout::eUndefined;
+    barriers[1].newLayout                     = vk::ImageLayout::eGeneral;
+    barriers[1].subresourceRange.baseMipLevel = 1;
+    barriers[1].subresourceRange.levelCount   = levelCount - 1;
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+                              vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), nullptr,
+                              counterBarrier, barriers);
+
+    // dispatch, a workgroup per 64x64 tile
+    const uint32_t groupsX = (size.width + 63) / 64;
+    const uint32_t groupsY = (size.height + 63) / 64;
+
+    PushConstant pushConstant;
+    pushConstant.invSize[0]    = 1.0f / size.width;
+    pushConstant.invSize[1]    = 1.0f / size.height;
+    pushConstant.mips          = levelCount - 1;
+    pushConstant.numWorkGroups = groupsX * groupsY;
+    pushConstant.counterIndex  = jobID;
+    pushConstant.srgb          = format == vk::Format::eR8G8B8A8Srgb ? 1 : 0;
+
+    cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, m_pipeline);
+    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_pipelineLayout, 0, job.descriptorSet, nullptr);
+    cmdBuffer.pushConstants<PushConstant>(m_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstant);
+    cmdBuffer.dispatch(groupsX, groupsY, 1);
+
+    // back to the layout of the caller
+    barriers[0].srcAccessMask = vk::AccessFlagBits::eShaderRead;
+    barriers[0].dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+    barriers[0].oldLayout     = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barriers[0].newLayout     = currentLayout;
+    barriers[1].srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+    barriers[1].dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+    barriers[1].oldLayout     = vk::ImageLayout::eGeneral;
+    barriers[1].newLayout     = currentLayout;
+
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eAllCommands,
+                              vk::DependencyFlags(), nullptr, nullptr, barriers);
+
+    return [this, jobID]() { release(jobID); };
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void MipGenerator::release(uint32_t jobID)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Job& job = m_jobs[jobID];
+    for (auto view : job.views)
+        m_device.destroyImageView(view);
+    job.views.clear();
+
+    job.nextFree = m_freeJob;
+    m_freeJob    = jobID;
+    m_stats.inFlight--;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+MipGenerator::Stats MipGenerator::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+} // namespace app
@@ -0,0 +1,136 @@
+/*
+ *
+ * Andrew Frost
+ * mipgenerator.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "allocator.hpp"
+#include "descriptorsets.hpp"
+#include "pipelinecache.hpp"
+#include "shadermodules.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// MipGenerator                                                          //
+///////////////////////////////////////////////////////////////////////////
+// Whole mip chain of an RGBA8 2D image in a single compute dispatch     //
+// (shaders/spd.comp), in place of image::generateMipmaps' blit and      //
+// barrier per level                                                     //
+// - workgroups reduce 64x64 tiles to level 6, the last one to finish,   //
+//   counted by a global atomic, reduces level 6 to the last level       //
+// - subgroup quad operations for the 2x2 reductions when the device has //
+//   them in compute shaders, shared memory otherwise                    //
+// - sRGB images are written through UNORM views, they need the flags    //
+//   and usage of prepareImageInfo()                                     //
+// - only compute commands and barriers on all commands are recorded,    //
+//   legal on an async compute queue                                     //
+// Thread safe, one call per command buffer and image at a time          //
+///////////////////////////////////////////////////////////////////////////
+
+class MipGenerator
+{
+public:
+    static const uint32_t s_maxLevels = 13;    // 4096x4096
+    static const uint32_t s_maxJobs   = 1024;  // generations in flight
+
+    struct Stats
+    {
+        uint32_t generated = 0;
+        uint32_t fallbacks = 0;  // blitted, every job in flight
+        uint32_t inFlight  = 0;
+    };
+
+    MipGenerator(MipGenerator const&) = delete;
+    MipGenerator& operator=(MipGenerator const&) = delete;
+
+    MipGenerator() {}
+    ~MipGenerator() { deinit(); }
+
+    // without support for the compute path, canGenerate() is always false
+    void init(vk::Device device, vk::PhysicalDevice physicalDevice, Allocator* allocator, PipelineCache* cache,
+              ShaderModuleRegistry* shaderModules);
+
+    // the GPU must be done with the generations
+    void deinit();
+
+    bool isSupported() const { return static_cast<bool>(m_pipeline); }
+    bool isSubgroupPath() const { return m_subgroups; }
+
+    bool canGenerate(vk::Format format, const vk::Extent2D& size, uint32_t levelCount) const;
+
+    // storage usage and the UNORM views on sRGB images
+    static void prepareImageInfo(vk::ImageCreateInfo& imageInfo);
+
+    // sRGB views of such images are for sampling only, usageInfo must
+    // outlive the view creation
+    static void prepareViewInfo(vk::ImageViewCreateInfo& viewInfo, vk::ImageViewUsageCreateInfo& usageInfo);
+
+    //-------------------------------------------------------------------------
+    // Records the generation of the levels from level 0, the image is in
+    // currentLayout before and after. Returns the function releasing the
+    // views and descriptor set of the call, to run once the GPU is done
+    // with it. With every job in flight, blits the levels instead (on a
+    // graphics queue) and returns an empty function
+    //
+    std::function<void()> cmdGenerate(
+        vk::CommandBuffer   cmdBuffer,
+        vk::Image           image,
+        vk::Format          format,
+        const vk::Extent2D& size,
+        uint32_t            levelCount,
+        vk::ImageLayout     currentLayout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    Stats getStats() const;
+
+private:
+    struct Job
+    {
+        vk::DescriptorSet          descriptorSet;  // allocated once
+        std::vector<vk::ImageView> views;          // of the image in flight
+        uint32_t                   nextFree = 0;
+    };
+
+    // matches pushC of spd.comp
+    struct PushConstant
+    {
+        float    invSize[2];
+        uint32_t mips;
+        uint32_t numWorkGroups;
+        uint32_t counterIndex;
+        uint32_t srgb;
+    };
+
+    void release(uint32_t jobID);
+
+    vk::Device              m_device;
+    Allocator*              m_allocator{ nullptr };
+    ShaderModuleRegistry*   m_shaderModules{ nullptr };
+    uint32_t                m_shaderModule{ ShaderModuleRegistry::INVALID_ID };
+    bool                    m_subgroups{ false };
+
+    DescriptorSetBindings   m_bindings;
+    vk::DescriptorSetLayout m_descriptorSetLayout;
+    vk::DescriptorPool      m_descriptorPool;
+    vk::PipelineLayout      m_pipelineLayout;
+    vk::Pipeline            m_pipeline;
+    vk::Sampler             m_sampler;
+    BufferVma               m_counters;     // one atomic per job
+
+    mutable std::mutex      m_mutex;
+    std::vector<Job>        m_jobs;
+    uint32_t                m_freeJob{ 0 };  // s_maxJobs when none
+    Stats                   m_stats;
+
+}; // class MipGenerator
+
+} // namespace app
@@ -8,11 +8,15 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <vulkan/vulkan.hpp>
 
+#include "pipelinecache.hpp"
+
 namespace app {
 
 ///////////////////////////////////////////////////////////////////////////
@@ -116,6 +120,214 @@ public:
         }
     }
 
+#ifdef VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME
+    //-------------------------------------------------------------------------
+    // Cull mode, front face, depth test / write / compare op and topology
+    // are set while recording (VK_EXT_extended_dynamic_state), variants
+    // differing there share one pipeline
+    //
+    void addExtendedDynamicStates()
+    {
+        for (vk::DynamicState state : { vk::DynamicState::eCullModeEXT, vk::DynamicState::eFrontFaceEXT,
+                                        vk::DynamicState::eDepthTestEnableEXT, vk::DynamicState::eDepthWriteEnableEXT,
+                                        vk::DynamicState::eDepthCompareOpEXT, vk::DynamicState::ePrimitiveTopologyEXT }) {
+            if (!isDynamic(state))
+                dynamicStateEnables.push_back(state);
+        }
+    }
+#endif
+
+    bool isDynamic(vk::DynamicState state) const
+    {
+        return std::find(dynamicStateEnables.begin(), dynamicStateEnables.end(), state) != dynamicStateEnables.end();
+    }
+
+    //-------------------------------------------------------------------------
+    // Key of everything baked in the pipeline, for hashing and equality.
+    // Dynamic states are left out, a dynamic topology only keeps its class
+    //
+    void appendKey(std::vector<uint32_t>& key) const
+    {
+        auto add      = [&key](uint32_t value) { key.push_back(value); };
+        auto addFloat = [&key](float value) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            key.push_back(bits);
+        };
+
+#ifdef VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME
+        const bool dynamicTopology   = isDynamic(vk::DynamicState::ePrimitiveTopologyEXT);
+        const bool dynamicCullMode   = isDynamic(vk::DynamicState::eCullModeEXT);
+        const bool dynamicFrontFace  = isDynamic(vk::DynamicState::eFrontFaceEXT);
+        const bool dynamicDepthTest  = isDynamic(vk::DynamicState::eDepthTestEnableEXT);
+        const bool dynamicDepthWrite = isDynamic(vk::DynamicState::eDepthWriteEnableEXT);
+        const bool dynamicCompareOp  = isDynamic(vk::DynamicState::eDepthCompareOpEXT);
+#else
+        const bool dynamicTopology   = false;
+        const bool dynamicCullMode   = false;
+        const bool dynamicFrontFace  = false;
+        const bool dynamicDepthTest  = false;
+        const bool dynamicDepthWrite = false;
+        const bool dynamicCompareOp  = false;
+#endif
+
+        // dynamic states, in any order
+        std::vector<vk::DynamicState> dynamicStates = dynamicStateEnables;
+        std::sort(dynamicStates.begin(), dynamicStates.end());
+        add(static_cast<uint32_t>(dynamicStates.size()));
+        for (vk::DynamicState state : dynamicStates)
+            add(static_cast<uint32_t>(state));
+
+        // input assembly
+        if (dynamicTopology)
+            add(getTopologyClass(inputAssemblyState.topology));
+        else
+            add(static_cast<uint32_t>(inputAssemblyState.topology));
+        add(inputAssemblyState.primitiveRestartEnable);
+
+        // rasterization
+        add(rasterizationState.depthClampEnable);
+        add(rasterizationState.rasterizerDiscardEnable);
+        add(static_cast<uint32_t>(rasterizationState.polygonMode));
+        add(dynamicCullMode ? 0 : static_cast<uint32_t>(rasterizationState.cullMode));
+        add(dynamicFrontFace ? 0 : static_cast<uint32_t>(rasterizationState.frontFace));
+        add(rasterizationState.depthBiasEnable);
+        addFloat(rasterizationState.depthBiasConstantFactor);
+        addFloat(rasterizationState.depthBiasClamp);
+        addFloat(rasterizationState.depthBiasSlopeFactor);
+        addFloat(rasterizationState.lineWidth);
+
+        // multisample
+        add(static_cast<uint32_t>(multisampleState.rasterizationSamples));
+        add(multisampleState.sampleShadingEnable);
+        addFloat(multisampleState.minSampleShading);
+        add(multisampleState.alphaToCoverageEnable);
+        add(multisampleState.alphaToOneEnable);
+        if (multisampleState.pSampleMask) {
+            for (uint32_t i = 0; i < (static_cast<uint32_t>(multisampleState.rasterizationSamples) + 31) / 32; i++)
+                add(multisampleState.pSampleMask[i]);
+        }
+
+        // depth stencil
+        auto addStencil = [&add](const vk::StencilOpState& op) {
+            add(static_cast<uint32_t>(op.failOp));
+            add(static_cast<uint32_t>(op.passOp));
+            add(static_cast<uint32_t>(op.depthFailOp));
+            add(static_cast<uint32_t>(op.compareOp));
+            add(op.compareMask);
+            add(op.writeMask);
+            add(op.reference);
+        };
+        add(dynamicDepthTest ? 0 : depthStencilState.depthTestEnable);
+        add(dynamicDepthWrite ? 0 : depthStencilState.depthWriteEnable);
+        add(dynamicCompareOp ? 0 : static_cast<uint32_t>(depthStencilState.depthCompareOp));
+        add(depthStencilState.depthBoundsTestEnable);
+        add(depthStencilState.stencilTestEnable);
+        addStencil(depthStencilState.front);
+        addStencil(depthStencilState.back);
+        addFloat(depthStencilState.minDepthBounds);
+        addFloat(depthStencilState.maxDepthBounds);
+
+        // color blend
+        add(colorBlendState.logicOpEnable);
+        add(static_cast<uint32_t>(colorBlendState.logicOp));
+        for (int i = 0; i < 4; i++)
+            addFloat(colorBlendState.blendConstants[i]);
+        add(static_cast<uint32_t>(blendAttachmentStates.size()));
+        for (const auto& blend : blendAttachmentStates) {
+            add(blend.blendEnable);
+            add(static_cast<uint32_t>(blend.srcColorBlendFactor));
+            add(static_cast<uint32_t>(blend.dstColorBlendFactor));
+            add(static_cast<uint32_t>(blend.colorBlendOp));
+            add(static_cast<uint32_t>(blend.srcAlphaBlendFactor));
+            add(static_cast<uint32_t>(blend.dstAlphaBlendFactor));
+            add(static_cast<uint32_t>(blend.alphaBlendOp));
+            add(static_cast<uint32_t>(blend.colorWriteMask));
+        }
+
+        // vertex input
+        add(static_cast<uint32_t>(bindingDescriptions.size()));
+        for (const auto& binding : bindingDescriptions) {
+            add(binding.binding);
+            add(binding.stride);
+            add(static_cast<uint32_t>(binding.inputRate));
+        }
+        add(static_cast<uint32_t>(attributeDescriptions.size()));
+        for (const auto& attribute : attributeDescriptions) {
+            add(attribute.location);
+            add(attribute.binding);
+            add(static_cast<uint32_t>(attribute.format));
+            add(attribute.offset);
+        }
+
+        // viewports and scissors, only their count when dynamic
+        add((std::max)(static_cast<uint32_t>(viewports.size()), 1u));
+        if (!isDynamic(vk::DynamicState::eViewport)) {
+            for (const auto& viewport : viewports) {
+                addFloat(viewport.x);
+                addFloat(viewport.y);
+                addFloat(viewport.width);
+                addFloat(viewport.height);
+                addFloat(viewport.minDepth);
+                addFloat(viewport.maxDepth);
+            }
+        }
+        add((std::max)(static_cast<uint32_t>(scissors.size()), 1u));
+        if (!isDynamic(vk::DynamicState::eScissor)) {
+            for (const auto& scissor : scissors) {
+                add(static_cast<uint32_t>(scissor.offset.x));
+                add(static_cast<uint32_t>(scissor.offset.y));
+                add(scissor.extent.width);
+                add(scissor.extent.height);
+            }
+        }
+    }
+
+    size_t hash() const
+    {
+        std::vector<uint32_t> key;
+        appendKey(key);
+        return hashKey(key);
+    }
+
+    bool operator==(const GraphicsPipelineState& other) const
+    {
+        std::vector<uint32_t> key, otherKey;
+        appendKey(key);
+        other.appendKey(otherKey);
+        return key == otherKey;
+    }
+
+    bool operator!=(const GraphicsPipelineState& other) const { return !(*this == other); }
+
+    // FNV-1a
+    static size_t hashKey(const std::vector<uint32_t>& key)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t word : key) {
+            hash ^= word;
+            hash *= 1099511628211ull;
+        }
+        return static_cast<size_t>(hash);
+    }
+
+    static uint32_t getTopologyClass(vk::PrimitiveTopology topology)
+    {
+        switch (topology) {
+        case vk::PrimitiveTopology::ePointList:
+            return 0;
+        case vk::PrimitiveTopology::eLineList:
+        case vk::PrimitiveTopology::eLineStrip:
+        case vk::PrimitiveTopology::eLineListWithAdjacency:
+        case vk::PrimitiveTopology::eLineStripWithAdjacency:
+            return 1;
+        case vk::PrimitiveTopology::ePatchList:
+            return 3;
+        default:
+            return 2;
+        }
+    }
+
     //-------------------------------------------------------------------------
     //
     //
@@ -391,6 +603,8 @@ public:
 
     void setLayout(vk::PipelineLayout layout) { createInfo.layout = layout; }
 
+    void setPipelineCache(vk::PipelineCache cache) { pipelineCache = cache; }
+
     //-------------------------------------------------------------------------
     //
     //
@@ -423,7 +637,10 @@ public:
         }
         temporaryModules.push_back(shaderModule);
 
-        return addShader(shaderModule, stage, entryPoint);
+        // identified by their code, the module is new every time
+        vk::PipelineShaderStageCreateInfo& shaderStage = addShader(shaderModule, stage, entryPoint);
+        shaderKeys.back() = hashCode(code.data(), sizeof(T) * code.size());
+        return shaderStage;
     }
 
     vk::PipelineShaderStageCreateInfo& addShader(
@@ -437,15 +654,29 @@ public:
         shaderStage.pName  = entryPoint;
 
         shaderStages.push_back(shaderStage);
+        shaderKeys.push_back((uint64_t)static_cast<VkShaderModule>(shaderModule));
         return shaderStages.back();
     }
 
+    // shared module, identified by the key of its owner (ShaderModuleRegistry)
+    vk::PipelineShaderStageCreateInfo& addShader(
+        vk::ShaderModule        shaderModule,
+        vk::ShaderStageFlagBits stage,
+        uint64_t                key,
+        const char*             entryPoint = "main")
+    {
+        vk::PipelineShaderStageCreateInfo& shaderStage = addShader(shaderModule, stage, entryPoint);
+        shaderKeys.back() = key;
+        return shaderStage;
+    }
+
     //-------------------------------------------------------------------------
     //
     //
     void clearShaders()
     {
         shaderStages.clear();
+        shaderKeys.clear();
         destroyShaderModules();
     }
 
@@ -475,6 +706,65 @@ public:
 
     vk::Pipeline createPipeline() { return createPipeline(pipelineCache); }
 
+    // through the persistent cache, timed
+    vk::Pipeline createPipeline(PipelineCache& cache)
+    {
+        update();
+        return cache.createGraphicsPipeline(createInfo);
+    }
+
+    //-------------------------------------------------------------------------
+    // Pipeline state, shaders (with their specialization), layout and
+    // render pass: equal keys give the same pipeline
+    //
+    std::vector<uint32_t> getKey() const
+    {
+        std::vector<uint32_t> key;
+        auto addHandle = [&key](uint64_t handle) {
+            key.push_back(static_cast<uint32_t>(handle));
+            key.push_back(static_cast<uint32_t>(handle >> 32));
+        };
+
+        addHandle((uint64_t)static_cast<VkPipelineLayout>(createInfo.layout));
+        addHandle((uint64_t)static_cast<VkRenderPass>(createInfo.renderPass));
+        key.push_back(createInfo.subpass);
+
+        key.push_back(static_cast<uint32_t>(shaderStages.size()));
+        for (size_t i = 0; i < shaderStages.size(); i++) {
+            const vk::PipelineShaderStageCreateInfo& stage = shaderStages[i];
+            key.push_back(static_cast<uint32_t>(stage.stage));
+            addHandle(shaderKeys[i]);
+            addHandle(hashCode(stage.pName, strlen(stage.pName)));
+
+            const vk::SpecializationInfo* specialization = stage.pSpecializationInfo;
+            if (!specialization) {
+                key.push_back(0);
+                continue;
+            }
+            key.push_back(specialization->mapEntryCount);
+            for (uint32_t e = 0; e < specialization->mapEntryCount; e++) {
+                key.push_back(specialization->pMapEntries[e].constantID);
+                key.push_back(specialization->pMapEntries[e].offset);
+                key.push_back(static_cast<uint32_t>(specialization->pMapEntries[e].size));
+            }
+            addHandle(hashCode(specialization->pData, specialization->dataSize));
+        }
+
+        pipelineState.appendKey(key);
+        return key;
+    }
+
+    // FNV-1a
+    static uint64_t hashCode(const void* data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= static_cast<const uint8_t*>(data)[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
     //-------------------------------------------------------------------------
     //
     //
@@ -519,6 +809,7 @@ private:
     vk::GraphicsPipelineCreateInfo                 createInfo;
 
     std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+    std::vector<uint64_t>                          shaderKeys;   // per stage, code hash or module handle
     std::vector<vk::ShaderModule>                  temporaryModules;
 
     GraphicsPipelineState&                         pipelineState;
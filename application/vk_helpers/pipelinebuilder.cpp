@@ -0,0 +1,163 @@
+/*
+ *
+ * Andrew Frost
+ * pipelinebuilder.cpp
+ * 2020
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <stdexcept>
+#include "pipelinebuilder.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// PipelineBuilder                                                       //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void PipelineBuilder::init(vk::Device device, PipelineCache* cache, uint32_t workerCount)
+{
+    assert(!m_device);
+    assert(cache);
+    m_device   = device;
+    m_cache    = cache;
+    m_stopping = false;
+    m_stats    = Stats();
+
+    if (!workerCount)
+        workerCount = (std::max)(std::thread::hardware_concurrency(), 2u) - 1;
+
+    // warm entries of the main cache are hits for every worker
+    const std::vector<uint8_t> data = m_cache->getData();
+    vk::PipelineCacheCreateInfo createInfo = {};
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData    = data.empty() ? nullptr : data.data();
+
+    for (uint32_t i = 0; i < workerCount; i++) {
+        try {
+            m_workerCaches.push_back(m_device.createPipelineCache(createInfo));
+        }
+        catch (vk::SystemError err) {
+            throw std::runtime_error("failed to create worker pipeline cache!");
+        }
+    }
+
+    m_stats.workerCount = workerCount;
+    for (uint32_t i = 0; i < workerCount; i++)
+        m_workers.emplace_back(&PipelineBuilder::run, this, i);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void PipelineBuilder::deinit()
+{
+    if (!m_device)
+        return;
+
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_taskCondition.notify_all();
+    for (auto& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+
+    for (const auto& cache : m_workerCaches)
+        m_device.destroyPipelineCache(cache);
+    m_workerCaches.clear();
+
+    m_cache  = nullptr;
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+std::future<vk::Pipeline> PipelineBuilder::submit(Job job)
+{
+    assert(m_device);
+
+    Task task;
+    task.job = std::move(job);
+    std::future<vk::Pipeline> future = task.promise.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+        m_stats.pending++;
+    }
+    m_taskCondition.notify_one();
+    return future;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void PipelineBuilder::wait()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idleCondition.wait(lock, [this]() { return m_stats.pending == 0; });
+    }
+    m_cache->merge(m_workerCaches);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void PipelineBuilder::run(uint32_t workerID)
+{
+    const vk::PipelineCache cache = m_workerCaches[workerID];
+
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_taskCondition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty())
+                return;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        try {
+            task.promise.set_value(task.job(cache));
+        }
+        catch (...) {
+            task.promise.set_exception(std::current_exception());
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        m_cache->addCreateTime(ms);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.pending--;
+            m_stats.compiled++;
+            m_stats.compileMs += ms;
+        }
+        m_idleCondition.notify_all();
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+PipelineBuilder::Stats PipelineBuilder::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+} // namespace app
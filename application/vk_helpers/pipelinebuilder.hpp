@@ -0,0 +1,97 @@
+/*
+ *
+ * Andrew Frost
+ * pipelinebuilder.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "pipelinecache.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// PipelineBuilder                                                       //
+///////////////////////////////////////////////////////////////////////////
+// Compiles pipelines on worker threads, the caller keeps going and      //
+// picks the pipeline up through the returned future                     //
+// - a job creates one pipeline with the cache it is given, shader       //
+//   modules and create infos live in the job                            //
+// - each worker has a cache of its own, seeded with the main one, so    //
+//   the driver does not serialize the workers on a shared cache         //
+// - wait() merges the worker caches back, the main cache saved on exit  //
+//   holds everything compiled                                           //
+// Exceptions thrown by a job are rethrown by the future's get()         //
+///////////////////////////////////////////////////////////////////////////
+
+class PipelineBuilder
+{
+public:
+    using Job = std::function<vk::Pipeline(vk::PipelineCache)>;
+
+    struct Stats
+    {
+        uint32_t workerCount = 0;
+        uint32_t pending     = 0;   // queued or compiling
+        uint32_t compiled    = 0;
+        double   compileMs   = 0.0; // summed over the workers
+    };
+
+    PipelineBuilder(PipelineBuilder const&) = delete;
+    PipelineBuilder& operator=(PipelineBuilder const&) = delete;
+
+    PipelineBuilder() {}
+    ~PipelineBuilder() { deinit(); }
+
+    // workerCount 0: one per core, the calling thread excluded
+    void init(vk::Device device, PipelineCache* cache, uint32_t workerCount = 0);
+
+    // finishes the queued jobs
+    void deinit();
+
+    std::future<vk::Pipeline> submit(Job job);
+
+    //-------------------------------------------------------------------------
+    // Blocks until no job is left, then merges the worker caches into the
+    // main one. Called by the thread that owns the main cache
+    //
+    void wait();
+
+    Stats getStats() const;
+
+private:
+    struct Task
+    {
+        Job                        job;
+        std::promise<vk::Pipeline> promise;
+    };
+
+    void run(uint32_t workerID);
+
+    vk::Device                     m_device;
+    PipelineCache*                 m_cache{ nullptr };
+
+    std::vector<std::thread>       m_workers;
+    std::vector<vk::PipelineCache> m_workerCaches;   // one per worker
+
+    mutable std::mutex             m_mutex;
+    std::condition_variable        m_taskCondition;  // task queued or stopping
+    std::condition_variable        m_idleCondition;  // task done
+    std::deque<Task>               m_tasks;
+    bool                           m_stopping{ false };
+    Stats                          m_stats;
+
+}; // class PipelineBuilder
+
+} // namespace app
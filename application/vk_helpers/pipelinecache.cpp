@@ -0,0 +1,252 @@
+/*
+ *
+ * Andrew Frost
+ * pipelinecache.cpp
+ * 2020
+ *
+ */
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "pipelinecache.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// PipelineCache                                                         //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void PipelineCache::init(vk::Device device, vk::PhysicalDevice physicalDevice, const std::string& filename)
+{
+    assert(!m_device);
+    m_device     = device;
+    m_filename   = filename;
+    m_properties = physicalDevice.getProperties();
+    m_stats      = Stats();
+
+    std::vector<char> data;
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (file.is_open()) {
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), data.size());
+        if (!file)
+            data.clear();
+    }
+
+    if (!file.is_open())
+        m_stats.status = "no cache file";
+    else if (isValid(data, m_stats.status))
+        m_stats.warm = true;
+    else
+        data.clear();
+
+    vk::PipelineCacheCreateInfo createInfo = {};
+    createInfo.initialDataSize = data.size();
+    createInfo.pInitialData    = data.empty() ? nullptr : data.data();
+
+    try {
+        m_cache = m_device.createPipelineCache(createInfo);
+    }
+    catch (vk::SystemError err) {
+        if (data.empty())
+            throw std::runtime_error("failed to create pipeline cache!");
+
+        // the driver may still refuse data it wrote itself
+        m_stats.warm   = false;
+        m_stats.status = "cache file rejected by the driver";
+        try {
+            m_cache = m_device.createPipelineCache(vk::PipelineCacheCreateInfo());
+        }
+        catch (vk::SystemError err) {
+            throw std::runtime_error("failed to create pipeline cache!");
+        }
+    }
+
+    if (m_stats.warm)
+        m_stats.loadedBytes = data.size();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void PipelineCache::deinit()
+{
+    if (!m_device)
+        return;
+
+    save();
+    m_device.destroyPipelineCache(m_cache);
+    m_cache  = nullptr;
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Header of VK_PIPELINE_CACHE_HEADER_VERSION_ONE, the rest of the data
+// is validated by the driver
+//
+bool PipelineCache::isValid(const std::vector<char>& data, std::string& status) const
+{
+    struct Header
+    {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t  uuid[VK_UUID_SIZE];
+    };
+
+    Header header = {};
+    if (data.size() < sizeof(Header)) {
+        status = "cache file truncated";
+        return false;
+    }
+    std::memcpy(&header, data.data(), sizeof(Header));
+
+    if (header.headerSize < sizeof(Header) || header.headerSize > data.size()) {
+        status = "cache file header size mismatch";
+        return false;
+    }
+    if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE) {
+        status = "cache file header version mismatch";
+        return false;
+    }
+    if (header.vendorID != m_properties.vendorID || header.deviceID != m_properties.deviceID) {
+        status = "cache file from another device";
+        return false;
+    }
+    if (std::memcmp(header.uuid, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        status = "cache file from another driver";
+        return false;
+    }
+
+    status = "cache file loaded";
+    return true;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+bool PipelineCache::save()
+{
+    if (!m_cache)
+        return false;
+
+    std::vector<uint8_t> data = getData();
+    if (data.empty())
+        return false;
+
+    const std::string tempname = m_filename + ".tmp";
+    {
+        std::ofstream file(tempname, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!file)
+            return false;
+    }
+
+    // rename does not replace an existing file everywhere
+    std::remove(m_filename.c_str());
+    if (std::rename(tempname.c_str(), m_filename.c_str()) != 0)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.savedBytes = data.size();
+    return true;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+std::vector<uint8_t> PipelineCache::getData() const
+{
+    try {
+        return m_device.getPipelineCacheData(m_cache);
+    }
+    catch (vk::SystemError err) {
+        return {};
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void PipelineCache::merge(const std::vector<vk::PipelineCache>& caches)
+{
+    if (caches.empty())
+        return;
+
+    try {
+        m_device.mergePipelineCaches(m_cache, caches);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to merge pipeline caches!");
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::Pipeline PipelineCache::createGraphicsPipeline(const vk::GraphicsPipelineCreateInfo& createInfo)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    vk::Pipeline pipeline;
+    try {
+        pipeline = m_device.createGraphicsPipeline(m_cache, createInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create graphics Pipeline!");
+    }
+
+    addCreateTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return pipeline;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::Pipeline PipelineCache::createComputePipeline(const vk::ComputePipelineCreateInfo& createInfo)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    vk::Pipeline pipeline;
+    try {
+        pipeline = m_device.createComputePipeline(m_cache, createInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create compute Pipeline!");
+    }
+
+    addCreateTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return pipeline;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void PipelineCache::addCreateTime(double ms)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.pipelineCount++;
+    m_stats.createMs += ms;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+PipelineCache::Stats PipelineCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+} // namespace app
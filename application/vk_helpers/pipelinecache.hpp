@@ -0,0 +1,97 @@
+/*
+ *
+ * Andrew Frost
+ * pipelinecache.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace app {
+
+#define APP_DEFAULT_PIPELINE_CACHE_FILE "pipeline_cache.bin"
+
+///////////////////////////////////////////////////////////////////////////
+// PipelineCache                                                         //
+///////////////////////////////////////////////////////////////////////////
+// vk::PipelineCache kept on disk between runs                           //
+// - init() seeds the cache with the file when its header matches the    //
+//   device: header version, vendor, device and pipelineCacheUUID. A     //
+//   driver or GPU change starts from an empty cache                     //
+// - deinit() writes the cache back, through a temporary file so a       //
+//   crash never leaves a truncated cache behind                         //
+// - pipelines created through it report their creation time, to tell    //
+//   cold (empty cache) from warm starts                                 //
+///////////////////////////////////////////////////////////////////////////
+
+class PipelineCache
+{
+public:
+    struct Stats
+    {
+        bool        warm          = false;   // seeded from the file
+        std::string status;                  // why the file was used or ignored
+        size_t      loadedBytes   = 0;
+        size_t      savedBytes    = 0;
+        uint32_t    pipelineCount = 0;
+        double      createMs      = 0.0;     // all pipelines created through the cache
+    };
+
+    PipelineCache(PipelineCache const&) = delete;
+    PipelineCache& operator=(PipelineCache const&) = delete;
+
+    PipelineCache() {}
+    ~PipelineCache() { deinit(); }
+
+    void init(vk::Device device, vk::PhysicalDevice physicalDevice,
+              const std::string& filename = APP_DEFAULT_PIPELINE_CACHE_FILE);
+
+    // saves, then destroys the cache
+    void deinit();
+
+    // false when the file could not be written
+    bool save();
+
+    vk::PipelineCache get() const { return m_cache; }
+
+    // current content, to seed other caches
+    std::vector<uint8_t> getData() const;
+
+    //-------------------------------------------------------------------------
+    // Adds what the other caches learned. The cache must not be used by
+    // another thread meanwhile
+    //
+    void merge(const std::vector<vk::PipelineCache>& caches);
+
+    //-------------------------------------------------------------------------
+    // Creation through the cache, timed. Thread safe, the driver
+    // synchronizes the cache itself
+    //
+    vk::Pipeline createGraphicsPipeline(const vk::GraphicsPipelineCreateInfo& createInfo);
+    vk::Pipeline createComputePipeline(const vk::ComputePipelineCreateInfo& createInfo);
+
+    // pipelines created elsewhere with get()
+    void addCreateTime(double ms);
+
+    Stats getStats() const;
+
+private:
+    bool isValid(const std::vector<char>& data, std::string& status) const;
+
+    vk::Device                   m_device;
+    std::string                  m_filename;
+    vk::PipelineCache            m_cache;
+    vk::PhysicalDeviceProperties m_properties;
+
+    mutable std::mutex           m_mutex;   // stats
+    Stats                        m_stats;
+
+}; // class PipelineCache
+
+} // namespace app
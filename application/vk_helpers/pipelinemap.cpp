@@ -0,0 +1,149 @@
+/*
+ *
+ * Andrew Frost
+ * pipelinemap.cpp
+ * 2020
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include "pipelinemap.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// GraphicsPipelineMap                                                   //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void GraphicsPipelineMap::init(vk::Device device, PipelineCache* cache)
+{
+    assert(!m_device);
+    assert(cache);
+    m_device = device;
+    m_cache  = cache;
+    m_stats  = Stats();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void GraphicsPipelineMap::deinit()
+{
+    if (!m_device)
+        return;
+
+    for (const auto& entry : m_pipelines)
+        m_device.destroyPipeline(entry.second.pipeline);
+    m_pipelines.clear();
+
+    m_stats  = Stats();
+    m_cache  = nullptr;
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::Pipeline GraphicsPipelineMap::find(const Key& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_pipelines.find(key);
+    if (it == m_pipelines.end())
+        return nullptr;
+
+    m_stats.hits++;
+    return it->second.pipeline;
+}
+
+//-------------------------------------------------------------------------
+// Another thread may have created the same pipeline meanwhile, the first
+// one in is kept
+//
+vk::Pipeline GraphicsPipelineMap::insert(const Key& key, vk::Pipeline pipeline,
+                                         const std::vector<uint64_t>& shaderKeys)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto result = m_pipelines.emplace(key, Value{ pipeline, shaderKeys });
+    if (!result.second) {
+        m_device.destroyPipeline(pipeline);
+        m_stats.hits++;
+        return result.first->second.pipeline;
+    }
+
+    m_stats.misses++;
+    m_stats.pipelineCount++;
+    return pipeline;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::Pipeline GraphicsPipelineMap::get(GraphicsPipelineGenerator& generator)
+{
+    Key key;
+    key.words = generator.getKey();
+    key.hash  = GraphicsPipelineState::hashKey(key.words);
+
+    vk::Pipeline pipeline = find(key);
+    if (pipeline)
+        return pipeline;
+
+    return insert(key, generator.createPipeline(*m_cache), generator.shaderKeys);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::Pipeline GraphicsPipelineMap::get(GraphicsPipelineGenerator& generator, vk::PipelineCache cache)
+{
+    Key key;
+    key.words = generator.getKey();
+    key.hash  = GraphicsPipelineState::hashKey(key.words);
+
+    vk::Pipeline pipeline = find(key);
+    if (pipeline)
+        return pipeline;
+
+    return insert(key, generator.createPipeline(cache), generator.shaderKeys);
+}
+
+//-------------------------------------------------------------------------
+// A pipeline made from a replaced module would only be found again by a
+// request with the old code, none will come
+//
+std::vector<vk::Pipeline> GraphicsPipelineMap::remove(const std::vector<uint64_t>& shaderKeys)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<vk::Pipeline> removed;
+    for (auto it = m_pipelines.begin(); it != m_pipelines.end();) {
+        const std::vector<uint64_t>& keys = it->second.shaderKeys;
+        if (std::find_first_of(keys.begin(), keys.end(), shaderKeys.begin(), shaderKeys.end()) == keys.end()) {
+            ++it;
+            continue;
+        }
+        removed.push_back(it->second.pipeline);
+        it = m_pipelines.erase(it);
+    }
+
+    m_stats.pipelineCount -= static_cast<uint32_t>(removed.size());
+    m_stats.removed       += static_cast<uint32_t>(removed.size());
+    return removed;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+GraphicsPipelineMap::Stats GraphicsPipelineMap::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+} // namespace app
@@ -0,0 +1,99 @@
+/*
+ *
+ * Andrew Frost
+ * pipelinemap.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "pipeline.hpp"
+#include "pipelinecache.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// GraphicsPipelineMap                                                   //
+///////////////////////////////////////////////////////////////////////////
+// Graphics pipelines deduplicated by GraphicsPipelineGenerator::getKey  //
+// - the pipeline state, shader code and specialization, layout and      //
+//   render pass: a request equal to an earlier one returns its pipeline //
+// - misses are created through the pipeline cache, or the cache given   //
+//   by the caller (builder workers)                                     //
+// - owns the pipelines, destroyed by deinit() or handed back by         //
+//   remove() when the shader code they were made from is replaced       //
+// Thread safe, creation runs outside the lock                           //
+///////////////////////////////////////////////////////////////////////////
+
+class GraphicsPipelineMap
+{
+public:
+    struct Stats
+    {
+        uint32_t pipelineCount = 0;
+        uint32_t hits          = 0;
+        uint32_t misses        = 0;
+        uint32_t removed       = 0;
+    };
+
+    GraphicsPipelineMap(GraphicsPipelineMap const&) = delete;
+    GraphicsPipelineMap& operator=(GraphicsPipelineMap const&) = delete;
+
+    GraphicsPipelineMap() {}
+    ~GraphicsPipelineMap() { deinit(); }
+
+    void init(vk::Device device, PipelineCache* cache);
+
+    // the GPU must be done with the pipelines
+    void deinit();
+
+    vk::Pipeline get(GraphicsPipelineGenerator& generator);
+    vk::Pipeline get(GraphicsPipelineGenerator& generator, vk::PipelineCache cache);
+
+    //-------------------------------------------------------------------------
+    // Takes out the pipelines made from any of the shader keys and returns
+    // them, for the caller to destroy once no frame uses them
+    //
+    std::vector<vk::Pipeline> remove(const std::vector<uint64_t>& shaderKeys);
+
+    Stats getStats() const;
+
+private:
+    struct Key
+    {
+        std::vector<uint32_t> words;
+        size_t                hash = 0;
+
+        bool operator==(const Key& other) const { return hash == other.hash && words == other.words; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const { return key.hash; }
+    };
+
+    struct Value
+    {
+        vk::Pipeline          pipeline;
+        std::vector<uint64_t> shaderKeys;   // GraphicsPipelineGenerator::shaderKeys
+    };
+
+    vk::Pipeline find(const Key& key);
+    vk::Pipeline insert(const Key& key, vk::Pipeline pipeline, const std::vector<uint64_t>& shaderKeys);
+
+    vk::Device                                      m_device;
+    PipelineCache*                                  m_cache{ nullptr };
+
+    mutable std::mutex                              m_mutex;
+    std::unordered_map<Key, Value, KeyHash>         m_pipelines;
+    Stats                                           m_stats;
+
+}; // class GraphicsPipelineMap
+
+} // namespace app
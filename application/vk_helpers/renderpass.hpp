@@ -15,6 +15,8 @@ namespace util {
 
 //////////////////////////////////////////////////////////////////////////
 // Create Renderpass
+// transientMultisample: with a resolve attachment, the multisampled color
+// and depth are not stored, they can live in lazily allocated memory
 //////////////////////////////////////////////////////////////////////////
 
 inline vk::RenderPass createRenderPass(
@@ -27,20 +29,22 @@ inline vk::RenderPass createRenderPass(
     bool                           clearColor    = true,
     bool                           clearDepth    = true,
     vk::ImageLayout                initialLayout = vk::ImageLayout::eUndefined,
-    vk::ImageLayout                finalLayout   = vk::ImageLayout::ePresentSrcKHR)
+    vk::ImageLayout                finalLayout   = vk::ImageLayout::ePresentSrcKHR,
+    bool                           transientMultisample = false)
 {
     std::vector<vk::AttachmentDescription> allAttachments;
     std::vector<vk::AttachmentReference>   colorAttachmentRefs;
 
     bool hasDepth = depthAttachmentFormat != vk::Format::eUndefined;
     bool hasResolve = resolveAttachmentFormat != vk::Format::eUndefined;
+    bool transient  = transientMultisample && hasResolve;
 
     for (const auto& format : colorAttachmentFormats) {
         vk::AttachmentDescription colorAttachment = {};
         colorAttachment.format         = format;
         colorAttachment.samples        = sampleCount;
         colorAttachment.loadOp         = clearColor ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eDontCare;
-        colorAttachment.storeOp        = vk::AttachmentStoreOp::eStore;
+        colorAttachment.storeOp        = transient ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore;
         colorAttachment.stencilLoadOp  = vk::AttachmentLoadOp::eDontCare;
         colorAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
         colorAttachment.initialLayout  = initialLayout;
@@ -61,7 +65,7 @@ inline vk::RenderPass createRenderPass(
         depthAttachment.format         = depthAttachmentFormat;
         depthAttachment.samples        = sampleCount;
         depthAttachment.loadOp         = clearDepth ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
-        depthAttachment.storeOp        = vk::AttachmentStoreOp::eStore;
+        depthAttachment.storeOp        = transient ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore;
         depthAttachment.stencilLoadOp  = vk::AttachmentLoadOp::eDontCare;
         depthAttachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
         depthAttachment.initialLayout  = vk::ImageLayout::eDepthStencilAttachmentOptimal;
@@ -0,0 +1,330 @@
+/*
+ *
+ * Andrew Frost
+ * rendertargetpool.cpp
+ * 2020
+ *
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include "rendertargetpool.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// RenderTargetPool                                                      //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void RenderTargetPool::init(vk::Device device, vk::PhysicalDevice physicalDevice, Timeline* timeline)
+{
+    assert(!m_device);
+    m_device           = device;
+    m_memoryProperties = physicalDevice.getMemoryProperties();
+    m_timeline         = timeline;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void RenderTargetPool::deinit()
+{
+    if (!m_device)
+        return;
+
+    for (auto& block : m_blocks) {
+        assert(!block.users && "render target not released");
+        if (block.memory) {
+            if (m_memoryStats)
+                m_memoryStats->remove((uint64_t)static_cast<VkDeviceMemory>(block.memory));
+            m_device.freeMemory(block.memory);
+        }
+    }
+    m_blocks.clear();
+
+    m_stats  = Stats();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void RenderTargetPool::setMemoryStats(MemoryStats* stats)
+{
+    for (const auto& block : m_blocks) {
+        if (!block.memory)
+            continue;
+        if (m_memoryStats)
+            m_memoryStats->remove((uint64_t)static_cast<VkDeviceMemory>(block.memory));
+        if (stats)
+            stats->add((uint64_t)static_cast<VkDeviceMemory>(block.memory), MemoryStats::Category::eRenderTarget, block.size);
+    }
+    m_memoryStats = stats;
+}
+
+//-------------------------------------------------------------------------
+// Memory type supporting typeBits with all of flags, ~0 when none
+//
+uint32_t RenderTargetPool::findMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags flags) const
+{
+    for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+        if ((typeBits & (1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & flags) == flags) {
+            return i;
+        }
+    }
+    return ~0u;
+}
+
+//-------------------------------------------------------------------------
+// Blocks of an alias group only serve that group
+//
+bool RenderTargetPool::isSameKind(const Block& a, const Block& b)
+{
+    if (a.aliasGroup || b.aliasGroup)
+        return a.aliasGroup == b.aliasGroup;
+    return a.format == b.format && a.samples == b.samples && a.usage == b.usage;
+}
+
+//-------------------------------------------------------------------------
+// Smallest free block of the same kind the image fits in, whose last
+// use has completed on the GPU. Alias groups also share blocks in use
+//
+uint32_t RenderTargetPool::findFreeBlock(const Block& key, const vk::MemoryRequirements& memReqs) const
+{
+    uint32_t bestID = ~0u;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_blocks.size()); i++) {
+        const Block& block = m_blocks[i];
+
+        if (!block.memory || !isSameKind(block, key))
+            continue;
+        if (block.users && !key.aliasGroup)
+            continue;
+        if (!(memReqs.memoryTypeBits & (1 << block.memoryTypeIndex)))
+            continue;
+        if (block.size < memReqs.size || (!key.aliasGroup && float(block.size) > float(memReqs.size) * m_maxWaste))
+            continue;
+        if (bestID != ~0u && m_blocks[bestID].size <= block.size)
+            continue;
+        if (!block.users && m_timeline && !m_timeline->isComplete(block.busyValue))
+            continue;
+
+        bestID = i;
+    }
+    return bestID;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint32_t RenderTargetPool::allocateBlock(const Block& key, const vk::MemoryRequirements& memReqs,
+                                         vk::MemoryPropertyFlags preferredFlags)
+{
+    uint32_t memoryTypeIndex = findMemoryType(memReqs.memoryTypeBits, preferredFlags);
+    if (memoryTypeIndex == ~0u)
+        memoryTypeIndex = findMemoryType(memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+    if (memoryTypeIndex == ~0u)
+        throw std::runtime_error("failed to find suitable memory type!");
+
+    // headroom, rounded to the image alignment
+    vk::DeviceSize size = vk::DeviceSize(double(memReqs.size) * double(m_headroom));
+    size = (std::max)(size, memReqs.size);
+    size = (size + memReqs.alignment - 1) / memReqs.alignment * memReqs.alignment;
+
+    vk::MemoryAllocateInfo memAllocInfo = {};
+    memAllocInfo.allocationSize  = size;
+    memAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    Block block           = key;
+    block.size            = size;
+    block.memoryTypeIndex = memoryTypeIndex;
+    try {
+        block.memory = m_device.allocateMemory(memAllocInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to allocate render target memory!");
+    }
+
+    m_stats.blockCount++;
+    m_stats.allocations++;
+    m_stats.allocatedSize += size;
+    if (m_memoryStats)
+        m_memoryStats->add((uint64_t)static_cast<VkDeviceMemory>(block.memory), MemoryStats::Category::eRenderTarget, size);
+
+    // recycle a freed slot
+    for (uint32_t i = 0; i < static_cast<uint32_t>(m_blocks.size()); i++) {
+        if (!m_blocks[i].memory) {
+            m_blocks[i] = block;
+            return i;
+        }
+    }
+    m_blocks.push_back(block);
+    return static_cast<uint32_t>(m_blocks.size() - 1);
+}
+
+//-------------------------------------------------------------------------
+// Free the least recently released blocks of this kind beyond the limit,
+// the memory goes away once its last use completed
+//
+void RenderTargetPool::trimFreeBlocks(const Block& key)
+{
+    while (true) {
+        uint32_t freeCount = 0;
+        uint32_t oldestID  = ~0u;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(m_blocks.size()); i++) {
+            const Block& block = m_blocks[i];
+            if (!block.memory || block.users || !isSameKind(block, key))
+                continue;
+
+            freeCount++;
+            if (oldestID == ~0u || block.lastRelease < m_blocks[oldestID].lastRelease)
+                oldestID = i;
+        }
+
+        if (freeCount <= m_maxFreeBlocks)
+            return;
+
+        Block& block = m_blocks[oldestID];
+        m_stats.blockCount--;
+        m_stats.allocatedSize -= block.size;
+        if (m_memoryStats)
+            m_memoryStats->remove((uint64_t)static_cast<VkDeviceMemory>(block.memory));
+
+        vk::Device       device = m_device;
+        vk::DeviceMemory memory = block.memory;
+        if (m_timeline)
+            m_timeline->retire(block.busyValue, [device, memory]() { device.freeMemory(memory); });
+        else
+            device.freeMemory(memory);
+
+        block = Block();
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+RenderTarget RenderTargetPool::acquire(const vk::Extent2D& extent, vk::Format format, vk::SampleCountFlagBits samples,
+                                       vk::ImageUsageFlags usage, vk::MemoryPropertyFlags preferredFlags,
+                                       uint32_t aliasGroup)
+{
+    RenderTarget target = {};
+    target.extent  = extent;
+    target.format  = format;
+    target.samples = samples;
+
+    vk::ImageCreateInfo imageCreateInfo = {};
+    imageCreateInfo.imageType     = vk::ImageType::e2D;
+    imageCreateInfo.format        = format;
+    imageCreateInfo.extent        = vk::Extent3D(extent.width, extent.height, 1);
+    imageCreateInfo.mipLevels     = 1;
+    imageCreateInfo.arrayLayers   = 1;
+    imageCreateInfo.samples       = samples;
+    imageCreateInfo.tiling        = vk::ImageTiling::eOptimal;
+    imageCreateInfo.usage         = usage;
+    imageCreateInfo.sharingMode   = vk::SharingMode::eExclusive;
+    imageCreateInfo.initialLayout = vk::ImageLayout::eUndefined;
+
+    try {
+        target.image = m_device.createImage(imageCreateInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create render target image!");
+    }
+
+    Block key      = {};
+    key.format     = format;
+    key.samples    = samples;
+    key.usage      = usage;
+    key.aliasGroup = aliasGroup;
+
+    const vk::MemoryRequirements memReqs = m_device.getImageMemoryRequirements(target.image);
+
+    target.blockID = findFreeBlock(key, memReqs);
+    if (target.blockID != ~0u)
+        m_stats.reuses++;
+    else
+        target.blockID = allocateBlock(key, memReqs, preferredFlags);
+
+    Block& block = m_blocks[target.blockID];
+    if (block.users++)
+        m_stats.aliases++;
+    else
+        m_stats.blocksInUse++;
+
+    m_device.bindImageMemory(target.image, block.memory, 0);
+
+    // view over the whole image
+    vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+    switch (format) {
+    case vk::Format::eD16Unorm:
+    case vk::Format::eX8D24UnormPack32:
+    case vk::Format::eD32Sfloat:
+        aspect = vk::ImageAspectFlagBits::eDepth;
+        break;
+    case vk::Format::eD16UnormS8Uint:
+    case vk::Format::eD24UnormS8Uint:
+    case vk::Format::eD32SfloatS8Uint:
+        aspect = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+        break;
+    default:
+        break;
+    }
+
+    vk::ImageViewCreateInfo viewCreateInfo = {};
+    viewCreateInfo.image            = target.image;
+    viewCreateInfo.viewType         = vk::ImageViewType::e2D;
+    viewCreateInfo.format           = format;
+    viewCreateInfo.subresourceRange = { aspect, 0, 1, 0, 1 };
+
+    try {
+        target.view = m_device.createImageView(viewCreateInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create render target image view!");
+    }
+
+    return target;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void RenderTargetPool::release(RenderTarget& target)
+{
+    if (!target.image)
+        return;
+
+    const uint64_t lastUse = m_timeline ? m_timeline->getSubmittedValue() : 0;
+
+    vk::Device    device = m_device;
+    vk::Image     image  = target.image;
+    vk::ImageView view   = target.view;
+    if (m_timeline) {
+        m_timeline->retire(lastUse, [device, image, view]() {
+            device.destroyImageView(view);
+            device.destroyImage(image);
+        });
+    }
+    else {
+        device.destroyImageView(view);
+        device.destroyImage(image);
+    }
+
+    Block& block    = m_blocks[target.blockID];
+    block.busyValue = (std::max)(block.busyValue, lastUse);
+    target          = RenderTarget();
+    if (--block.users)
+        return;   // still aliased
+
+    block.lastRelease = ++m_releaseCounter;
+    m_stats.blocksInUse--;
+
+    Block key = block;
+    trimFreeBlocks(key);
+}
+
+} // namespace app
@@ -0,0 +1,152 @@
+/*
+ *
+ * Andrew Frost
+ * rendertargetpool.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "timeline.hpp"
+#include "memorystats.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// RenderTarget                                                          //
+///////////////////////////////////////////////////////////////////////////
+
+struct RenderTarget
+{
+    vk::Image               image;
+    vk::ImageView           view;
+    vk::Extent2D            extent{ 0, 0 };
+    vk::Format              format{ vk::Format::eUndefined };
+    vk::SampleCountFlagBits samples{ vk::SampleCountFlagBits::e1 };
+    uint32_t                blockID{ ~0u };   // memory block inside the pool
+};
+
+///////////////////////////////////////////////////////////////////////////
+// RenderTargetPool                                                      //
+///////////////////////////////////////////////////////////////////////////
+// Render targets are recreated at the exact extent on every resize, but //
+// their memory is not:                                                  //
+// - memory blocks are keyed by (format, samples, usage) and allocated   //
+//   with headroom, so growing a little reuses the same block            //
+// - released blocks go back to a free list once the GPU is done with   //
+//   them (timeline value), shrinking and re-growing reuse them          //
+// - the least recently used free blocks beyond a limit are freed        //
+// - targets of the same alias group share a block, for intermediates    //
+//   whose uses in a frame don't overlap                                 //
+///////////////////////////////////////////////////////////////////////////
+
+class RenderTargetPool
+{
+public:
+    struct Stats
+    {
+        uint32_t       blockCount    = 0;
+        uint32_t       blocksInUse   = 0;
+        vk::DeviceSize allocatedSize = 0;
+        uint32_t       allocations   = 0;   // blocks ever allocated
+        uint32_t       reuses        = 0;   // acquires served from a free block
+        uint32_t       aliases       = 0;   // acquires sharing a block with a live target
+    };
+
+    RenderTargetPool(RenderTargetPool const&) = delete;
+    RenderTargetPool& operator=(RenderTargetPool const&) = delete;
+
+    RenderTargetPool() {}
+    ~RenderTargetPool() { deinit(); }
+
+    void init(vk::Device device, vk::PhysicalDevice physicalDevice, Timeline* timeline);
+
+    // GPU must be idle and all targets released
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // headroom   - new blocks are sized for (headroom x required) bytes
+    // maxWaste   - a free block is not used for a target needing less than
+    //              1 / maxWaste of it
+    // freeBlocks - free blocks kept around, per pool
+    //
+    void setHeadroom(float headroom)       { m_headroom = headroom; }
+    void setMaxWaste(float maxWaste)       { m_maxWaste = maxWaste; }
+    void setMaxFreeBlocks(uint32_t count)  { m_maxFreeBlocks = count; }
+
+    // blocks are reported as render targets, the current ones included
+    void setMemoryStats(MemoryStats* stats);
+
+    //-------------------------------------------------------------------------
+    // Image of the exact extent with a view over it. Memory comes from a
+    // free block when one fits, otherwise a new block with headroom.
+    // preferredFlags are tried first, device local is the fallback, e.g.
+    // eLazilyAllocated for eTransientAttachment images.
+    // aliasGroup != 0 binds the target to the memory of the other targets
+    // of the group when it fits, the caller guarantees their uses within a
+    // frame are separated by barriers. Acquire the largest first
+    //
+    RenderTarget acquire(
+        const vk::Extent2D&     extent,
+        vk::Format              format,
+        vk::SampleCountFlagBits samples,
+        vk::ImageUsageFlags     usage,
+        vk::MemoryPropertyFlags preferredFlags = vk::MemoryPropertyFlagBits::eDeviceLocal,
+        uint32_t                aliasGroup     = 0);
+
+    //-------------------------------------------------------------------------
+    // The image / view are retired on the timeline, the block is reusable
+    // once the GPU reached the last submitted value
+    //
+    void release(RenderTarget& target);
+
+    const Stats& getStats() const { return m_stats; }
+
+private:
+    struct Block
+    {
+        vk::Format              format{ vk::Format::eUndefined };
+        vk::SampleCountFlagBits samples{ vk::SampleCountFlagBits::e1 };
+        vk::ImageUsageFlags     usage;
+        uint32_t                aliasGroup{ 0 };  // matched instead of the above when != 0
+
+        vk::DeviceMemory        memory;
+        vk::DeviceSize          size{ 0 };
+        uint32_t                memoryTypeIndex{ ~0u };
+
+        uint32_t                users{ 0 };       // targets bound, > 1 when aliased
+        uint64_t                busyValue{ 0 };   // timeline value of the last use
+        uint64_t                lastRelease{ 0 }; // for LRU trimming
+    };
+
+    uint32_t findMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags flags) const;
+
+    static bool isSameKind(const Block& a, const Block& b);
+
+    uint32_t findFreeBlock(const Block& key, const vk::MemoryRequirements& memReqs) const;
+
+    uint32_t allocateBlock(const Block& key, const vk::MemoryRequirements& memReqs, vk::MemoryPropertyFlags preferredFlags);
+
+    void trimFreeBlocks(const Block& key);
+
+    vk::Device                         m_device;
+    vk::PhysicalDeviceMemoryProperties m_memoryProperties;
+    Timeline*                          m_timeline{ nullptr };
+    MemoryStats*                       m_memoryStats{ nullptr };
+
+    std::vector<Block>                 m_blocks;          // index = blockID, freed slots have no memory
+    uint64_t                           m_releaseCounter{ 0 };
+
+    float                              m_headroom{ 1.5f };
+    float                              m_maxWaste{ 4.0f };
+    uint32_t                           m_maxFreeBlocks{ 4 };
+
+    Stats                              m_stats;
+
+}; // class RenderTargetPool
+
+} // namespace app
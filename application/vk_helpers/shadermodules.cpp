@@ -0,0 +1,259 @@
+/*
+ *
+ * Andrew Frost
+ * shadermodules.cpp
+ * 2020
+ *
+ */
+
+#include <cassert>
+#include <stdexcept>
+#include "shadermodules.hpp"
+#include "pipeline.hpp"
+#include "../general_helpers/mappedfile.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// ShaderModuleRegistry                                                  //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void ShaderModuleRegistry::init(vk::Device device)
+{
+    assert(!m_device);
+    m_device = device;
+    m_stats  = Stats();
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void ShaderModuleRegistry::deinit()
+{
+    if (!m_device)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& entry : m_entries) {
+        if (entry.module)
+            m_device.destroyShaderModule(entry.module);
+        if (entry.staged)
+            m_device.destroyShaderModule(entry.staged);
+    }
+    m_entries.clear();
+    m_ids.clear();
+    m_stats  = Stats();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Free entries are reused, ids stay small
+//
+uint32_t ShaderModuleRegistry::acquire(const std::string& filename)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it = m_ids.find(filename);
+    if (it != m_ids.end()) {
+        m_entries[it->second].refCount++;
+        m_stats.references++;
+        m_stats.shared++;
+        return it->second;
+    }
+
+    Entry entry;
+    entry.filename  = filename;
+    entry.writeTime = tools::getFileWriteTime(filename);
+    entry.module    = load(filename, entry.key);
+    entry.refCount  = 1;
+
+    uint32_t moduleID = 0;
+    while (moduleID < m_entries.size() && m_entries[moduleID].refCount)
+        moduleID++;
+    if (moduleID == m_entries.size())
+        m_entries.emplace_back();
+    m_entries[moduleID] = entry;
+    m_ids[filename]     = moduleID;
+
+    m_stats.moduleCount++;
+    m_stats.references++;
+    return moduleID;
+}
+
+//-------------------------------------------------------------------------
+// Pipelines keep working once created, the module is not needed by them
+//
+void ShaderModuleRegistry::release(uint32_t moduleID)
+{
+    if (moduleID == INVALID_ID)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry& entry = m_entries[moduleID];
+    assert(entry.refCount);
+    m_stats.references--;
+    if (--entry.refCount)
+        return;
+
+    m_device.destroyShaderModule(entry.module);
+    if (entry.staged)
+        m_device.destroyShaderModule(entry.staged);
+    m_ids.erase(entry.filename);
+    entry = Entry();
+    m_stats.moduleCount--;
+}
+
+//-------------------------------------------------------------------------
+// The staged module while there is one, pipelines are built from it
+//
+vk::ShaderModule ShaderModuleRegistry::getModule(uint32_t moduleID) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Entry& entry = m_entries[moduleID];
+    return entry.staged ? entry.staged : entry.module;
+}
+
+uint64_t ShaderModuleRegistry::getKey(uint32_t moduleID) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Entry& entry = m_entries[moduleID];
+    return entry.staged ? entry.stagedKey : entry.key;
+}
+
+//-------------------------------------------------------------------------
+// A compiler may still be writing the file, whatever fails is tried again
+// with the next write
+//
+std::vector<uint32_t> ShaderModuleRegistry::stageChanged()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<uint32_t> changed;
+    for (uint32_t moduleID = 0; moduleID < m_entries.size(); moduleID++) {
+        Entry& entry = m_entries[moduleID];
+        if (!entry.refCount || entry.staged)
+            continue;
+
+        const uint64_t writeTime = tools::getFileWriteTime(entry.filename);
+        if (!writeTime || writeTime == entry.writeTime)
+            continue;
+        entry.writeTime = writeTime;
+
+        uint64_t         key = 0;
+        vk::ShaderModule module;
+        try {
+            module = load(entry.filename, key);
+        }
+        catch (const std::exception& e) {
+            m_stats.failures++;
+            m_stats.lastError = e.what();
+            continue;
+        }
+
+        // saved again without changes, nothing to rebuild
+        if (key == entry.key) {
+            m_device.destroyShaderModule(module);
+            continue;
+        }
+
+        entry.staged    = module;
+        entry.stagedKey = key;
+        changed.push_back(moduleID);
+    }
+    return changed;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+vk::ShaderModule ShaderModuleRegistry::commitStaged(uint32_t moduleID, uint64_t& replacedKey)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry& entry = m_entries[moduleID];
+    assert(entry.staged);
+
+    vk::ShaderModule replaced = entry.module;
+    replacedKey               = entry.key;
+    entry.module    = entry.staged;
+    entry.key       = entry.stagedKey;
+    entry.staged    = nullptr;
+    entry.stagedKey = 0;
+    m_stats.reloads++;
+    return replaced;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void ShaderModuleRegistry::discardStaged(uint32_t moduleID, const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry& entry = m_entries[moduleID];
+    assert(entry.staged);
+
+    m_device.destroyShaderModule(entry.staged);
+    entry.staged    = nullptr;
+    entry.stagedKey = 0;
+    m_stats.failures++;
+    m_stats.lastError = error;
+}
+
+//-------------------------------------------------------------------------
+// The driver copies the code, the mapping is closed on return
+//
+vk::ShaderModule ShaderModuleRegistry::load(const std::string& filename, uint64_t& key)
+{
+    tools::MappedFile file;
+    if (!file.open(filename))
+        throw std::runtime_error("failed to open file : " + filename);
+
+    const uint32_t* code = static_cast<const uint32_t*>(file.data());
+    if (!isValid(code, file.size()))
+        throw std::runtime_error("invalid SPIR-V : " + filename);
+
+    vk::ShaderModuleCreateInfo createInfo = {};
+    createInfo.codeSize = file.size();
+    createInfo.pCode    = code;
+
+    vk::ShaderModule module;
+    try {
+        module = m_device.createShaderModule(createInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create shader module!");
+    }
+
+    key = GraphicsPipelineGenerator::hashCode(code, file.size());
+    m_stats.loads++;
+    m_stats.mappedBytes += file.size();
+    return module;
+}
+
+//-------------------------------------------------------------------------
+// Header of the SPIR-V specification: magic, version, generator, bound,
+// schema. The rest is the driver's (and the validation layers') business
+//
+bool ShaderModuleRegistry::isValid(const uint32_t* code, size_t size)
+{
+    if (size < 5 * sizeof(uint32_t) || size % sizeof(uint32_t) != 0)
+        return false;
+    if (code[0] != 0x07230203)
+        return false;
+    if ((code[1] >> 16) != 1)
+        return false;  // major version
+    return code[3] != 0 && code[4] == 0;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+ShaderModuleRegistry::Stats ShaderModuleRegistry::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+} // namespace app
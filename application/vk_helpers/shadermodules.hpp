@@ -0,0 +1,125 @@
+/*
+ *
+ * Andrew Frost
+ * shadermodules.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// ShaderModuleRegistry                                                  //
+///////////////////////////////////////////////////////////////////////////
+// One vk::ShaderModule per SPIR-V file, shared by the pipelines using   //
+// it                                                                    //
+// - files are memory mapped and validated, the mapping is dropped once  //
+//   the module is created                                               //
+// - acquire() / release() count the users, the last release destroys    //
+//   the module                                                          //
+// - the key of a module is the hash of its code, the same as            //
+//   GraphicsPipelineGenerator gives code added directly                 //
+// - stageChanged() loads the files written since, next to the modules  //
+//   in use. getModule() hands out the staged module, the caller builds  //
+//   its pipelines from it then commits or discards it                   //
+// - a committed module is replaced, not destroyed: pipelines of frames  //
+//   in flight were made from it, the caller retires it                  //
+// Thread safe, but no pipeline may be in creation from a module that is //
+// staged, committed or discarded                                        //
+///////////////////////////////////////////////////////////////////////////
+
+class ShaderModuleRegistry
+{
+public:
+    static const uint32_t INVALID_ID = ~0u;
+
+    struct Stats
+    {
+        uint32_t    moduleCount = 0;
+        uint32_t    references  = 0;
+        uint32_t    loads       = 0;  // modules created, reloads included
+        uint32_t    shared      = 0;  // acquires served by a loaded module
+        uint32_t    reloads     = 0;
+        uint32_t    failures    = 0;  // reloads rejected, the old module kept
+        size_t      mappedBytes = 0;  // SPIR-V read through mappings
+        std::string lastError;
+    };
+
+    ShaderModuleRegistry(ShaderModuleRegistry const&) = delete;
+    ShaderModuleRegistry& operator=(ShaderModuleRegistry const&) = delete;
+
+    ShaderModuleRegistry() {}
+    ~ShaderModuleRegistry() { deinit(); }
+
+    void init(vk::Device device);
+
+    // modules still acquired are destroyed as well
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Adds a user to the module of the file, loaded on first use. Throws
+    // when the file is missing or not SPIR-V
+    //
+    uint32_t acquire(const std::string& filename);
+    void     release(uint32_t moduleID);
+
+    vk::ShaderModule getModule(uint32_t moduleID) const;
+    uint64_t         getKey(uint32_t moduleID) const;
+
+    //-------------------------------------------------------------------------
+    // Compares the write time of every file, stages the new code of the
+    // changed ones and returns their ids. A file failing to load keeps its
+    // old module and is tried again once written again
+    //
+    std::vector<uint32_t> stageChanged();
+
+    //-------------------------------------------------------------------------
+    // The pipelines of the staged module were built: it replaces the
+    // module in use, which is returned for the caller to destroy once no
+    // frame uses its pipelines. replacedKey is the key they were made with
+    //
+    vk::ShaderModule commitStaged(uint32_t moduleID, uint64_t& replacedKey);
+
+    //-------------------------------------------------------------------------
+    // The pipelines of the staged module failed, it is destroyed and the
+    // module in use stays. Counted as a failed reload
+    //
+    void discardStaged(uint32_t moduleID, const std::string& error);
+
+    Stats getStats() const;
+
+private:
+    struct Entry
+    {
+        std::string      filename;
+        vk::ShaderModule module;
+        uint64_t         key       = 0;
+        vk::ShaderModule staged;         // reloaded, until committed or discarded
+        uint64_t         stagedKey = 0;
+        uint64_t         writeTime = 0;
+        uint32_t         refCount  = 0;  // 0: free entry
+    };
+
+    // throws std::runtime_error
+    vk::ShaderModule load(const std::string& filename, uint64_t& key);
+
+    static bool isValid(const uint32_t* code, size_t size);
+
+    vk::Device                                m_device;
+
+    mutable std::mutex                        m_mutex;
+    std::vector<Entry>                        m_entries;
+    std::unordered_map<std::string, uint32_t> m_ids;  // by filename
+    Stats                                     m_stats;
+
+}; // class ShaderModuleRegistry
+
+} // namespace app
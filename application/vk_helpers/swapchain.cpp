@@ -97,10 +97,43 @@ void SwapChain::destroy()
     m_changeID       = 0;
 }
 
+//-------------------------------------------------------------------------
+// Pick the requested present mode if supported, otherwise the closest
+// one with the same tearing / latency behaviour. FIFO is always there
+//
+static vk::PresentModeKHR choosePresentMode(vk::PresentModeKHR requested,
+                                            const std::vector<vk::PresentModeKHR>& available)
+{
+    auto isAvailable = [&](vk::PresentModeKHR mode) {
+        return std::find(available.begin(), available.end(), mode) != available.end();
+    };
+
+    std::vector<vk::PresentModeKHR> candidates;
+    switch (requested) {
+    case vk::PresentModeKHR::eMailbox:
+        candidates = { vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate };
+        break;
+    case vk::PresentModeKHR::eImmediate:
+        candidates = { vk::PresentModeKHR::eImmediate, vk::PresentModeKHR::eMailbox };
+        break;
+    case vk::PresentModeKHR::eFifoRelaxed:
+        candidates = { vk::PresentModeKHR::eFifoRelaxed };
+        break;
+    default:
+        break;
+    }
+
+    for (auto mode : candidates) {
+        if (isAvailable(mode))
+            return mode;
+    }
+    return vk::PresentModeKHR::eFifo;
+}
+
 //-------------------------------------------------------------------------
 // Update the swapchain configuration
 //
-void SwapChain::update(uint32_t width, uint32_t height, bool vsync)
+void SwapChain::update(uint32_t width, uint32_t height, vk::PresentModeKHR requestedPresentMode)
 {
     m_changeID++;
 
@@ -110,24 +143,15 @@ void SwapChain::update(uint32_t width, uint32_t height, bool vsync)
 
     const vk::SwapchainKHR oldSwapchain = m_swapchain;
 
-    vkDeviceWaitIdle(m_device);
+    if (!m_timeline)
+        vkDeviceWaitIdle(m_device);
 
     // get physical device surface capabilities
     vk::SurfaceCapabilitiesKHR surfaceCaps = m_physicalDevice.getSurfaceCapabilitiesKHR(m_surface);
 
     // get present modes
     std::vector<vk::PresentModeKHR> presentModes = m_physicalDevice.getSurfacePresentModesKHR(m_surface);
-    // everyone must support FIFO mode
-    vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo;
-
-    for (const auto& availablePresentMode : presentModes) {
-        if (availablePresentMode == vk::PresentModeKHR::eMailbox) {
-            presentMode = availablePresentMode; break;
-        }
-        else if (availablePresentMode == vk::PresentModeKHR::eImmediate) {
-            presentMode = availablePresentMode; break;
-        }
-    }
+    vk::PresentModeKHR presentMode = choosePresentMode(requestedPresentMode, presentModes);
 
     // get Extent
     VkExtent2D swapchainExtent;
@@ -143,8 +167,12 @@ void SwapChain::update(uint32_t width, uint32_t height, bool vsync)
     }
 
     // Determine number of images
-    // We desire 1 image at a time, beside images being displayed and queued
+    // By default we desire 1 image at a time, beside images being displayed and queued.
+    // Fewer images lower latency with FIFO, more images keep MAILBOX from stalling
     uint32_t desiredSwapchainImages = surfaceCaps.minImageCount + 1;
+    if (m_desiredImageCount > 0) {
+        desiredSwapchainImages = (std::max)(m_desiredImageCount, surfaceCaps.minImageCount);
+    }
     if (surfaceCaps.maxImageCount > 0 && desiredSwapchainImages > surfaceCaps.maxImageCount) {
         // application must settle for fewer than desired images
         desiredSwapchainImages = surfaceCaps.maxImageCount;
@@ -202,12 +230,28 @@ void SwapChain::update(uint32_t width, uint32_t height, bool vsync)
 
     // if existing swapchain is re-created, destroy old swapchain and cleanup
     if (oldSwapchain) {
-        for (auto iter : m_entries){
-            m_device.destroyImageView(iter.imageView);
-            m_device.destroySemaphore(iter.readSemaphore);
-            m_device.destroySemaphore(iter.writtenSemaphore);
+        std::vector<Entry> oldEntries = std::move(m_entries);
+        m_entries.clear();
+
+        vk::Device device     = m_device;
+        auto       destroyOld = [device, oldEntries, oldSwapchain]() {
+            for (auto iter : oldEntries) {
+                device.destroyImageView(iter.imageView);
+                device.destroySemaphore(iter.readSemaphore);
+                device.destroySemaphore(iter.writtenSemaphore);
+            }
+            device.destroySwapchainKHR(oldSwapchain);
+        };
+
+        if (m_timeline) {
+            // Presentation has no completion signal, the pending presents of the
+            // old swapchain are done once a full round of frames on the new one
+            // went through the GPU
+            m_timeline->retire(m_timeline->getSubmittedValue() + m_imageCount, destroyOld);
+        }
+        else {
+            destroyOld();
         }
-        m_device.destroySwapchainKHR(oldSwapchain);
     }
 
     // get Images
@@ -272,9 +316,12 @@ void SwapChain::update(uint32_t width, uint32_t height, bool vsync)
 #endif
     }
 
-    m_width  = width;
-    m_height = height;
-    m_vsync  = vsync;
+    m_width                = swapchainExtent.width;
+    m_height               = swapchainExtent.height;
+    m_requestedPresentMode = requestedPresentMode;
+    m_presentMode          = presentMode;
+    m_vsync                = presentMode == vk::PresentModeKHR::eFifo 
+                          || presentMode == vk::PresentModeKHR::eFifoRelaxed;
 
     m_currentSemaphore = 0;
     m_currentImage     = 0;
@@ -297,8 +344,9 @@ vk::Result SwapChain::acquireSemaphore(vk::Semaphore semaphore)
     const vk::Result result 
         = m_device.acquireNextImageKHR(m_swapchain, UINT64_MAX, semaphore, {}, &m_currentImage);
     
-    if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR) {
-        throw std::error_code(result);
+    if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR
+        && result != vk::Result::eErrorOutOfDateKHR) {
+        throw std::runtime_error("failed to acquire swapchain image!");
     }
     return result;
 }
@@ -306,7 +354,7 @@ vk::Result SwapChain::acquireSemaphore(vk::Semaphore semaphore)
 //-------------------------------------------------------------------------
 // present on provided queue
 //
-void SwapChain::present(vk::Queue queue)
+vk::Result SwapChain::present(vk::Queue queue)
 {
     //vk::Semaphore& written = m_entries[(m_currentSemaphore % m_imageCount)].writtenSemaphore;
     const vk::Semaphore& written = getActiveWrittenSemaphore();
@@ -320,7 +368,15 @@ void SwapChain::present(vk::Queue queue)
 
     m_currentSemaphore++;
 
-    m_graphicsQueue.presentKHR(presentInfo);
+    try {
+        return queue.presentKHR(presentInfo);
+    }
+    catch (vk::OutOfDateKHRError err) {
+        return vk::Result::eErrorOutOfDateKHR;
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to present swapchain image!");
+    }
 }
 
 //-------------------------------------------------------------------------
@@ -359,6 +415,11 @@ VkImageView SwapChain::getActiveImageView() const
     return m_entries[m_currentImage].imageView;
 }
 
+std::vector<vk::PresentModeKHR> SwapChain::getSupportedPresentModes() const
+{
+    return m_physicalDevice.getSurfacePresentModesKHR(m_surface);
+}
+
 vk::Image SwapChain::getImage(uint32_t i) const
 {
     if (i >= m_imageCount)
@@ -8,8 +8,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 
+#include "timeline.hpp"
+
 namespace app {
 
 ///////////////////////////////////////////////////////////////////////////
@@ -42,16 +46,29 @@ public:
     void destroy();
 
     // Update swapchain Configuration
-    void update(uint32_t width, uint32_t height, bool vsync);
-    void update(uint32_t width, uint32_t height) { update(width, height, m_vsync); }
+    // the requested present mode falls back to a supported one
+    void update(uint32_t width, uint32_t height, vk::PresentModeKHR presentMode);
+    void update(uint32_t width, uint32_t height, bool vsync)
+    {
+        update(width, height, vsync ? vk::PresentModeKHR::eFifo : vk::PresentModeKHR::eMailbox);
+    }
+    void update(uint32_t width, uint32_t height) { update(width, height, m_requestedPresentMode); }
+
+    // 0 = minImageCount + 1, clamped to the surface limits on next update
+    void setDesiredImageCount(uint32_t count) { m_desiredImageCount = count; }
+
+    // With a timeline, update() no longer idles the device: the old
+    // swapchain, views and semaphores are retired instead
+    void setTimeline(Timeline* timeline) { m_timeline = timeline; }
     
     // Aquire active index
     vk::Result acquire();
     vk::Result acquireSemaphore(vk::Semaphore semaphore);
 
-    // Present 
-    void present() { present(m_graphicsQueue); }
-    void present(vk::Queue queue);
+    // Present, returns eSuboptimalKHR / eErrorOutOfDateKHR when the
+    // swapchain needs to be updated
+    vk::Result present() { return present(m_graphicsQueue); }
+    vk::Result present(vk::Queue queue);
 
     // Update Barriers
     void cmdUpdateBarriers(vk::CommandBuffer cmdBuffer) const;
@@ -63,15 +80,19 @@ public:
     VkImageView getActiveImageView() const; 
     uint32_t    getActiveImageIndex() const { return m_currentImage; }
 
-    uint32_t         getImageCount()          const { return m_imageCount; }
-    vk::Image        getImage(uint32_t i)     const;
-    vk::ImageView    getImageView(uint32_t i) const;
-    vk::Format       getFormat()              const { return m_surfaceFormat; }
-    uint32_t         getWidth()               const { return m_width; }
-    uint32_t         getHeight()              const { return m_height; }
-    bool             getVsync()               const { return m_vsync; }
-    vk::SwapchainKHR getSwapchain()           const { return m_swapchain; }
-    uint32_t         getChangeID()            const { return m_changeID;  }
+    uint32_t                        getImageCount()             const { return m_imageCount; }
+    vk::Image                       getImage(uint32_t i)        const;
+    vk::ImageView                   getImageView(uint32_t i)    const;
+    vk::Format                      getFormat()                 const { return m_surfaceFormat; }
+    uint32_t                        getWidth()                  const { return m_width; }
+    uint32_t                        getHeight()                 const { return m_height; }
+    bool                            getVsync()                  const { return m_vsync; }
+    vk::PresentModeKHR              getPresentMode()            const { return m_presentMode; }
+    vk::PresentModeKHR              getRequestedPresentMode()   const { return m_requestedPresentMode; }
+    std::vector<vk::PresentModeKHR> getSupportedPresentModes()  const;
+    uint32_t                        getDesiredImageCount()      const { return m_desiredImageCount; }
+    vk::SwapchainKHR                getSwapchain()              const { return m_swapchain; }
+    uint32_t                        getChangeID()               const { return m_changeID;  }
 
 private:
 
@@ -91,6 +112,7 @@ private:
 
     vk::Device                          m_device;
     vk::PhysicalDevice                  m_physicalDevice;
+    Timeline*                           m_timeline{ nullptr };
 
     vk::Queue                           m_graphicsQueue;
     uint32_t                            m_graphicsQueueIdx{ VK_QUEUE_FAMILY_IGNORED };
@@ -115,6 +137,10 @@ private:
     uint32_t                            m_height{ 0 };
     bool                                m_vsync = false;
 
+    vk::PresentModeKHR                  m_requestedPresentMode{ vk::PresentModeKHR::eMailbox };
+    vk::PresentModeKHR                  m_presentMode{ vk::PresentModeKHR::eFifo };
+    uint32_t                            m_desiredImageCount{ 0 };
+
 }; // class SwapChain
 
 } // namespace app
\ No newline at end of file
@@ -0,0 +1,187 @@
+/*
+ *
+ * Andrew Frost
+ * timeline.cpp
+ * 2020
+ *
+ */
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <iterator>
+#include "timeline.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// Timeline                                                              //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+// Create the timeline semaphore, starting at value 0
+//
+void Timeline::init(vk::Device device)
+{
+    assert(!m_device);
+    m_device = device;
+
+    vk::SemaphoreTypeCreateInfo typeCreateInfo = {};
+    typeCreateInfo.semaphoreType = vk::SemaphoreType::eTimeline;
+    typeCreateInfo.initialValue  = 0;
+
+    vk::SemaphoreCreateInfo createInfo = {};
+    createInfo.pNext = &typeCreateInfo;
+
+    try {
+        m_semaphore = m_device.createSemaphore(createInfo);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to create timeline semaphore!");
+    }
+
+    m_submittedValue = 0;
+    m_completedValue = 0;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void Timeline::deinit()
+{
+    if (!m_device)
+        return;
+
+    for (auto& retired : m_retired) {
+        retired.destroyFn();
+    }
+    m_retired.clear();
+
+    m_device.destroySemaphore(m_semaphore);
+    m_semaphore = nullptr;
+    m_device    = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Binary semaphores ignore their entry in the value arrays, they only
+// need to be there so the counts match
+//
+uint64_t Timeline::submit(vk::Queue queue, uint32_t cmdCount, const vk::CommandBuffer* cmds,
+                          vk::Semaphore waitSemaphore, vk::PipelineStageFlags waitStage,
+                          vk::Semaphore signalSemaphore)
+{
+    std::lock_guard<std::mutex> lock(m_submitMutex);
+
+    const uint64_t signalValue = m_submittedValue + 1;
+    const uint64_t waitValue   = 0;
+
+    std::array<vk::Semaphore, 2> signalSemaphores = { m_semaphore, signalSemaphore };
+    std::array<uint64_t, 2>      signalValues     = { signalValue, 0 };
+    const uint32_t               signalCount      = signalSemaphore ? 2 : 1;
+    const uint32_t               waitCount        = waitSemaphore ? 1 : 0;
+
+    vk::TimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.waitSemaphoreValueCount   = waitCount;
+    timelineInfo.pWaitSemaphoreValues      = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = signalCount;
+    timelineInfo.pSignalSemaphoreValues    = signalValues.data();
+
+    vk::SubmitInfo submitInfo = {};
+    submitInfo.pNext                = &timelineInfo;
+    submitInfo.waitSemaphoreCount   = waitCount;
+    submitInfo.pWaitSemaphores      = &waitSemaphore;
+    submitInfo.pWaitDstStageMask    = &waitStage;
+    submitInfo.commandBufferCount   = cmdCount;
+    submitInfo.pCommandBuffers      = cmds;
+    submitInfo.signalSemaphoreCount = signalCount;
+    submitInfo.pSignalSemaphores    = signalSemaphores.data();
+
+    try {
+        queue.submit(submitInfo, nullptr);
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to submit to timeline!");
+    }
+
+    m_submittedValue = signalValue;
+    return signalValue;
+}
+
+//-------------------------------------------------------------------------
+// Ask the driver for the value reached by the GPU
+//
+uint64_t Timeline::getCompletedValue() const
+{
+    uint64_t value = m_device.getSemaphoreCounterValueKHR(m_semaphore);
+    m_completedValue = value;
+    return value;
+}
+
+//-------------------------------------------------------------------------
+// Non-blocking poll
+//
+bool Timeline::isComplete(uint64_t value) const
+{
+    if (value <= m_completedValue)
+        return true;
+
+    return value <= getCompletedValue();
+}
+
+//-------------------------------------------------------------------------
+// Block until the GPU reaches value, returns false on timeout
+//
+bool Timeline::wait(uint64_t value, uint64_t timeout) const
+{
+    if (value <= m_completedValue)
+        return true;
+
+    vk::SemaphoreWaitInfo waitInfo = {};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores    = &m_semaphore;
+    waitInfo.pValues        = &value;
+
+    vk::Result result = m_device.waitSemaphoresKHR(waitInfo, timeout);
+    if (result == vk::Result::eTimeout)
+        return false;
+
+    uint64_t completed = m_completedValue;
+    while (completed < value && !m_completedValue.compare_exchange_weak(completed, value)) {}
+    return true;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void Timeline::retire(uint64_t value, std::function<void()> destroyFn)
+{
+    std::lock_guard<std::mutex> lock(m_retireMutex);
+    m_retired.push_back({ value, std::move(destroyFn) });
+}
+
+//-------------------------------------------------------------------------
+// Destroy every retired resource the GPU is done with
+//
+void Timeline::collect()
+{
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_retireMutex);
+        if (m_retired.empty())
+            return;
+
+        const uint64_t completed = getCompletedValue();
+
+        auto it = std::stable_partition(m_retired.begin(), m_retired.end(),
+            [completed](const Retired& r) { return r.value > completed; });
+
+        std::move(it, m_retired.end(), std::back_inserter(ready));
+        m_retired.erase(it, m_retired.end());
+    }
+
+    for (auto& retired : ready) {
+        retired.destroyFn();
+    }
+}
+
+} // namespace app
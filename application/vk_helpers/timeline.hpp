@@ -0,0 +1,102 @@
+/*
+ *
+ * Andrew Frost
+ * timeline.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// Timeline                                                              //
+///////////////////////////////////////////////////////////////////////////
+// CPU/GPU synchronization through one timeline semaphore                //
+// (VK_KHR_timeline_semaphore / Vulkan 1.2)                              //
+// - every submission signals a new, monotonically increasing value      //
+// - waiting on a value replaces fences and queue.waitIdle               //
+// - resources are retired against a value and destroyed once the GPU    //
+//   has reached it                                                      //
+///////////////////////////////////////////////////////////////////////////
+
+class Timeline
+{
+public:
+    Timeline(Timeline const&) = delete;
+    Timeline& operator=(Timeline const&) = delete;
+
+    Timeline() {}
+    Timeline(vk::Device device) { init(device); }
+    ~Timeline() { deinit(); }
+
+    void init(vk::Device device);
+
+    // GPU must be idle, runs all pending retirements
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Submit command buffers, signalling the next timeline value.
+    // Optional binary semaphores cover the swapchain acquire / present
+    // which cannot use timeline semaphores
+    //
+    uint64_t submit(
+        vk::Queue                queue,
+        uint32_t                 cmdCount,
+        const vk::CommandBuffer* cmds,
+        vk::Semaphore            waitSemaphore   = nullptr,
+        vk::PipelineStageFlags   waitStage       = vk::PipelineStageFlagBits::eAllCommands,
+        vk::Semaphore            signalSemaphore = nullptr);
+
+    uint64_t submit(vk::Queue queue, vk::CommandBuffer cmd) { return submit(queue, 1, &cmd); }
+
+    //-------------------------------------------------------------------------
+    // Host side queries
+    // isComplete only asks the driver when the cached value is behind
+    //
+    uint64_t getCompletedValue() const;
+    uint64_t getSubmittedValue() const { return m_submittedValue; }
+    bool     isComplete(uint64_t value) const;
+
+    bool wait(uint64_t value, uint64_t timeout = UINT64_MAX) const;
+    void waitIdle() const { wait(m_submittedValue); }
+
+    //-------------------------------------------------------------------------
+    // Deferred destruction
+    // destroyFn runs in collect() once the GPU reached value, without a
+    // value the resource is assumed used by everything submitted so far
+    //
+    void retire(uint64_t value, std::function<void()> destroyFn);
+    void retire(std::function<void()> destroyFn) { retire(m_submittedValue, std::move(destroyFn)); }
+
+    void collect();
+
+    vk::Semaphore getSemaphore() const { return m_semaphore; }
+
+private:
+    struct Retired
+    {
+        uint64_t              value;
+        std::function<void()> destroyFn;
+    };
+
+    vk::Device                    m_device;
+    vk::Semaphore                 m_semaphore;
+
+    std::atomic<uint64_t>         m_submittedValue{ 0 };
+    mutable std::atomic<uint64_t> m_completedValue{ 0 };
+
+    std::mutex                    m_submitMutex;  // queue submission is externally synchronized
+    std::mutex                    m_retireMutex;
+    std::vector<Retired>          m_retired;
+
+}; // class Timeline
+
+} // namespace app
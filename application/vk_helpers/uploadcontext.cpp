@@ -0,0 +1,128 @@
+/*
+ *
+ * Andrew Frost
+ * uploadcontext.cpp
+ * 2020
+ *
+ */
+
+#include <cassert>
+#include <stdexcept>
+#include "uploadcontext.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// UploadContext                                                         //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadContext::init(Allocator* allocator, Timeline* timeline, vk::Device device, uint32_t queueFamily,
+                         vk::DeviceSize stagingBlockSize)
+{
+    assert(!m_device);
+    assert(allocator && timeline);
+
+    m_allocator = allocator;
+    m_timeline  = timeline;
+    m_device    = device;
+    m_queue     = device.getQueue(queueFamily, 0);
+    m_lastValue = 0;
+
+    m_cmdPool.init(device, queueFamily, vk::CommandPoolCreateFlagBits::eTransient, m_queue);
+    m_allocator->initStaging(m_staging, stagingBlockSize);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadContext::deinit()
+{
+    if (!m_device)
+        return;
+
+    assert(!m_cmdBuffer && "uploads recorded but not submitted");
+    assert(m_retired.empty());
+
+    wait();
+    for (const auto& pending : m_pending)
+        m_cmdPool.destroy(pending.cmdBuffer);
+    m_pending.clear();
+
+    m_staging.deinit();
+    m_cmdPool.deinit();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Reclaims the command buffers and staging space of completed submits
+// before opening a new command buffer
+//
+vk::CommandBuffer UploadContext::getCommandBuffer()
+{
+    if (m_cmdBuffer)
+        return m_cmdBuffer;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < m_pending.size(); i++) {
+        if (m_timeline->isComplete(m_pending[i].value))
+            m_cmdPool.destroy(m_pending[i].cmdBuffer);
+        else
+            m_pending[kept++] = m_pending[i];
+    }
+    m_pending.resize(kept);
+    m_staging.releaseResources();
+
+    m_cmdBuffer = m_cmdPool.createBuffer();
+    return m_cmdBuffer;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+uint64_t UploadContext::submit()
+{
+    if (!m_cmdBuffer)
+        return 0;
+
+    try {
+        m_cmdBuffer.end();
+    }
+    catch (vk::SystemError err) {
+        throw std::runtime_error("failed to end upload command buffer!");
+    }
+
+    // the timeline serializes the queue between contexts
+    m_lastValue = m_timeline->submit(m_queue, m_cmdBuffer);
+    m_staging.finalizeResources(*m_timeline, m_lastValue);
+    for (auto& destroyFn : m_retired)
+        m_timeline->retire(m_lastValue, std::move(destroyFn));
+    m_retired.clear();
+
+    m_pending.push_back({ m_cmdBuffer, m_lastValue });
+    m_cmdBuffer = nullptr;
+    return m_lastValue;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadContext::retire(std::function<void()> destroyFn)
+{
+    assert(m_cmdBuffer && "nothing recorded to retire against");
+    if (destroyFn)
+        m_retired.push_back(std::move(destroyFn));
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadContext::wait() const
+{
+    if (m_lastValue)
+        m_timeline->wait(m_lastValue);
+}
+
+} // namespace app
@@ -0,0 +1,119 @@
+/*
+ *
+ * Andrew Frost
+ * uploadcontext.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "allocator.hpp"
+#include "commands.hpp"
+#include "timeline.hpp"
+
+namespace app {
+
+#define APP_DEFAULT_UPLOAD_CONTEXT_BLOCKSIZE (VkDeviceSize(16) * 1024 * 1024)
+
+///////////////////////////////////////////////////////////////////////////
+// UploadContext                                                         //
+///////////////////////////////////////////////////////////////////////////
+// Uploads from a worker thread, one context per thread                  //
+// - own staging blocks and command pool, recording needs no lock        //
+// - resources are created through the shared Allocator, which is safe   //
+//   to call from several threads                                        //
+// - submit() goes through the Timeline, the only serialized step, and   //
+//   the staging space is released once the timeline passed its value    //
+// A context must only be used by one thread at a time                   //
+///////////////////////////////////////////////////////////////////////////
+
+class UploadContext
+{
+public:
+    UploadContext(UploadContext const&) = delete;
+    UploadContext& operator=(UploadContext const&) = delete;
+
+    UploadContext() {}
+    ~UploadContext() { deinit(); }
+
+    void init(Allocator* allocator, Timeline* timeline, vk::Device device, uint32_t queueFamily,
+              vk::DeviceSize stagingBlockSize = APP_DEFAULT_UPLOAD_CONTEXT_BLOCKSIZE);
+
+    // waits for the uploads of this context
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Command buffer the uploads are recorded in, begun on first use and
+    // open until submit()
+    //
+    vk::CommandBuffer getCommandBuffer();
+
+    BufferVma createBuffer(vk::DeviceSize size, const void* data, VkBufferUsageFlags usage)
+    {
+        return m_allocator->createBuffer(m_staging, getCommandBuffer(), size, data, usage);
+    }
+
+    template <typename T>
+    BufferVma createBuffer(const std::vector<T>& data, VkBufferUsageFlags usage)
+    {
+        return createBuffer(sizeof(T) * data.size(), data.empty() ? nullptr : data.data(), usage);
+    }
+
+    ImageVma createImage(vk::DeviceSize size, const void* data, const VkImageCreateInfo& info,
+                         VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+    {
+        return m_allocator->createImage(m_staging, getCommandBuffer(), size, data, info, layout);
+    }
+
+    TextureVma createTexture(size_t size, const void* data, const vk::ImageCreateInfo& info,
+                             const vk::SamplerCreateInfo& samplerCreateInfo,
+                             const vk::ImageLayout& layout = vk::ImageLayout::eShaderReadOnlyOptimal)
+    {
+        return m_allocator->createTexture(m_staging, getCommandBuffer(), size, data, info, samplerCreateInfo, layout);
+    }
+
+    //-------------------------------------------------------------------------
+    // Ends and submits what was recorded, does not wait. Returns the
+    // timeline value to wait on, 0 when nothing was recorded
+    //
+    uint64_t submit();
+
+    // destroyFn runs once the GPU is done with the next submit, for
+    // objects used by the commands recorded so far
+    void retire(std::function<void()> destroyFn);
+
+    // waits for the last submit
+    void wait() const;
+
+    uint64_t getLastValue() const { return m_lastValue; }
+
+    StagingMemoryManager& getStaging() { return m_staging; }
+
+private:
+    struct Pending
+    {
+        vk::CommandBuffer cmdBuffer;
+        uint64_t          value = 0;
+    };
+
+    Allocator*              m_allocator{ nullptr };
+    Timeline*               m_timeline{ nullptr };
+    vk::Device              m_device;
+    vk::Queue               m_queue;
+
+    CommandPool             m_cmdPool;
+    StagingMemoryManagerVma m_staging;
+
+    vk::CommandBuffer       m_cmdBuffer;   // recording, null otherwise
+    std::vector<std::function<void()>> m_retired;  // until the next submit
+    std::vector<Pending>    m_pending;     // submitted, freed once complete
+    uint64_t                m_lastValue{ 0 };
+
+}; // class UploadContext
+
+} // namespace app
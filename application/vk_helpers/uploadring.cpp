@@ -0,0 +1,210 @@
+/*
+ *
+ * Andrew Frost
+ * uploadring.cpp
+ * 2020
+ *
+ */
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include "uploadring.hpp"
+
+namespace app {
+
+///////////////////////////////////////////////////////////////////////////
+// UploadRing                                                            //
+///////////////////////////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadRing::init(vk::Device device, VmaAllocator allocator, Timeline* timeline,
+                      vk::DeviceSize size, uint32_t maxFrames)
+{
+    assert(!m_device);
+    assert(timeline);
+
+    m_device    = device;
+    m_allocator = allocator;
+    m_timeline  = timeline;
+    m_capacity  = size;
+
+    VkBufferCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    createInfo.size  = size;
+
+    VmaAllocationCreateInfo allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VmaAllocationInfo allocationInfo = {};
+    VkResult result = vmaCreateBuffer(m_allocator, &createInfo, &allocInfo,
+        reinterpret_cast<VkBuffer*>(&m_buffer), &m_allocation, &allocationInfo);
+    if (result != VK_SUCCESS)
+        throw std::runtime_error("failed to create upload ring buffer!");
+
+    m_mapping = static_cast<uint8_t*>(allocationInfo.pMappedData);
+
+    m_head       = 0;
+    m_used       = 0;
+    m_frameSize  = 0;
+    m_flushBegin = 0;
+    m_flushSize  = 0;
+    m_frameFirst = 0;
+    m_frameCount = 0;
+    m_waitCount  = 0;
+    m_frames.resize(maxFrames);
+
+    m_copyBuffers.reserve(64);
+    m_copyRegions.reserve(64);
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadRing::deinit()
+{
+    if (!m_device)
+        return;
+
+    vmaDestroyBuffer(m_allocator, m_buffer, m_allocation);
+    m_buffer     = nullptr;
+    m_allocation = nullptr;
+    m_mapping    = nullptr;
+
+    m_frames.clear();
+    m_copyBuffers.clear();
+    m_copyRegions.clear();
+    m_device = nullptr;
+}
+
+//-------------------------------------------------------------------------
+// Frees the space of the oldest frame in flight, waiting for the GPU to
+// be done with it if asked to
+//
+bool UploadRing::reclaimOldest(bool wait)
+{
+    if (!m_frameCount)
+        return false;
+
+    const Frame& frame = m_frames[m_frameFirst];
+    if (!m_timeline->isComplete(frame.timelineValue)) {
+        if (!wait)
+            return false;
+        m_timeline->wait(frame.timelineValue);
+        m_waitCount++;
+    }
+
+    m_used -= frame.size;
+    m_frameFirst = (m_frameFirst + 1) % static_cast<uint32_t>(m_frames.size());
+    m_frameCount--;
+    return true;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadRing::beginFrame()
+{
+    assert(m_copyRegions.empty() && "cmdFlush missing for the previous frame");
+
+    // the previous frame's copies went out with the last submit
+    if (m_frameSize) {
+        if (m_frameCount == m_frames.size())
+            reclaimOldest(true);
+
+        Frame& frame = m_frames[(m_frameFirst + m_frameCount) % m_frames.size()];
+        frame.timelineValue = m_timeline->getSubmittedValue();
+        frame.size          = m_frameSize;
+        m_frameCount++;
+        m_frameSize = 0;
+    }
+
+    while (reclaimOldest(false)) {
+    }
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void* UploadRing::cmdToBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, const void* data)
+{
+    if (!size)
+        return nullptr;
+    if (size > m_capacity)
+        throw std::runtime_error("upload larger than the upload ring!");
+
+    // 16 bytes aligned, an upload never straddles the end of the ring
+    vk::DeviceSize srcOffset = (m_head + 15) & ~vk::DeviceSize(15);
+    if (srcOffset + size > m_capacity)
+        srcOffset = 0;
+
+    const vk::DeviceSize taken = (srcOffset >= m_head ? srcOffset - m_head : m_capacity - m_head) + size;
+
+    while (m_capacity - m_used < taken) {
+        if (!reclaimOldest(true))
+            throw std::runtime_error("upload ring too small for one frame!");
+    }
+
+    m_head = srcOffset + size;
+    m_used += taken;
+    m_frameSize += taken;
+    m_flushSize += taken;
+
+    m_copyBuffers.push_back(buffer);
+    m_copyRegions.push_back({ srcOffset, offset, size });
+
+    uint8_t* mapping = m_mapping + srcOffset;
+    if (data)
+        memcpy(mapping, data, size);
+
+    return data ? nullptr : mapping;
+}
+
+//-------------------------------------------------------------------------
+//
+//
+void UploadRing::cmdFlush(vk::CommandBuffer cmdBuffer, vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess)
+{
+    if (m_copyRegions.empty())
+        return;
+
+    // no-op on coherent memory, split where the ring wrapped
+    vk::DeviceSize flushEnd = m_flushBegin + m_flushSize;
+    if (flushEnd > m_capacity) {
+        vmaFlushAllocation(m_allocator, m_allocation, m_flushBegin, m_capacity - m_flushBegin);
+        vmaFlushAllocation(m_allocator, m_allocation, 0, flushEnd - m_capacity);
+    }
+    else {
+        vmaFlushAllocation(m_allocator, m_allocation, m_flushBegin, m_flushSize);
+    }
+    m_flushBegin = m_head;
+    m_flushSize  = 0;
+
+    // previous frames may still read the destinations
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+        vk::DependencyFlags(), nullptr, nullptr, nullptr);
+
+    // one copy command per run of regions to the same buffer
+    size_t first = 0;
+    for (size_t i = 1; i <= m_copyRegions.size(); i++) {
+        if (i == m_copyRegions.size() || m_copyBuffers[i] != m_copyBuffers[first]) {
+            cmdBuffer.copyBuffer(m_buffer, m_copyBuffers[first], static_cast<uint32_t>(i - first), &m_copyRegions[first]);
+            first = i;
+        }
+    }
+
+    vk::MemoryBarrier barrier = {};
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = dstAccess;
+    cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, dstStages,
+        vk::DependencyFlags(), barrier, nullptr, nullptr);
+
+    m_copyBuffers.clear();
+    m_copyRegions.clear();
+}
+
+} // namespace app
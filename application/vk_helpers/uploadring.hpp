@@ -0,0 +1,116 @@
+/*
+ *
+ * Andrew Frost
+ * uploadring.hpp
+ * 2020
+ *
+ */
+
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+#include "../external/vk_mem_alloc.h"
+#include "timeline.hpp"
+
+namespace app {
+
+#define APP_DEFAULT_UPLOAD_RING_SIZE (VkDeviceSize(4) * 1024 * 1024)
+
+///////////////////////////////////////////////////////////////////////////
+// UploadRing                                                            //
+///////////////////////////////////////////////////////////////////////////
+// Per frame streaming of small dynamic data (camera, transforms, light  //
+// and material tweaks) into device buffers                              //
+// - one persistently mapped buffer used as a linear ring, no allocation //
+//   happens after init                                                  //
+// - cmdToBuffer() writes into the ring and queues a copy region,        //
+//   cmdFlush() records them into the frame's command buffer, before the //
+//   render pass                                                         //
+// - beginFrame() tags the previous frame's space with the timeline      //
+//   value of its submit; wrapping around waits on the oldest frame      //
+//   only when its space is still in use                                 //
+///////////////////////////////////////////////////////////////////////////
+
+class UploadRing
+{
+public:
+    UploadRing(UploadRing const&) = delete;
+    UploadRing& operator=(UploadRing const&) = delete;
+
+    UploadRing() {}
+    ~UploadRing() { deinit(); }
+
+    void init(vk::Device device, VmaAllocator allocator, Timeline* timeline,
+              vk::DeviceSize size = APP_DEFAULT_UPLOAD_RING_SIZE, uint32_t maxFrames = 8);
+
+    // GPU must be idle
+    void deinit();
+
+    //-------------------------------------------------------------------------
+    // Closes the previous frame with the last submitted timeline value and
+    // reclaims the space of the frames the GPU is done with
+    //
+    void beginFrame();
+
+    //-------------------------------------------------------------------------
+    // if data != nullptr, memcpies to the ring and returns nullptr
+    // otherwise returns the mapping to fill before cmdFlush
+    //
+    void* cmdToBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size, const void* data = nullptr);
+
+    template <class T>
+    T* cmdToBufferT(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize size = sizeof(T))
+    {
+        return (T*)cmdToBuffer(buffer, offset, size, nullptr);
+    }
+
+    //-------------------------------------------------------------------------
+    // Records the queued copies, must be outside of a render pass.
+    // Destinations are written after previous frames read them and made
+    // visible to dstStages / dstAccess
+    //
+    void cmdFlush(vk::CommandBuffer cmdBuffer,
+                  vk::PipelineStageFlags dstStages = vk::PipelineStageFlagBits::eAllCommands,
+                  vk::AccessFlags        dstAccess = vk::AccessFlagBits::eMemoryRead);
+
+    vk::DeviceSize getCapacity() const  { return m_capacity; }
+    vk::DeviceSize getUsedSize() const  { return m_used; }
+    uint32_t       getWaitCount() const { return m_waitCount; }   // wraps that had to wait on the GPU
+
+private:
+    struct Frame
+    {
+        uint64_t       timelineValue = 0;
+        vk::DeviceSize size          = 0;   // bytes taken, wrap padding included
+    };
+
+    bool reclaimOldest(bool wait);
+
+    vk::Device     m_device;
+    VmaAllocator   m_allocator{ nullptr };
+    Timeline*      m_timeline{ nullptr };
+
+    vk::Buffer     m_buffer;
+    VmaAllocation  m_allocation{ nullptr };
+    uint8_t*       m_mapping{ nullptr };
+
+    vk::DeviceSize m_capacity{ 0 };
+    vk::DeviceSize m_head{ 0 };         // next write offset
+    vk::DeviceSize m_used{ 0 };         // bytes of frames in flight + current frame
+    vk::DeviceSize m_frameSize{ 0 };    // bytes taken by the current frame
+    vk::DeviceSize m_flushBegin{ 0 };   // first byte not flushed yet
+    vk::DeviceSize m_flushSize{ 0 };    // bytes written since the last flush
+
+    std::vector<Frame> m_frames;        // frames in flight, circular
+    uint32_t           m_frameFirst{ 0 };
+    uint32_t           m_frameCount{ 0 };
+    uint32_t           m_waitCount{ 0 };
+
+    std::vector<vk::Buffer>     m_copyBuffers;   // destination per region, capacity is kept
+    std::vector<vk::BufferCopy> m_copyRegions;
+
+}; // class UploadRing
+
+} // namespace app
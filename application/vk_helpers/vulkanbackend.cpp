@@ -31,6 +31,8 @@ void VulkanBackend::setupVulkan(const ContextCreateInfo& info, GLFWwindow* windo
 
     createLogicalDeviceAndQueues(info);
 
+    createSyncObjects();
+
     createSwapChain();
 
     createCommandPool();
@@ -44,9 +46,6 @@ void VulkanBackend::setupVulkan(const ContextCreateInfo& info, GLFWwindow* windo
     createPipelineCache();
 
     createFrameBuffers();
-
-    createSyncObjects();
-
 }
 
 //-------------------------------------------------------------------------
@@ -55,6 +54,7 @@ void VulkanBackend::setupVulkan(const ContextCreateInfo& info, GLFWwindow* windo
 void VulkanBackend::destroy()
 {
     m_device.waitIdle();
+    m_timeline.collect();
 
     if (ImGui::GetCurrentContext() != nullptr) {
         ImGui_ImplVulkan_Shutdown();
@@ -66,16 +66,16 @@ void VulkanBackend::destroy()
 
     m_device.destroyRenderPass(m_renderPass);
 
-    m_device.destroyImageView(m_depthView);
-    m_device.destroyImage(m_depthImage);
-    m_device.freeMemory(m_depthMemory);
+    m_renderTargetPool.release(m_depth);
 
-    m_device.destroyPipelineCache(m_pipelineCache);
+    m_pipelineBuilder.deinit();
+    m_pipelineMap.deinit();
+    m_pipelineCache.deinit();
+    m_shaderModules.deinit();
 
     for (uint32_t i = 0; i < m_swapchain.getImageCount(); i++) {
 
         m_device.destroyFramebuffer(m_framebuffers[i]);
-        m_device.destroyFence(m_fences[i]);
         m_device.freeCommandBuffers(m_commandPool, m_commandBuffers[i]);
     }
 
@@ -83,6 +83,9 @@ void VulkanBackend::destroy()
 
     m_device.destroyCommandPool(m_commandPool);
 
+    m_timeline.deinit();
+    m_renderTargetPool.deinit();
+
     m_device.destroy();
 
     if (m_debugMessenger)
@@ -109,7 +112,7 @@ void VulkanBackend::initInstance(const ContextCreateInfo& info)
     vk::ApplicationInfo appInfo = {};
     appInfo.pApplicationName = info.appTitle;
     appInfo.pEngineName = info.appEngine;
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    appInfo.apiVersion = VK_API_VERSION_1_1;  // subgroup operations, extended image usage
 
     vk::InstanceCreateInfo createInfo = {};
     createInfo.pApplicationInfo = &appInfo;
@@ -138,7 +141,8 @@ void VulkanBackend::createSurface(GLFWwindow* window)
 {
     int width, height;
     glfwGetWindowSize(window, &width, &height);
-    m_size = vk::Extent2D(width, height);
+    m_size       = vk::Extent2D(width, height);
+    m_windowSize = m_size;
 
     VkSurfaceKHR rawSurface;
     if (glfwCreateWindowSurface(m_instance, window, nullptr, &rawSurface) != VK_SUCCESS) {
@@ -206,7 +210,6 @@ void VulkanBackend::pickPhysicalDevice(const ContextCreateInfo& info)
             m_graphicsQueueIdx = graphicsIdx;
             m_presentQueueIdx = presentIdx;
 
-            m_vsync = false;
             m_depthFormat = vk::Format::eD32SfloatS8Uint;
             m_colorFormat = vk::Format::eB8G8R8A8Unorm;
             
@@ -241,6 +244,17 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
     std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
     std::set<uint32_t> uniqueQueueFamilies = { m_graphicsQueueIdx,  m_presentQueueIdx };
 
+    // async compute, a family without graphics when the device has one
+    for (uint32_t j = 0; j < queueFamilyProperties.size(); ++j) {
+        const vk::QueueFlags flags = queueFamilyProperties[j].queueFlags;
+        if (queueFamilyProperties[j].queueCount && (flags & vk::QueueFlagBits::eCompute)
+            && !(flags & vk::QueueFlagBits::eGraphics)) {
+            m_computeQueueIdx = j;
+            uniqueQueueFamilies.insert(j);
+            break;
+        }
+    }
+
     const float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
         vk::DeviceQueueCreateInfo queueInfo = {};
@@ -250,7 +264,17 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
 
         queueCreateInfos.push_back(queueInfo);
     }
+    vk::PhysicalDeviceBufferDeviceAddressFeaturesKHR addressFeature = {};
+#ifdef VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME
+    vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeature = {};
+    addressFeature.pNext = &dynamicStateFeature;
+#endif
+
+    vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR  timelineFeature = {};
+    timelineFeature.pNext = &addressFeature;
+
     vk::PhysicalDeviceDescriptorIndexingFeaturesEXT indexFeature = {};
+    indexFeature.pNext = &timelineFeature;
 
     vk::PhysicalDeviceScalarBlockLayoutFeaturesEXT  scalarFeature = {};
     scalarFeature.pNext = &indexFeature;
@@ -262,11 +286,42 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
     enabledFeatures2.pNext = &scalarFeature;
     m_physicalDevice.getFeatures2(&enabledFeatures2);
 
+    // all CPU/GPU synchronization goes through app::Timeline
+    if (!timelineFeature.timelineSemaphore)
+        throw std::runtime_error("timeline semaphores not supported!");
+
+    // every supported feature is enabled, descriptor indexing ones are kept
+    // for the layouts to pick their binding flags
+    m_descriptorIndexingFeatures       = indexFeature;
+    m_descriptorIndexingFeatures.pNext = nullptr;
+
+    // required extensions, plus the optional ones the device supports
+    std::vector<const char*> deviceExtensions = info.deviceExtensions;
+    for (const auto& extension : m_physicalDevice.enumerateDeviceExtensionProperties()) {
+        for (const char* name : info.optionalDeviceExtensions) {
+            if (strcmp(extension.extensionName, name) == 0)
+                deviceExtensions.push_back(name);
+        }
+    }
+    m_enabledDeviceExtensions = std::set<std::string>(deviceExtensions.begin(), deviceExtensions.end());
+
+    // optional, only chained when its extension is enabled
+    m_bufferDeviceAddress = isDeviceExtensionEnabled(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)
+                         && addressFeature.bufferDeviceAddress;
+#ifdef VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME
+    m_extendedDynamicState = isDeviceExtensionEnabled(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)
+                          && dynamicStateFeature.extendedDynamicState;
+    if (!isDeviceExtensionEnabled(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME))
+        addressFeature.pNext = nullptr;
+#endif
+    if (!isDeviceExtensionEnabled(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME))
+        timelineFeature.pNext = addressFeature.pNext;
+
     vk::DeviceCreateInfo deviceCreateInfo = {};
     deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
-    deviceCreateInfo.enabledExtensionCount = info.numDeviceExtensions;
-    deviceCreateInfo.ppEnabledExtensionNames = info.deviceExtensions.data();
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
     deviceCreateInfo.pEnabledFeatures = nullptr;
     deviceCreateInfo.pNext = &enabledFeatures2;
 
@@ -288,6 +343,8 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
     // Initialize default queues
     m_graphicsQueue = m_device.getQueue(m_graphicsQueueIdx, 0);
     m_presentQueue = m_device.getQueue(m_presentQueueIdx, 0);
+    if (m_computeQueueIdx != VK_QUEUE_FAMILY_IGNORED)
+        m_computeQueue = m_device.getQueue(m_computeQueueIdx, 0);
 
     // Initialize debugging tool for queue object names
 #if _DEBUG
@@ -296,6 +353,10 @@ void VulkanBackend::createLogicalDeviceAndQueues(const ContextCreateInfo& info)
 
     m_device.setDebugUtilsObjectNameEXT(
         { vk::ObjectType::eQueue, (uint64_t)(VkQueue)m_presentQueue, "presentQueue" });
+
+    if (m_computeQueue)
+        m_device.setDebugUtilsObjectNameEXT(
+            { vk::ObjectType::eQueue, (uint64_t)(VkQueue)m_computeQueue, "computeQueue" });
 #endif
 }
 
@@ -307,7 +368,15 @@ void VulkanBackend::createSwapChain()
     m_swapchain.init(m_instance, m_device, m_physicalDevice, m_graphicsQueue, m_graphicsQueueIdx,
         m_presentQueue, m_presentQueueIdx, m_surface, vk::Format::eB8G8R8A8Unorm);
 
-    m_swapchain.update(m_size.width, m_size.height, m_vsync);
+    m_swapchain.setTimeline(&m_timeline);
+    m_swapchain.setDesiredImageCount(m_swapchainImageCount);
+    m_swapchain.update(m_size.width, m_size.height, m_presentMode);
+
+    m_size.width  = m_swapchain.getWidth();
+    m_size.height = m_swapchain.getHeight();
+
+    m_activePresentMode = m_swapchain.getPresentMode();
+    m_activeImageCount  = m_swapchain.getImageCount();
 
     m_colorFormat = m_swapchain.getFormat();
 }
@@ -336,6 +405,7 @@ void VulkanBackend::createCommandPool()
 void VulkanBackend::createCommandBuffer()
 {
     m_commandBuffers.resize(m_swapchain.getImageCount());
+    m_frameValues.assign(m_swapchain.getImageCount(), 0);
 
     vk::CommandBufferAllocateInfo cmdBufferAllocInfo = {};
     cmdBufferAllocInfo.commandPool = m_commandPool;
@@ -431,15 +501,16 @@ void VulkanBackend::createRenderPass()
 
 //-------------------------------------------------------------------------
 // Create Pipeline Cache
+// - seeded with the data saved by the last run on this device and driver
+// - the builder's workers start from a copy of it
+// - along with the shader modules the pipelines are made from
 //
 void VulkanBackend::createPipelineCache()
 {
-    try {
-        m_pipelineCache = m_device.createPipelineCache(vk::PipelineCacheCreateInfo());
-    }
-    catch (vk::SystemError err) {
-        throw std::runtime_error("failed to create pipeline cache!");
-    }
+    m_pipelineCache.init(m_device, m_physicalDevice);
+    m_pipelineBuilder.init(m_device, &m_pipelineCache);
+    m_pipelineMap.init(m_device, &m_pipelineCache);
+    m_shaderModules.init(m_device);
 }
 
 
@@ -448,71 +519,19 @@ void VulkanBackend::createPipelineCache()
 //
 void VulkanBackend::createDepthBuffer()
 {
-    m_device.destroyImageView(m_depthView);
-    m_device.destroyImage(m_depthImage);
-    m_device.freeMemory(m_depthMemory);
+    // previous frames may still use the old one, its memory is reused
+    // once they are done
+    m_renderTargetPool.release(m_depth);
 
     // Depth Info
     const vk::ImageAspectFlags aspect =
         vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
 
-    vk::ImageCreateInfo depthStencilCreateInfo = {};
-    depthStencilCreateInfo.imageType = vk::ImageType::e2D;
-    depthStencilCreateInfo.extent = vk::Extent3D(m_size.width, m_size.height, 1);
-    depthStencilCreateInfo.format = m_depthFormat;
-    depthStencilCreateInfo.mipLevels = 1;
-    depthStencilCreateInfo.arrayLayers = 1;
-    depthStencilCreateInfo.samples = vk::SampleCountFlagBits::e1;
-    depthStencilCreateInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment
-        | vk::ImageUsageFlagBits::eTransferSrc;
-
-    try {
-        m_depthImage = m_device.createImage(depthStencilCreateInfo);
-    }
-    catch (vk::SystemError err) {
-        throw std::runtime_error("failed to create depth images!");
-    }
-
-    // find memory requirements
-    const vk::MemoryRequirements memReqs = m_device.getImageMemoryRequirements(m_depthImage);
-    uint32_t memoryTypeIdx = -1;
-    {
-        auto deviceMemoryProperties = m_physicalDevice.getMemoryProperties();
-        for (uint32_t i = 0; i < deviceMemoryProperties.memoryTypeCount; i++) {
-            if ((memReqs.memoryTypeBits & (1 << i))
-                && (deviceMemoryProperties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal) == vk::MemoryPropertyFlagBits::eDeviceLocal) {
-                memoryTypeIdx = i;
-                break;
-            }
-        }
-        if (memoryTypeIdx == -1)
-            throw std::runtime_error("failed to find suitable memory type!");
-    }
-
-    //Allocate the memory
-    vk::MemoryAllocateInfo memAllocInfo = {};
-    memAllocInfo.allocationSize  = memReqs.size;
-    memAllocInfo.memoryTypeIndex = memoryTypeIdx;
-
-    try {
-        m_depthMemory = m_device.allocateMemory(memAllocInfo);
-    }
-    catch (vk::SystemError err) {
-        throw std::runtime_error("failed to allocate depth image memory!");
-    }
-
-    // Bind image & memory
-    m_device.bindImageMemory(m_depthImage, m_depthMemory, 0);
+    m_depth = m_renderTargetPool.acquire(m_size, m_depthFormat, vk::SampleCountFlagBits::e1,
+        vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc);
 
     // Create an image barrier to change the layout from undefined to DepthStencilAttachmentOptimal
-    vk::CommandBufferAllocateInfo cmdBufAllocateInfo = {};
-    cmdBufAllocateInfo.commandPool = m_commandPool;
-    cmdBufAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
-    cmdBufAllocateInfo.commandBufferCount = 1;
-
-    vk::CommandBuffer cmdBuffer;
-    cmdBuffer = m_device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
-    cmdBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    vk::CommandBuffer cmdBuffer = createTempCmdBuffer();
 
     // barrier on top, barrier inside set up cmdbuffer
     vk::ImageSubresourceRange subresourceRange;
@@ -525,7 +544,7 @@ void VulkanBackend::createDepthBuffer()
     imageMemoryBarrier.newLayout           = vk::ImageLayout::eDepthStencilAttachmentOptimal;
     imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.image               = m_depthImage;
+    imageMemoryBarrier.image               = m_depth.image;
     imageMemoryBarrier.subresourceRange    = subresourceRange;
     imageMemoryBarrier.srcAccessMask       = vk::AccessFlags();
     imageMemoryBarrier.dstAccessMask       = vk::AccessFlagBits::eDepthStencilAttachmentWrite
@@ -536,26 +555,9 @@ void VulkanBackend::createDepthBuffer()
 
     cmdBuffer.pipelineBarrier(srcStageMask, destStageMask, vk::DependencyFlags(),
         nullptr, nullptr, imageMemoryBarrier);
-    cmdBuffer.end();
-
-    m_graphicsQueue.submit(vk::SubmitInfo{ 0, nullptr, nullptr, 1, &cmdBuffer }, vk::Fence());
 
-    m_graphicsQueue.waitIdle();
-
-    m_device.freeCommandBuffers(m_commandPool, cmdBuffer);
-
-    // Setting up the view
-    vk::ImageViewCreateInfo depthStencilView;
-    depthStencilView.viewType         = vk::ImageViewType::e2D;
-    depthStencilView.format           = m_depthFormat;
-    depthStencilView.subresourceRange = { aspect, 0, 1, 0, 1 };
-    depthStencilView.image            = m_depthImage;
-    try {
-        m_depthView = m_device.createImageView(depthStencilView);
-    }
-    catch (vk::SystemError err) {
-        throw std::runtime_error("failed to create depth image view!");
-    }
+    // no wait, frames submitted afterwards are ordered behind the barrier
+    submitTempCmdBuffer(cmdBuffer);
 }
 
 //-------------------------------------------------------------------------
@@ -564,16 +566,23 @@ void VulkanBackend::createDepthBuffer()
 //
 void VulkanBackend::createFrameBuffers()
 {
-    // recreate frame buffers
-    for (auto framebuffer : m_framebuffers)
-        m_device.destroyFramebuffer(framebuffer);
+    // recreate frame buffers, the old ones are destroyed once unused
+    if (!m_framebuffers.empty()) {
+        vk::Device                   device       = m_device;
+        std::vector<vk::Framebuffer> framebuffers = m_framebuffers;
+        m_timeline.retire([device, framebuffers]() {
+            for (auto framebuffer : framebuffers)
+                device.destroyFramebuffer(framebuffer);
+        });
+    }
+    m_framebuffers.clear();
     m_framebuffers.resize(m_swapchain.getImageCount());
 
     // create frame buffer for every swapchain image
     for (uint32_t i = 0; i < m_swapchain.getImageCount(); i++) {
         std::array<vk::ImageView, 2> attachments;
         attachments[0] = m_swapchain.getImageView(i);
-        attachments[1] = m_depthView;
+        attachments[1] = m_depth.view;
 
         vk::FramebufferCreateInfo framebufferInfo = {};
         framebufferInfo.renderPass      = m_renderPass;
@@ -602,40 +611,55 @@ void VulkanBackend::createFrameBuffers()
 
 //-------------------------------------------------------------------------
 // Create Sync Objects
-// Fences - are used to synchronize the CPU and the GPU
+// Timeline - single semaphore used to synchronize the CPU and the GPU,
+// frames, uploads and deferred destruction all share it
 //
 void VulkanBackend::createSyncObjects()
 {
-    m_fences.resize(m_swapchain.getImageCount());
-
-    try {
-        for (uint32_t i = 0; i < m_swapchain.getImageCount(); ++i) {
-            m_fences[i] = m_device.createFence({ vk::FenceCreateFlagBits::eSignaled });
-        }
-    }
-    catch (vk::SystemError err) {
-        throw std::runtime_error("failed to create synchronization objects for a frame!");
-    }
+    m_timeline.init(m_device);
+    m_renderTargetPool.init(m_device, m_physicalDevice, &m_timeline);
 }
 
 //-------------------------------------------------------------------------
-// function to call before rendering
+// function to call before rendering, false when no image was acquired:
+// nothing is recorded or submitted this frame
 //
-void VulkanBackend::prepareFrame()
+bool VulkanBackend::prepareFrame()
 {
+    // Resize / present mode requests, or suboptimal from the last frame
+    applyPendingSwapchainChanges();
+
     // Acquire the next image from the swap chain
     auto result = m_swapchain.acquire();    
-    // Recreate the swapchain if it's no longer compatible with the surface
-    if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR) {
-        onWindowResize(m_size.width, m_size.height);
+
+    // Out of date: nothing was acquired, recreate and try once more. Still
+    // out of date, or a zero size surface (minimized) the rebuild skipped:
+    // the frame is dropped and the rebuild tried again with the next one
+    if (result == vk::Result::eErrorOutOfDateKHR) {
+        rebuildSwapchain(m_size.width, m_size.height);
+        result = m_swapchain.acquire();
+        if (result == vk::Result::eErrorOutOfDateKHR) {
+            m_pendingRebuild = true;
+            return false;
+        }
+    }
+
+    // Suboptimal: the image is acquired and still presentable, use it
+    // and recreate before the next frame
+    if (result == vk::Result::eSuboptimalKHR) {
+        m_pendingRebuild = true;
     }
     else if (result != vk::Result::eSuccess) {
         throw std::runtime_error("failed to acquire image from swapchain!");
     }
 
-    // fence until cmd buffer has finished executing before using again
+    // wait until cmd buffer has finished executing before using again
     uint32_t imageIndex = m_swapchain.getActiveImageIndex();
-    while (m_device.waitForFences(m_fences[imageIndex], VK_TRUE, 10000) == vk::Result::eTimeout) {}
+    m_timeline.wait(m_frameValues[imageIndex]);
+
+    // destroy whatever the GPU no longer references
+    m_timeline.collect();
+    return true;
 }
 
 //-------------------------------------------------------------------------
@@ -644,32 +668,58 @@ void VulkanBackend::prepareFrame()
 void VulkanBackend::submitFrame()
 {
     uint32_t imageIndex = m_swapchain.getActiveImageIndex();
-    m_device.resetFences(m_fences[imageIndex]);
 
+    // Swapchain acquire / present only work with binary semaphores
     vk::Semaphore semaphoreRead  = m_swapchain.getActiveReadSemaphore();
     vk::Semaphore semaphoreWrite = m_swapchain.getActiveWrittenSemaphore();
 
     // Pipeline stage at which the queue submission will wait (via pWaitSemaphores)
     const vk::PipelineStageFlags waitStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
 
-    vk::SubmitInfo submitInfo = {};
-    submitInfo.waitSemaphoreCount   = 1;                              // One wait semaphore
-    submitInfo.pWaitSemaphores      = &semaphoreRead;                 // Semaphore(s) to wait upon before the submitted command buffer starts executing
-    submitInfo.pWaitDstStageMask    = &waitStageMask;                 // Pointer to the list of pipeline stages that the semaphore waits will occur at
-    submitInfo.commandBufferCount   = 1;                              // One Command Buffer
-    submitInfo.pCommandBuffers      = &m_commandBuffers[imageIndex];  // Command buffers(s) to execute in this batch (submission)
-    submitInfo.signalSemaphoreCount = 1;                              // One signal Semaphore
-    submitInfo.pSignalSemaphores    = &semaphoreWrite;                // Semaphore(s) to be signaled when command buffers have completed
+    // Remember the timeline value this command buffer signals
+    m_frameValues[imageIndex] = m_timeline.submit(m_graphicsQueue, 1, &m_commandBuffers[imageIndex],
+                                                  semaphoreRead, waitStageMask, semaphoreWrite);
+
+    vk::Result result = m_swapchain.present(m_graphicsQueue);
+    if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR)
+        m_pendingRebuild = true;
+}
+
+//-------------------------------------------------------------------------
+// One time command buffer from the backend pool
+//
+vk::CommandBuffer VulkanBackend::createTempCmdBuffer()
+{
+    vk::CommandBufferAllocateInfo cmdBufAllocateInfo = {};
+    cmdBufAllocateInfo.commandPool        = m_commandPool;
+    cmdBufAllocateInfo.level              = vk::CommandBufferLevel::ePrimary;
+    cmdBufAllocateInfo.commandBufferCount = 1;
 
-    // Submit to the graphics queue passing a wait fence
+    vk::CommandBuffer cmdBuffer;
     try {
-        m_graphicsQueue.submit(submitInfo, m_fences[imageIndex]);
+        cmdBuffer = m_device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
+        cmdBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
     }
     catch (vk::SystemError err) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+        throw std::runtime_error("failed to allocate temporary command buffer!");
     }
+    return cmdBuffer;
+}
 
-    m_swapchain.present(m_graphicsQueue);
+//-------------------------------------------------------------------------
+// Ends and submits through the timeline without waiting, the command
+// buffer is freed once the GPU reached the returned value
+//
+uint64_t VulkanBackend::submitTempCmdBuffer(vk::CommandBuffer cmdBuffer)
+{
+    cmdBuffer.end();
+
+    uint64_t value = m_timeline.submit(m_graphicsQueue, cmdBuffer);
+
+    vk::Device      device = m_device;
+    vk::CommandPool pool   = m_commandPool;
+    m_timeline.retire(value, [device, pool, cmdBuffer]() { device.freeCommandBuffers(pool, cmdBuffer); });
+    return value;
 }
 
 //-------------------------------------------------------------------------
@@ -804,12 +854,69 @@ void VulkanBackend::onKeyboardChar(unsigned int key)
     if (ImGui::GetCurrentContext() != nullptr && ImGui::GetIO().WantCaptureMouse)
         return;
 
-    // Toggling vsync TODO
+    // Cycle through the supported present modes
     if (key == 'v') {
+        const std::array<vk::PresentModeKHR, 4> order = {
+            vk::PresentModeKHR::eFifo,    vk::PresentModeKHR::eFifoRelaxed,
+            vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate };
 
+        std::vector<vk::PresentModeKHR> supported = m_swapchain.getSupportedPresentModes();
+
+        size_t current = std::find(order.begin(), order.end(), getPresentMode()) - order.begin();
+        for (size_t i = 1; i <= order.size(); i++) {
+            vk::PresentModeKHR next = order[(current + i) % order.size()];
+            if (std::find(supported.begin(), supported.end(), next) != supported.end()) {
+                setPresentMode(next);
+                break;
+            }
+        }
     }
 }
 
+//-------------------------------------------------------------------------
+// Present mode is requested, the swapchain falls back to a supported one
+//
+void VulkanBackend::setPresentMode(vk::PresentModeKHR presentMode)
+{
+    m_presentMode = presentMode;
+    requestSwapchainRebuild();
+}
+
+//-------------------------------------------------------------------------
+// 0 lets the swapchain pick minImageCount + 1
+//
+void VulkanBackend::setSwapchainImageCount(uint32_t count)
+{
+    m_swapchainImageCount = count;
+    requestSwapchainRebuild();
+}
+
+//-------------------------------------------------------------------------
+// Rebuild now, or let the render thread do it before its next frame
+//
+void VulkanBackend::requestSwapchainRebuild()
+{
+    if (m_renderThreaded)
+        m_pendingRebuild = true;
+    else if (m_swapchain.getSwapchain())
+        rebuildSwapchain(m_size.width, m_size.height);
+}
+
+//-------------------------------------------------------------------------
+// Render thread side of the resize / rebuild requests
+// must be called before prepareFrame
+//
+void VulkanBackend::applyPendingSwapchainChanges()
+{
+    const uint64_t size    = m_pendingResize.exchange(0);
+    const bool     rebuild = m_pendingRebuild.exchange(false);
+
+    if (size != 0)
+        rebuildSwapchain(static_cast<uint32_t>(size >> 32), static_cast<uint32_t>(size & 0xffffffff));
+    else if (rebuild)
+        rebuildSwapchain(m_size.width, m_size.height);
+}
+
 void VulkanBackend::onCharCallback(GLFWwindow* window, unsigned int key)
 {
     auto app = reinterpret_cast<VulkanBackend*>(glfwGetWindowUserPointer(window));
@@ -837,8 +944,8 @@ void VulkanBackend::onMouseMove(int x, int y)
 
     // Left Mouse Button
     if (m_inputs.lmb) {
-        const float hval = 2 * dx / static_cast<float>(m_size.width);
-        const float vval = 2 * dy / static_cast<float>(m_size.height);
+        const float hval = 2 * dx / static_cast<float>(m_windowSize.width);
+        const float vval = 2 * dy / static_cast<float>(m_windowSize.height);
         m_inertCamera.tau = s_cameraTau;
         m_inertCamera.rotateH(hval);
         m_inertCamera.rotateV(vval);
@@ -846,8 +953,8 @@ void VulkanBackend::onMouseMove(int x, int y)
 
     //Middle Mouse Button
     if (m_inputs.mmb) {
-        const float hval = 2 * dx / static_cast<float>(m_size.width);
-        const float vval = 2 * dy / static_cast<float>(m_size.height);
+        const float hval = 2 * dx / static_cast<float>(m_windowSize.width);
+        const float vval = 2 * dy / static_cast<float>(m_windowSize.height);
         m_inertCamera.tau = s_cameraTau;
         m_inertCamera.rotateH(hval, true);
         m_inertCamera.rotateV(vval, true);
@@ -855,8 +962,8 @@ void VulkanBackend::onMouseMove(int x, int y)
 
     //Right mouse button
     if (m_inputs.rmb) {
-        const float hval = 2 * dx / static_cast<float>(m_size.width);
-        const float vval = -2 * dy / static_cast<float>(m_size.height);
+        const float hval = 2 * dx / static_cast<float>(m_windowSize.width);
+        const float vval = -2 * dy / static_cast<float>(m_windowSize.height);
         m_inertCamera.tau = s_cameraTau;
         m_inertCamera.rotateH(hval, m_inputs.ctrl);
         m_inertCamera.move(vval, m_inputs.ctrl);
@@ -916,28 +1023,59 @@ void VulkanBackend::onScrollCallback(GLFWwindow* window, double x, double y)
 
 //-------------------------------------------------------------------------
 // On Window Size Callback
-// - Destroy allocated frames, then rebuild with new size
+// - UI, camera and m_windowSize are updated here, on the thread polling
+//   the events. m_size belongs to the thread recording the frames
+// - the Vulkan side is rebuilt right away, or forwarded to the render
+//   thread when rendering is threaded
 //
 void VulkanBackend::onWindowResize(uint32_t width, uint32_t height)
 {
     if (width == 0 || height == 0) return;
 
-    m_size.width = width;
-    m_size.height = height;
-
     if (ImGui::GetCurrentContext() != nullptr)
     {
         auto& imgui_io = ImGui::GetIO();
         imgui_io.DisplaySize = ImVec2(static_cast<float>(width), static_cast<float>(height));
     }
     CameraManipulator.setWindowSize(width, height);
+    m_windowSize = vk::Extent2D(width, height);
 
+    if (m_renderThreaded)
+        m_pendingResize = (uint64_t(width) << 32) | uint64_t(height);
+    else
+        rebuildSwapchain(width, height);
+}
 
-    m_device.waitIdle();
-    m_graphicsQueue.waitIdle();
+//-------------------------------------------------------------------------
+// Rebuild the frames with new size, without idling the device: the old
+// swapchain is passed as oldSwapchain and everything previous frames may
+// still reference is retired on the timeline
+//
+void VulkanBackend::rebuildSwapchain(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0) return;
+
+    m_swapchain.setDesiredImageCount(m_swapchainImageCount);
+    m_swapchain.update(width, height, m_presentMode);
 
-    m_swapchain.update(m_size.width, m_size.height, m_vsync);
-    onResize(width, height);
+    // the surface decides the final extent
+    m_size.width  = m_swapchain.getWidth();
+    m_size.height = m_swapchain.getHeight();
+
+    m_activePresentMode = m_swapchain.getPresentMode();
+    m_activeImageCount  = m_swapchain.getImageCount();
+
+    // the image count can change with the present mode or desired count
+    if (m_swapchain.getImageCount() != m_commandBuffers.size()) {
+        vk::Device                     device = m_device;
+        vk::CommandPool                pool   = m_commandPool;
+        std::vector<vk::CommandBuffer> cmds   = m_commandBuffers;
+        m_timeline.retire([device, pool, cmds]() { device.freeCommandBuffers(pool, cmds); });
+
+        createCommandBuffer();
+    }
+
+    onResize(m_size.width, m_size.height);
     createDepthBuffer();
     createFrameBuffers();
 }
@@ -990,7 +1128,7 @@ void VulkanBackend::initGUI(GLFWwindow* window)
     imGuiInitInfo.Instance        = m_instance;
     imGuiInitInfo.MinImageCount   = (uint32_t)m_framebuffers.size();
     imGuiInitInfo.PhysicalDevice  = m_physicalDevice;
-    imGuiInitInfo.PipelineCache   = m_pipelineCache;
+    imGuiInitInfo.PipelineCache   = m_pipelineCache.get();
     imGuiInitInfo.Queue           = m_graphicsQueue;
     imGuiInitInfo.QueueFamily     = m_graphicsQueueIdx;
     imGuiInitInfo.MSAASamples     = VK_SAMPLE_COUNT_1_BIT;
@@ -1006,7 +1144,7 @@ void VulkanBackend::initGUI(GLFWwindow* window)
 
     auto cmdBuffer = cmdBufferGen.createBuffer();
     ImGui_ImplVulkan_CreateFontsTexture(cmdBuffer);
-    cmdBufferGen.submitAndWait(cmdBuffer);
+    cmdBufferGen.submitAndWait(cmdBuffer, m_timeline);
 
     ImGui_ImplVulkan_DestroyFontUploadObjects();
 
@@ -1133,8 +1271,12 @@ ContextCreateInfo::ContextCreateInfo()
 //-------------------------------------------------------------------------
 // 
 //
-void ContextCreateInfo::addDeviceExtension(const char* name)
+void ContextCreateInfo::addDeviceExtension(const char* name, bool optional)
 {
+    if (optional) {
+        optionalDeviceExtensions.emplace_back(name);
+        return;
+    }
     numDeviceExtensions++;
     deviceExtensions.emplace_back(name);
 }
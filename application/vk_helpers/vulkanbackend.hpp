@@ -17,6 +17,7 @@
 #include <regex>
 #include <sstream>
 #include <mutex>
+#include <atomic>
 
 #include "../external/imgui/imgui.h"
 #include "../external/imgui/imgui_impl_vulkan.h"
@@ -27,6 +28,12 @@
 
 #include "swapchain.hpp"
 #include "commands.hpp"
+#include "pipelinebuilder.hpp"
+#include "pipelinecache.hpp"
+#include "pipelinemap.hpp"
+#include "shadermodules.hpp"
+#include "timeline.hpp"
+#include "rendertargetpool.hpp"
 #include "../general_helpers/manipulator.h"
 #include "../general_helpers/cameraintertia.hpp"
 
@@ -47,7 +54,8 @@ struct ContextCreateInfo
 {
     ContextCreateInfo();
 
-    void addDeviceExtension(const char* name);
+    // optional extensions are enabled when the device supports them
+    void addDeviceExtension(const char* name, bool optional = false);
 
     void addInstanceExtension(const char* name);
 
@@ -61,6 +69,7 @@ struct ContextCreateInfo
 
     uint32_t numDeviceExtensions;
     std::vector<const char*> deviceExtensions;
+    std::vector<const char*> optionalDeviceExtensions;
 
     uint32_t numValidationLayers;
     std::vector<const char*> validationLayers;
@@ -110,14 +119,36 @@ public:
 
     void createSyncObjects();
     
-    void prepareFrame();
+    bool prepareFrame();
 
     void submitFrame();
 
+    vk::CommandBuffer createTempCmdBuffer();
+
+    uint64_t submitTempCmdBuffer(vk::CommandBuffer cmdBuffer);
+
     void setViewport(const vk::CommandBuffer& cmdBuffer);
 
     bool isMinimized(bool doSleeping = true);
 
+    void setPresentMode(vk::PresentModeKHR presentMode);
+
+    void setSwapchainImageCount(uint32_t count);
+
+    //-------------------------------------------------------------------------
+    // Threaded rendering: window events arrive on the main thread, the
+    // swapchain is only rebuilt by the render thread, in
+    // applyPendingSwapchainChanges (start of prepareFrame)
+    //
+    void setRenderThreaded(bool threaded) { m_renderThreaded = threaded; }
+    bool isRenderThreaded() const         { return m_renderThreaded; }
+
+    void requestSwapchainRebuild();
+
+    void applyPendingSwapchainChanges();
+
+    void rebuildSwapchain(uint32_t width, uint32_t height);
+
 
     ///////////////////////////////////////////////////////////////////////////
     // GLFW Callbacks / ImGUI                                                //
@@ -177,20 +208,38 @@ public:
     uint32_t                              getGraphicsQueueIdx()   { return m_graphicsQueueIdx; }
     vk::Queue                             getPresentQueue()       { return m_presentQueue; }
     uint32_t                              getPresentQueueIdx()    { return m_presentQueueIdx; }
+    vk::Queue                             getComputeQueue()       { return m_computeQueue; }      // null without one
+    uint32_t                              getComputeQueueIdx()    { return m_computeQueueIdx; }
     vk::Extent2D                          getSize()               { return m_size; }
     vk::RenderPass                        getRenderPass()         { return m_renderPass; }
-    vk::PipelineCache                     getPipelineCache()      { return m_pipelineCache; }
+    app::PipelineCache&                   getPipelineCache()      { return m_pipelineCache; }
+    app::PipelineBuilder&                 getPipelineBuilder()    { return m_pipelineBuilder; }
+    app::GraphicsPipelineMap&             getPipelineMap()        { return m_pipelineMap; }
+    app::ShaderModuleRegistry&            getShaderModules()      { return m_shaderModules; }
+    app::Timeline&                        getTimeline()           { return m_timeline; }
+    app::RenderTargetPool&                getRenderTargetPool()   { return m_renderTargetPool; }
     const std::vector<vk::Framebuffer>&   getFramebuffers()       { return m_framebuffers; }
     const std::vector<vk::CommandBuffer>& getCommandBuffers()     { return m_commandBuffers; }
     uint32_t                              getCurrentFrame() const { return m_swapchain.getActiveImageIndex(); }
     vk::Format                            getColorFormat()  const { return m_colorFormat; }
     vk::Format                            getDepthFormat()  const { return m_depthFormat; }
     vk::SampleCountFlagBits               getSampleCount()  const { return m_sampleCount; }
+    vk::PresentModeKHR                    getPresentMode()  const { return m_activePresentMode; }
+    std::vector<vk::PresentModeKHR>       getSupportedPresentModes() const { return m_swapchain.getSupportedPresentModes(); }
+    uint32_t                              getImageCount()   const { return m_activeImageCount; }
+    bool                                  isDeviceExtensionEnabled(const char* name) const { return m_enabledDeviceExtensions.count(name) != 0; }
+    const vk::PhysicalDeviceDescriptorIndexingFeaturesEXT& getDescriptorIndexingFeatures() const { return m_descriptorIndexingFeatures; }
+    bool                                  isBufferDeviceAddressSupported() const { return m_bufferDeviceAddress; }
+    bool                                  isExtendedDynamicStateSupported() const { return m_extendedDynamicState; }
      
 protected:
     vk::Instance                   m_instance;
     vk::PhysicalDevice             m_physicalDevice;
     vk::Device                     m_device;
+    std::set<std::string>          m_enabledDeviceExtensions;  // required + supported optional
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT m_descriptorIndexingFeatures;  // enabled on the device
+    bool                           m_bufferDeviceAddress{ false };  // VK_KHR_buffer_device_address enabled
+    bool                           m_extendedDynamicState{ false }; // VK_EXT_extended_dynamic_state enabled
 
     vk::SurfaceKHR                 m_surface;
 
@@ -199,6 +248,13 @@ protected:
     uint32_t                       m_graphicsQueueIdx{ VK_QUEUE_FAMILY_IGNORED };
     uint32_t                       m_presentQueueIdx{ VK_QUEUE_FAMILY_IGNORED };
 
+    // Async compute queue, VK_QUEUE_FAMILY_IGNORED when the device has no
+    // compute family without graphics. The timeline's values must signal
+    // in order, submit to it through the timeline with the graphics queue
+    // idle
+    vk::Queue                      m_computeQueue;
+    uint32_t                       m_computeQueueIdx{ VK_QUEUE_FAMILY_IGNORED };
+
     vk::CommandPool                m_commandPool;
 
     app::SwapChain                 m_swapchain;
@@ -206,16 +262,28 @@ protected:
     std::vector<vk::CommandBuffer> m_commandBuffers;    // Command buffer per nb element in Swapchain
 
     vk::RenderPass                 m_renderPass;        // Base render pass
-    vk::PipelineCache              m_pipelineCache;     // Cache for pipeline/shaders
+    app::PipelineCache             m_pipelineCache;     // Cache for pipeline/shaders, saved on destroy
+    app::PipelineBuilder           m_pipelineBuilder;   // Pipelines compiled on worker threads
+    app::GraphicsPipelineMap       m_pipelineMap;       // Graphics pipelines by state, shaders, layout and pass
+    app::ShaderModuleRegistry      m_shaderModules;     // Shader modules shared by the pipelines
 
-    vk::Image                      m_depthImage;        // Depth/Stencil
-    vk::DeviceMemory               m_depthMemory;       // Depth/Stencil
-    vk::ImageView                  m_depthView;         // Depth/Stencil
+    app::RenderTarget              m_depth;             // Depth/Stencil
     
-    std::vector<vk::Fence>         m_fences;            // Fences per nb element in Swapchain
+    app::Timeline                  m_timeline;          // CPU/GPU synchronization
+    app::RenderTargetPool          m_renderTargetPool;  // Memory of size dependent images
+    std::vector<uint64_t>          m_frameValues;       // Timeline value per nb element in Swapchain
     
-    vk::Extent2D                   m_size{ 0, 0 };      // Size of the window
-    bool                           m_vsync{ false };    // Swapchain v-Sync
+    vk::Extent2D                   m_size{ 0, 0 };      // Size of the window, thread recording the frames
+    vk::Extent2D                   m_windowSize{ 0, 0 }; // Same, for input on the thread polling the events
+    std::atomic<vk::PresentModeKHR> m_presentMode{ vk::PresentModeKHR::eMailbox };     // Requested present mode
+    std::atomic<uint32_t>           m_swapchainImageCount{ 0 };                         // Desired images, 0 = driver minimum + 1
+    std::atomic<vk::PresentModeKHR> m_activePresentMode{ vk::PresentModeKHR::eFifo };   // Present mode in use
+    std::atomic<uint32_t>           m_activeImageCount{ 0 };                            // Images in use
+
+    // Threaded rendering, swapchain changes requested by the main thread
+    bool                           m_renderThreaded{ false };
+    std::atomic<uint64_t>          m_pendingResize{ 0 };    // width << 32 | height, 0 = none
+    std::atomic<bool>              m_pendingRebuild{ false };
     GLFWwindow*                    m_window{ nullptr }; // GLFW Window
         
     // Surface buffer formats